@@ -0,0 +1,1300 @@
+#include "Aot.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <sstream>
+#include <typeinfo>
+#include <unordered_set>
+#include <vector>
+#include "Ast.h"
+#include "Types.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+const char* tokenName(Token opt) {
+    switch (opt) {
+        case TK_BITAND:
+            return "TK_BITAND";
+        case TK_BITOR:
+            return "TK_BITOR";
+        case TK_BITNOT:
+            return "TK_BITNOT";
+        case TK_LOGAND:
+            return "TK_LOGAND";
+        case TK_LOGOR:
+            return "TK_LOGOR";
+        case TK_LOGNOT:
+            return "TK_LOGNOT";
+        case TK_PLUS:
+            return "TK_PLUS";
+        case TK_MINUS:
+            return "TK_MINUS";
+        case TK_TIMES:
+            return "TK_TIMES";
+        case TK_DIV:
+            return "TK_DIV";
+        case TK_MOD:
+            return "TK_MOD";
+        case TK_EQ:
+            return "TK_EQ";
+        case TK_NE:
+            return "TK_NE";
+        case TK_GT:
+            return "TK_GT";
+        case TK_GE:
+            return "TK_GE";
+        case TK_LT:
+            return "TK_LT";
+        case TK_LE:
+            return "TK_LE";
+        case TK_ASSIGN:
+            return "TK_ASSIGN";
+        case TK_PLUS_AGN:
+            return "TK_PLUS_AGN";
+        case TK_MINUS_AGN:
+            return "TK_MINUS_AGN";
+        case TK_TIMES_AGN:
+            return "TK_TIMES_AGN";
+        case TK_DIV_AGN:
+            return "TK_DIV_AGN";
+        case TK_MOD_AGN:
+            return "TK_MOD_AGN";
+        default:
+            panic("InternalError: can not emit operator %d\n", opt);
+    }
+}
+
+// C++ string literal holding exactly the bytes of text
+std::string quote(std::string_view text) {
+    std::string result = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (c >= 0x20 && c < 0x7f && c != '?') {
+            result += c;
+        } else {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\%03o", c);
+            result += escaped;
+        }
+    }
+    return result + "\"";
+}
+
+std::string position(AstNode* node) {
+    return std::to_string(node->line) + ", " + std::to_string(node->column);
+}
+
+// Values of these types are emitted as lin::aot::Integer, double and bool
+// where type inference proved a single type. Integer computes on long long
+// and holds the BigInt an overflow promotes a result to.
+bool scalarType(TypeMask mask, ValueType& type) {
+    return singleType(mask, type) && anyone(type, Int, Double, Bool);
+}
+
+const char* cppType(ValueType type) {
+    return type == Int      ? "lin::aot::Integer"
+           : type == Double ? "double"
+                            : "bool";
+}
+
+std::string boxValue(ValueType type, const std::string& scalar) {
+    return std::string(type == Int      ? "lin::aot::toValue("
+                       : type == Double ? "lin::Value(lin::Double, "
+                                        : "lin::Value(lin::Bool, ") +
+           scalar + ")";
+}
+
+std::string unboxValue(ValueType type, const std::string& value) {
+    if (type == Int) {
+        return "lin::aot::Integer::of(" + value + ")";
+    }
+    return value + ".cast<" + cppType(type) + ">()";
+}
+
+//===----------------------------------------------------------------------===//
+// Every context the interpreter would create becomes a C++ block declaring
+// all variables the context might ever hold. A variable is definite once an
+// assignment which always runs before the current point created it, any other
+// variable of the chain is checked at runtime in the same order the
+// interpreter searches contexts.
+//===----------------------------------------------------------------------===//
+struct Scope {
+    int id;
+    std::vector<std::string> names;
+    std::unordered_set<std::string> hoisted;
+    std::unordered_set<std::string> definite;
+
+    void add(const std::string& name) {
+        if (hoisted.insert(name).second) {
+            names.push_back(name);
+        }
+    }
+    std::string var(const std::string& name) const {
+        return "v" + std::to_string(id) + "_" + name;
+    }
+};
+
+void collectNames(Expression* e, Scope& scope) {
+    if (e == nullptr) {
+        return;
+    }
+    if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+        collectNames(assign->rhs, scope);
+        if (auto* ident = dynamic_cast<IdentExpr*>(assign->lhs)) {
+            scope.add(ident->identName);
+        } else if (auto* index = dynamic_cast<IndexExpr*>(assign->lhs)) {
+            // Assigning an element of an undefined variable creates it
+            collectNames(index->index, scope);
+            collectNames(index->second, scope);
+            scope.add(index->identName);
+        }
+    } else if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+        collectNames(binary->lhs, scope);
+        collectNames(binary->rhs, scope);
+    } else if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+        collectNames(logical->lhs, scope);
+        collectNames(logical->rhs, scope);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(e)) {
+        collectNames(index->index, scope);
+        collectNames(index->second, scope);
+    } else if (auto* slice = dynamic_cast<SliceExpr*>(e)) {
+        collectNames(slice->base, scope);
+        collectNames(slice->lo, scope);
+        collectNames(slice->hi, scope);
+    } else if (auto* call = dynamic_cast<FunCallExpr*>(e)) {
+        for (auto* arg : call->args) {
+            collectNames(arg, scope);
+        }
+    } else if (auto* array = dynamic_cast<ArrayExpr*>(e)) {
+        for (auto* element : array->literal) {
+            collectNames(element, scope);
+        }
+    } else if (auto* dict = dynamic_cast<DictExpr*>(e)) {
+        for (auto& [key, value] : dict->literal) {
+            collectNames(key, scope);
+            collectNames(value, scope);
+        }
+    }
+}
+
+// Names assigned by statements of a block itself, nested blocks are contexts
+// of their own. Conditions and bounds run within the enclosing context.
+void collectNames(const std::vector<Statement*>& stmts, Scope& scope) {
+    for (auto* stmt : stmts) {
+        if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+            collectNames(s->expr, scope);
+        } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+            collectNames(s->ret, scope);
+        } else if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+            collectNames(s->cond, scope);
+        } else if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+            collectNames(s->cond, scope);
+        } else if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+            collectNames(s->lo, scope);
+            collectNames(s->hi, scope);
+            collectNames(s->step, scope);
+        }
+    }
+}
+
+// Whether stmt leaves the top-level statement it belongs to. Outside of loops
+// break and continue only skip the rest of enclosing if blocks, a return of
+// top-level statements is ignored likewise.
+bool escapes(Statement* stmt, bool topLevel, int loops) {
+    if (dynamic_cast<BreakStmt*>(stmt) || dynamic_cast<ContinueStmt*>(stmt)) {
+        return loops == 0;
+    }
+    if (dynamic_cast<ReturnStmt*>(stmt)) {
+        return topLevel;
+    }
+    auto any = [&](Block* block, int depth) {
+        return block != nullptr &&
+               std::any_of(block->stmts.begin(), block->stmts.end(),
+                           [&](Statement* s) {
+                               return escapes(s, topLevel, depth);
+                           });
+    };
+    if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+        return any(s->block, loops) || any(s->elseBlock, loops);
+    }
+    if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+        return any(s->block, loops + 1);
+    }
+    if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+        return any(s->block, loops + 1);
+    }
+    return false;
+}
+
+// Whether a continue within block belongs to the loop owning block
+bool continues(Block* block) {
+    if (block == nullptr) {
+        return false;
+    }
+    for (auto* stmt : block->stmts) {
+        if (dynamic_cast<ContinueStmt*>(stmt)) {
+            return true;
+        }
+        if (auto* s = dynamic_cast<IfStmt*>(stmt);
+            s != nullptr && (continues(s->block) || continues(s->elseBlock))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// A variable of a function, nullptr stands for top-level statements
+using VariableKey = std::pair<Function*, std::string>;
+
+class CppEmitter {
+public:
+    explicit CppEmitter(Runtime* rt, const TypeInference& types)
+        : rt(rt), types(types) {}
+
+    void emit(const std::string& sourceName, std::ostream& os);
+
+    // Variables found to need a lin::aot::Var while emitting, every other
+    // variable of a single scalar type is unboxed by the next emitter
+    const std::set<VariableKey>& boxedVariables() const { return boxed; }
+    void unbox(std::set<VariableKey> boxedVariables) {
+        boxed = std::move(boxedVariables);
+        unboxing = true;
+    }
+
+private:
+    void line(const std::string& text);
+    std::string temp();
+
+    bool inert(Expression* e);
+    std::string expr(Expression* e, bool mayInline);
+    std::string value(Expression* e);
+    // Expression of the single scalar type inference proved for e
+    std::string scalar(Expression* e, bool mayInline);
+    bool scalarBinary(BinaryExpr* e, ValueType& type);
+    bool scalarLogical(LogicalExpr* e);
+    bool isBool(Expression* e);
+    bool isInt(Expression* e);
+    std::string scalarOperation(Token opt, ValueType lhsType,
+                                const std::string& lhs, ValueType rhsType,
+                                const std::string& rhs, AstNode* at);
+    std::string ident(IdentExpr* e, bool mayInline);
+    std::string index(IndexExpr* e);
+    std::string slice(SliceExpr* e);
+    std::string binary(BinaryExpr* e);
+    std::string logical(LogicalExpr* e);
+    std::string call(FunCallExpr* e);
+    std::string assign(AssignExpr* e, bool used);
+    std::string stringLiteral(const StringData& literal);
+    std::string bigIntLiteral(const BigIntData& literal);
+    std::vector<std::string> operands(const std::vector<Expression*>& exprs);
+
+    // Variable lookup and creation in the current chain of scopes
+    std::string readVar(const std::string& name, AstNode* at);
+    std::string writeVar(const std::string& name);
+    bool isDefinite(const std::string& name);
+    bool scalarVar(const std::string& name, ValueType& type);
+    void box(const std::string& name);
+
+    Scope& pushScope();
+    void hoist();
+    void declare(const Scope& scope);
+    void stmt(Statement* s);
+    void stmts(const std::vector<Statement*>& list);
+    void scopedBlock(Block* block);
+    void whileStmt(WhileStmt* s);
+    void forStmt(ForStmt* s);
+    void body(const std::vector<Statement*>& list);
+    void function(Function* f);
+
+    Runtime* rt;
+    const TypeInference& types;
+    std::set<VariableKey> boxed;
+    bool unboxing = false;
+    // Function being emitted, nullptr for top-level statements
+    Function* unit{};
+
+    std::string out;
+    int indent = 0;
+    int nextTemp = 0;
+    int nextLabel = 0;
+    int nextScope = 0;
+    std::vector<Scope> scopes;
+
+    bool inFunction = false;
+    // Label behind the top-level statement being emitted
+    std::string escape;
+    // Label re-evaluating the condition of each enclosing loop, empty for
+    // loops where continue jumps to the right place anyway
+    std::vector<std::string> loops;
+    // Expressions which might be skipped, their assignments are not definite
+    int conditional = 0;
+
+    std::map<std::string, int> strings;
+    std::map<std::string, int> bigInts;
+    std::set<std::string> builtins;
+    std::set<std::string> mutators;
+};
+
+void CppEmitter::line(const std::string& text) {
+    out.append(indent * 4, ' ');
+    out += text;
+    out += '\n';
+}
+
+std::string CppEmitter::temp() { return "t" + std::to_string(nextTemp++); }
+
+bool CppEmitter::isDefinite(const std::string& name) {
+    for (auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+        if (s->hoisted.count(name) == 1) {
+            return s->definite.count(name) == 1;
+        }
+    }
+    return false;
+}
+
+bool CppEmitter::scalarVar(const std::string& name, ValueType& type) {
+    return unboxing && boxed.count({unit, name}) == 0 &&
+           scalarType(types.variableType(unit, name), type);
+}
+
+void CppEmitter::box(const std::string& name) { boxed.insert({unit, name}); }
+
+std::string CppEmitter::readVar(const std::string& name, AstNode* at) {
+    std::string result;
+    std::string fallback;
+    for (auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+        if (s->hoisted.count(name) == 0) {
+            continue;
+        }
+        if (s->definite.count(name) == 1) {
+            fallback = s->var(name);
+            break;
+        }
+        result += s->var(name) + ".defined ? " + s->var(name) + " : ";
+    }
+    if (fallback.empty()) {
+        fallback = "lin::aot::undefinedVariable(" + quote(name) + ", " +
+                   position(at) + ")";
+    }
+    if (result.empty()) {
+        return fallback;
+    }
+    // Checking whether it is defined needs a lin::aot::Var
+    box(name);
+    return "(" + result + fallback + ")";
+}
+
+std::string CppEmitter::writeVar(const std::string& name) {
+    Scope& innermost = scopes.back();
+    std::vector<std::string> candidates;
+    std::string fallback = innermost.var(name);
+    for (auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+        if (s->hoisted.count(name) == 0) {
+            continue;
+        }
+        if (s->definite.count(name) == 1) {
+            fallback = s->var(name);
+            break;
+        }
+        candidates.push_back(s->var(name));
+    }
+    // An undefined variable is created within the innermost context
+    if (candidates.size() == 1 && candidates[0] == fallback) {
+        candidates.clear();
+    }
+    if (candidates.empty()) {
+        if (fallback == innermost.var(name) && conditional == 0) {
+            innermost.definite.insert(name);
+        }
+        return fallback;
+    }
+    box(name);
+    std::string result = "(";
+    for (auto& c : candidates) {
+        result += c + ".defined ? " + c + " : ";
+    }
+    return result + fallback + ")";
+}
+
+bool CppEmitter::inert(Expression* e) {
+    if (auto* ident = dynamic_cast<IdentExpr*>(e)) {
+        return isDefinite(ident->identName);
+    }
+    return dynamic_cast<IntExpr*>(e) || dynamic_cast<BigIntExpr*>(e) ||
+           dynamic_cast<DoubleExpr*>(e) || dynamic_cast<BoolExpr*>(e) ||
+           dynamic_cast<CharExpr*>(e) || dynamic_cast<NullExpr*>(e) ||
+           dynamic_cast<StringExpr*>(e);
+}
+
+std::string CppEmitter::stringLiteral(const StringData& literal) {
+    auto [it, inserted] =
+        strings.emplace(literal.str(), static_cast<int>(strings.size()));
+    return "s" + std::to_string(it->second);
+}
+
+std::string CppEmitter::bigIntLiteral(const BigIntData& literal) {
+    auto [it, inserted] =
+        bigInts.emplace(literal.str(), static_cast<int>(bigInts.size()));
+    return "z" + std::to_string(it->second);
+}
+
+// Operands are evaluated from left to right, an operand may only be referred
+// to in place if nothing evaluated after it can change or panic
+std::vector<std::string> CppEmitter::operands(
+    const std::vector<Expression*>& exprs) {
+    std::vector<std::string> result;
+    for (size_t i = 0; i < exprs.size(); i++) {
+        bool mayInline = std::all_of(exprs.begin() + i + 1, exprs.end(),
+                                     [&](Expression* e) { return inert(e); });
+        result.push_back(expr(exprs[i], mayInline));
+    }
+    return result;
+}
+
+std::string CppEmitter::value(Expression* e) {
+    std::string v = expr(e, false);
+    if (v.size() > 1 && v[0] == 't' && isdigit(v[1])) {
+        return v;
+    }
+    std::string t = temp();
+    line("lin::Value " + t + " = " + v + ";");
+    return t;
+}
+
+std::string CppEmitter::scalarOperation(Token opt, ValueType lhsType,
+                                        const std::string& lhs,
+                                        ValueType rhsType,
+                                        const std::string& rhs, AstNode* at) {
+    bool ints = lhsType == Int && rhsType == Int;
+    bool numbers =
+        anyone(lhsType, Int, Double) && anyone(rhsType, Int, Double) && !ints;
+    // Ints compute on lin::aot::Integer, an int operand of a double
+    // operation is converted
+    auto integer = [&](const char* kind) {
+        return std::string("lin::aot::") + kind + "<" + tokenName(opt) +
+               ">(" + lhs + ", " + rhs + ", " + position(at) + ")";
+    };
+    auto number = [&](ValueType type, const std::string& operand) {
+        return type == Int ? "lin::aot::toDouble(" + operand + ")" : operand;
+    };
+    auto infix = [&](const char* op) {
+        return "(" + number(lhsType, lhs) + op + number(rhsType, rhs) + ")";
+    };
+    switch (opt) {
+        case TK_PLUS:
+        case TK_MINUS:
+        case TK_TIMES:
+        case TK_DIV:
+            if (ints) {
+                return integer("arithmetic");
+            }
+            return !numbers           ? ""
+                   : opt == TK_PLUS   ? infix(" + ")
+                   : opt == TK_MINUS  ? infix(" - ")
+                   : opt == TK_TIMES  ? infix(" * ")
+                                      : infix(" / ");
+        case TK_MOD:
+        case TK_BITAND:
+        case TK_BITOR:
+            return ints ? integer("arithmetic") : "";
+        case TK_EQ:
+        case TK_NE:
+        case TK_GT:
+        case TK_GE:
+        case TK_LT:
+        case TK_LE:
+            if (lhsType != rhsType ||
+                (lhsType == Bool && !anyone(opt, TK_EQ, TK_NE))) {
+                return "";
+            }
+            if (ints) {
+                return integer("compare");
+            }
+            switch (opt) {
+                case TK_EQ:
+                    return infix(" == ");
+                case TK_NE:
+                    return infix(" != ");
+                case TK_GT:
+                    return infix(" > ");
+                case TK_GE:
+                    return infix(" >= ");
+                case TK_LT:
+                    return infix(" < ");
+                default:
+                    return infix(" <= ");
+            }
+        default:
+            return "";
+    }
+}
+
+// Whether e and its operands are of single scalar types the operator can
+// work on without boxing them
+bool CppEmitter::scalarBinary(BinaryExpr* e, ValueType& type) {
+    ValueType lhsType, rhsType;
+    if (e->lhs == nullptr || !scalarType(types.typeOf(e), type) ||
+        !scalarType(types.typeOf(e->lhs), lhsType)) {
+        return false;
+    }
+    if (e->rhs == nullptr) {
+        switch (e->opt) {
+            case TK_MINUS:
+                return anyone(lhsType, Int, Double);
+            case TK_LOGNOT:
+                return lhsType == Bool;
+            case TK_BITNOT:
+                return lhsType == Int;
+            default:
+                return true;
+        }
+    }
+    return scalarType(types.typeOf(e->rhs), rhsType) &&
+           !scalarOperation(e->opt, lhsType, "", rhsType, "", e).empty();
+}
+
+bool CppEmitter::scalarLogical(LogicalExpr* e) {
+    return isBool(e->lhs) && isBool(e->rhs);
+}
+
+bool CppEmitter::isBool(Expression* e) {
+    ValueType type;
+    return scalarType(types.typeOf(e), type) && type == Bool;
+}
+
+bool CppEmitter::isInt(Expression* e) {
+    ValueType type;
+    return scalarType(types.typeOf(e), type) && type == Int;
+}
+
+std::string CppEmitter::scalar(Expression* e, bool mayInline) {
+    ValueType type = Int;
+    scalarType(types.typeOf(e), type);
+    if (auto* lit = dynamic_cast<IntExpr*>(e)) {
+        return std::to_string(lit->literal) + "LL";
+    }
+    if (auto* lit = dynamic_cast<DoubleExpr*>(e)) {
+        char text[64];
+        snprintf(text, sizeof(text), "%a", lit->literal);
+        return text;
+    }
+    if (auto* lit = dynamic_cast<BoolExpr*>(e)) {
+        return lit->literal ? "true" : "false";
+    }
+    if (auto* ident = dynamic_cast<IdentExpr*>(e);
+        ident != nullptr && isDefinite(ident->identName) &&
+        scalarVar(ident->identName, type)) {
+        std::string v = readVar(ident->identName, e);
+        if (mayInline) {
+            return v;
+        }
+        std::string t = temp();
+        line(std::string(cppType(type)) + " " + t + " = " + v + ";");
+        return t;
+    }
+    if (auto* binary = dynamic_cast<BinaryExpr*>(e);
+        binary != nullptr && scalarBinary(binary, type)) {
+        std::string result;
+        if (binary->rhs == nullptr) {
+            std::string operand = scalar(binary->lhs, true);
+            if (type == Int && anyone(binary->opt, TK_MINUS, TK_BITNOT)) {
+                result = std::string("lin::aot::unary<") +
+                         tokenName(binary->opt) + ">(" + operand + ", " +
+                         position(binary) + ")";
+            } else {
+                result = binary->opt == TK_MINUS    ? "(-" + operand + ")"
+                         : binary->opt == TK_LOGNOT ? "(!" + operand + ")"
+                                                    : operand;
+            }
+        } else {
+            ValueType lhsType = Int, rhsType = Int;
+            scalarType(types.typeOf(binary->lhs), lhsType);
+            scalarType(types.typeOf(binary->rhs), rhsType);
+            std::string lhs = scalar(binary->lhs, inert(binary->rhs));
+            std::string rhs = scalar(binary->rhs, true);
+            result = scalarOperation(binary->opt, lhsType, lhs, rhsType, rhs,
+                                     binary);
+        }
+        std::string t = temp();
+        line(std::string(cppType(type)) + " " + t + " = " + result + ";");
+        return t;
+    }
+    if (auto* logical = dynamic_cast<LogicalExpr*>(e);
+        logical != nullptr && scalarLogical(logical)) {
+        std::string t = temp();
+        line("bool " + t + " = " + scalar(logical->lhs, true) + ";");
+        line(std::string("if (") + (logical->opt == TK_LOGOR ? "!" : "") + t +
+             ") {");
+        indent++;
+        conditional++;
+        line(t + " = " + scalar(logical->rhs, true) + ";");
+        conditional--;
+        indent--;
+        line("}");
+        return t;
+    }
+    return unboxValue(type, expr(e, mayInline));
+}
+
+std::string CppEmitter::expr(Expression* e, bool mayInline) {
+    if (auto* lit = dynamic_cast<IntExpr*>(e)) {
+        return "lin::Value(lin::Int, " + std::to_string(lit->literal) +
+               "LL)";
+    }
+    if (auto* lit = dynamic_cast<DoubleExpr*>(e)) {
+        char text[64];
+        snprintf(text, sizeof(text), "%a", lit->literal);
+        return std::string("lin::Value(lin::Double, ") + text + ")";
+    }
+    if (auto* lit = dynamic_cast<BoolExpr*>(e)) {
+        return lit->literal ? "lin::Value(lin::Bool, true)"
+                            : "lin::Value(lin::Bool, false)";
+    }
+    if (auto* lit = dynamic_cast<CharExpr*>(e)) {
+        return "lin::Value(lin::Char, static_cast<char>(" +
+               std::to_string(static_cast<int>(lit->literal)) + "))";
+    }
+    if (dynamic_cast<NullExpr*>(e)) {
+        return "lin::Value(lin::Null)";
+    }
+    if (auto* lit = dynamic_cast<StringExpr*>(e)) {
+        return stringLiteral(lit->literal);
+    }
+    if (auto* lit = dynamic_cast<BigIntExpr*>(e)) {
+        return bigIntLiteral(lit->literal);
+    }
+    if (auto* ident = dynamic_cast<IdentExpr*>(e)) {
+        return this->ident(ident, mayInline);
+    }
+    if (auto* array = dynamic_cast<ArrayExpr*>(e)) {
+        std::string elements;
+        for (auto& v : operands(array->literal)) {
+            elements += (elements.empty() ? "" : ", ") + v;
+        }
+        std::string t = temp();
+        line("lin::Value " + t + " = lin::toValue(std::vector<lin::Value>{" +
+             elements + "});");
+        return t;
+    }
+    if (auto* dict = dynamic_cast<DictExpr*>(e)) {
+        std::string table = "h" + std::to_string(nextTemp++);
+        line("lin::HashTable " + table + ";");
+        for (auto& [key, value] : dict->literal) {
+            std::string k = expr(key, inert(value));
+            std::string v = expr(value, true);
+            line(table + ".getOrInsert(" + k + ") = " + v + ";");
+        }
+        std::string t = temp();
+        line("lin::Value " + t + "(lin::Dict, std::move(" + table + "));");
+        return t;
+    }
+    if (auto* index = dynamic_cast<IndexExpr*>(e)) {
+        return this->index(index);
+    }
+    if (auto* slice = dynamic_cast<SliceExpr*>(e)) {
+        return this->slice(slice);
+    }
+    if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+        if (ValueType type; scalarBinary(binary, type)) {
+            return boxValue(type, scalar(binary, mayInline));
+        }
+        return this->binary(binary);
+    }
+    if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+        if (scalarLogical(logical)) {
+            return boxValue(Bool, scalar(logical, mayInline));
+        }
+        return this->logical(logical);
+    }
+    if (auto* call = dynamic_cast<FunCallExpr*>(e)) {
+        return this->call(call);
+    }
+    if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+        return this->assign(assign, true);
+    }
+    panic("InternalError: can not emit expression at line %d, col %d\n",
+          e->line, e->column);
+}
+
+std::string CppEmitter::ident(IdentExpr* e, bool mayInline) {
+    if (ValueType type; isDefinite(e->identName) &&
+                        scalarVar(e->identName, type)) {
+        std::string v = boxValue(type, readVar(e->identName, e));
+        if (mayInline) {
+            return v;
+        }
+        std::string t = temp();
+        line("lin::Value " + t + " = " + v + ";");
+        return t;
+    }
+    if (mayInline && isDefinite(e->identName)) {
+        return readVar(e->identName, e) + ".value";
+    }
+    std::string t = temp();
+    line("lin::Value " + t + " = " + readVar(e->identName, e) + ".value;");
+    return t;
+}
+
+std::string CppEmitter::index(IndexExpr* e) {
+    // Variable is looked up before index is evaluated and read after it
+    box(e->identName);
+    std::string base = readVar(e->identName, e);
+    if (!isDefinite(e->identName)) {
+        std::string ref = "r" + std::to_string(nextTemp++);
+        line("lin::aot::Var& " + ref + " = " + base + ";");
+        base = ref;
+    }
+    bool last = e->second == nullptr || inert(e->second);
+    std::string idx =
+        isInt(e->index) ? scalar(e->index, last) : expr(e->index, last);
+    if (e->second != nullptr) {
+        std::string second = isInt(e->second) ? scalar(e->second, true)
+                                              : expr(e->second, true);
+        idx += ", " + second;
+    }
+    std::string t = temp();
+    line("lin::Value " + t + " = lin::aot::subscript(" + base + ".value, " +
+         idx + ", " + quote(e->identName) + ", " + position(e) + ");");
+    return t;
+}
+
+std::string CppEmitter::slice(SliceExpr* e) {
+    std::string base = expr(e->base, inert(e->lo) && inert(e->hi));
+    std::string length = "n" + std::to_string(nextTemp++);
+    line("long long " + length + " = Interpreter::sliceLength(" + base +
+         ", " + position(e) + ");");
+    auto bound = [&](Expression* b, const std::string& defaultValue) {
+        if (b == nullptr) {
+            return defaultValue;
+        }
+        std::string v = expr(b, true);
+        std::string n = "n" + std::to_string(nextTemp++);
+        line("long long " + n + " = Interpreter::sliceBound(" + v + ", " +
+             position(e) + ");");
+        return n;
+    };
+    std::string lo = bound(e->lo, "0");
+    std::string hi = bound(e->hi, length);
+    std::string t = temp();
+    line("lin::Value " + t + " = sliceValue(" + base + ", " + lo + ", " + hi +
+         ");");
+    return t;
+}
+
+std::string CppEmitter::binary(BinaryExpr* e) {
+    std::string lhs = e->lhs ? expr(e->lhs, e->rhs == nullptr || inert(e->rhs))
+                             : "lin::Value(lin::Null)";
+    std::string rhs = e->rhs ? expr(e->rhs, true) : "lin::Value(lin::Null)";
+    std::string t = temp();
+    line("lin::Value " + t + " = lin::aot::binary<" + tokenName(e->opt) + ">(" +
+         lhs + ", " + rhs + ", " + position(e) + ");");
+    return t;
+}
+
+std::string CppEmitter::logical(LogicalExpr* e) {
+    std::string op = tokenName(e->opt);
+    std::string t = temp();
+    line("lin::Value " + t + " = " + expr(e->lhs, true) + ";");
+    line("lin::aot::checkLogical(" + t + ", " + op + ", " + position(e) + ");");
+    line(std::string("if (") + (e->opt == TK_LOGOR ? "!" : "") + t +
+         ".cast<bool>()) {");
+    indent++;
+    conditional++;
+    line(t + " = " + expr(e->rhs, true) + ";");
+    line("lin::aot::checkLogical(" + t + ", " + op + ", " + position(e) + ");");
+    conditional--;
+    indent--;
+    line("}");
+    return t;
+}
+
+std::string CppEmitter::call(FunCallExpr* e) {
+    const std::string& name = e->funcName;
+    std::string t = temp();
+    if (rt->getMutatorFunction(name) != nullptr) {
+        if (e->args.empty()) {
+            line("panic(\"ArgumentError: %s expects at least one argument\\n\", " +
+                 quote(name) + ");");
+            line("lin::Value " + t + "(lin::Null);");
+            return t;
+        }
+        mutators.insert(name);
+        std::string self;
+        if (auto* ident = dynamic_cast<IdentExpr*>(e->args[0])) {
+            box(ident->identName);
+            self = readVar(ident->identName, ident);
+            if (!isDefinite(ident->identName)) {
+                std::string ref = "r" + std::to_string(nextTemp++);
+                line("lin::aot::Var& " + ref + " = " + self + ";");
+                self = ref;
+            }
+            self += ".value";
+        } else {
+            self = value(e->args[0]);
+        }
+        std::string args;
+        for (auto& v : operands({e->args.begin() + 1, e->args.end()})) {
+            args += (args.empty() ? "" : ", ") + v;
+        }
+        line("lin::Value " + t + " = lin::aot::call(m_" + name + ", " + self +
+             ", {" + args + "});");
+        return t;
+    }
+    if (rt->getBuiltinFunction(name) != nullptr) {
+        builtins.insert(name);
+        std::string args;
+        for (auto& v : operands(e->args)) {
+            args += (args.empty() ? "" : ", ") + v;
+        }
+        line("lin::Value " + t + " = lin::aot::call(b_" + name + ", {" + args +
+             "});");
+        return t;
+    }
+    if (auto* f = rt->getFunction(name); f != nullptr) {
+        if (f->params.size() != e->args.size()) {
+            line("panic(\"ArgumentError: expects %d arguments but got %d\", " +
+                 std::to_string(f->params.size()) + ", " +
+                 std::to_string(e->args.size()) + ");");
+            line("lin::Value " + t + "(lin::Null);");
+            return t;
+        }
+        std::string args;
+        for (auto& v : operands(e->args)) {
+            args += (args.empty() ? "" : ", ") + v;
+        }
+        line("lin::Value " + t + " = f_" + name + "({" + args + "});");
+        return t;
+    }
+    line(
+        "panic(\"RuntimeError: can not find function definition of %s in "
+        "both built-in functions and user defined functions\", " +
+        quote(name) + ");");
+    line("lin::Value " + t + "(lin::Null);");
+    return t;
+}
+
+std::string CppEmitter::assign(AssignExpr* e, bool used) {
+    std::string op = tokenName(e->opt);
+    if (auto* ident = dynamic_cast<IdentExpr*>(e->lhs)) {
+        const std::string& name = ident->identName;
+        ValueType type, rhsType;
+        if (!used && scalarVar(name, type) &&
+            (e->opt == TK_ASSIGN || isDefinite(name)) &&
+            scalarType(types.typeOf(e->rhs), rhsType) &&
+            (e->opt == TK_ASSIGN
+                 ? rhsType == type
+                 : !scalarOperation(compoundOperator(e->opt), type, "",
+                                    rhsType, "", e)
+                        .empty())) {
+            std::string rhs = scalar(e->rhs, true);
+            std::string target = writeVar(name);
+            if (e->opt != TK_ASSIGN) {
+                rhs = scalarOperation(compoundOperator(e->opt), type, target,
+                                      rhsType, rhs, e);
+            }
+            line(target + " = " + rhs + ";");
+            return "";
+        }
+        std::string rhs = used ? value(e->rhs) : expr(e->rhs, true);
+        if (e->opt != TK_ASSIGN && !isDefinite(name)) {
+            // Compound assignments create an undefined variable
+            box(name);
+        }
+        std::string target = writeVar(name);
+        if (!used && rhs[0] == 't') {
+            rhs = "std::move(" + rhs + ")";
+        }
+        line("lin::aot::assign(" + target + ", " + op + ", " + rhs + ");");
+        return used ? rhs : "";
+    }
+    if (auto* index = dynamic_cast<IndexExpr*>(e->lhs)) {
+        bool inertIndex = inert(index->index) &&
+                          (index->second == nullptr || inert(index->second));
+        std::string rhs = used ? value(e->rhs) : expr(e->rhs, inertIndex);
+        std::string idx = expr(index->index, index->second == nullptr ||
+                                                 inert(index->second));
+        if (index->second != nullptr) {
+            idx += ", " + expr(index->second, true);
+        }
+        box(index->identName);
+        std::string target = writeVar(index->identName);
+        if (!used && rhs[0] == 't') {
+            rhs = "std::move(" + rhs + ")";
+        }
+        line("lin::aot::assignIndex(" + target + ", " + op + ", " + idx +
+             ", " + rhs + ", " + quote(index->identName) + ", " +
+             position(e) + ");");
+        return used ? rhs : "";
+    }
+    std::string rhs = value(e->rhs);
+    line("panic(\"SyntaxError: can not assign to %s at line %d, col %d\\n\", " +
+         quote(typeid(e->lhs).name()) + ", " + position(e) + ");");
+    return rhs;
+}
+
+Scope& CppEmitter::pushScope() {
+    scopes.emplace_back();
+    scopes.back().id = ++nextScope;
+    return scopes.back();
+}
+
+// Variables defined for sure by enclosing contexts are always assigned there,
+// the innermost scope does not need to hold them
+void CppEmitter::hoist() {
+    Scope scope = std::move(scopes.back());
+    scopes.pop_back();
+    std::vector<std::string> names;
+    for (auto& name : scope.names) {
+        if (scope.definite.count(name) == 1 || !isDefinite(name)) {
+            names.push_back(name);
+        } else {
+            scope.hoisted.erase(name);
+        }
+    }
+    scope.names = std::move(names);
+    scopes.push_back(std::move(scope));
+}
+
+void CppEmitter::declare(const Scope& scope) {
+    std::string names;
+    for (auto& name : scope.names) {
+        if (scope.definite.count(name) == 1) {
+            continue;
+        }
+        if (ValueType type; scalarVar(name, type)) {
+            line(std::string(cppType(type)) + " " + scope.var(name) + "{};");
+        } else {
+            names += (names.empty() ? "" : ", ") + scope.var(name);
+        }
+    }
+    if (!names.empty()) {
+        line("lin::aot::Var " + names + ";");
+    }
+}
+
+void CppEmitter::stmts(const std::vector<Statement*>& list) {
+    for (auto* s : list) {
+        stmt(s);
+    }
+}
+
+void CppEmitter::scopedBlock(Block* block) {
+    Scope& scope = pushScope();
+    collectNames(block->stmts, scope);
+    hoist();
+    declare(scopes.back());
+    stmts(block->stmts);
+    scopes.pop_back();
+}
+
+void CppEmitter::stmt(Statement* stmt) {
+    if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+        if (auto* assign = dynamic_cast<AssignExpr*>(s->expr)) {
+            this->assign(assign, false);
+        } else {
+            expr(s->expr, true);
+        }
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+        std::string v = s->ret ? expr(s->ret, true) : "lin::Value(lin::Null)";
+        line(inFunction ? "return " + v + ";" : "goto " + escape + ";");
+    } else if (dynamic_cast<BreakStmt*>(stmt)) {
+        line(loops.empty() ? "goto " + escape + ";" : "break;");
+    } else if (dynamic_cast<ContinueStmt*>(stmt)) {
+        if (loops.empty()) {
+            line("goto " + escape + ";");
+        } else {
+            line(loops.back().empty() ? "continue;"
+                                      : "goto " + loops.back() + ";");
+        }
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+        if (isBool(s->cond)) {
+            line("if (" + scalar(s->cond, true) + ") {");
+        } else {
+            std::string cond = expr(s->cond, true);
+            line("if (lin::aot::condition(" + cond + ", " + position(s) +
+                 ")) {");
+        }
+        indent++;
+        scopedBlock(s->block);
+        indent--;
+        if (s->elseBlock != nullptr) {
+            line("} else {");
+            indent++;
+            scopedBlock(s->elseBlock);
+            indent--;
+        }
+        line("}");
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+        whileStmt(s);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+        forStmt(s);
+    } else {
+        panic("InternalError: can not emit statement at line %d, col %d\n",
+              stmt->line, stmt->column);
+    }
+}
+
+void CppEmitter::whileStmt(WhileStmt* s) {
+    // Conditions proven to be bool need no check
+    bool typed = isBool(s->cond);
+    std::string cond = temp();
+    line(typed ? "bool " + cond + " = " + scalar(s->cond, true) + ";"
+               : "lin::Value " + cond + " = " + expr(s->cond, true) + ";");
+    line("{");
+    indent++;
+    // Condition is evaluated again within the loop context
+    Scope& scope = pushScope();
+    collectNames(s->cond, scope);
+    collectNames(s->block->stmts, scope);
+    hoist();
+    declare(scopes.back());
+    line("while (" + cond + (typed ? "" : ".cast<bool>()") + ") {");
+    indent++;
+    loops.push_back(continues(s->block) ? "c" + std::to_string(nextLabel++)
+                                        : "");
+    line("{");
+    indent++;
+    stmts(s->block->stmts);
+    indent--;
+    line("}");
+    if (!loops.back().empty()) {
+        line(loops.back() + ":;");
+    }
+    loops.pop_back();
+    // Nothing assigned by the body is known to have run at this point
+    scopes.back().definite.clear();
+    if (typed) {
+        line(cond + " = " + scalar(s->cond, true) + ";");
+    } else {
+        line(cond + " = " + expr(s->cond, true) + ";");
+        line("lin::aot::condition(" + cond + ", " + position(s) + ");");
+    }
+    indent--;
+    line("}");
+    scopes.pop_back();
+    indent--;
+    line("}");
+}
+
+void CppEmitter::forStmt(ForStmt* s) {
+    auto bound = [&](Expression* e, const char* what) {
+        if (isInt(e)) {
+            std::string v = scalar(e, true);
+            std::string n = "n" + std::to_string(nextTemp++);
+            line("long long " + n + " = lin::aot::forBound(" + v + ", " +
+                 quote(what) + ", " + position(s) + ");");
+            return n;
+        }
+        std::string v = expr(e, true);
+        std::string n = "n" + std::to_string(nextTemp++);
+        line("long long " + n + " = Interpreter::forBound(" + v + ", " +
+             quote(what) + ", " + position(s) + ");");
+        return n;
+    };
+    std::string i = bound(s->lo, "lower bound");
+    std::string end = bound(s->hi, "upper bound");
+    std::string stride = "1";
+    if (s->step != nullptr) {
+        stride = bound(s->step, "step");
+        line("if (" + stride + " == 0) {");
+        line(
+            "    panic(\"ValueError: step of for loop can not be zero at line "
+            "%d, col %d\\n\", " +
+            position(s) + ");");
+        line("}");
+    }
+    line("{");
+    indent++;
+    Scope& scope = pushScope();
+    scope.add(s->identName);
+    scope.definite.insert(s->identName);
+    ValueType type;
+    bool unboxed = scalarVar(s->identName, type);
+    line(unboxed ? std::string(cppType(Int)) + " " +
+                       scope.var(s->identName) + ";"
+                 : "lin::aot::Var " + scope.var(s->identName) +
+                       "(lin::Value(lin::Int, 0LL));");
+    collectNames(s->block->stmts, scope);
+    hoist();
+    declare(scopes.back());
+    if (s->step != nullptr) {
+        line("for (; " + stride + " > 0 ? " + i + " < " + end + " : " + i +
+             " > " + end + "; lin::aot::advance(" + i + ", " + stride + ", " +
+             end + ")) {");
+    } else {
+        line("for (; " + i + " < " + end + "; " + i + "++) {");
+    }
+    indent++;
+    line(unboxed ? scopes.back().var(s->identName) + " = " + i + ";"
+                 : "lin::aot::setCounter(" + scopes.back().var(s->identName) +
+                       ", " + i + ");");
+    loops.push_back("");
+    line("{");
+    indent++;
+    stmts(s->block->stmts);
+    indent--;
+    line("}");
+    loops.pop_back();
+    indent--;
+    line("}");
+    scopes.pop_back();
+    indent--;
+    line("}");
+}
+
+// Top-level statements of a function or of the script, a statement which
+// jumps out of itself is followed by a label to jump to
+void CppEmitter::body(const std::vector<Statement*>& list) {
+    for (auto* s : list) {
+        if (!escapes(s, !inFunction, 0)) {
+            stmt(s);
+            continue;
+        }
+        escape = "e" + std::to_string(nextLabel++);
+        line("{");
+        indent++;
+        stmt(s);
+        indent--;
+        line("}");
+        line(escape + ":;");
+    }
+}
+
+void CppEmitter::function(Function* f) {
+    // Body of a memoized function is run through its result cache
+    std::string entry = (f->memo != nullptr ? "r_" : "f_") + f->name;
+    line("lin::Value " + entry + "(std::vector<lin::Value> args) {");
+    indent++;
+    nextTemp = 0;
+    inFunction = true;
+    unit = f;
+    Scope& scope = pushScope();
+    for (size_t i = 0; i < f->params.size(); i++) {
+        // Like createVariable() the first of duplicated parameters wins
+        if (scope.hoisted.count(f->params[i]) == 1) {
+            continue;
+        }
+        scope.add(f->params[i]);
+        scope.definite.insert(f->params[i]);
+        std::string arg = "args[" + std::to_string(i) + "]";
+        if (ValueType type; scalarVar(f->params[i], type)) {
+            line(std::string(cppType(type)) + " " + scope.var(f->params[i]) +
+                 " = " + unboxValue(type, arg) + ";");
+        } else {
+            line("lin::aot::Var " + scope.var(f->params[i]) + "(std::move(" +
+                 arg + "));");
+        }
+    }
+    collectNames(f->block->stmts, scope);
+    declare(scope);
+    body(f->block->stmts);
+    line("return lin::Value(lin::Null);");
+    scopes.pop_back();
+    indent--;
+    line("}");
+    line("");
+    if (f->memo != nullptr) {
+        line("lin::Value f_" + f->name + "(std::vector<lin::Value> args) {");
+        line("    return lin::aot::memoized(*c_" + f->name +
+             ", std::move(args), r_" + f->name + ");");
+        line("}");
+        line("");
+    }
+}
+
+void CppEmitter::emit(const std::string& sourceName, std::ostream& os) {
+    auto functions = rt->getFunctions();
+    std::sort(functions.begin(), functions.end(),
+              [](Function* a, Function* b) { return a->name < b->name; });
+
+    for (auto* f : functions) {
+        function(f);
+    }
+    std::string functionDefs = std::move(out);
+
+    out.clear();
+    nextTemp = 0;
+    inFunction = false;
+    unit = nullptr;
+    indent = 1;
+    Scope& scope = pushScope();
+    auto stmts = rt->getStatements();
+    collectNames(stmts, scope);
+    declare(scope);
+    body(stmts);
+    scopes.pop_back();
+    std::string mainDef = std::move(out);
+
+    os << "// Generated by lin --emit-cpp from " << sourceName << "\n";
+    os << "#include \"AotRuntime.hpp\"\n\n";
+    os << "namespace {\n";
+    for (auto& [text, id] : strings) {
+        os << "const lin::Value s" << id << "(lin::String, lin::StringData("
+           << "std::string(" << quote(text) << ", " << text.size()
+           << ")));\n";
+    }
+    for (auto& [digits, id] : bigInts) {
+        os << "const lin::Value z" << id << "(lin::BigInt, "
+           << "lin::BigIntData::parse(\"" << digits << "\"));\n";
+    }
+    for (auto& name : builtins) {
+        os << "lin::Runtime::BuiltinFuncType b_" << name << ";\n";
+    }
+    for (auto& name : mutators) {
+        os << "lin::Runtime::MutatorFuncType m_" << name << ";\n";
+    }
+    for (auto* f : functions) {
+        os << "lin::Value f_" << f->name << "(std::vector<lin::Value> args);\n";
+        if (f->memo != nullptr) {
+            os << "lin::MemoCache* c_" << f->name << ";\n";
+        }
+    }
+    os << "\n" << functionDefs;
+
+    os << "void setup() {\n";
+    for (auto& name : builtins) {
+        os << "    b_" << name << " = lin::aot::runtime->getBuiltinFunction("
+           << quote(name) << ");\n";
+    }
+    for (auto& name : mutators) {
+        os << "    m_" << name << " = lin::aot::runtime->getMutatorFunction("
+           << quote(name) << ");\n";
+    }
+    for (auto* f : functions) {
+        if (f->memo != nullptr) {
+            // @memo keeps caching even when calls hardly ever hit
+            os << "    c_" << f->name << " = lin::aot::addMemoCache("
+               << (f->memoize == MemoizeOn ? "true" : "false") << ");\n";
+        }
+        std::string params;
+        for (auto& p : f->params) {
+            params += (params.empty() ? "" : ", ") + quote(p);
+        }
+        os << "    lin::aot::addFunction(" << quote(f->name) << ", {" << params
+           << "}, &f_" << f->name << ");\n";
+    }
+    os << "}\n\n";
+    os << "void run() {\n" << mainDef << "}\n";
+    os << "}  // namespace\n\n";
+    os << "int main() { return lin::aot::run(setup, run); }\n";
+}
+}  // namespace
+
+void Aot::emitCpp(Runtime* rt, const std::string& sourceName,
+                  std::ostream& os) {
+    TypeInference types(rt);
+    // Emitting once finds variables which must stay boxed, e.g. those checked
+    // for being defined at runtime, the second pass unboxes all others
+    CppEmitter probe(rt, types);
+    std::ostringstream discarded;
+    probe.emit(sourceName, discarded);
+    CppEmitter emitter(rt, types);
+    emitter.unbox(probe.boxedVariables());
+    emitter.emit(sourceName, os);
+}
+}  // namespace lin
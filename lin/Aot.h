@@ -0,0 +1,23 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Ahead-of-time back end of lin. A parsed program is translated into a single
+// C++17 translation unit which includes AotRuntime.hpp and links against the
+// interpreter sources, e.g.
+//      lin --emit-cpp prog.lin > prog.cpp
+//      g++ -std=c++17 -O2 -Ilin prog.cpp lin/{Lin,Builtin,...}.cpp -o prog
+// Contexts of the interpreter become C++ blocks whose variables are resolved
+// while emitting, so the executable behaves exactly like the interpreter.
+// Variables which lin::TypeInference proves to hold a single int, double or
+// bool are unboxed into plain C++ locals, operators on them need no checks.
+//===----------------------------------------------------------------------===//
+class Aot {
+public:
+    static void emitCpp(Runtime* rt, const std::string& sourceName,
+                        std::ostream& os);
+};
+}  // namespace lin
@@ -0,0 +1,386 @@
+#pragma once
+#include <cstdlib>
+#include <deque>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "HashTable.h"
+#include "Interpreter.h"
+#include "Lin.hpp"
+#include "Matrix.h"
+#include "Memo.h"
+#include "Utils.hpp"
+
+namespace lin::aot {
+//===----------------------------------------------------------------------===//
+// Runtime support of C++ code emitted by lin --emit-cpp. Values, operators and
+// builtin functions are exactly those of the interpreter, emitted code only
+// replaces walking the AST and looking variables up by name.
+//===----------------------------------------------------------------------===//
+inline Runtime* runtime{};
+
+// Builtins get no context chain of the caller, none of them uses it
+inline const std::deque<Context*>& noContext() {
+    static const std::deque<Context*> chain;
+    return chain;
+}
+
+// A variable of the context it lives in when being interpreted. Every
+// variable a context might hold is allocated up front, it only exists for
+// the script once it is defined.
+struct Var {
+    explicit Var() = default;
+    explicit Var(Value value) : value(std::move(value)), defined(true) {}
+
+    Value value;
+    bool defined = false;
+};
+
+// An int of a variable or expression type inference proved to be int. Its
+// arithmetic runs on the unboxed 64 bits with overflow checks, a result
+// which does not fit them moves to big as a BigInt the way the interpreter
+// promotes it.
+struct Integer {
+    Integer(long long small = 0) : small(small) {}
+
+    // Int or BigInt value v
+    static Integer of(Value v) {
+        if (v.isType<lin::Int>()) {
+            return v.ref<long long>();
+        }
+        Integer result;
+        result.big = std::move(v);
+        return result;
+    }
+
+    bool fits() const { return big.isType<lin::Null>(); }
+    Value box() const { return fits() ? Value(lin::Int, small) : big; }
+
+    long long small;
+    Value big{lin::Null};
+};
+
+inline Value toValue(const Integer& v) { return v.box(); }
+
+inline double toDouble(const Integer& v) {
+    return v.fits() ? static_cast<double>(v.small)
+                    : v.big.ref<BigIntData>().toDouble();
+}
+
+[[noreturn]] inline Var& undefinedVariable(const char* identName, int line,
+                                           int column) {
+    panic("RuntimeError: use of undefined variable \"%s\" at line %d, col %d\n",
+          identName, line, column);
+}
+
+inline void assign(Var& var, Token opt, Value rhs) {
+    if (var.defined) {
+        Interpreter::assignTo(opt, var.value, std::move(rhs));
+    } else {
+        // Compound assignments create an undefined variable as well
+        var.value = std::move(rhs);
+        var.defined = true;
+    }
+}
+
+// Variables proven to hold a single int, double or bool are plain C++ values,
+// operators static types can not resolve work on a boxed copy
+template <typename _ScalarType>
+inline void assign(_ScalarType& var, Token opt, Value rhs) {
+    Value value = toValue(var);
+    Interpreter::assignTo(opt, value, std::move(rhs));
+    var = value.cast<_ScalarType>();
+}
+
+inline void assign(Integer& var, Token opt, Value rhs) {
+    Value value = var.box();
+    Interpreter::assignTo(opt, value, std::move(rhs));
+    var = Integer::of(std::move(value));
+}
+
+inline void assignIndex(Var& var, Token opt, const Value& index, Value rhs,
+                        const char* identName, int line, int column) {
+    if (var.defined) {
+        Interpreter::assignIndex(opt, var.value, index, std::move(rhs),
+                                 identName, line, column);
+    } else {
+        var.value = std::move(rhs);
+        var.defined = true;
+    }
+}
+
+inline void assignIndex(Var& var, Token opt, const Value& index,
+                        const Value& second, Value rhs, const char* identName,
+                        int line, int column) {
+    if (var.defined) {
+        Interpreter::assignIndex(opt, var.value, index, second, std::move(rhs),
+                                 identName, line, column);
+    } else {
+        var.value = std::move(rhs);
+        var.defined = true;
+    }
+}
+
+inline void setCounter(Var& var, long long i) {
+    if (var.value.isType<lin::Int>()) {
+        var.value.ref<long long>() = i;
+    } else {
+        var.value = Value(lin::Int, i);
+    }
+}
+
+// Step the counter of a for loop, stepping beyond the range of ints ends the
+// loop
+inline void advance(long long& i, long long stride, long long end) {
+    if (__builtin_add_overflow(i, stride, &i)) {
+        i = end;
+    }
+}
+
+// Same as BinaryExpr::eval, unary operators get a null rhs
+template <Token _Opt>
+inline Value binary(const Value& lhs, const Value& rhs, int line, int column) {
+    if (lhs.isType<lin::Int>() && rhs.isType<lin::Int>()) {
+        long long l = lhs.ref<long long>(), r = rhs.ref<long long>();
+        if constexpr (_Opt == TK_PLUS) {
+            return addInts(l, r);
+        } else if constexpr (_Opt == TK_MINUS) {
+            return subInts(l, r);
+        } else if constexpr (_Opt == TK_TIMES) {
+            return mulInts(l, r);
+        } else if constexpr (_Opt == TK_DIV || _Opt == TK_MOD) {
+            if (r != 0) {
+                return _Opt == TK_DIV ? divInts(l, r) : modInts(l, r);
+            }
+        } else if constexpr (_Opt == TK_EQ) {
+            return Value(lin::Bool, l == r);
+        } else if constexpr (_Opt == TK_NE) {
+            return Value(lin::Bool, l != r);
+        } else if constexpr (_Opt == TK_GT) {
+            return Value(lin::Bool, l > r);
+        } else if constexpr (_Opt == TK_GE) {
+            return Value(lin::Bool, l >= r);
+        } else if constexpr (_Opt == TK_LT) {
+            return Value(lin::Bool, l < r);
+        } else if constexpr (_Opt == TK_LE) {
+            return Value(lin::Bool, l <= r);
+        }
+    }
+    if (!lhs.isType<lin::Null>() && rhs.isType<lin::Null>()) {
+        Value operand = lhs;
+        return Interpreter::calcUnaryExpr(operand, _Opt, line, column);
+    }
+    return Interpreter::calcBinaryExpr(lhs, _Opt, rhs, line, column);
+}
+
+// Int operators of unboxed operands. Results which overflow, BigInt operands
+// and a zero divisor take the way of binary().
+template <Token _Opt>
+inline Integer arithmetic(const Integer& lhs, const Integer& rhs, int line,
+                          int column) {
+    if (lhs.fits() && rhs.fits()) {
+        long long l = lhs.small, r = rhs.small, result;
+        if constexpr (_Opt == TK_PLUS) {
+            if (!__builtin_add_overflow(l, r, &result)) {
+                return result;
+            }
+        } else if constexpr (_Opt == TK_MINUS) {
+            if (!__builtin_sub_overflow(l, r, &result)) {
+                return result;
+            }
+        } else if constexpr (_Opt == TK_TIMES) {
+            if (!__builtin_mul_overflow(l, r, &result)) {
+                return result;
+            }
+        } else if constexpr (_Opt == TK_DIV) {
+            // The one quotient which overflows is -2^63 / -1
+            if (r != 0 && r != -1) {
+                return l / r;
+            }
+        } else if constexpr (_Opt == TK_MOD) {
+            if (r != 0) {
+                return r == -1 ? 0 : l % r;
+            }
+        } else if constexpr (_Opt == TK_BITAND) {
+            return l & r;
+        } else if constexpr (_Opt == TK_BITOR) {
+            return l | r;
+        }
+    }
+    return Integer::of(binary<_Opt>(lhs.box(), rhs.box(), line, column));
+}
+
+template <Token _Opt>
+inline Integer unary(const Integer& v, int line, int column) {
+    if (v.fits()) {
+        if constexpr (_Opt == TK_MINUS) {
+            if (long long result; !__builtin_sub_overflow(0LL, v.small,
+                                                          &result)) {
+                return result;
+            }
+        } else if constexpr (_Opt == TK_BITNOT) {
+            return ~v.small;
+        }
+    }
+    return Integer::of(
+        binary<_Opt>(v.box(), Value(lin::Null), line, column));
+}
+
+template <Token _Opt>
+inline bool compare(const Integer& lhs, const Integer& rhs, int line,
+                    int column) {
+    if (lhs.fits() && rhs.fits()) {
+        long long l = lhs.small, r = rhs.small;
+        if constexpr (_Opt == TK_EQ) {
+            return l == r;
+        } else if constexpr (_Opt == TK_NE) {
+            return l != r;
+        } else if constexpr (_Opt == TK_GT) {
+            return l > r;
+        } else if constexpr (_Opt == TK_GE) {
+            return l >= r;
+        } else if constexpr (_Opt == TK_LT) {
+            return l < r;
+        } else {
+            return l <= r;
+        }
+    }
+    Value result = binary<_Opt>(lhs.box(), rhs.box(), line, column);
+    return result.cast<bool>();
+}
+
+inline long long forBound(const Integer& v, const char* what, int line,
+                          int column) {
+    return v.fits() ? v.small
+                    : Interpreter::forBound(v.big, what, line, column);
+}
+
+inline void checkLogical(const Value& v, Token opt, int line, int column) {
+    if (!v.isType<lin::Bool>()) {
+        panic("TypeError: unexpected arguments of operator %s at line %d, "
+              "col %d\n",
+              opt == TK_LOGAND ? "&&" : "||", line, column);
+    }
+}
+
+inline bool condition(const Value& v, int line, int column) {
+    if (!v.isType<lin::Bool>()) {
+        panic(
+            "TypeError: expects bool type in while condition at line %d, "
+            "col %d\n",
+            line, column);
+    }
+    return v.cast<bool>();
+}
+
+inline Value subscript(const Value& base, const Value& idx,
+                       const char* identName, int line, int column) {
+    if (base.isType<lin::Array>() && idx.isType<lin::Int>()) {
+        auto& arr = base.ref<ArrayData>();
+        if (auto i = static_cast<size_t>(idx.ref<long long>());
+            i < arr.size()) {
+            return arr[i];
+        }
+    }
+    return Interpreter::subscript(base, idx, identName, line, column);
+}
+
+inline Value subscript(const Value& base, const Integer& idx,
+                       const char* identName, int line, int column) {
+    if (base.isType<lin::Array>() && idx.fits()) {
+        auto& arr = base.ref<ArrayData>();
+        if (auto i = static_cast<size_t>(idx.small); i < arr.size()) {
+            return arr[i];
+        }
+    }
+    return Interpreter::subscript(base, idx.box(), identName, line, column);
+}
+
+inline const Value& boxIndex(const Value& idx) { return idx; }
+inline Value boxIndex(const Integer& idx) { return idx.box(); }
+
+// Element of m[i, j] or m[i][j], indices are boxed or unboxed ints
+template <typename _IndexType, typename _SecondType>
+inline Value subscript(const Value& base, const _IndexType& idx,
+                       const _SecondType& second, const char* identName,
+                       int line, int column) {
+    if constexpr (!std::is_same_v<_IndexType, Value> &&
+                  !std::is_same_v<_SecondType, Value>) {
+        const Integer& row = idx;
+        const Integer& col = second;
+        if (base.isType<lin::Matrix>() && row.fits() && col.fits()) {
+            auto& m = base.ref<MatrixData>();
+            auto i = static_cast<size_t>(row.small);
+            auto j = static_cast<size_t>(col.small);
+            if (i < m.rows() && j < m.cols()) {
+                return m.at(i, j);
+            }
+        }
+    }
+    return Interpreter::subscript(base, boxIndex(idx), boxIndex(second),
+                                  identName, line, column);
+}
+
+inline Value call(Runtime::BuiltinFuncType f, std::initializer_list<Value> args) {
+    return f(runtime, noContext(), Arguments(args.begin(), args.size()));
+}
+
+inline Value call(Runtime::MutatorFuncType f, Value& self,
+                  std::initializer_list<Value> args) {
+    return f(runtime, self, Arguments(args.begin(), args.size()));
+}
+
+// Functions are registered as native functions of runtime, so builtins like
+// sort_by can still call them by name
+inline void addFunction(const char* name, std::vector<std::string> params,
+                        Function::NativeFuncType native) {
+    auto* f = new Function;
+    f->name = name;
+    f->params = std::move(params);
+    f->native = native;
+    runtime->addFunction(name, f);
+}
+
+// Result cache of a function the interpreter would memoize, owned by runtime
+inline MemoCache* addMemoCache(bool forced) {
+    auto* cache = new MemoCache(forced);
+    runtime->addMemoCache(cache);
+    return cache;
+}
+
+// Same as the cached calls of Interpreter::callFunction
+inline Value memoized(MemoCache& cache, std::vector<Value> args,
+                      Function::NativeFuncType run) {
+    if (!cache.active() || !MemoCache::cacheable(args)) {
+        return run(std::move(args));
+    }
+    if (auto* cached = cache.find(args); cached != nullptr) {
+        return *cached;
+    }
+    auto key = args;
+    Value result = run(std::move(args));
+    cache.insert(std::move(key), result);
+    return result;
+}
+
+// Runs the program and reports errors like the interpreter does
+template <typename _SetupType, typename _MainType>
+inline int run(_SetupType setup, _MainType main) {
+    int status = 0;
+    Runtime rt;
+    runtime = &rt;
+    try {
+        setup();
+        main();
+    } catch (const LinError& e) {
+        std::cout << std::flush;
+        fputs(e.what(), stdout);
+        status = EXIT_FAILURE;
+    }
+    runtime = nullptr;
+    return status;
+}
+}  // namespace lin::aot
@@ -1,6 +1,39 @@
 #include "Ast.h"
 #include "Utils.hpp"
 
+lin::Block::~Block() {
+    for (auto* stmt : stmts) {
+        delete stmt;
+    }
+}
+
+void deleteOperands(Expression* lhs, Expression* rhs) {
+    if (lhs == nullptr && rhs == nullptr) {
+        return;
+    }
+    std::vector<Expression*> worklist{lhs, rhs};
+    while (!worklist.empty()) {
+        Expression* e = worklist.back();
+        worklist.pop_back();
+        if (auto* quickened = dynamic_cast<QuickenedExpr*>(e)) {
+            worklist.push_back(quickened->releaseGeneric());
+        } else if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+            worklist.push_back(binary->lhs);
+            worklist.push_back(binary->rhs);
+            binary->lhs = binary->rhs = nullptr;
+        } else if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+            worklist.push_back(logical->lhs);
+            worklist.push_back(logical->rhs);
+            logical->lhs = logical->rhs = nullptr;
+        } else if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+            worklist.push_back(assign->lhs);
+            worklist.push_back(assign->rhs);
+            assign->lhs = assign->rhs = nullptr;
+        }
+        delete e;
+    }
+}
+
 std::string Expression::astString() { return "Expr()"; }
 
 std::string Statement::astString() { return "Stmt()"; }
@@ -19,11 +52,17 @@ std::string IntExpr::astString() {
     return "IntExpr(" + std::to_string(literal) + ")";
 }
 
+std::string BigIntExpr::astString() {
+    return "BigIntExpr(" + literal.str() + ")";
+}
+
 std::string DoubleExpr::astString() {
     return "DoubleExpr(" + std::to_string(literal) + ")";
 }
 
-std::string StringExpr::astString() { return "StringExpr(" + literal + ")"; }
+std::string StringExpr::astString() {
+    return "StringExpr(" + literal.str() + ")";
+}
 
 std::string ArrayExpr::astString() {
     std::string str = "ArrayExpr(elements=[";
@@ -36,11 +75,42 @@ std::string ArrayExpr::astString() {
     return str;
 }
 
+std::string DictExpr::astString() {
+    std::string str = "DictExpr(elements=[";
+    for (auto& [key, value] : literal) {
+        str += key->astString();
+        str += ":";
+        str += value->astString();
+        str += ",";
+    }
+    str += "])";
+    return str;
+}
+
 std::string IdentExpr::astString() { return "IdentExpr(" + identName + ")"; }
 
 std::string IndexExpr::astString() {
     std::string str = "IndexExpr(index=";
     str += index->astString();
+    if (second) {
+        str += ",second=";
+        str += second->astString();
+    }
+    str += ")";
+    return str;
+}
+
+std::string SliceExpr::astString() {
+    std::string str = "SliceExpr(base=";
+    str += base->astString();
+    if (lo) {
+        str += ",lo=";
+        str += lo->astString();
+    }
+    if (hi) {
+        str += ",hi=";
+        str += hi->astString();
+    }
     str += ")";
     return str;
 }
@@ -121,6 +191,44 @@ std::string BinaryExpr::astString() {
     return str;
 }
 
+template <Token _Opt>
+std::string IntBinaryExpr<_Opt>::astString() {
+    std::string str = "IntBinaryExpr(generic=";
+    str += generic->astString();
+    str += ")";
+    return str;
+}
+
+std::string ArrayIndexIntExpr::astString() {
+    std::string str = "ArrayIndexIntExpr(generic=";
+    str += generic->astString();
+    str += ")";
+    return str;
+}
+
+template struct IntBinaryExpr<TK_PLUS>;
+template struct IntBinaryExpr<TK_MINUS>;
+template struct IntBinaryExpr<TK_TIMES>;
+template struct IntBinaryExpr<TK_DIV>;
+template struct IntBinaryExpr<TK_MOD>;
+template struct IntBinaryExpr<TK_EQ>;
+template struct IntBinaryExpr<TK_NE>;
+template struct IntBinaryExpr<TK_GT>;
+template struct IntBinaryExpr<TK_GE>;
+template struct IntBinaryExpr<TK_LT>;
+template struct IntBinaryExpr<TK_LE>;
+
+std::string LogicalExpr::astString() {
+    std::string str = "LogicalExpr(opt=";
+    str += (opt == TK_LOGAND ? "&&" : "||");
+    str += ",lhs=";
+    str += lhs->astString();
+    str += ",rhs=";
+    str += rhs->astString();
+    str += ")";
+    return str;
+}
+
 std::string FunCallExpr::astString() {
     std::string str = "FunCallExpr(func=";
     str += funcName;
@@ -161,6 +269,26 @@ std::string WhileStmt::astString() {
     return str;
 }
 
+std::string ForStmt::astString() {
+    std::string str = "ForStmt(ident=";
+    str += identName;
+    str += ",lo=";
+    str += lo->astString();
+    str += ",hi=";
+    str += hi->astString();
+    if (step) {
+        str += ",step=";
+        str += step->astString();
+    }
+    str += ",exprs=[";
+    for (auto& e : block->stmts) {
+        str += e->astString();
+        str += ",";
+    }
+    str += "])";
+    return str;
+}
+
 std::string IfStmt::astString() {
     std::string str = "IfStmt(cond=";
     str += cond->astString();
@@ -6,12 +6,19 @@ Expression <|-- BoolExpr
 Expression <|-- CharExpr
 Expression <|-- NullExpr
 Expression <|-- IntExpr
+Expression <|-- BigIntExpr
 Expression <|-- DoubleExpr
 Expression <|-- StringExpr
 Expression <|-- ArrayExpr
+Expression <|-- DictExpr
 Expression <|-- IdentExpr
 Expression <|-- IndexExpr
+Expression <|-- SliceExpr
 Expression <|-- BinaryExpr
+Expression <|-- LogicalExpr
+Expression <|-- QuickenedExpr
+QuickenedExpr <|-- IntBinaryExpr
+QuickenedExpr <|-- ArrayIndexIntExpr
 Expression <|-- FunCallExpr
 Expression <|-- AssignExpr
 
@@ -24,6 +31,7 @@ Statement <|-- ExpressionStmt
 Statement <|-- ReturnStmt
 Statement <|-- IfStmt
 Statement <|-- WhileStmt
+Statement <|-- ForStmt
 
 @enduml
  */
@@ -66,19 +74,22 @@ enum Token {
     TK_LT,  // <
     TK_LE,  // <=
 
-    TK_ASSIGN,     // =
-    TK_PLUS_AGN,   // +=
-    TK_MINUS_AGN,  // -=
-    TK_TIMES_AGN,  // *=
-    TK_DIV_AGN,    // /=
-    TK_MOD_AGN,    // %=
-    TK_COMMA,      // ,
-    TK_LPAREN,     // (
-    TK_RPAREN,     // )
-    TK_LBRACE,     // {
-    TK_RBRACE,     // }
-    TK_LBRACKET,   // [
-    TK_RBRACKET,   // ]
+    TK_ASSIGN,      // =
+    TK_PLUS_AGN,    // +=
+    TK_MINUS_AGN,   // -=
+    TK_TIMES_AGN,   // *=
+    TK_DIV_AGN,     // /=
+    TK_MOD_AGN,     // %=
+    TK_COMMA,       // ,
+    TK_COLON,       // :
+    TK_RANGE,       // ..
+    TK_LPAREN,      // (
+    TK_RPAREN,      // )
+    TK_LBRACE,      // {
+    TK_RBRACE,      // }
+    TK_LBRACKET,    // [
+    TK_RBRACKET,    // ]
+    TK_ANNOTATION,  // @<identifier>
 
     KW_IF,        // if
     KW_ELSE,      // else
@@ -86,11 +97,13 @@ enum Token {
     KW_FALSE,     // false
     KW_WHILE,     // while
     KW_FOR,       // for
+    KW_IN,        // in
     KW_NULL,      // null
     KW_FUNC,      // func
     KW_RETURN,    // return
     KW_BREAK,     // break
     KW_CONTINUE,  // continue
+    KW_IMPORT,    // import
 };
 
 using lin::Block;
@@ -98,10 +111,11 @@ using lin::Context;
 using lin::ExecResult;
 using lin::Runtime;
 using lin::Value;
+using lin::Variable;
 struct Expression;
 struct Statement;
 
-struct AstNode {
+struct AstNode : public lin::HeapCharged<lin::HeapAst> {
     explicit AstNode(int line, int column) : line(line), column(column) {}
     virtual ~AstNode() = default;
 
@@ -119,16 +133,41 @@ struct Expression : public AstNode {
 
     virtual ~Expression() = default;
 
-    virtual Value eval(Runtime* rt, std::deque<Context*> ctxChain);
+    virtual Value eval(Runtime* rt, std::deque<Context*>& ctxChain);
 
     std::string astString() override;
+
+    // Set by a node which wants its parent to replace it by a specialized
+    // variant of itself, or by the generic node again once a guard failed
+    Expression* replacement{};
+    // Height of the tree below the node if evaluating it calls no user
+    // defined function, -1 if it may call one and -2 until fibers need it
+    int callFreeHeight = -2;
 };
 
+// Evaluate the expression held by slot of a parent node and swap in its
+// replacement if it asked for one
+inline Value evalExpr(Expression*& slot, Runtime* rt,
+                      std::deque<Context*>& ctxChain) {
+    Expression* node = slot;
+    Value result = node->eval(rt, ctxChain);
+    if (node->replacement != nullptr) {
+        slot = node->replacement;
+        node->replacement = nullptr;
+    }
+    return result;
+}
+
+// Delete both operands of a node. Operands of binary, logical and assignment
+// nodes are taken apart on a worklist rather than by their destructors, so
+// freeing a chain like 0 + 1 + ... + n can not overflow the stack.
+void deleteOperands(Expression* lhs, Expression* rhs);
+
 struct BoolExpr : public Expression {
     explicit BoolExpr(int line, int column) : Expression(line, column) {}
     bool literal;
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
@@ -137,23 +176,33 @@ struct CharExpr : public Expression {
 
     char literal;
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct NullExpr : public Expression {
     explicit NullExpr(int line, int column) : Expression(line, column) {}
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct IntExpr : public Expression {
     explicit IntExpr(int line, int column) : Expression(line, column) {}
 
-    int literal;
+    long long literal;
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+};
+
+// Integer literal beyond the range of int values
+struct BigIntExpr : public Expression {
+    explicit BigIntExpr(int line, int column) : Expression(line, column) {}
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    lin::BigIntData literal{0};
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
@@ -162,73 +211,216 @@ struct DoubleExpr : public Expression {
 
     double literal;
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct StringExpr : public Expression {
     explicit StringExpr(int line, int column) : Expression(line, column) {}
 
-    std::string literal;
+    // Interned by parser, equal literals share one buffer and its hash
+    lin::StringData literal;
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString();
 };
 
 struct ArrayExpr : public Expression {
     explicit ArrayExpr(int line, int column) : Expression(line, column) {}
+    ~ArrayExpr() override {
+        for (auto* e : literal) {
+            delete e;
+        }
+    }
 
     std::vector<Expression*> literal;
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString();
 };
 
+struct DictExpr : public Expression {
+    explicit DictExpr(int line, int column) : Expression(line, column) {}
+    ~DictExpr() override {
+        for (auto& [key, value] : literal) {
+            delete key;
+            delete value;
+        }
+    }
+
+    std::vector<std::pair<Expression*, Expression*>> literal;
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+};
+
 struct IdentExpr : public Expression {
     explicit IdentExpr(std::string identName, int line, int column)
         : Expression(line, column), identName(std::move(identName)) {}
     std::string identName;
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
 
     std::string astString() override;
 };
 
+// identName[index], or identName[index][second] and identName[index, second]
+// which both index a matrix element or an element of an element
 struct IndexExpr : public Expression {
     explicit IndexExpr(int line, int column) : Expression(line, column) {}
+    ~IndexExpr() override {
+        delete index;
+        delete second;
+    }
 
     std::string identName;
     Expression* index;
+    Expression* second{};
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    // Consecutive executions which indexed an array by int
+    int intHits = 0;
+    bool quickened = false;
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+
+    Variable* lookup(const std::deque<Context*>& ctxChain);
+    Value subscript(const Value& base, const Value& idx);
+    Value subscript(const Value& base, const Value& idx, const Value& second);
+};
+
+struct SliceExpr : public Expression {
+    explicit SliceExpr(int line, int column) : Expression(line, column) {}
+    ~SliceExpr() override {
+        delete base;
+        delete lo;
+        delete hi;
+    }
+
+    Expression* base{};
+    // Omitted bounds are null, they default to start and end of base
+    Expression* lo{};
+    Expression* hi{};
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct BinaryExpr : public Expression {
     explicit BinaryExpr(int line, int column) : Expression(line, column) {}
+    ~BinaryExpr() override { deleteOperands(lhs, rhs); }
     Expression* lhs{};
     Token opt{};
     Expression* rhs{};
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+
+    // Consecutive executions whose operands were both ints
+    int intHits = 0;
+    bool quickened = false;
+
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+
+    std::string astString() override;
+};
+
+//===----------------------------------------------------------------------===//
+// Quickened expressions replace a generic node after it observed the same
+// operand types for a number of executions. They own the generic node and
+// hand control back to it for good when their guard fails.
+//===----------------------------------------------------------------------===//
+struct QuickenedExpr : public Expression {
+    using Expression::Expression;
+
+    // The generic node this one stands for, passes over the tree look through
+    // quickened nodes with it
+    virtual Expression* genericExpr() = 0;
+    // Give up ownership of the generic node, null if the node was deoptimized
+    // and the tree owns it already
+    virtual Expression* releaseGeneric() = 0;
+};
+
+template <Token _Opt>
+struct IntBinaryExpr : public QuickenedExpr {
+    explicit IntBinaryExpr(BinaryExpr* generic)
+        : QuickenedExpr(generic->line, generic->column), generic(generic) {}
+    ~IntBinaryExpr() override {
+        if (!deoptimized) {
+            delete generic;
+        }
+    }
+
+    BinaryExpr* generic;
+    bool deoptimized = false;
+
+    Expression* genericExpr() override { return generic; }
+    Expression* releaseGeneric() override {
+        if (deoptimized) {
+            return nullptr;
+        }
+        deoptimized = true;
+        return generic;
+    }
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+};
+
+struct ArrayIndexIntExpr : public QuickenedExpr {
+    explicit ArrayIndexIntExpr(IndexExpr* generic)
+        : QuickenedExpr(generic->line, generic->column), generic(generic) {}
+    ~ArrayIndexIntExpr() override {
+        if (!deoptimized) {
+            delete generic;
+        }
+    }
+
+    IndexExpr* generic;
+    bool deoptimized = false;
+
+    Expression* genericExpr() override { return generic; }
+    Expression* releaseGeneric() override {
+        if (deoptimized) {
+            return nullptr;
+        }
+        deoptimized = true;
+        return generic;
+    }
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+};
+
+// Operands of && and || are evaluated lazily, rhs is skipped once lhs alone
+// decides the result
+struct LogicalExpr : public Expression {
+    explicit LogicalExpr(int line, int column) : Expression(line, column) {}
+    ~LogicalExpr() override { deleteOperands(lhs, rhs); }
+    Expression* lhs{};
+    Token opt{};
+    Expression* rhs{};
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
 
     std::string astString() override;
 };
 
 struct FunCallExpr : public Expression {
     explicit FunCallExpr(int line, int column) : Expression(line, column) {}
+    ~FunCallExpr() override {
+        for (auto* e : args) {
+            delete e;
+        }
+    }
     std::string funcName;
     std::vector<Expression*> args;
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct AssignExpr : public Expression {
     explicit AssignExpr(int line, int column) : Expression(line, column) {}
+    ~AssignExpr() override { deleteOperands(lhs, rhs); }
 
     Expression* lhs{};
     Token opt;
     Expression* rhs{};
 
-    Value eval(Runtime* rt, std::deque<Context*> ctxChain) override;
+    Value eval(Runtime* rt, std::deque<Context*>& ctxChain) override;
 
     std::string astString() override;
 };
@@ -240,7 +432,7 @@ struct Statement : public AstNode {
     using AstNode::AstNode;
 
     virtual ~Statement() = default;
-    virtual ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain);
+    virtual ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain);
 
     std::string astString() override;
 };
@@ -248,53 +440,87 @@ struct Statement : public AstNode {
 struct BreakStmt : public Statement {
     explicit BreakStmt(int line, int column) : Statement(line, column) {}
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct ContinueStmt : public Statement {
     explicit ContinueStmt(int line, int column) : Statement(line, column) {}
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct ExpressionStmt : public Statement {
     explicit ExpressionStmt(Expression* expr, int line, int column)
         : Statement(line, column), expr(expr) {}
+    ~ExpressionStmt() override { delete expr; }
 
     Expression* expr{};
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct ReturnStmt : public Statement {
     explicit ReturnStmt(int line, int column) : Statement(line, column) {}
+    ~ReturnStmt() override { delete ret; }
 
     Expression* ret{};
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct IfStmt : public Statement {
     explicit IfStmt(int line, int column) : Statement(line, column) {}
+    ~IfStmt() override {
+        delete cond;
+        delete block;
+        delete elseBlock;
+    }
 
     Expression* cond{};
     Block* block{};
     Block* elseBlock{};
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
+    std::string astString() override;
+};
+
+// for ident in lo..hi step s, the counter runs from lo up to but excluding hi
+// (down to for negative steps). Bounds and step are evaluated once.
+struct ForStmt : public Statement {
+    explicit ForStmt(int line, int column) : Statement(line, column) {}
+    ~ForStmt() override {
+        delete lo;
+        delete hi;
+        delete step;
+        delete block;
+    }
+
+    std::string identName;
+    Expression* lo{};
+    Expression* hi{};
+    Expression* step{};
+    Block* block{};
+    lin::JitProfile jit;
+
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
 
 struct WhileStmt : public Statement {
     explicit WhileStmt(int line, int column) : Statement(line, column) {}
+    ~WhileStmt() override {
+        delete cond;
+        delete block;
+    }
 
     Expression* cond{};
     Block* block{};
+    lin::JitProfile jit;
 
-    ExecResult interpret(Runtime* rt, std::deque<Context*> ctxChain) override;
+    ExecResult interpret(Runtime* rt, std::deque<Context*>& ctxChain) override;
     std::string astString() override;
 };
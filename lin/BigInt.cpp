@@ -0,0 +1,597 @@
+#include "BigInt.h"
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include "Lin.hpp"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+using Limb = BigIntData::Limb;
+using Magnitude = BigIntData::Magnitude;
+
+// Operands shorter than these limbs are multiplied by the schoolbook method,
+// divided by Knuth's algorithm D and converted to decimal chunk by chunk
+constexpr size_t kKaratsubaThreshold = 40;
+constexpr size_t kBurnikelThreshold = 80;
+constexpr size_t kDecimalThreshold = 60;
+// Decimal conversions go through base 10^9 chunks which fit a limb
+constexpr size_t kChunkDigits = 9;
+constexpr Limb kChunkBase = 1000000000;
+
+// Limbs [p, p + n) of a magnitude
+struct Span {
+    const Limb* p;
+    size_t n;
+};
+
+Span span(const Magnitude& m) { return {m.data(), m.size()}; }
+
+Span trimmed(Span a) {
+    while (a.n > 0 && a.p[a.n - 1] == 0) {
+        a.n--;
+    }
+    return a;
+}
+
+// Limbs [lo, hi) of a, limbs beyond its end count as zeros
+Span part(Span a, size_t lo, size_t hi) {
+    if (lo >= a.n) {
+        return {a.p, 0};
+    }
+    return trimmed({a.p + lo, std::min(hi, a.n) - lo});
+}
+
+void trim(Magnitude& a) {
+    while (!a.empty() && a.back() == 0) {
+        a.pop_back();
+    }
+}
+
+int compareMagnitudes(Span a, Span b) {
+    a = trimmed(a);
+    b = trimmed(b);
+    if (a.n != b.n) {
+        return a.n < b.n ? -1 : 1;
+    }
+    for (size_t i = a.n; i-- > 0;) {
+        if (a.p[i] != b.p[i]) {
+            return a.p[i] < b.p[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// r += a * 2^(32 * shift)
+void addInto(Magnitude& r, Span a, size_t shift) {
+    if (r.size() < shift + a.n) {
+        r.resize(shift + a.n, 0);
+    }
+    uint64_t carry = 0;
+    for (size_t i = 0; i < a.n; i++) {
+        carry += static_cast<uint64_t>(r[shift + i]) + a.p[i];
+        r[shift + i] = static_cast<Limb>(carry);
+        carry >>= 32;
+    }
+    for (size_t i = shift + a.n; carry != 0; i++) {
+        if (i == r.size()) {
+            r.push_back(0);
+        }
+        carry += r[i];
+        r[i] = static_cast<Limb>(carry);
+        carry >>= 32;
+    }
+}
+
+// r -= a * 2^(32 * shift), which must not exceed r
+void subtractFrom(Magnitude& r, Span a, size_t shift) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.n; i++) {
+        int64_t d = static_cast<int64_t>(r[shift + i]) - a.p[i] - borrow;
+        r[shift + i] = static_cast<Limb>(d);
+        borrow = d < 0;
+    }
+    for (size_t i = shift + a.n; borrow != 0; i++) {
+        int64_t d = static_cast<int64_t>(r[i]) - borrow;
+        r[i] = static_cast<Limb>(d);
+        borrow = d < 0;
+    }
+}
+
+Magnitude add(Span a, Span b) {
+    if (a.n < b.n) {
+        std::swap(a, b);
+    }
+    Magnitude r(a.p, a.p + a.n);
+    addInto(r, b, 0);
+    trim(r);
+    return r;
+}
+
+// a - b where b does not exceed a
+Magnitude subtract(Span a, Span b) {
+    Magnitude r(a.p, a.p + a.n);
+    subtractFrom(r, b, 0);
+    trim(r);
+    return r;
+}
+
+Magnitude shiftLeft(Span a, size_t bits) {
+    size_t limbs = bits / 32;
+    int s = bits % 32;
+    Magnitude r(a.n + limbs + 1, 0);
+    for (size_t i = 0; i < a.n; i++) {
+        uint64_t v = static_cast<uint64_t>(a.p[i]) << s;
+        r[i + limbs] |= static_cast<Limb>(v);
+        r[i + limbs + 1] |= static_cast<Limb>(v >> 32);
+    }
+    trim(r);
+    return r;
+}
+
+Magnitude shiftRight(Span a, size_t bits) {
+    size_t limbs = bits / 32;
+    int s = bits % 32;
+    if (limbs >= a.n) {
+        return Magnitude();
+    }
+    Magnitude r(a.n - limbs);
+    for (size_t i = limbs; i < a.n; i++) {
+        uint64_t v = a.p[i];
+        if (i + 1 < a.n) {
+            v |= static_cast<uint64_t>(a.p[i + 1]) << 32;
+        }
+        r[i - limbs] = static_cast<Limb>(v >> s);
+    }
+    trim(r);
+    return r;
+}
+
+Magnitude multiplySchoolbook(Span a, Span b) {
+    Magnitude r(a.n + b.n, 0);
+    for (size_t i = 0; i < b.n; i++) {
+        uint64_t factor = b.p[i];
+        if (factor == 0) {
+            continue;
+        }
+        // At most (2^32 - 1)^2 + 2 * (2^32 - 1), which still fits 64 bits
+        uint64_t carry = 0;
+        for (size_t j = 0; j < a.n; j++) {
+            carry += factor * a.p[j] + r[i + j];
+            r[i + j] = static_cast<Limb>(carry);
+            carry >>= 32;
+        }
+        r[i + a.n] = static_cast<Limb>(carry);
+    }
+    trim(r);
+    return r;
+}
+
+Magnitude multiply(Span a, Span b) {
+    a = trimmed(a);
+    b = trimmed(b);
+    if (a.n < b.n) {
+        std::swap(a, b);
+    }
+    if (b.n == 0) {
+        return Magnitude();
+    }
+    if (b.n < kKaratsubaThreshold) {
+        return multiplySchoolbook(a, b);
+    }
+    Magnitude r(a.n + b.n, 0);
+    if (a.n >= 2 * b.n) {
+        // Unbalanced operands, pieces of a as long as b are multiplied
+        for (size_t i = 0; i < a.n; i += b.n) {
+            addInto(r, span(multiply(part(a, i, i + b.n), b)), i);
+        }
+    } else {
+        // Karatsuba: (a1 x + a0)(b1 x + b0) needs the products a1 b1, a0 b0
+        // and (a1 + a0)(b1 + b0) only
+        size_t h = (a.n + 1) / 2;
+        Span a0 = part(a, 0, h), a1 = part(a, h, a.n);
+        Span b0 = part(b, 0, h), b1 = part(b, h, b.n);
+        Magnitude low = multiply(a0, b0);
+        Magnitude high = multiply(a1, b1);
+        Magnitude middle =
+            multiply(span(add(a0, a1)), span(add(b0, b1)));
+        subtractFrom(middle, span(low), 0);
+        subtractFrom(middle, span(high), 0);
+        addInto(r, span(low), 0);
+        addInto(r, span(middle), h);
+        addInto(r, span(high), 2 * h);
+    }
+    trim(r);
+    return r;
+}
+
+// Divide a by d in place, returns the remainder
+Limb divideByLimb(Magnitude& a, Limb d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        uint64_t current = (rem << 32) | a[i];
+        a[i] = static_cast<Limb>(current / d);
+        rem = current % d;
+    }
+    trim(a);
+    return static_cast<Limb>(rem);
+}
+
+// Knuth's algorithm D, b has at least two limbs and does not exceed a
+void divideKnuth(Span a, Span b, Magnitude& q, Magnitude& r) {
+    const size_t n = b.n, m = a.n - b.n;
+    // Normalize so that the top bit of the divisor is set
+    const int s = __builtin_clz(b.p[n - 1]);
+    auto shifted = [s](Span x, size_t i) -> Limb {
+        Limb hi = i < x.n ? x.p[i] : 0;
+        Limb lo = i > 0 && s > 0 ? x.p[i - 1] >> (32 - s) : 0;
+        return (hi << s) | lo;
+    };
+    Magnitude v(n), u(a.n + 1);
+    for (size_t i = 0; i < n; i++) {
+        v[i] = shifted(b, i);
+    }
+    for (size_t i = 0; i <= a.n; i++) {
+        u[i] = shifted(a, i);
+    }
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t top = (static_cast<uint64_t>(u[j + n]) << 32) | u[j + n - 1];
+        uint64_t qhat = top / v[n - 1], rhat = top % v[n - 1];
+        while ((qhat >> 32) != 0 ||
+               qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            qhat--;
+            rhat += v[n - 1];
+            if ((rhat >> 32) != 0) {
+                break;
+            }
+        }
+        // Multiply and subtract, the estimate is one too large at most
+        int64_t k = 0, t;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * v[i];
+            t = static_cast<int64_t>(u[i + j]) - k -
+                static_cast<int64_t>(p & 0xffffffff);
+            u[i + j] = static_cast<Limb>(t);
+            k = static_cast<int64_t>(p >> 32) - (t >> 32);
+        }
+        t = static_cast<int64_t>(u[j + n]) - k;
+        u[j + n] = static_cast<Limb>(t);
+        q[j] = static_cast<Limb>(qhat);
+        if (t < 0) {
+            q[j]--;
+            uint64_t carry = 0;
+            for (size_t i = 0; i < n; i++) {
+                carry += static_cast<uint64_t>(u[i + j]) + v[i];
+                u[i + j] = static_cast<Limb>(carry);
+                carry >>= 32;
+            }
+            u[j + n] += static_cast<Limb>(carry);
+        }
+    }
+    trim(q);
+    u.resize(n);
+    r = shiftRight(span(u), s);
+}
+
+void divideSchoolbook(Span a, Span b, Magnitude& q, Magnitude& r) {
+    a = trimmed(a);
+    b = trimmed(b);
+    if (compareMagnitudes(a, b) < 0) {
+        q.clear();
+        r.assign(a.p, a.p + a.n);
+    } else if (b.n == 1) {
+        q.assign(a.p, a.p + a.n);
+        Limb rem = divideByLimb(q, b.p[0]);
+        r.clear();
+        if (rem != 0) {
+            r.push_back(rem);
+        }
+    } else {
+        divideKnuth(a, b, q, r);
+    }
+}
+
+void divide3n2n(Span a, Span b, size_t h, Magnitude& q, Magnitude& r);
+
+// Burnikel-Ziegler division of a by b, where b has n limbs and its top bit
+// set, and a is less than b * 2^(32 * n). Halves of b divide a in two steps
+// of three halves by two, which recurse on halves again.
+void divide2n1n(Span a, Span b, Magnitude& q, Magnitude& r) {
+    const size_t n = b.n;
+    if (n % 2 == 1 || n < kBurnikelThreshold) {
+        divideSchoolbook(a, b, q, r);
+        return;
+    }
+    const size_t h = n / 2;
+    Magnitude q1, r1;
+    divide3n2n(part(a, h, 4 * h), b, h, q1, r1);
+    Magnitude rest;
+    Span a4 = part(a, 0, h);
+    rest.assign(a4.p, a4.p + a4.n);
+    addInto(rest, span(r1), h);
+    Magnitude q2;
+    divide3n2n(span(rest), b, h, q2, r);
+    addInto(q2, span(q1), h);
+    trim(q2);
+    q = std::move(q2);
+}
+
+// Divide a by b, where b has 2h limbs and its top bit set, and a is less
+// than b * 2^(32 * h)
+void divide3n2n(Span a, Span b, size_t h, Magnitude& q, Magnitude& r) {
+    Span b1{b.p + h, h};
+    Span b2 = part(b, 0, h);
+    Span a1 = part(a, 2 * h, 3 * h), a12 = part(a, h, 3 * h);
+    Magnitude r1;
+    if (compareMagnitudes(a1, b1) < 0) {
+        divide2n1n(a12, b1, q, r1);
+    } else {
+        // The top halves are equal, the quotient is estimated as the largest
+        // one of h limbs, which leaves a12 - q * b1 = a12 - b1 x + b1
+        q.assign(h, ~Limb(0));
+        r1 = add(a12, b1);
+        subtractFrom(r1, b1, h);
+        trim(r1);
+    }
+    Span a3 = part(a, 0, h);
+    Magnitude rem(a3.p, a3.p + a3.n);
+    addInto(rem, span(r1), h);
+    trim(rem);
+    Magnitude d = multiply(span(q), b2);
+    // The estimate is two too large at most
+    const Limb one = 1;
+    while (compareMagnitudes(span(rem), span(d)) < 0) {
+        addInto(rem, b, 0);
+        subtractFrom(q, {&one, 1}, 0);
+    }
+    subtractFrom(rem, span(d), 0);
+    trim(rem);
+    trim(q);
+    r = std::move(rem);
+}
+
+void divide(Span a, Span b, Magnitude& q, Magnitude& r) {
+    a = trimmed(a);
+    b = trimmed(b);
+    if (b.n < kBurnikelThreshold || a.n < b.n + kBurnikelThreshold) {
+        divideSchoolbook(a, b, q, r);
+        return;
+    }
+    // Pad b to n limbs, where n is a multiple of a power of two large enough
+    // for the recursion to halve it down to the threshold, and normalize it
+    size_t k = 0;
+    while ((b.n >> k) >= kBurnikelThreshold) {
+        k++;
+    }
+    const size_t n = ((b.n + (size_t(1) << k) - 1) >> k) << k;
+    const size_t shift = (n - b.n) * 32 + __builtin_clz(b.p[b.n - 1]);
+    Magnitude divisor = shiftLeft(b, shift);
+    Magnitude dividend = shiftLeft(a, shift);
+    // Blocks of n limbs, the top one stays below the divisor
+    const size_t blocks = dividend.size() / n + 1;
+    Span z = part(span(dividend), (blocks - 2) * n, blocks * n);
+    Magnitude current(z.p, z.p + z.n), quotient, qi, ri;
+    for (size_t i = blocks - 1; i-- > 0;) {
+        divide2n1n(span(current), span(divisor), qi, ri);
+        addInto(quotient, span(qi), i * n);
+        if (i > 0) {
+            Span next = part(span(dividend), (i - 1) * n, i * n);
+            current.assign(next.p, next.p + next.n);
+            addInto(current, span(ri), n);
+            trim(current);
+        }
+    }
+    trim(quotient);
+    q = std::move(quotient);
+    r = shiftRight(span(ri), shift);
+}
+
+// 10^(9 * 2^i), each computed once by squaring the previous one
+const Magnitude& powerOfTen(size_t i) {
+    static std::deque<Magnitude> powers{Magnitude{kChunkBase}};
+    while (powers.size() <= i) {
+        powers.push_back(multiply(span(powers.back()), span(powers.back())));
+    }
+    return powers[i];
+}
+
+// Append digits of a, padded with zeros to width. Large numbers are split
+// at a power of ten of about half their length.
+void appendDecimal(Span a, size_t width, std::string& out) {
+    a = trimmed(a);
+    if (a.n < kDecimalThreshold) {
+        // Digits are collected least significant first
+        std::string digits;
+        Magnitude rest(a.p, a.p + a.n);
+        while (!rest.empty()) {
+            Limb chunk = divideByLimb(rest, kChunkBase);
+            for (size_t d = 0; d < kChunkDigits; d++) {
+                digits += static_cast<char>('0' + chunk % 10);
+                chunk /= 10;
+            }
+        }
+        while (!digits.empty() && digits.back() == '0') {
+            digits.pop_back();
+        }
+        if (digits.size() < width) {
+            digits.append(width - digits.size(), '0');
+        }
+        out.append(digits.rbegin(), digits.rend());
+        return;
+    }
+    size_t i = 0;
+    while (2 * powerOfTen(i + 1).size() <= a.n) {
+        i++;
+    }
+    Magnitude q, r;
+    divide(a, span(powerOfTen(i)), q, r);
+    const size_t low = kChunkDigits << i;
+    appendDecimal(span(q), width > low ? width - low : 0, out);
+    appendDecimal(span(r), low, out);
+}
+
+Magnitude parseDecimal(std::string_view digits) {
+    if (digits.size() <= kChunkDigits * kDecimalThreshold) {
+        Magnitude m;
+        size_t length = digits.size() % kChunkDigits;
+        for (size_t pos = 0; pos < digits.size(); pos += length) {
+            if (pos > 0 || length == 0) {
+                length = kChunkDigits;
+            }
+            uint64_t carry = 0, scale = 1;
+            for (size_t i = pos; i < pos + length; i++) {
+                carry = carry * 10 + (digits[i] - '0');
+                scale *= 10;
+            }
+            for (auto& limb : m) {
+                carry += static_cast<uint64_t>(limb) * scale;
+                limb = static_cast<Limb>(carry);
+                carry >>= 32;
+            }
+            if (carry != 0) {
+                m.push_back(static_cast<Limb>(carry));
+            }
+        }
+        trim(m);
+        return m;
+    }
+    size_t i = 0;
+    while ((kChunkDigits << (i + 1)) < digits.size()) {
+        i++;
+    }
+    const size_t split = digits.size() - (kChunkDigits << i);
+    Magnitude high = parseDecimal(digits.substr(0, split));
+    Magnitude r = multiply(span(high), span(powerOfTen(i)));
+    addInto(r, span(parseDecimal(digits.substr(split))), 0);
+    trim(r);
+    return r;
+}
+
+// Magnitude of sign * lhs + rhsSign * rhs, sign becomes the sign of the sum
+Magnitude addSigned(bool& sign, Span lhs, bool rhsSign, Span rhs) {
+    if (sign == rhsSign) {
+        return add(lhs, rhs);
+    }
+    if (compareMagnitudes(lhs, rhs) >= 0) {
+        return subtract(lhs, rhs);
+    }
+    sign = rhsSign;
+    return subtract(rhs, lhs);
+}
+}  // namespace
+
+BigIntData::BigIntData(long long v) : sign(v < 0) {
+    uint64_t m = v < 0 ? 0 - static_cast<uint64_t>(v) : v;
+    Magnitude limbs;
+    for (; m != 0; m >>= 32) {
+        limbs.push_back(static_cast<Limb>(m));
+    }
+    magnitude = HeapRef<Magnitude>::make(std::move(limbs));
+}
+
+BigIntData::BigIntData(bool sign, Magnitude magnitude)
+    : sign(sign), magnitude(HeapRef<Magnitude>::make(std::move(magnitude))) {}
+
+BigIntData BigIntData::parse(std::string_view text) {
+    bool sign = !text.empty() && text[0] == '-';
+    std::string_view digits = text.substr(sign ? 1 : 0);
+    if (digits.empty() ||
+        !std::all_of(digits.begin(), digits.end(),
+                     [](char c) { return c >= '0' && c <= '9'; })) {
+        panic("ValueError: invalid integer %s\n", std::string(text).c_str());
+    }
+    return BigIntData(sign, parseDecimal(digits));
+}
+
+BigIntData BigIntData::of(const Value& v) {
+    return v.isType<Int>() ? BigIntData(v.ref<long long>())
+                           : v.ref<BigIntData>();
+}
+
+int BigIntData::compare(const BigIntData& rhs) const {
+    if (sign != rhs.sign) {
+        return sign ? -1 : 1;
+    }
+    int c = compareMagnitudes(span(limbs()), span(rhs.limbs()));
+    return sign ? -c : c;
+}
+
+size_t BigIntData::hash() const {
+    uint64_t h = sign ? 0x9e3779b97f4a7c15ull : 0xcbf29ce484222325ull;
+    for (Limb limb : limbs()) {
+        h = (h ^ limb) * 0x100000001b3ull;
+    }
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+double BigIntData::toDouble() const {
+    double result = 0;
+    for (size_t i = limbs().size(); i-- > 0;) {
+        result = result * 4294967296.0 + limbs()[i];
+    }
+    return sign ? -result : result;
+}
+
+std::string BigIntData::str() const {
+    std::string out = sign ? "-" : "";
+    appendDecimal(span(limbs()), 1, out);
+    return out;
+}
+
+Value BigIntData::make(bool sign, Magnitude magnitude) {
+    trim(magnitude);
+    if (magnitude.size() <= 2) {
+        uint64_t m = magnitude.empty() ? 0 : magnitude[0];
+        if (magnitude.size() == 2) {
+            m |= static_cast<uint64_t>(magnitude[1]) << 32;
+        }
+        // -2^63 is the one negative int without positive counterpart
+        if (m <= static_cast<uint64_t>(LLONG_MAX) + sign) {
+            return Value(Int, static_cast<long long>(sign ? 0 - m : m));
+        }
+    }
+    return Value(BigInt, BigIntData(sign, std::move(magnitude)));
+}
+
+Value BigIntData::add(const BigIntData& lhs, const BigIntData& rhs) {
+    bool sign = lhs.sign;
+    Magnitude m =
+        addSigned(sign, span(lhs.limbs()), rhs.sign, span(rhs.limbs()));
+    return make(sign, std::move(m));
+}
+
+Value BigIntData::sub(const BigIntData& lhs, const BigIntData& rhs) {
+    bool sign = lhs.sign;
+    Magnitude m =
+        addSigned(sign, span(lhs.limbs()), !rhs.sign, span(rhs.limbs()));
+    return make(sign, std::move(m));
+}
+
+Value BigIntData::mul(const BigIntData& lhs, const BigIntData& rhs) {
+    return make(lhs.sign != rhs.sign,
+                multiply(span(lhs.limbs()), span(rhs.limbs())));
+}
+
+Value BigIntData::div(const BigIntData& lhs, const BigIntData& rhs) {
+    if (rhs.limbs().empty()) {
+        panic("ValueError: integer division by zero\n");
+    }
+    Magnitude q, r;
+    divide(span(lhs.limbs()), span(rhs.limbs()), q, r);
+    return make(lhs.sign != rhs.sign, std::move(q));
+}
+
+Value BigIntData::mod(const BigIntData& lhs, const BigIntData& rhs) {
+    if (rhs.limbs().empty()) {
+        panic("ValueError: integer division by zero\n");
+    }
+    Magnitude q, r;
+    divide(span(lhs.limbs()), span(rhs.limbs()), q, r);
+    return make(lhs.sign, std::move(r));
+}
+
+Value BigIntData::neg(const BigIntData& v) {
+    return make(!v.sign, v.limbs());
+}
+}  // namespace lin
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Heap.h"
+
+namespace lin {
+struct Value;
+
+template <>
+struct HeapTraits<std::vector<uint32_t>> {
+    static constexpr HeapKind kind = HeapBigInt;
+    static size_t bytes(const std::vector<uint32_t>& v) {
+        return v.capacity() * sizeof(uint32_t);
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// Integers beyond the 64 bits an int value holds inline. Int operators check
+// for overflow and hand the operation over to a BigInt once the result does
+// not fit anymore, results which fit again are turned back into ints, so a
+// BigInt value is never within the range of int values. Scripts only ever
+// see one integer type.
+//
+// The magnitude is stored as 32 bits limbs, least significant first, and is
+// shared by copies of the value. Large products are computed by Karatsuba
+// multiplication and large quotients by Burnikel-Ziegler division, decimal
+// conversions split the number at powers of ten recursively, so printing and
+// parsing are subquadratic as well.
+//===----------------------------------------------------------------------===//
+class BigIntData {
+public:
+    using Limb = uint32_t;
+    using Magnitude = std::vector<Limb>;
+
+    explicit BigIntData(long long v);
+    // Decimal digits with an optional leading minus sign
+    static BigIntData parse(std::string_view text);
+    // Int or BigInt value v
+    static BigIntData of(const Value& v);
+
+    bool negative() const { return sign; }
+    const Magnitude& limbs() const { return *magnitude; }
+
+    int compare(const BigIntData& rhs) const;
+    size_t hash() const;
+    double toDouble() const;
+    std::string str() const;
+
+    // Exact results of the int operators, division truncates towards zero.
+    // Results are int values whenever they fit 64 bits.
+    static Value add(const BigIntData& lhs, const BigIntData& rhs);
+    static Value sub(const BigIntData& lhs, const BigIntData& rhs);
+    static Value mul(const BigIntData& lhs, const BigIntData& rhs);
+    static Value div(const BigIntData& lhs, const BigIntData& rhs);
+    static Value mod(const BigIntData& lhs, const BigIntData& rhs);
+    static Value neg(const BigIntData& v);
+
+private:
+    explicit BigIntData(bool sign, Magnitude magnitude);
+    static Value make(bool sign, Magnitude magnitude);
+
+    bool sign;
+    HeapRef<Magnitude> magnitude;
+};
+}  // namespace lin
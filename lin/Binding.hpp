@@ -0,0 +1,156 @@
+#pragma once
+#include <climits>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "Lin.hpp"
+#include "Matrix.h"
+#include "Utils.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Typed native bindings. An ordinary C++ function such as
+//      int f(const std::string& s, double d);
+// is wrapped by bindNative<&f> into a lin::Runtime::BuiltinFuncType. Argument
+// count and types are checked and unpacked by code generated at compile time,
+// string and array arguments are passed as views into the stored values.
+//===----------------------------------------------------------------------===//
+template <typename _ParamType>
+struct ArgCast;
+
+template <>
+struct ArgCast<long long> {
+    static bool accepts(const Value& v) { return v.isType<lin::Int>(); }
+    static long long get(const Value& v) { return v.cast<long long>(); }
+    static constexpr const char* name = "int";
+};
+
+// Ints beyond 32 bits are rejected rather than truncated
+template <>
+struct ArgCast<int> {
+    static bool accepts(const Value& v) {
+        return v.isType<lin::Int>() && v.cast<long long>() >= INT_MIN &&
+               v.cast<long long>() <= INT_MAX;
+    }
+    static int get(const Value& v) {
+        return static_cast<int>(v.cast<long long>());
+    }
+    static constexpr const char* name = "int";
+};
+
+template <>
+struct ArgCast<double> {
+    static bool accepts(const Value& v) {
+        return v.isType<lin::Double>() || v.isType<lin::Int>() ||
+               v.isType<lin::BigInt>();
+    }
+    static double get(const Value& v) {
+        if (v.isType<lin::BigInt>()) {
+            return v.ref<BigIntData>().toDouble();
+        }
+        return v.isType<lin::Int>() ? v.cast<long long>() : v.cast<double>();
+    }
+    static constexpr const char* name = "double";
+};
+
+template <>
+struct ArgCast<bool> {
+    static bool accepts(const Value& v) { return v.isType<lin::Bool>(); }
+    static bool get(const Value& v) { return v.cast<bool>(); }
+    static constexpr const char* name = "bool";
+};
+
+template <>
+struct ArgCast<char> {
+    static bool accepts(const Value& v) { return v.isType<lin::Char>(); }
+    static char get(const Value& v) { return v.cast<char>(); }
+    static constexpr const char* name = "char";
+};
+
+template <>
+struct ArgCast<std::string_view> {
+    static bool accepts(const Value& v) { return v.isType<lin::String>(); }
+    static std::string_view get(const Value& v) {
+        return v.ref<StringData>().view();
+    }
+    static constexpr const char* name = "string";
+};
+
+// Strings may be slices of a larger buffer, prefer std::string_view parameter
+// to avoid copying the characters
+template <>
+struct ArgCast<std::string> {
+    static bool accepts(const Value& v) { return v.isType<lin::String>(); }
+    static std::string get(const Value& v) { return v.ref<StringData>().str(); }
+    static constexpr const char* name = "string";
+};
+
+template <>
+struct ArgCast<ArrayData> {
+    static bool accepts(const Value& v) { return v.isType<lin::Array>(); }
+    static const ArrayData& get(const Value& v) { return v.ref<ArrayData>(); }
+    static constexpr const char* name = "array";
+};
+
+template <>
+struct ArgCast<MatrixData> {
+    static bool accepts(const Value& v) { return v.isType<lin::Matrix>(); }
+    static const MatrixData& get(const Value& v) { return v.ref<MatrixData>(); }
+    static constexpr const char* name = "matrix";
+};
+
+template <>
+struct ArgCast<Value> {
+    static bool accepts(const Value& v) { return true; }
+    static const Value& get(const Value& v) { return v; }
+    static constexpr const char* name = "any";
+};
+
+template <auto _Func>
+struct NativeBinding;
+
+template <typename _RetType, typename... _ParamType,
+          _RetType (*_Func)(_ParamType...)>
+struct NativeBinding<_Func> {
+    static Value call(Arguments args) {
+        if (args.size() != sizeof...(_ParamType)) {
+            panic("ArgumentError: expects %d arguments but got %d\n",
+                  (int)sizeof...(_ParamType), (int)args.size());
+        }
+        return invoke(args, std::index_sequence_for<_ParamType...>{});
+    }
+
+private:
+    template <typename _ParamCast>
+    static void check(const Value& v, size_t i) {
+        if (!_ParamCast::accepts(v)) {
+            panic("TypeError: expects %s type of argument %d but got %s\n",
+                  _ParamCast::name, (int)i + 1, valueTypeName(v.type));
+        }
+    }
+
+    template <size_t... _Index>
+    static Value invoke(Arguments args, std::index_sequence<_Index...>) {
+        (check<ArgCast<std::decay_t<_ParamType>>>(args[_Index], _Index), ...);
+        if constexpr (std::is_void_v<_RetType>) {
+            _Func(ArgCast<std::decay_t<_ParamType>>::get(args[_Index])...);
+            return Value(lin::Null);
+        } else {
+            return toValue(
+                _Func(ArgCast<std::decay_t<_ParamType>>::get(args[_Index])...));
+        }
+    }
+};
+
+template <auto _Func>
+Value bindNative(Runtime* rt, const std::deque<Context*>& ctxChain,
+                 Arguments args) {
+    return NativeBinding<_Func>::call(args);
+}
+
+template <auto _Func>
+void registerNative(Runtime* rt, const std::string& name) {
+    rt->addBuiltinFunction(name, &bindNative<_Func>);
+}
+}  // namespace lin
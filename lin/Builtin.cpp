@@ -1,97 +1,556 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <iostream>
+#include <optional>
 #include <vector>
 #include "Ast.h"
 #include "Builtin.h"
+#include "HashTable.h"
+#include "Interpreter.h"
 #include "Lin.hpp"
+#include "Snapshot.h"
 #include "Utils.hpp"
 
+static void printValue(std::ostream& out, const lin::Value& v) {
+    if (v.isType<lin::String>()) {
+        out << v.ref<lin::StringData>().view();
+    } else {
+        out << valueToStdString(v);
+    }
+}
+
 lin::Value lin_builtin_print(lin::Runtime* rt,
-                             std::deque<lin::Context*> ctxChain,
-                             std::vector<lin::Value> args) {
-    for (auto arg : args) {
-        std::cout << valueToStdString(arg);
+                             const std::deque<lin::Context*>& ctxChain,
+                             lin::Arguments args) {
+    for (auto& arg : args) {
+        printValue(std::cout, arg);
     }
-    return lin::Value(lin::Int, (int)args.size());
+    return lin::Value(lin::Int, static_cast<long long>(args.size()));
 }
 
 lin::Value lin_builtin_println(lin::Runtime* rt,
-                               std::deque<lin::Context*> ctxChain,
-                               std::vector<lin::Value> args) {
+                               const std::deque<lin::Context*>& ctxChain,
+                               lin::Arguments args) {
     if (args.size() != 0) {
-        for (auto arg : args) {
-            std::cout << valueToStdString(arg) << "\n";
+        for (auto& arg : args) {
+            printValue(std::cout, arg);
+            std::cout << "\n";
         }
     } else {
         std::cout << "\n";
     }
 
-    return lin::Value(lin::Int, (int)args.size());
+    return lin::Value(lin::Int, static_cast<long long>(args.size()));
 }
 
-lin::Value lin_builtin_input(lin::Runtime* rt,
-                             std::deque<lin::Context*> ctxChain,
-                             std::vector<lin::Value> args) {
-    lin::Value result{lin::String};
+lin::Value lin_builtin_slice(const lin::Value& x, long long lo,
+                             long long hi) {
+    return sliceValue(x, lo, hi);
+}
 
+std::string lin_builtin_input() {
     std::string str;
     std::cin >> str;
-    result.data = std::make_any<std::string>(std::move(str));
-    return result;
+    return str;
 }
 
 lin::Value lin_builtin_typeof(lin::Runtime* rt,
-                              std::deque<lin::Context*> ctxChain,
-                              std::vector<lin::Value> args) {
+                              const std::deque<lin::Context*>& ctxChain,
+                              lin::Arguments args) {
     if (args.size() != 1) {
-        panic("ArgumentError: expects one argument but got %d", args.size());
-    }
-    lin::Value result(lin::String);
-    switch (args[0].type) {
-        case lin::Bool:
-            result.set<std::string>("bool");
-            break;
-        case lin::Double:
-            result.set<std::string>("double");
-            break;
-        case lin::Int:
-            result.set<std::string>("int");
-            break;
-        case lin::String:
-            result.set<std::string>("string");
-            break;
-        case lin::Null:
-            result.set<std::string>("null");
-            break;
-        case lin::Char:
-            result.set<std::string>("char");
-            break;
-        case lin::Array:
-            result.set<std::string>("array");
-            break;
-        default:
-            panic("TypeError: unknown type!");
-    }
-    return result;
+        panic("ArgumentError: expects one argument but got %d",
+              (int)args.size());
+    }
+    return lin::toValue(valueTypeName(args[0].type));
 }
 
 lin::Value lin_builtin_length(lin::Runtime* rt,
-                              std::deque<lin::Context*> ctxChain,
-                              std::vector<lin::Value> args) {
+                              const std::deque<lin::Context*>& ctxChain,
+                              lin::Arguments args) {
     if (args.size() != 1) {
-        panic("ArgumentError: expects one argument but got %d", args.size());
+        panic("ArgumentError: expects one argument but got %d",
+              (int)args.size());
     }
 
     if (args[0].isType<lin::String>()) {
         return lin::Value(
-            lin::Int, std::make_any<int>(args[0].cast<std::string>().length()));
+            lin::Int,
+            std::make_any<long long>(args[0].ref<lin::StringData>().size()));
     }
     if (args[0].isType<lin::Array>()) {
         return lin::Value(
             lin::Int,
-            std::make_any<int>(args[0].cast<std::vector<lin::Value>>().size()));
+            std::make_any<long long>(args[0].ref<lin::ArrayData>().size()));
+    }
+    if (args[0].isType<lin::Dict>()) {
+        return lin::Value(lin::Int, std::make_any<long long>(
+                                        args[0].ref<lin::HashTable>().size()));
+    }
+    // Number of rows, like the length of an array of rows
+    if (args[0].isType<lin::Matrix>()) {
+        return lin::Value(lin::Int, std::make_any<long long>(
+                                        args[0].ref<lin::MatrixData>().rows()));
     }
 
     panic(
-        "TypeError: unexpected type of arguments, requires string type or "
-        "array type");
+        "TypeError: unexpected type of arguments, requires string type, array "
+        "type, dict type or matrix type");
+}
+
+lin::Value lin_builtin_keys(lin::Runtime* rt,
+                            const std::deque<lin::Context*>& ctxChain,
+                            lin::Arguments args) {
+    if (args.size() != 1 || !args[0].isType<lin::Dict>()) {
+        panic("ArgumentError: keys expects one dict argument\n");
+    }
+    auto& table = args[0].ref<lin::HashTable>();
+    std::vector<lin::Value> keys;
+    keys.reserve(table.size());
+    table.forEach([&keys](const lin::Value& key, const lin::Value& value) {
+        keys.push_back(key);
+    });
+    return lin::toValue(std::move(keys));
+}
+
+lin::Value lin_builtin_has(lin::Runtime* rt,
+                           const std::deque<lin::Context*>& ctxChain,
+                           lin::Arguments args) {
+    if (args.size() != 2 || !args[0].isType<lin::Dict>()) {
+        panic("ArgumentError: has expects a dict and a key\n");
+    }
+    return lin::Value(lin::Bool,
+                      args[0].ref<lin::HashTable>().find(args[1]) != nullptr);
+}
+
+lin::Value lin_builtin_memstats(lin::Runtime* rt,
+                                const std::deque<lin::Context*>& ctxChain,
+                                lin::Arguments args) {
+    if (args.size() != 0) {
+        panic("ArgumentError: memstats expects no arguments\n");
+    }
+    lin::HashTable stats;
+    auto put = [&stats](const char* key, long long bytes) {
+        stats.getOrInsert(lin::toValue(key)) = lin::toValue(bytes);
+    };
+    for (int kind = 0; kind < lin::HeapKinds; kind++) {
+        auto k = static_cast<lin::HeapKind>(kind);
+        put(lin::Heap::kindName(k), lin::Heap::usage(k).live);
+    }
+    put("total", lin::Heap::total().live);
+    put("peak", lin::Heap::total().peak);
+    put("limit", lin::Heap::limit());
+    return lin::Value(lin::Dict, std::move(stats));
+}
+
+lin::Value lin_builtin_snapshot(lin::Runtime* rt,
+                                const std::deque<lin::Context*>& ctxChain,
+                                lin::Arguments args) {
+    if (args.size() != 1 || !args[0].isType<lin::String>()) {
+        panic("ArgumentError: snapshot expects a file name\n");
+    }
+    auto* globals = rt->getResumeGlobals();
+    if (globals == nullptr || ctxChain.size() != 1 ||
+        ctxChain.front() != globals) {
+        panic("RuntimeError: snapshot can only be taken at top level\n");
+    }
+    lin::Snapshot::save(args[0].ref<lin::StringData>().str(), rt, globals,
+                        rt->getResumeStatement());
+    return lin::Value(lin::Null);
+}
+
+lin::Value lin_builtin_remove(lin::Runtime* rt, lin::Value& self,
+                              lin::Arguments args) {
+    if (args.size() != 1 || !self.isType<lin::Dict>()) {
+        panic("ArgumentError: remove expects a dict and a key\n");
+    }
+    return lin::Value(lin::Bool, self.ref<lin::HashTable>().erase(args[0]));
+}
+
+lin::Value lin_builtin_fill(lin::Runtime* rt, lin::Value& self,
+                            lin::Arguments args) {
+    if (args.size() != 1 ||
+        (!self.isType<lin::Matrix>() && !self.isType<lin::Array>())) {
+        panic("ArgumentError: fill expects a matrix or an array and a value\n");
+    }
+    if (self.isType<lin::Array>()) {
+        auto& arr = self.ref<lin::ArrayData>();
+        std::fill_n(arr.mutableData(), arr.size(), args[0]);
+        return lin::Value(lin::Null);
+    }
+    auto& m = self.ref<lin::MatrixData>();
+    if (!m.accepts(args[0])) {
+        panic("TypeError: can not fill %s matrix with %s value\n",
+              m.isDouble() ? "double" : "int", valueTypeName(args[0].type));
+    }
+    m.fill(args[0]);
+    return lin::Value(lin::Null);
+}
+
+//===----------------------------------------------------------------------===//
+// Sorting, searching and reductions work on array storage directly. Sorted or
+// reversed results are new arrays, arguments are never modified.
+//===----------------------------------------------------------------------===//
+enum class ElementKind { Empty, Int, Integer, Number, String, Char };
+
+// Kind shared by all elements. Integers are ints which include a BigInt,
+// numbers may mix any of them with double elements
+static ElementKind classifyElements(const lin::ArrayData& arr,
+                                    const char* funcName) {
+    ElementKind kind = ElementKind::Empty;
+    for (auto& e : arr) {
+        ElementKind k;
+        switch (e.type) {
+            case lin::Int:
+                k = ElementKind::Int;
+                break;
+            case lin::BigInt:
+                k = ElementKind::Integer;
+                break;
+            case lin::Double:
+                k = ElementKind::Number;
+                break;
+            case lin::String:
+                k = ElementKind::String;
+                break;
+            case lin::Char:
+                k = ElementKind::Char;
+                break;
+            default:
+                panic("TypeError: %s can not order elements of %s type\n",
+                      funcName, valueTypeName(e.type));
+        }
+        auto integral = [](ElementKind k) {
+            return k == ElementKind::Int || k == ElementKind::Integer;
+        };
+        if (kind == ElementKind::Empty || kind == k) {
+            kind = k;
+        } else if (integral(kind) && integral(k)) {
+            kind = ElementKind::Integer;
+        } else if ((integral(kind) || kind == ElementKind::Number) &&
+                   (integral(k) || k == ElementKind::Number)) {
+            kind = ElementKind::Number;
+        } else {
+            panic("TypeError: %s expects elements of comparable types\n",
+                  funcName);
+        }
+    }
+    return kind;
+}
+
+static double numberOf(const lin::Value& v) {
+    if (v.isType<lin::BigInt>()) {
+        return v.ref<lin::BigIntData>().toDouble();
+    }
+    return v.isType<lin::Int>() ? v.cast<long long>() : v.cast<double>();
+}
+
+static int compareElements(const lin::Value& lhs, const lin::Value& rhs) {
+    if (lhs.isType<lin::Int>() && rhs.isType<lin::Int>()) {
+        long long l = lhs.cast<long long>(), r = rhs.cast<long long>();
+        return (l > r) - (l < r);
+    }
+    if (anyone(lhs.type, lin::Int, lin::BigInt) &&
+        anyone(rhs.type, lin::Int, lin::BigInt)) {
+        return lin::BigIntData::of(lhs).compare(lin::BigIntData::of(rhs));
+    }
+    if (anyone(lhs.type, lin::Int, lin::BigInt, lin::Double) &&
+        anyone(rhs.type, lin::Int, lin::BigInt, lin::Double)) {
+        double l = numberOf(lhs), r = numberOf(rhs);
+        return (l > r) - (l < r);
+    }
+    if (lhs.isType<lin::String>() && rhs.isType<lin::String>()) {
+        return lhs.ref<lin::StringData>().compare(rhs.ref<lin::StringData>());
+    }
+    if (lhs.isType<lin::Char>() && rhs.isType<lin::Char>()) {
+        char l = lhs.cast<char>(), r = rhs.cast<char>();
+        return (l > r) - (l < r);
+    }
+    panic("TypeError: can not compare %s with %s\n", valueTypeName(lhs.type),
+          valueTypeName(rhs.type));
+}
+
+// LSD radix sort on bytes of keys with flipped sign bit, passes whose byte is
+// the same for every key are skipped
+static void radixSort(std::vector<long long>& keys) {
+    constexpr uint64_t kSignBit = 0x8000000000000000u;
+    const size_t n = keys.size();
+    std::vector<uint64_t> src(n), dst(n);
+    for (size_t i = 0; i < n; i++) {
+        src[i] = static_cast<uint64_t>(keys[i]) ^ kSignBit;
+    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t count[257] = {0};
+        for (auto k : src) {
+            count[((k >> shift) & 0xff) + 1]++;
+        }
+        if (count[((src[0] >> shift) & 0xff) + 1] == n) {
+            continue;
+        }
+        for (int b = 0; b < 256; b++) {
+            count[b + 1] += count[b];
+        }
+        for (auto k : src) {
+            dst[count[(k >> shift) & 0xff]++] = k;
+        }
+        src.swap(dst);
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = static_cast<long long>(src[i] ^ kSignBit);
+    }
+}
+
+lin::Value lin_builtin_sort(const lin::ArrayData& arr) {
+    ElementKind kind = classifyElements(arr, "sort");
+    if (kind == ElementKind::Int) {
+        std::vector<long long> keys;
+        keys.reserve(arr.size());
+        for (auto& e : arr) {
+            keys.push_back(e.cast<long long>());
+        }
+        // Radix sort only pays off once its fixed passes are amortized
+        constexpr size_t kRadixThreshold = 256;
+        if (keys.size() >= kRadixThreshold) {
+            radixSort(keys);
+        } else {
+            std::sort(keys.begin(), keys.end());
+        }
+        std::vector<lin::Value> elements;
+        elements.reserve(keys.size());
+        for (long long k : keys) {
+            elements.emplace_back(lin::Int, k);
+        }
+        return lin::toValue(std::move(elements));
+    }
+
+    std::vector<lin::Value> elements(arr.begin(), arr.end());
+    std::sort(elements.begin(), elements.end(),
+              [](const lin::Value& lhs, const lin::Value& rhs) {
+                  return compareElements(lhs, rhs) < 0;
+              });
+    return lin::toValue(std::move(elements));
+}
+
+lin::Value lin_builtin_sort_by(lin::Runtime* rt,
+                               const std::deque<lin::Context*>& ctxChain,
+                               lin::Arguments args) {
+    if (args.size() != 2 || !args[0].isType<lin::Array>() ||
+        !args[1].isType<lin::String>()) {
+        panic(
+            "ArgumentError: sort_by expects an array and name of a compare "
+            "function\n");
+    }
+    std::string funcName = args[1].ref<lin::StringData>().str();
+    auto* f = rt->getFunction(funcName);
+    if (f == nullptr || f->params.size() != 2) {
+        panic(
+            "ArgumentError: sort_by expects a user defined function with two "
+            "parameters but got %s\n",
+            funcName.c_str());
+    }
+
+    auto& arr = args[0].ref<lin::ArrayData>();
+    std::vector<lin::Value> elements(arr.begin(), arr.end());
+    // Merge sort stays well defined even if compare is not a strict ordering
+    std::stable_sort(elements.begin(), elements.end(),
+                     [&](const lin::Value& lhs, const lin::Value& rhs) {
+                         lin::Value less =
+                             Interpreter::callFunction(rt, f, {lhs, rhs});
+                         if (!less.isType<lin::Bool>()) {
+                             panic(
+                                 "TypeError: compare function %s should "
+                                 "return bool\n",
+                                 funcName.c_str());
+                         }
+                         return less.cast<bool>();
+                     });
+    return lin::toValue(std::move(elements));
+}
+
+long long lin_builtin_bsearch(const lin::ArrayData& arr, const lin::Value& x) {
+    auto pos = std::lower_bound(arr.begin(), arr.end(), x,
+                                [](const lin::Value& e, const lin::Value& x) {
+                                    return compareElements(e, x) < 0;
+                                });
+    if (pos != arr.end() && compareElements(*pos, x) == 0) {
+        return static_cast<long long>(pos - arr.begin());
+    }
+    return -1;
+}
+
+static const lin::Value& extremum(const lin::ArrayData& arr,
+                                  const char* funcName, int sign) {
+    if (arr.size() == 0) {
+        panic("ArgumentError: %s expects a non-empty array\n", funcName);
+    }
+    ElementKind kind = classifyElements(arr, funcName);
+    const lin::Value* best = &arr[0];
+    if (kind == ElementKind::Int) {
+        long long bestInt = best->cast<long long>();
+        for (auto& e : arr) {
+            long long v = e.cast<long long>();
+            if (sign > 0 ? v > bestInt : v < bestInt) {
+                best = &e;
+                bestInt = v;
+            }
+        }
+        return *best;
+    }
+    for (auto& e : arr) {
+        if (compareElements(e, *best) * sign > 0) {
+            best = &e;
+        }
+    }
+    return *best;
+}
+
+lin::Value lin_builtin_min(const lin::ArrayData& arr) {
+    return extremum(arr, "min", -1);
+}
+
+lin::Value lin_builtin_max(const lin::ArrayData& arr) {
+    return extremum(arr, "max", 1);
+}
+
+// Sum elements while checking that they are numbers. Int sums stay int, any
+// double element makes the sum a double. If prefix is given, running sums are
+// collected into it as well.
+static lin::Value reduceSum(const lin::ArrayData& arr, const char* funcName,
+                            std::vector<lin::Value>* prefix) {
+    long long intSum = 0;
+    double doubleSum = 0;
+    bool isDouble = false;
+    // Exact sum once it did not fit 64 bits or a BigInt element came along
+    std::optional<lin::Value> bigSum;
+    auto sum = [&] {
+        if (isDouble) {
+            return lin::toValue(doubleSum);
+        }
+        return bigSum ? *bigSum : lin::toValue(intSum);
+    };
+    for (auto& e : arr) {
+        if (isDouble && anyone(e.type, lin::Int, lin::BigInt)) {
+            doubleSum += numberOf(e);
+        } else if (e.isType<lin::Int>() && !bigSum) {
+            long long v = e.cast<long long>(), next;
+            if (__builtin_add_overflow(intSum, v, &next)) {
+                bigSum = lin::addInts(intSum, v);
+            } else {
+                intSum = next;
+            }
+        } else if (anyone(e.type, lin::Int, lin::BigInt)) {
+            bigSum = sum() + e;
+        } else if (e.isType<lin::Double>()) {
+            if (!isDouble) {
+                isDouble = true;
+                doubleSum = bigSum ? numberOf(*bigSum)
+                                   : static_cast<double>(intSum);
+            }
+            doubleSum += e.cast<double>();
+        } else {
+            panic("TypeError: %s expects numeric elements but got %s\n",
+                  funcName, valueTypeName(e.type));
+        }
+        if (prefix != nullptr) {
+            prefix->push_back(sum());
+        }
+    }
+    return sum();
+}
+
+lin::Value lin_builtin_sum(const lin::ArrayData& arr) {
+    return reduceSum(arr, "sum", nullptr);
+}
+
+lin::Value lin_builtin_prefix_sum(const lin::ArrayData& arr) {
+    std::vector<lin::Value> prefix;
+    prefix.reserve(arr.size());
+    reduceSum(arr, "prefix_sum", &prefix);
+    return lin::toValue(std::move(prefix));
+}
+
+lin::Value lin_builtin_reverse(const lin::Value& x) {
+    if (x.isType<lin::Array>()) {
+        auto& arr = x.ref<lin::ArrayData>();
+        return lin::toValue(std::vector<lin::Value>(
+            std::make_reverse_iterator(arr.end()),
+            std::make_reverse_iterator(arr.begin())));
+    }
+    if (x.isType<lin::String>()) {
+        auto text = x.ref<lin::StringData>().view();
+        return lin::toValue(std::string(text.rbegin(), text.rend()));
+    }
+    panic("TypeError: reverse expects an array or a string but got %s\n",
+          valueTypeName(x.type));
+}
+
+lin::MatrixData lin_builtin_matrix(long long rows, long long cols,
+                                   const lin::Value& fill) {
+    if (rows < 0 || cols < 0) {
+        panic("ValueError: matrix expects non-negative sizes but got %lld x "
+              "%lld\n",
+              rows, cols);
+    }
+    if (fill.isType<lin::Int>()) {
+        return lin::MatrixData(rows, cols, fill.cast<long long>());
+    }
+    if (fill.isType<lin::Double>()) {
+        return lin::MatrixData(rows, cols, fill.cast<double>());
+    }
+    panic("TypeError: matrix expects int or double elements but got %s\n",
+          valueTypeName(fill.type));
+}
+
+lin::MatrixData lin_builtin_to_matrix(const lin::ArrayData& rows) {
+    return lin::MatrixData::fromRows(rows);
+}
+
+lin::Value lin_builtin_shape(const lin::MatrixData& m) {
+    return lin::toValue(std::vector<lin::Value>{
+        lin::toValue(static_cast<long long>(m.rows())),
+        lin::toValue(static_cast<long long>(m.cols()))});
+}
+
+lin::MatrixData lin_builtin_matmul(const lin::MatrixData& lhs,
+                                   const lin::MatrixData& rhs) {
+    return lin::MatrixData::multiply(lhs, rhs);
+}
+
+lin::MatrixData lin_builtin_transpose(const lin::MatrixData& m) {
+    return m.transpose();
+}
+
+// Minimums and maximums of rows or columns without elements are undefined
+static lin::Value reduceMatrix(const lin::MatrixData& m, bool rows,
+                               lin::MatrixData::Reduction op,
+                               const char* funcName) {
+    if (op != lin::MatrixData::ReduceSum && (rows ? m.cols() : m.rows()) == 0) {
+        panic("ArgumentError: %s expects a matrix with non-empty %s\n",
+              funcName, rows ? "rows" : "columns");
+    }
+    return lin::toValue(rows ? m.reduceRows(op) : m.reduceColumns(op));
+}
+
+lin::Value lin_builtin_row_sum(const lin::MatrixData& m) {
+    return reduceMatrix(m, true, lin::MatrixData::ReduceSum, "row_sum");
+}
+
+lin::Value lin_builtin_row_min(const lin::MatrixData& m) {
+    return reduceMatrix(m, true, lin::MatrixData::ReduceMin, "row_min");
+}
+
+lin::Value lin_builtin_row_max(const lin::MatrixData& m) {
+    return reduceMatrix(m, true, lin::MatrixData::ReduceMax, "row_max");
+}
+
+lin::Value lin_builtin_col_sum(const lin::MatrixData& m) {
+    return reduceMatrix(m, false, lin::MatrixData::ReduceSum, "col_sum");
+}
+
+lin::Value lin_builtin_col_min(const lin::MatrixData& m) {
+    return reduceMatrix(m, false, lin::MatrixData::ReduceMin, "col_min");
+}
+
+lin::Value lin_builtin_col_max(const lin::MatrixData& m) {
+    return reduceMatrix(m, false, lin::MatrixData::ReduceMax, "col_max");
 }
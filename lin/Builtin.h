@@ -1,25 +1,109 @@
 #pragma once
 
 #include <deque>
+#include <string>
 #include <vector>
 #include "Lin.hpp"
+#include "Matrix.h"
 
 lin::Value lin_builtin_print(lin::Runtime* rt,
-                             std::deque<lin::Context*> ctxChain,
-                             std::vector<lin::Value> args);
+                             const std::deque<lin::Context*>& ctxChain,
+                             lin::Arguments args);
 
 lin::Value lin_builtin_println(lin::Runtime* rt,
-                               std::deque<lin::Context*> ctxChain,
-                               std::vector<lin::Value> args);
-
-lin::Value lin_builtin_input(lin::Runtime* rt,
-                             std::deque<lin::Context*> ctxChain,
-                             std::vector<lin::Value> args);
+                               const std::deque<lin::Context*>& ctxChain,
+                               lin::Arguments args);
 
 lin::Value lin_builtin_typeof(lin::Runtime* rt,
-                              std::deque<lin::Context*> ctxChain,
-                              std::vector<lin::Value> args);
+                              const std::deque<lin::Context*>& ctxChain,
+                              lin::Arguments args);
 
 lin::Value lin_builtin_length(lin::Runtime* rt,
-                              std::deque<lin::Context*> ctxChain,
-                              std::vector<lin::Value> args);
+                              const std::deque<lin::Context*>& ctxChain,
+                              lin::Arguments args);
+
+lin::Value lin_builtin_keys(lin::Runtime* rt,
+                            const std::deque<lin::Context*>& ctxChain,
+                            lin::Arguments args);
+
+lin::Value lin_builtin_has(lin::Runtime* rt,
+                           const std::deque<lin::Context*>& ctxChain,
+                           lin::Arguments args);
+
+lin::Value lin_builtin_sort_by(lin::Runtime* rt,
+                               const std::deque<lin::Context*>& ctxChain,
+                               lin::Arguments args);
+
+// Live bytes per heap kind, total and peak bytes and the heap limit
+lin::Value lin_builtin_memstats(lin::Runtime* rt,
+                                const std::deque<lin::Context*>& ctxChain,
+                                lin::Arguments args);
+
+// Save a snapshot of the program to the given file, the snapshot resumes
+// after the calling top-level statement
+lin::Value lin_builtin_snapshot(lin::Runtime* rt,
+                                const std::deque<lin::Context*>& ctxChain,
+                                lin::Arguments args);
+
+//===----------------------------------------------------------------------===//
+// Mutator builtin functions, they update their first argument in place.
+//===----------------------------------------------------------------------===//
+lin::Value lin_builtin_remove(lin::Runtime* rt, lin::Value& self,
+                              lin::Arguments args);
+
+// Set every element of a matrix or an array to the given value
+lin::Value lin_builtin_fill(lin::Runtime* rt, lin::Value& self,
+                            lin::Arguments args);
+
+//===----------------------------------------------------------------------===//
+// Typed builtin functions, they are registered through lin::bindNative which
+// generates argument checking and unpacking for them.
+//===----------------------------------------------------------------------===//
+std::string lin_builtin_input();
+
+lin::Value lin_builtin_slice(const lin::Value& x, long long lo,
+                             long long hi);
+
+lin::Value lin_builtin_sort(const lin::ArrayData& arr);
+
+long long lin_builtin_bsearch(const lin::ArrayData& arr, const lin::Value& x);
+
+lin::Value lin_builtin_min(const lin::ArrayData& arr);
+
+lin::Value lin_builtin_max(const lin::ArrayData& arr);
+
+lin::Value lin_builtin_sum(const lin::ArrayData& arr);
+
+lin::Value lin_builtin_prefix_sum(const lin::ArrayData& arr);
+
+lin::Value lin_builtin_reverse(const lin::Value& x);
+
+//===----------------------------------------------------------------------===//
+// Matrix builtin functions. Results are new matrices or arrays, kernels run
+// over the unboxed elements.
+//===----------------------------------------------------------------------===//
+// rows x cols matrix of the given int or double value
+lin::MatrixData lin_builtin_matrix(long long rows, long long cols,
+                                   const lin::Value& fill);
+
+lin::MatrixData lin_builtin_to_matrix(const lin::ArrayData& rows);
+
+// Number of rows and columns as an array of two ints
+lin::Value lin_builtin_shape(const lin::MatrixData& m);
+
+lin::MatrixData lin_builtin_matmul(const lin::MatrixData& lhs,
+                                   const lin::MatrixData& rhs);
+
+lin::MatrixData lin_builtin_transpose(const lin::MatrixData& m);
+
+lin::Value lin_builtin_row_sum(const lin::MatrixData& m);
+
+lin::Value lin_builtin_row_min(const lin::MatrixData& m);
+
+lin::Value lin_builtin_row_max(const lin::MatrixData& m);
+
+lin::Value lin_builtin_col_sum(const lin::MatrixData& m);
+
+lin::Value lin_builtin_col_min(const lin::MatrixData& m);
+
+lin::Value lin_builtin_col_max(const lin::MatrixData& m);
@@ -0,0 +1,91 @@
+#include <sstream>
+#include "Engine.h"
+#include "Fiber.h"
+#include "HotReload.h"
+#include "Interpreter.h"
+#include "Memo.h"
+#include "Parser.h"
+
+namespace lin {
+
+Program::Program(std::unique_ptr<Runtime> rt) : rt(std::move(rt)) {}
+
+Program::Program(std::unique_ptr<Runtime> rt,
+                 std::unique_ptr<HotReload> reload)
+    : rt(std::move(rt)), reload(std::move(reload)) {}
+
+Program::~Program() = default;
+
+bool Program::hasFunction(const std::string& name) const {
+    return rt->hasFunction(name);
+}
+
+bool Program::update() { return reload != nullptr && reload->update(); }
+
+void Program::wait() {
+    if (reload == nullptr) {
+        panic("ReloadError: program does not watch a file\n");
+    }
+    reload->wait();
+}
+
+std::shared_ptr<Program> Engine::compile(const std::string& source,
+                                         const std::string& directory) {
+    Parser p(std::make_unique<std::istringstream>(source), directory);
+    auto rt = std::make_unique<Runtime>();
+    p.parse(rt.get());
+    Memo::analyze(rt.get());
+    return std::make_shared<Program>(std::move(rt));
+}
+
+std::shared_ptr<Program> Engine::compileFile(const std::string& fileName) {
+    Parser p(fileName);
+    auto rt = std::make_unique<Runtime>();
+    p.parse(rt.get());
+    Memo::analyze(rt.get());
+    return std::make_shared<Program>(std::move(rt));
+}
+
+std::shared_ptr<Program> Engine::watchFile(const std::string& fileName) {
+    Parser p(fileName);
+    auto rt = std::make_unique<Runtime>();
+    p.parse(rt.get());
+    Memo::analyze(rt.get());
+    auto reload = std::make_unique<HotReload>(rt.get(), fileName, p.getItems());
+    return std::make_shared<Program>(std::move(rt), std::move(reload));
+}
+
+void Engine::run(const Program& program) {
+    std::deque<Context*> ctxChain;
+    Interpreter::enterContext(ctxChain);
+    try {
+        Interpreter::runStatements(program.runtime(), ctxChain);
+    } catch (...) {
+        // Release global context before propagating the error to host
+        for (auto* ctx : ctxChain) {
+            delete ctx;
+        }
+        throw;
+    }
+    Interpreter::leaveContext(ctxChain);
+}
+
+std::unique_ptr<Fiber> Engine::spawn(const Program& program) {
+    return std::make_unique<Fiber>(program.runtime());
+}
+
+Value Engine::call(const Program& program, const std::string& funcName,
+                   std::vector<Value> args) {
+    auto* f = program.runtime()->getFunction(funcName);
+    if (f == nullptr) {
+        panic("RuntimeError: can not find function definition of %s\n",
+              funcName.c_str());
+    }
+    if (f->params.size() != args.size()) {
+        panic("ArgumentError: expects %d arguments but got %d\n",
+              (int)f->params.size(), (int)args.size());
+    }
+    return Interpreter::callFunction(program.runtime(), f, std::move(args));
+}
+
+}  // namespace lin
@@ -0,0 +1,70 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "Lin.hpp"
+#include "Utils.hpp"
+
+namespace lin {
+class Fiber;
+class HotReload;
+
+//===----------------------------------------------------------------------===//
+// Embedding interface of lin. A Program is parsed once and can then be run or
+// called into any number of times without touching the parser again. Errors
+// never terminate the host process, they are thrown as lin::LinError.
+//===----------------------------------------------------------------------===//
+class Program {
+public:
+    explicit Program(std::unique_ptr<Runtime> rt);
+    explicit Program(std::unique_ptr<Runtime> rt,
+                     std::unique_ptr<HotReload> reload);
+    ~Program();
+
+    bool hasFunction(const std::string& name) const;
+    Runtime* runtime() const { return rt.get(); }
+
+    // Apply edits of the file a program of Engine::watchFile was parsed
+    // from, returns whether the program changed. Must not be called while
+    // the program runs.
+    bool update();
+    // Block until the file of a program of Engine::watchFile is written
+    void wait();
+
+private:
+    std::unique_ptr<Runtime> rt;
+    std::unique_ptr<HotReload> reload;
+};
+
+class Engine {
+public:
+    explicit Engine() = default;
+
+    // Imports of source are resolved against directory, empty for the
+    // working directory
+    std::shared_ptr<Program> compile(const std::string& source,
+                                     const std::string& directory = "");
+    std::shared_ptr<Program> compileFile(const std::string& fileName);
+    // Like compileFile, the program then follows edits of the file as far
+    // as they are applied by Program::update, see HotReload.h
+    std::shared_ptr<Program> watchFile(const std::string& fileName);
+
+    // Interpret top-level statements of program within a fresh global context
+    void run(const Program& program);
+    // Like run, the statements run on a fiber which takes as many steps as
+    // it is resumed for, see Fiber.h. The program must outlive the fiber
+    // and must not be updated while it runs.
+    std::unique_ptr<Fiber> spawn(const Program& program);
+
+    // Call user defined function funcName, arguments are passed by value
+    Value call(const Program& program, const std::string& funcName,
+               std::vector<Value> args);
+
+    template <typename... _ArgumentType>
+    Value invoke(const Program& program, const std::string& funcName,
+                 _ArgumentType&&... args) {
+        return call(program, funcName,
+                    {toValue(std::forward<_ArgumentType>(args))...});
+    }
+};
+}  // namespace lin
@@ -0,0 +1,1070 @@
+#include "Fiber.h"
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <typeinfo>
+#include "HashTable.h"
+#include "Heap.h"
+#include "HotReload.h"
+#include "Interpreter.h"
+#include "Jit.h"
+#include "Memo.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+// Expressions up to this height which call no user defined function are
+// evaluated recursively, which bounds the C++ stack they take
+constexpr int kMaxRecursiveHeight = 64;
+constexpr int kUnknownHeight = -2;
+constexpr long long kDefaultStackLimit = 256LL << 20;
+
+bool fibersEnabled = false;
+long long stackLimitBytes = kDefaultStackLimit;
+
+template <typename _Visitor>
+void forEachChild(Expression* e, _Visitor&& visit) {
+    const auto& type = typeid(*e);
+    if (type == typeid(BinaryExpr)) {
+        auto* b = static_cast<BinaryExpr*>(e);
+        visit(b->lhs);
+        visit(b->rhs);
+    } else if (type == typeid(FunCallExpr)) {
+        for (auto* arg : static_cast<FunCallExpr*>(e)->args) {
+            visit(arg);
+        }
+    } else if (type == typeid(AssignExpr)) {
+        visit(static_cast<AssignExpr*>(e)->lhs);
+        visit(static_cast<AssignExpr*>(e)->rhs);
+    } else if (type == typeid(IndexExpr)) {
+        visit(static_cast<IndexExpr*>(e)->index);
+        visit(static_cast<IndexExpr*>(e)->second);
+    } else if (type == typeid(LogicalExpr)) {
+        visit(static_cast<LogicalExpr*>(e)->lhs);
+        visit(static_cast<LogicalExpr*>(e)->rhs);
+    } else if (type == typeid(ArrayExpr)) {
+        for (auto* element : static_cast<ArrayExpr*>(e)->literal) {
+            visit(element);
+        }
+    } else if (type == typeid(DictExpr)) {
+        for (auto& [key, value] : static_cast<DictExpr*>(e)->literal) {
+            visit(key);
+            visit(value);
+        }
+    } else if (type == typeid(SliceExpr)) {
+        auto* s = static_cast<SliceExpr*>(e);
+        visit(s->base);
+        visit(s->lo);
+        visit(s->hi);
+    } else if (auto* q = dynamic_cast<QuickenedExpr*>(e)) {
+        visit(q->genericExpr());
+    }
+}
+
+// Height of the tree below e if evaluating it calls no user defined function,
+// -1 otherwise. Heights are computed once and kept with the nodes.
+int heightOf(Runtime* rt, Expression* e) {
+    if (e->callFreeHeight != kUnknownHeight) {
+        return e->callFreeHeight;
+    }
+    // Nodes are measured after their children, without recursion as trees
+    // may be arbitrarily deep
+    std::vector<std::pair<Expression*, bool>> stack{{e, false}};
+    while (!stack.empty()) {
+        auto [node, expanded] = stack.back();
+        stack.pop_back();
+        if (node->callFreeHeight != kUnknownHeight) {
+            continue;
+        }
+        if (!expanded) {
+            stack.emplace_back(node, true);
+            forEachChild(node, [&](Expression* child) {
+                if (child != nullptr) {
+                    stack.emplace_back(child, false);
+                }
+            });
+            continue;
+        }
+        int height = 1;
+        forEachChild(node, [&](Expression* child) {
+            if (child == nullptr || height < 0) {
+                return;
+            }
+            int h = child->callFreeHeight;
+            height = h < 0 ? -1 : std::max(height, h + 1);
+        });
+        if (auto* call = dynamic_cast<FunCallExpr*>(node);
+            call != nullptr && rt->getMutatorFunction(call->funcName) ==
+                                   nullptr &&
+            rt->getBuiltinFunction(call->funcName) == nullptr) {
+            height = -1;
+        }
+        node->callFreeHeight = height;
+    }
+    return e->callFreeHeight;
+}
+
+bool recursive(Runtime* rt, Expression* e) {
+    int height = heightOf(rt, e);
+    return height >= 0 && height <= kMaxRecursiveHeight;
+}
+
+[[noreturn]] void notBool(Token opt, int line, int column) {
+    panic("TypeError: unexpected arguments of operator %s at line %d, "
+          "col %d\n",
+          opt == TK_LOGAND ? "&&" : "||", line, column);
+}
+}  // namespace
+
+bool Fiber::enabled() { return fibersEnabled; }
+
+void Fiber::setEnabled(bool on) { fibersEnabled = on; }
+
+void Fiber::setStackLimit(long long bytes) { stackLimitBytes = bytes; }
+
+long long Fiber::stackLimit() { return stackLimitBytes; }
+
+Fiber::Fiber(Runtime* rt, Context* globals, size_t first, size_t last)
+    : program(rt), rt(rt), statements(rt->getStatements()) {
+    chains.push_back(std::make_unique<std::deque<Context*>>());
+    depth = 1;
+    if (globals != nullptr) {
+        chain().push_back(globals);
+        borrowed = 1;
+    } else {
+        Interpreter::enterContext(chain());
+    }
+    this->last = std::min(last, statements.size());
+    pushFrame(TopFrame, nullptr);
+    frames.back().index = first;
+}
+
+Fiber::Fiber(Runtime* rt, Function* f, std::vector<Value> args)
+    : program(rt), rt(rt) {
+    for (auto& arg : args) {
+        push(std::move(arg));
+    }
+    try {
+        invoke(f, 0, nullptr);
+    } catch (...) {
+        release();
+        Heap::charge(heapAccount, HeapFrame, -charged);
+        Heap::dropAccount(heapAccount);
+        throw;
+    }
+}
+
+Fiber::~Fiber() {
+    release();
+    Heap::charge(heapAccount, HeapFrame, -charged);
+    Heap::dropAccount(heapAccount);
+}
+
+Value Fiber::result() const {
+    if (!finished() || values.empty()) {
+        return Value(Null);
+    }
+    return values.back();
+}
+
+bool Fiber::resume(long long steps) {
+    if (!frames.empty() && frames.front().kind == TopFrame) {
+        // Other fibers of the program may have run in between
+        program->setResumePoint(chains.front()->front(),
+                                frames.front().index);
+    }
+    // Iterations of loops the JIT runs are taken out of the steps as well
+    budget = steps;
+    sliced = steps != LLONG_MAX;
+    try {
+        for (; budget > 0 && !frames.empty(); budget--) {
+            step();
+        }
+    } catch (...) {
+        release();
+        throw;
+    }
+    return frames.empty();
+}
+
+void Fiber::run() {
+    while (!resume(LLONG_MAX)) {
+    }
+}
+
+void Fiber::step() {
+    size_t top = frames.size() - 1;
+    switch (frames[top].kind) {
+        case TopFrame:
+            return stepTop(top);
+        case CallFrame:
+            return stepCall(top);
+        case IfFrame:
+            return stepIf(top);
+        case WhileFrame:
+            return stepWhile(top);
+        case ForFrame:
+            return stepFor(top);
+        case ExpressionStmtFrame:
+            return stepExpressionStmt(top);
+        case ReturnFrame:
+            return stepReturn(top);
+        case ArrayFrame:
+            return stepArray(top);
+        case DictFrame:
+            return stepDict(top);
+        case IndexFrame:
+            return stepIndex(top);
+        case SliceFrame:
+            return stepSlice(top);
+        case BinaryFrame:
+            return stepBinary(top);
+        case LogicalFrame:
+            return stepLogical(top);
+        case FunCallFrame:
+            return stepFunCall(top);
+        case AssignFrame:
+            return stepAssign(top);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Statements. A frame running a block is stepped again once the statement it
+// started finished, signal then tells how that statement ended. Break and
+// continue outside of loops, and return at top level, merely end the blocks
+// they are in, just like in the recursive interpreter.
+//===----------------------------------------------------------------------===//
+bool Fiber::start(Statement* s) {
+    const auto& type = typeid(*s);
+    if (type == typeid(ExpressionStmt)) {
+        auto* stmt = static_cast<ExpressionStmt*>(s);
+        if (!recursive(rt, stmt->expr)) {
+            pushFrame(ExpressionStmtFrame, stmt);
+            return false;
+        }
+        evalExpr(stmt->expr, rt, chain());
+        signal = ExecNormal;
+    } else if (type == typeid(ReturnStmt)) {
+        auto* stmt = static_cast<ReturnStmt*>(s);
+        if (stmt->ret != nullptr && !recursive(rt, stmt->ret)) {
+            pushFrame(ReturnFrame, stmt);
+            return false;
+        }
+        returned = stmt->ret != nullptr ? evalExpr(stmt->ret, rt, chain())
+                                        : Value(Null);
+        signal = ExecReturn;
+    } else if (type == typeid(IfStmt)) {
+        pushFrame(IfFrame, s);
+        return false;
+    } else if (type == typeid(WhileStmt)) {
+        pushFrame(WhileFrame, s);
+        return false;
+    } else if (type == typeid(ForStmt)) {
+        pushFrame(ForFrame, s);
+        return false;
+    } else {
+        signal = s->interpret(rt, chain()).execType;
+    }
+    return true;
+}
+
+bool Fiber::runBlock(size_t top) {
+    auto& stmts = frames[top].block->stmts;
+    while (frames[top].index < stmts.size()) {
+        if (!start(stmts[frames[top].index++])) {
+            return false;
+        }
+        if (signal != ExecNormal) {
+            return true;
+        }
+    }
+    return true;
+}
+
+void Fiber::stepTop(size_t top) {
+    // Results of top-level statements are dropped
+    signal = ExecNormal;
+    returned = Value();
+    while (frames[top].index < last) {
+        size_t i = frames[top].index++;
+        program->setResumePoint(chain().front(), i + 1);
+        if (!start(statements[i])) {
+            return;
+        }
+        signal = ExecNormal;
+    }
+    program->setResumePoint(nullptr, 0);
+    if (borrowed == 0) {
+        Interpreter::leaveContext(chain());
+    }
+    depth--;
+    frames.pop_back();
+}
+
+void Fiber::stepCall(size_t top) {
+    for (;;) {
+        // The body of a function goes on after break and continue
+        if (signal == ExecBreak || signal == ExecContinue) {
+            signal = ExecNormal;
+        }
+        if (signal == ExecReturn) {
+            break;
+        }
+        if (!runBlock(top)) {
+            return;
+        }
+        if (signal == ExecNormal) {
+            break;
+        }
+    }
+    finishCall(top);
+}
+
+void Fiber::stepIf(size_t top) {
+    auto* s = static_cast<IfStmt*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(s->cond)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1: {
+            Value cond = pop();
+            if (!cond.isType<Bool>()) {
+                panic(
+                    "TypeError: expects bool type in while condition at line "
+                    "%d, col %d\n",
+                    s->line, s->column);
+            }
+            Block* block = cond.cast<bool>() ? s->block : s->elseBlock;
+            if (block == nullptr) {
+                signal = ExecNormal;
+                frames.pop_back();
+                return;
+            }
+            Interpreter::enterContext(chain());
+            frames[top].block = block;
+            frames[top].state = 2;
+            [[fallthrough]];
+        }
+        case 2:
+            // Return, break and continue end the block and pass on
+            if (signal == ExecNormal && !runBlock(top)) {
+                return;
+            }
+            Interpreter::leaveContext(chain());
+            frames.pop_back();
+            return;
+    }
+}
+
+void Fiber::stepWhile(size_t top) {
+    auto* s = static_cast<WhileStmt*>(frames[top].node);
+    // Start an iteration, returns false if the JIT ran the rest of the loop
+    auto iterate = [&]() {
+        ExecResult ret;
+        frames[top].state = 2;
+        frames[top].index = 0;
+        if (Jit::enabled() &&
+            Jit::runLoop(rt, s, chain(), ret, sliced ? &budget : nullptr)) {
+            if (ret.execType == ExecContinue) {
+                // Suspended by the budget, the iteration it stopped after is
+                // done and the next step checks the condition again
+                frames[top].index = s->block->stmts.size();
+                signal = ExecNormal;
+                return true;
+            }
+            signal = ret.execType;
+            returned = std::move(ret.retValue);
+            return false;
+        }
+        return true;
+    };
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(s->cond)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1: {
+            Value cond = pop();
+            Interpreter::enterContext(chain());
+            frames[top].block = s->block;
+            if (true == cond.cast<bool>() && iterate()) {
+                return;
+            }
+            break;
+        }
+        case 2:
+            if (signal == ExecNormal && !runBlock(top)) {
+                return;
+            }
+            if (signal == ExecReturn) {
+                break;
+            }
+            if (signal == ExecBreak) {
+                signal = ExecNormal;
+                break;
+            }
+            signal = ExecNormal;
+            frames[top].state = 3;
+            if (!evaluate(s->cond)) {
+                return;
+            }
+            [[fallthrough]];
+        case 3: {
+            Value cond = pop();
+            if (!cond.isType<Bool>()) {
+                panic(
+                    "TypeError: expects bool type in while condition at line "
+                    "%d, col %d\n",
+                    s->line, s->column);
+            }
+            if (true == cond.cast<bool>() && iterate()) {
+                return;
+            }
+            break;
+        }
+    }
+    Interpreter::leaveContext(chain());
+    frames.pop_back();
+}
+
+void Fiber::stepFor(size_t top) {
+    auto* s = static_cast<ForStmt*>(frames[top].node);
+    auto bound = [&](const char* what) {
+        return Interpreter::forBound(pop(), what, s->line, s->column);
+    };
+    // Start an iteration, returns false once the loop is done
+    auto iterate = [&]() {
+        auto& loop = frames[top].loop;
+        if (loop.stride > 0 ? loop.counter >= loop.end
+                            : loop.counter <= loop.end) {
+            return false;
+        }
+        ExecResult ret;
+        if (Jit::enabled() &&
+            Jit::runLoop(rt, s, chain(), loop.counter, loop.end, loop.stride,
+                         ret, sliced ? &budget : nullptr)) {
+            if (ret.execType == ExecContinue) {
+                // Suspended by the budget with counter advanced, the next
+                // step goes on from there
+                frames[top].state = 5;
+                return true;
+            }
+            signal = ret.execType;
+            returned = std::move(ret.retValue);
+            return false;
+        }
+        // Assignments to the loop variable do not affect iteration
+        if (loop.var->value.isType<Int>()) {
+            loop.var->value.ref<long long>() = loop.counter;
+        } else {
+            loop.var->value = Value(Int, loop.counter);
+        }
+        frames[top].state = 4;
+        frames[top].index = 0;
+        return true;
+    };
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(s->lo)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            frames[top].loop.counter = bound("lower bound");
+            frames[top].state = 2;
+            if (!evaluate(s->hi)) {
+                return;
+            }
+            [[fallthrough]];
+        case 2:
+            frames[top].loop.end = bound("upper bound");
+            frames[top].state = 3;
+            if (s->step != nullptr && !evaluate(s->step)) {
+                return;
+            }
+            [[fallthrough]];
+        case 3: {
+            auto& loop = frames[top].loop;
+            loop.stride = s->step != nullptr ? bound("step") : 1;
+            if (loop.stride == 0) {
+                panic("ValueError: step of for loop can not be zero at line "
+                      "%d, col %d\n",
+                      s->line, s->column);
+            }
+            Interpreter::enterContext(chain());
+            chain().back()->createVariable(s->identName, Value(Int, 0LL));
+            loop.var = chain().back()->getVariable(s->identName);
+            frames[top].block = s->block;
+            if (iterate()) {
+                return;
+            }
+            break;
+        }
+        case 4:
+            if (signal == ExecNormal && !runBlock(top)) {
+                return;
+            }
+            if (signal == ExecReturn) {
+                break;
+            }
+            if (signal == ExecBreak) {
+                signal = ExecNormal;
+                break;
+            }
+            signal = ExecNormal;
+            // Stepping beyond the range of ints ends the loop
+            if (!__builtin_add_overflow(frames[top].loop.counter,
+                                        frames[top].loop.stride,
+                                        &frames[top].loop.counter) &&
+                iterate()) {
+                return;
+            }
+            break;
+        case 5:
+            if (iterate()) {
+                return;
+            }
+            break;
+    }
+    Interpreter::leaveContext(chain());
+    frames.pop_back();
+}
+
+void Fiber::stepExpressionStmt(size_t top) {
+    auto* s = static_cast<ExpressionStmt*>(frames[top].node);
+    if (frames[top].state == 0) {
+        frames[top].state = 1;
+        if (!evaluate(s->expr)) {
+            return;
+        }
+    }
+    pop();
+    signal = ExecNormal;
+    frames.pop_back();
+}
+
+void Fiber::stepReturn(size_t top) {
+    auto* s = static_cast<ReturnStmt*>(frames[top].node);
+    if (frames[top].state == 0) {
+        frames[top].state = 1;
+        if (!evaluate(s->ret)) {
+            return;
+        }
+    }
+    returned = pop();
+    signal = ExecReturn;
+    frames.pop_back();
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions evaluate their operands in the same order and fail with the
+// same errors as Expression::eval. Quickened nodes are evaluated through
+// their generic node.
+//===----------------------------------------------------------------------===//
+bool Fiber::evaluate(Expression*& slot) {
+    if (recursive(rt, slot)) {
+        push(evalExpr(slot, rt, chain()));
+        return true;
+    }
+    pushExpression(slot);
+    return false;
+}
+
+void Fiber::pushExpression(Expression* e) {
+    if (auto* q = dynamic_cast<QuickenedExpr*>(e)) {
+        e = q->genericExpr();
+    }
+    const auto& type = typeid(*e);
+    if (type == typeid(BinaryExpr)) {
+        pushFrame(BinaryFrame, e);
+    } else if (type == typeid(FunCallExpr)) {
+        pushFrame(FunCallFrame, e);
+    } else if (type == typeid(AssignExpr)) {
+        pushFrame(AssignFrame, e);
+    } else if (type == typeid(IndexExpr)) {
+        pushFrame(IndexFrame, e);
+    } else if (type == typeid(LogicalExpr)) {
+        pushFrame(LogicalFrame, e);
+    } else if (type == typeid(ArrayExpr)) {
+        pushFrame(ArrayFrame, e);
+    } else if (type == typeid(DictExpr)) {
+        pushFrame(DictFrame, e);
+    } else if (type == typeid(SliceExpr)) {
+        pushFrame(SliceFrame, e);
+    } else {
+        // Leaves are always evaluated right away
+        push(e->eval(rt, chain()));
+    }
+}
+
+void Fiber::finish(Value value) {
+    frames.pop_back();
+    push(std::move(value));
+}
+
+void Fiber::stepArray(size_t top) {
+    auto* e = static_cast<ArrayExpr*>(frames[top].node);
+    if (frames[top].state == 0) {
+        frames[top].state = 1;
+        frames[top].call.base = values.size();
+    }
+    while (frames[top].index < e->literal.size()) {
+        if (!evaluate(e->literal[frames[top].index++])) {
+            return;
+        }
+    }
+    auto first = values.begin() + frames[top].call.base;
+    std::vector<Value> elements(std::make_move_iterator(first),
+                                std::make_move_iterator(values.end()));
+    values.erase(first, values.end());
+    finish(toValue(std::move(elements)));
+}
+
+void Fiber::stepDict(size_t top) {
+    auto* e = static_cast<DictExpr*>(frames[top].node);
+    if (frames[top].state == 0) {
+        frames[top].state = 1;
+        push(Value(Dict, HashTable()));
+    }
+    // Operands alternate between keys and values, a pair is inserted once
+    // both are there
+    while (frames[top].index < 2 * e->literal.size()) {
+        size_t i = frames[top].index++;
+        auto& pair = e->literal[i / 2];
+        if (!evaluate(i % 2 == 0 ? pair.first : pair.second)) {
+            return;
+        }
+        if (i % 2 == 1) {
+            Value value = pop();
+            Value key = pop();
+            values.back().ref<HashTable>().getOrInsert(key) = std::move(value);
+        }
+    }
+    finish(pop());
+}
+
+void Fiber::stepIndex(size_t top) {
+    auto* e = static_cast<IndexExpr*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            // An undefined variable is reported before the index is evaluated
+            e->lookup(chain());
+            frames[top].state = 1;
+            if (!evaluate(e->index)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            frames[top].state = 2;
+            if (e->second != nullptr && !evaluate(e->second)) {
+                return;
+            }
+    }
+    if (e->second != nullptr) {
+        Value second = pop();
+        Value idx = pop();
+        finish(e->subscript(e->lookup(chain())->value, idx, second));
+        return;
+    }
+    Value idx = pop();
+    finish(e->subscript(e->lookup(chain())->value, idx));
+}
+
+void Fiber::stepSlice(size_t top) {
+    auto* e = static_cast<SliceExpr*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(e->base)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            frames[top].index =
+                Interpreter::sliceLength(values.back(), e->line, e->column);
+            frames[top].state = 2;
+            if (e->lo == nullptr) {
+                push(Value(Int, 0LL));
+            } else if (!evaluate(e->lo)) {
+                return;
+            }
+            [[fallthrough]];
+        case 2:
+            Interpreter::sliceBound(values.back(), e->line, e->column);
+            frames[top].state = 3;
+            if (e->hi == nullptr) {
+                push(Value(Int, static_cast<long long>(frames[top].index)));
+            } else if (!evaluate(e->hi)) {
+                return;
+            }
+            [[fallthrough]];
+        case 3: {
+            long long hi =
+                Interpreter::sliceBound(pop(), e->line, e->column);
+            long long lo = pop().cast<long long>();
+            Value base = pop();
+            finish(sliceValue(base, lo, hi));
+            return;
+        }
+    }
+}
+
+void Fiber::stepBinary(size_t top) {
+    auto* e = static_cast<BinaryExpr*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (e->lhs == nullptr) {
+                push(Value(Null));
+            } else if (!evaluate(e->lhs)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            frames[top].state = 2;
+            if (e->rhs == nullptr) {
+                push(Value(Null));
+            } else if (!evaluate(e->rhs)) {
+                return;
+            }
+            [[fallthrough]];
+        case 2: {
+            Value rhs = pop();
+            Value lhs = pop();
+            if (!lhs.isType<Null>() && rhs.isType<Null>()) {
+                finish(Interpreter::calcUnaryExpr(lhs, e->opt, e->line,
+                                                  e->column));
+            } else {
+                finish(Interpreter::calcBinaryExpr(lhs, e->opt, rhs, e->line,
+                                                   e->column));
+            }
+            return;
+        }
+    }
+}
+
+void Fiber::stepLogical(size_t top) {
+    auto* e = static_cast<LogicalExpr*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(e->lhs)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            if (!values.back().isType<Bool>()) {
+                notBool(e->opt, e->line, e->column);
+            }
+            // false && rhs and true || rhs are decided without evaluating rhs
+            if (values.back().cast<bool>() == (e->opt == TK_LOGOR)) {
+                finish(pop());
+                return;
+            }
+            pop();
+            frames[top].state = 2;
+            if (!evaluate(e->rhs)) {
+                return;
+            }
+            [[fallthrough]];
+        case 2:
+            if (!values.back().isType<Bool>()) {
+                notBool(e->opt, e->line, e->column);
+            }
+            finish(pop());
+            return;
+    }
+}
+
+void Fiber::stepAssign(size_t top) {
+    auto* e = static_cast<AssignExpr*>(frames[top].node);
+    switch (frames[top].state) {
+        case 0:
+            frames[top].state = 1;
+            if (!evaluate(e->rhs)) {
+                return;
+            }
+            [[fallthrough]];
+        case 1:
+            if (typeid(*e->lhs) == typeid(IdentExpr)) {
+                const std::string& identName =
+                    static_cast<IdentExpr*>(e->lhs)->identName;
+                auto* var = Interpreter::findVariable(chain(), identName);
+                if (var != nullptr) {
+                    Interpreter::assignTo(e->opt, var->value, values.back());
+                } else {
+                    chain().back()->createVariable(identName, values.back());
+                }
+                finish(pop());
+                return;
+            }
+            if (typeid(*e->lhs) != typeid(IndexExpr)) {
+                panic("SyntaxError: can not assign to %s at line %d, col %d\n",
+                      typeid(e->lhs).name(), e->line, e->column);
+            }
+            frames[top].state = 2;
+            if (!evaluate(static_cast<IndexExpr*>(e->lhs)->index)) {
+                return;
+            }
+            [[fallthrough]];
+        case 2:
+            frames[top].state = 3;
+            if (auto* lhs = static_cast<IndexExpr*>(e->lhs);
+                lhs->second != nullptr && !evaluate(lhs->second)) {
+                return;
+            }
+            [[fallthrough]];
+        case 3: {
+            auto* lhs = static_cast<IndexExpr*>(e->lhs);
+            Value second;
+            if (lhs->second != nullptr) {
+                second = pop();
+            }
+            Value index = pop();
+            auto* var = Interpreter::findVariable(chain(), lhs->identName);
+            if (var == nullptr) {
+                chain().back()->createVariable(lhs->identName, values.back());
+            } else if (lhs->second != nullptr) {
+                Interpreter::assignIndex(e->opt, var->value, index, second,
+                                         values.back(), lhs->identName,
+                                         e->line, e->column);
+            } else {
+                Interpreter::assignIndex(e->opt, var->value, index,
+                                         values.back(), lhs->identName,
+                                         e->line, e->column);
+            }
+            finish(pop());
+            return;
+        }
+    }
+}
+
+void Fiber::stepFunCall(size_t top) {
+    auto* e = static_cast<FunCallExpr*>(frames[top].node);
+    // States tell which kind of function is called once it was looked up
+    enum { LookUp, Mutator, Builtin, User };
+    if (frames[top].state == LookUp) {
+        frames[top].call.base = values.size();
+        if (rt->getMutatorFunction(e->funcName) != nullptr) {
+            if (e->args.empty()) {
+                panic("ArgumentError: %s expects at least one argument\n",
+                      e->funcName.c_str());
+            }
+            frames[top].state = Mutator;
+            // The variable named by the first argument is updated in place,
+            // it only takes a placeholder on the value stack
+            if (typeid(*e->args[0]) == typeid(IdentExpr)) {
+                auto* ident = static_cast<IdentExpr*>(e->args[0]);
+                if (Interpreter::findVariable(chain(), ident->identName) ==
+                    nullptr) {
+                    panic(
+                        "RuntimeError: use of undefined variable \"%s\" at "
+                        "line %d, col %d\n",
+                        ident->identName.c_str(), ident->line, ident->column);
+                }
+                push(Value());
+                frames[top].index = 1;
+            }
+        } else if (rt->getBuiltinFunction(e->funcName) != nullptr) {
+            frames[top].state = Builtin;
+        } else if (auto* f = rt->getFunction(e->funcName); f != nullptr) {
+            if (f->params.size() != e->args.size()) {
+                panic("ArgumentError: expects %d arguments but got %d",
+                      f->params.size(), e->args.size());
+            }
+            frames[top].state = User;
+            frames[top].call.function = f;
+        } else {
+            panic(
+                "RuntimeError: can not find function definition of %s in "
+                "both built-in functions and user defined functions",
+                e->funcName.c_str());
+        }
+    }
+    while (frames[top].index < e->args.size()) {
+        if (!evaluate(e->args[frames[top].index++])) {
+            return;
+        }
+    }
+
+    size_t base = frames[top].call.base;
+    Value* args = values.data() + base;
+    size_t count = values.size() - base;
+    switch (frames[top].state) {
+        case Mutator: {
+            Value* self = args;
+            if (typeid(*e->args[0]) == typeid(IdentExpr)) {
+                auto* ident = static_cast<IdentExpr*>(e->args[0]);
+                self = &Interpreter::findVariable(chain(), ident->identName)
+                            ->value;
+            }
+            Value result = rt->getMutatorFunction(e->funcName)(
+                rt, *self, Arguments(args + 1, count - 1));
+            values.resize(base);
+            finish(std::move(result));
+            return;
+        }
+        case Builtin: {
+            Value result = rt->getBuiltinFunction(e->funcName)(
+                rt, chain(), Arguments(args, count));
+            values.resize(base);
+            finish(std::move(result));
+            return;
+        }
+        default: {
+            auto* f = frames[top].call.function;
+            frames.pop_back();
+            invoke(f, base, e);
+            return;
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Calls of user defined functions take the same tiers as
+// Interpreter::callFunction: native code compiled ahead of time, the result
+// cache, code of the JIT and finally a frame running the body.
+//===----------------------------------------------------------------------===//
+void Fiber::invoke(Function* f, size_t base, const AstNode* site) {
+    auto first = values.begin() + base;
+    std::vector<Value> args(std::make_move_iterator(first),
+                            std::make_move_iterator(values.end()));
+    values.erase(first, values.end());
+    if (f->native != nullptr) {
+        push(f->native(std::move(args)));
+        return;
+    }
+    Runtime* callee = f->home != nullptr ? f->home : rt;
+    bool memoized = false;
+    if (f->memo != nullptr && f->memo->active() &&
+        MemoCache::cacheable(args)) {
+        if (auto* cached = f->memo->find(args); cached != nullptr) {
+            push(*cached);
+            return;
+        }
+        // The arguments stay on the value stack as key of the result
+        memoized = true;
+        for (auto& arg : args) {
+            push(arg);
+        }
+    }
+    if (f->lineShift != 0) {
+        HotReload::shiftLines(f);
+    }
+    if (Value result;
+        Jit::enabled() && Jit::callFunction(callee, f, args, result, sliced)) {
+        if (memoized) {
+            f->memo->insert(std::vector<Value>(values.begin() + base,
+                                               values.end()),
+                            result);
+            values.resize(base);
+        }
+        push(std::move(result));
+        return;
+    }
+
+    long long bytes = static_cast<long long>(frames.size() * sizeof(Frame) +
+                                             values.size() * sizeof(Value));
+    if (stackLimitBytes > 0 && bytes > stackLimitBytes) {
+        if (site == nullptr) {
+            panic("MemoryError: call of %s exceeds stack limit of %lld "
+                  "bytes\n",
+                  f->name.c_str(), stackLimitBytes);
+        }
+        panic("MemoryError: call of %s exceeds stack limit of %lld bytes at "
+              "line %d, col %d\n",
+              f->name.c_str(), stackLimitBytes, site->line, site->column);
+    }
+    if (depth == chains.size()) {
+        chains.push_back(std::make_unique<std::deque<Context*>>());
+    }
+    depth++;
+    Interpreter::enterContext(chain());
+    auto* ctx = chain().back();
+    for (size_t i = 0; i < f->params.size(); i++) {
+        ctx->createVariable(f->params[i], std::move(args[i]));
+    }
+    pushFrame(CallFrame, nullptr);
+    auto& frame = frames.back();
+    frame.block = f->block;
+    frame.call.function = f;
+    frame.call.caller = rt;
+    frame.call.base = base;
+    frame.call.memoized = memoized;
+    rt = callee;
+}
+
+void Fiber::finishCall(size_t top) {
+    auto frame = frames[top];
+    Value result = signal == ExecReturn ? std::move(returned) : Value(Null);
+    signal = ExecNormal;
+    Interpreter::leaveContext(chain());
+    depth--;
+    rt = frame.call.caller;
+    frames.pop_back();
+    if (frame.call.memoized) {
+        frame.call.function->memo->insert(
+            std::vector<Value>(values.begin() + frame.call.base, values.end()),
+            result);
+        values.resize(frame.call.base);
+    }
+    push(std::move(result));
+}
+
+//===----------------------------------------------------------------------===//
+// Both stacks
+//===----------------------------------------------------------------------===//
+void Fiber::pushFrame(FrameKind kind, AstNode* node) {
+    Frame frame{};
+    frame.kind = kind;
+    frame.node = node;
+    frames.push_back(frame);
+    if (frames.capacity() * sizeof(Frame) + values.capacity() * sizeof(Value) !=
+        static_cast<size_t>(charged)) {
+        account();
+    }
+}
+
+void Fiber::push(Value value) {
+    values.push_back(std::move(value));
+    if (frames.capacity() * sizeof(Frame) + values.capacity() * sizeof(Value) !=
+        static_cast<size_t>(charged)) {
+        account();
+    }
+}
+
+Value Fiber::pop() {
+    Value value = std::move(values.back());
+    values.pop_back();
+    return value;
+}
+
+void Fiber::account() {
+    long long bytes = static_cast<long long>(
+        frames.capacity() * sizeof(Frame) + values.capacity() * sizeof(Value));
+    Heap::charge(heapAccount, HeapFrame, bytes - charged);
+    charged = bytes;
+}
+
+void Fiber::release() {
+    if (!frames.empty() && frames.front().kind == TopFrame) {
+        program->setResumePoint(nullptr, 0);
+    }
+    frames.clear();
+    values.clear();
+    // Contexts of calls still running and of the top level, except for the
+    // ones the fiber was given
+    for (; depth > 0; depth--) {
+        auto& contexts = *chains[depth - 1];
+        while (contexts.size() > (depth == 1 ? borrowed : 0)) {
+            Interpreter::leaveContext(contexts);
+        }
+    }
+}
+}  // namespace lin
@@ -0,0 +1,166 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "Ast.h"
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Stackless execution of lin code. A fiber keeps the statements and
+// expressions it is in the middle of as frames of an explicit stack on the
+// heap, the operands they evaluated on a value stack next to it. Calls of
+// user defined functions push frames instead of recursing on the C++ stack,
+// so recursion is only limited by a cap on the bytes of both stacks, and a
+// fiber can stop after any number of steps and resume later. Many fibers can
+// take turns on one thread this way.
+//
+// Expressions which call no user defined function and are not nested too
+// deeply are handed to Expression::eval as a whole, they keep quickening and
+// run as fast as with the recursive interpreter. So do loops the JIT
+// compiled, each of their iterations counts as a step and native code stops
+// once the steps a fiber was resumed for are used up.
+//===----------------------------------------------------------------------===//
+class Fiber {
+public:
+    // Run top-level statements within [first, last) of rt, globals becomes
+    // the global context if given, a fresh one owned by the fiber otherwise
+    explicit Fiber(Runtime* rt, Context* globals = nullptr, size_t first = 0,
+                   size_t last = SIZE_MAX);
+    // Call f of rt with args
+    explicit Fiber(Runtime* rt, Function* f, std::vector<Value> args);
+    ~Fiber();
+
+    // Take up to steps more steps, returns whether the execution finished.
+    // Errors are thrown as LinError and finish the execution as well.
+    bool resume(long long steps);
+    void run();
+    bool finished() const { return frames.empty(); }
+    // Result of a finished call, null for top-level statements
+    Value result() const;
+
+    // Whether the interpreter runs everything on fibers
+    static bool enabled();
+    static void setEnabled(bool on);
+    // Bytes of frames and values a fiber may hold, zero means unlimited
+    static void setStackLimit(long long bytes);
+    static long long stackLimit();
+
+private:
+    enum FrameKind : uint8_t {
+        TopFrame,
+        CallFrame,
+        IfFrame,
+        WhileFrame,
+        ForFrame,
+        ExpressionStmtFrame,
+        ReturnFrame,
+        ArrayFrame,
+        DictFrame,
+        IndexFrame,
+        SliceFrame,
+        BinaryFrame,
+        LogicalFrame,
+        FunCallFrame,
+        AssignFrame,
+    };
+
+    struct Frame {
+        FrameKind kind;
+        int state = 0;
+        // Next statement of a block, operand of an expression or argument of
+        // a call
+        size_t index = 0;
+        AstNode* node{};
+        // Statements the frame runs, if any
+        Block* block{};
+        union {
+            struct {
+                long long counter;
+                long long end;
+                long long stride;
+                Variable* var;
+            } loop;
+            struct {
+                Function* function;
+                // Runtime of the caller, restored on return
+                Runtime* caller;
+                // Where arguments, or the result cache key, start on the
+                // value stack
+                size_t base;
+                bool memoized;
+            } call;
+        };
+    };
+
+    void step();
+    void stepTop(size_t top);
+    void stepCall(size_t top);
+    void stepIf(size_t top);
+    void stepWhile(size_t top);
+    void stepFor(size_t top);
+    void stepExpressionStmt(size_t top);
+    void stepReturn(size_t top);
+    void stepArray(size_t top);
+    void stepDict(size_t top);
+    void stepIndex(size_t top);
+    void stepSlice(size_t top);
+    void stepBinary(size_t top);
+    void stepLogical(size_t top);
+    void stepFunCall(size_t top);
+    void stepAssign(size_t top);
+
+    // Run statement s, returns false if it pushed frames of its own. Its
+    // outcome is left in signal otherwise.
+    bool start(Statement* s);
+    // Start statements of the block of frame top from its index on, returns
+    // false once one pushed frames of its own and true once the block ended
+    // or one of them broke off with a signal
+    bool runBlock(size_t top);
+    // Push the value of the expression in slot if it can be evaluated right
+    // away, otherwise push frames evaluating it. Returns whether the value is
+    // there already.
+    bool evaluate(Expression*& slot);
+    void pushExpression(Expression* e);
+    // Call f with the arguments on the value stack from base on, its result
+    // replaces them
+    void invoke(Function* f, size_t base, const AstNode* site);
+    void finishCall(size_t top);
+    // Replace the frame on top by value of the expression it evaluated
+    void finish(Value value);
+
+    void pushFrame(FrameKind kind, AstNode* node);
+    void push(Value value);
+    Value pop();
+    std::deque<Context*>& chain() { return *chains[depth - 1]; }
+    // Charge capacity of both stacks to the heap
+    void account();
+    // Leave all contexts the fiber entered and drop its stacks
+    void release();
+
+    Runtime* program;
+    // Runtime of the function running now, functions of modules run in the
+    // runtime of their module
+    Runtime* rt;
+    std::vector<Frame> frames;
+    std::vector<Value> values;
+    // Context chains of the top level and of every running call, kept for
+    // reuse once a call returned
+    std::vector<std::unique_ptr<std::deque<Context*>>> chains;
+    size_t depth = 0;
+    // Contexts the top-level chain started with which are not the fiber's
+    size_t borrowed = 0;
+    std::vector<Statement*> statements;
+    size_t last = 0;
+    // How the statement which finished last ended, and the value it returned
+    ExecutionResultType signal = ExecNormal;
+    Value returned;
+    // Frame bytes charged to the account current when the fiber was made
+    HeapAccount* heapAccount = Heap::holdAccount();
+    long long charged = 0;
+    // Steps left of the current resume, and whether they are limited at all
+    long long budget = 0;
+    bool sliced = false;
+};
+}  // namespace lin
@@ -0,0 +1,163 @@
+#include "HashTable.h"
+#include "Utils.hpp"
+
+namespace lin {
+
+static size_t mixBits(uint64_t x) {
+    // Finalizer of MurmurHash3, spreads sequential keys over all slots
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+void HashTable::makeUnique() {
+    if (storage.use_count() != 1) {
+        storage = HeapRef<HashTableStorage>::make(*storage);
+    }
+}
+
+bool HashTable::isHashable(const Value& key) {
+    return anyone(key.type, lin::Int, lin::BigInt, lin::Char, lin::Bool,
+                  lin::String);
+}
+
+size_t HashTable::hashOf(const Value& key) {
+    switch (key.type) {
+        case lin::Int:
+            return mixBits(static_cast<uint64_t>(key.cast<long long>()));
+        case lin::BigInt:
+            return mixBits(key.ref<BigIntData>().hash());
+        case lin::Char:
+            return mixBits((1ULL << 32) |
+                           static_cast<uint8_t>(key.cast<char>()));
+        case lin::Bool:
+            return mixBits((2ULL << 32) | key.cast<bool>());
+        case lin::String:
+            return key.ref<StringData>().hash();
+        default:
+            panic("TypeError: unhashable type %s used as dict key\n",
+                  valueTypeName(key.type));
+    }
+}
+
+bool HashTable::keyEquals(const Value& lhs, const Value& rhs) {
+    if (lhs.type != rhs.type) {
+        return false;
+    }
+    switch (lhs.type) {
+        case lin::Int:
+            return lhs.cast<long long>() == rhs.cast<long long>();
+        case lin::BigInt:
+            return lhs.ref<BigIntData>().compare(rhs.ref<BigIntData>()) == 0;
+        case lin::Char:
+            return lhs.cast<char>() == rhs.cast<char>();
+        case lin::Bool:
+            return lhs.cast<bool>() == rhs.cast<bool>();
+        case lin::String:
+            return lhs.ref<StringData>().equals(rhs.ref<StringData>());
+        default:
+            return false;
+    }
+}
+
+size_t HashTable::probe(const Value& key, size_t hash) const {
+    auto& slots = storage->slots;
+    const size_t mask = slots.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        int32_t index = slots[i];
+        if (index == kEmptySlot) {
+            return i;
+        }
+        // Erased entries stay in the probe sequence until next rehash
+        auto& e = storage->entries[index];
+        if (e.alive && e.hash == hash && keyEquals(e.key, key)) {
+            return i;
+        }
+    }
+}
+
+const Value* HashTable::find(const Value& key) const {
+    size_t hash = hashOf(key);
+    if (storage->slots.empty()) {
+        return nullptr;
+    }
+    int32_t index = storage->slots[probe(key, hash)];
+    return index == kEmptySlot ? nullptr : &storage->entries[index].value;
+}
+
+Value* HashTable::find(const Value& key) {
+    makeUnique();
+    return const_cast<Value*>(static_cast<const HashTable*>(this)->find(key));
+}
+
+Value& HashTable::getOrInsert(const Value& key) {
+    size_t hash = hashOf(key);
+    makeUnique();
+    auto& entries = storage->entries;
+    auto& slots = storage->slots;
+    // Keep load factor, counting erased entries, below 3/4
+    if ((entries.size() + 1) * 4 > slots.size() * 3) {
+        size_t slotCount = slots.empty() ? 8 : slots.size();
+        while ((storage->live + 1) * 2 > slotCount) {
+            slotCount *= 2;
+        }
+        rehash(slotCount);
+    }
+
+    size_t slot = probe(key, hash);
+    if (slots[slot] != kEmptySlot) {
+        return entries[slots[slot]].value;
+    }
+    slots[slot] = static_cast<int32_t>(entries.size());
+    entries.push_back(Entry{key, Value(lin::Null), hash, true});
+    storage->live++;
+    storage.resized();
+    return entries.back().value;
+}
+
+bool HashTable::erase(const Value& key) {
+    size_t hash = hashOf(key);
+    if (storage->slots.empty()) {
+        return false;
+    }
+    int32_t index = storage->slots[probe(key, hash)];
+    if (index == kEmptySlot) {
+        return false;
+    }
+    makeUnique();
+    auto& e = storage->entries[index];
+    e.alive = false;
+    e.key = Value(lin::Null);
+    e.value = Value(lin::Null);
+    storage->live--;
+    return true;
+}
+
+void HashTable::rehash(size_t slotCount) {
+    // Compact erased entries away, insertion order of the rest is preserved
+    auto& entries = storage->entries;
+    auto& slots = storage->slots;
+    std::vector<Entry> compacted;
+    compacted.reserve(storage->live);
+    for (auto& e : entries) {
+        if (e.alive) {
+            compacted.push_back(std::move(e));
+        }
+    }
+    entries = std::move(compacted);
+    slots.assign(slotCount, kEmptySlot);
+
+    const size_t mask = slotCount - 1;
+    for (size_t index = 0; index < entries.size(); index++) {
+        size_t i = entries[index].hash & mask;
+        while (slots[i] != kEmptySlot) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = static_cast<int32_t>(index);
+    }
+}
+
+}  // namespace lin
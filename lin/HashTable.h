@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Lin.hpp"
+
+namespace lin {
+// Entries of a dict, shared between copies of the dict until one of them is
+// modified
+struct HashTableStorage {
+    struct Entry {
+        Value key;
+        Value value;
+        size_t hash;
+        bool alive;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<int32_t> slots;
+    size_t live = 0;
+};
+
+template <>
+struct HeapTraits<HashTableStorage> {
+    static constexpr HeapKind kind = HeapDict;
+    static size_t bytes(const HashTableStorage& v) {
+        return v.entries.capacity() * sizeof(HashTableStorage::Entry) +
+               v.slots.capacity() * sizeof(int32_t);
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// Storage of dict values. Entries are kept densely in insertion order while a
+// power-of-two slot array indexes them with open addressing and linear
+// probing, so lookups touch one flat array and iteration order is stable.
+// Only int, char, bool and string values are valid keys. Like arrays, copies
+// of a dict share its storage on the counted heap and the storage is copied
+// before the first mutation of a dict which does not own it exclusively.
+//===----------------------------------------------------------------------===//
+class HashTable {
+public:
+    explicit HashTable()
+        : storage(HeapRef<HashTableStorage>::make()) {}
+
+    static bool isHashable(const Value& key);
+
+    size_t size() const { return storage->live; }
+
+    const Value* find(const Value& key) const;
+    // The value may be modified through the returned pointer
+    Value* find(const Value& key);
+
+    // Return the value slot of key, inserting a null value if key is absent
+    Value& getOrInsert(const Value& key);
+    bool erase(const Value& key);
+
+    template <typename _Visitor>
+    void forEach(_Visitor&& visit) const {
+        for (auto& e : storage->entries) {
+            if (e.alive) {
+                visit(e.key, e.value);
+            }
+        }
+    }
+
+private:
+    using Entry = HashTableStorage::Entry;
+
+    static constexpr int32_t kEmptySlot = -1;
+
+    static size_t hashOf(const Value& key);
+    static bool keyEquals(const Value& lhs, const Value& rhs);
+
+    // Index of key's slot, or of the empty slot which ends its probe sequence
+    size_t probe(const Value& key, size_t hash) const;
+    void rehash(size_t slotCount);
+    void makeUnique();
+
+    HeapRef<HashTableStorage> storage;
+};
+}  // namespace lin
@@ -0,0 +1,175 @@
+#include "Heap.h"
+#include <algorithm>
+#include <chrono>
+#include "Utils.hpp"
+
+namespace lin {
+// Objects one drain releases at most, the rest stays queued for later drains
+static constexpr long long kReleaseBudget = 4096;
+
+namespace {
+struct HeapStats {
+    long long allocations = 0;
+    long long releases = 0;
+    // Drains which released nested objects and how long they took
+    long long collections = 0;
+    long long deferred = 0;
+    long long pauseNanos = 0;
+    long long maxPauseNanos = 0;
+} stats;
+
+// Account of the process, never dropped
+HeapAccount processAccount;
+HeapAccount* current = &processAccount;
+
+const char* const kKindNames[HeapKinds] = {
+    "array", "string", "dict", "bigint", "matrix", "frames", "ast"};
+
+HeapObject* pending{};
+long long queued = 0;
+bool draining = false;
+
+void drain(long long budget) {
+    if (draining || pending == nullptr) {
+        return;
+    }
+    draining = true;
+    std::chrono::steady_clock::time_point start;
+    bool timed = false;
+    long long released = 0;
+    while (pending != nullptr && (budget < 0 || released < budget)) {
+        auto* object = pending;
+        pending = object->nextPending;
+        queued--;
+        auto* account = object->account;
+        Heap::charge(account, object->kind,
+                     -static_cast<long long>(object->bytes));
+        // Elements of the object queue themselves here instead of recursing
+        delete object;
+        Heap::dropAccount(account);
+        released++;
+        if (!timed && pending != nullptr) {
+            timed = true;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    stats.releases += released;
+    if (timed) {
+        long long pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+        stats.collections++;
+        stats.pauseNanos += pause;
+        stats.maxPauseNanos = std::max(stats.maxPauseNanos, pause);
+        stats.deferred += pending != nullptr;
+    }
+    draining = false;
+}
+
+void reserveIn(HeapAccount* account, long long bytes) {
+    long long limit = account->limit;
+    if (limit > 0 && account->total.live + bytes > limit) {
+        // Garbage still queued may make room
+        drain(-1);
+        if (account->total.live + bytes > limit) {
+            panic("MemoryError: allocating %lld bytes exceeds heap limit of "
+                  "%lld bytes\n",
+                  bytes, limit);
+        }
+    }
+}
+}  // namespace
+
+void Heap::allocated() {
+    stats.allocations++;
+    drain(kReleaseBudget);
+}
+
+void Heap::release(HeapObject* object) {
+    object->nextPending = pending;
+    pending = object;
+    queued++;
+    drain(kReleaseBudget);
+}
+
+void Heap::collect() { drain(-1); }
+
+void Heap::charge(HeapKind kind, long long bytes) {
+    charge(current, kind, bytes);
+}
+
+void Heap::charge(HeapAccount* account, HeapKind kind, long long bytes) {
+    if (bytes > 0) {
+        reserveIn(account, bytes);
+    }
+    auto& usage = account->usages[kind];
+    usage.live += bytes;
+    usage.peak = std::max(usage.peak, usage.live);
+    auto& total = account->total;
+    total.live += bytes;
+    total.peak = std::max(total.peak, total.live);
+}
+
+void Heap::reserve(long long bytes) { reserveIn(current, bytes); }
+
+void Heap::resize(HeapObject* object, size_t bytes) {
+    charge(object->account, object->kind,
+           static_cast<long long>(bytes) -
+               static_cast<long long>(object->bytes));
+    object->bytes = bytes;
+}
+
+HeapAccount* Heap::newAccount(long long limit) {
+    auto* account = new HeapAccount();
+    account->limit = limit;
+    return account;
+}
+
+HeapAccount* Heap::switchAccount(HeapAccount* account) {
+    std::swap(current, account);
+    return account;
+}
+
+HeapAccount* Heap::holdAccount() {
+    current->refs++;
+    return current;
+}
+
+void Heap::dropAccount(HeapAccount* account) {
+    if (--account->refs == 0 && account != &processAccount) {
+        delete account;
+    }
+}
+
+void Heap::setLimit(long long bytes) { current->limit = bytes; }
+
+long long Heap::limit() { return current->limit; }
+
+HeapUsage Heap::usage(HeapKind kind) { return current->usages[kind]; }
+
+HeapUsage Heap::total() { return current->total; }
+
+const char* Heap::kindName(HeapKind kind) { return kKindNames[kind]; }
+
+void Heap::dumpStats(std::ostream& os) {
+    os << "heap: " << stats.allocations << " objects allocated, "
+       << stats.releases << " released, "
+       << stats.allocations - stats.releases - queued << " live, " << queued
+       << " queued\n";
+    os << "heap: " << stats.collections << " collections, "
+       << stats.deferred << " deferred, total pause "
+       << stats.pauseNanos / 1000 << " us, max pause "
+       << stats.maxPauseNanos / 1000 << " us\n";
+    for (int kind = 0; kind < HeapKinds; kind++) {
+        auto& usage = current->usages[kind];
+        os << "heap: " << kKindNames[kind] << " " << usage.live
+           << " bytes live, " << usage.peak << " peak\n";
+    }
+    os << "heap: total " << current->total.live << " bytes live, "
+       << current->total.peak << " peak";
+    if (current->limit > 0) {
+        os << ", limit " << current->limit;
+    }
+    os << "\n";
+}
+}  // namespace lin
@@ -0,0 +1,232 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Managed heap of storage shared between array and string values. Objects
+// are reference counted without atomics, a runtime only ever runs on one
+// thread. Decrements which drop an object to zero are deferred: the object
+// is queued and the queue is drained iteratively with a budget per drain, so
+// releasing a deeply nested array neither recurses once per level nor
+// pauses for longer than the budget. Objects left over are released by the
+// next allocation or release.
+//
+// Copy-on-write keeps arrays from ever containing themselves (storing an
+// array into itself copies it first), so the counts alone reclaim all
+// garbage and no cycle collector is needed.
+//
+// Every byte lin allocates is charged to a kind: arrays, strings, dicts, big
+// integers and matrices are the value types which own memory beyond their
+// Value, frames and AST nodes are bookkeeping of the interpreter. A limit on
+// the total is enforced when bytes are charged, the allocation which would
+// exceed it raises MemoryError.
+//
+// Bytes are charged to the current account. A process has one account
+// unless it serves several tenants, a server gives each request its own, so
+// the limit and usage apply to each of them alone. Objects credit the account
+// they were charged to whichever account is current once they are released.
+//===----------------------------------------------------------------------===//
+enum HeapKind {
+    HeapArray,
+    HeapString,
+    HeapDict,
+    HeapBigInt,
+    HeapMatrix,
+    HeapFrame,
+    HeapAst,
+    HeapKinds,
+};
+
+struct HeapUsage {
+    long long live = 0;
+    long long peak = 0;
+};
+
+// Usage of one tenant and the limit on it. An account lives on as long as
+// its owner or any object charged to it does.
+struct HeapAccount {
+    HeapUsage usages[HeapKinds];
+    HeapUsage total;
+    // Zero means unlimited
+    long long limit = 0;
+    // Objects charged to the account plus one for its owner
+    long long refs = 1;
+};
+
+struct HeapObject {
+    explicit HeapObject() = default;
+    HeapObject(const HeapObject&) = delete;
+    HeapObject& operator=(const HeapObject&) = delete;
+    virtual ~HeapObject() = default;
+
+    uint32_t refs = 0;
+    HeapKind kind = HeapArray;
+    // Bytes charged for the object to account, released along with it
+    size_t bytes = 0;
+    HeapAccount* account{};
+    HeapObject* nextPending{};
+};
+
+class Heap {
+public:
+    // Called for every new object, releases some queued objects first
+    static void allocated();
+    // Queue an object whose last reference went away
+    static void release(HeapObject* object);
+    // Release every queued object, e.g. before a runtime goes away
+    static void collect();
+
+    // Charge bytes to kind, negative amounts release them. Nothing is charged
+    // if the total would exceed the limit, MemoryError is raised instead
+    static void charge(HeapKind kind, long long bytes);
+    static void charge(HeapAccount* account, HeapKind kind, long long bytes);
+    // Raise MemoryError if bytes more would exceed the limit, checked before
+    // large allocations which are charged once they are done
+    static void reserve(long long bytes);
+    // Charge the new size of object to its kind
+    static void resize(HeapObject* object, size_t bytes);
+
+    // A new account with limit, owned by the caller until it drops it
+    static HeapAccount* newAccount(long long limit);
+    // Make account the current one, returns the previous one
+    static HeapAccount* switchAccount(HeapAccount* account);
+    // The current account with one more reference for something charged to
+    // it, given back by dropAccount
+    static HeapAccount* holdAccount();
+    static void dropAccount(HeapAccount* account);
+
+    // Limit and usage of the current account, zero means unlimited
+    static void setLimit(long long bytes);
+    static long long limit();
+    static HeapUsage usage(HeapKind kind);
+    static HeapUsage total();
+    static const char* kindName(HeapKind kind);
+
+    static void dumpStats(std::ostream& os);
+};
+
+// Charges everything allocated during its lifetime to account
+class HeapAccountScope {
+public:
+    explicit HeapAccountScope(HeapAccount* account)
+        : previous(Heap::switchAccount(account)) {}
+    HeapAccountScope(const HeapAccountScope&) = delete;
+    HeapAccountScope& operator=(const HeapAccountScope&) = delete;
+    ~HeapAccountScope() { Heap::switchAccount(previous); }
+
+private:
+    HeapAccount* previous;
+};
+
+// Specialized for types stored on the heap, tells which kind their bytes are
+// charged to and how many bytes a value owns beyond its box
+template <typename _ValueType>
+struct HeapTraits;
+
+// Base of interpreter objects whose allocations are charged to _Kind, the
+// sized delete receives the size of the most derived object. The account
+// charged is kept in front of the object.
+template <HeapKind _Kind>
+struct HeapCharged {
+    static void* operator new(size_t size) {
+        Heap::charge(_Kind, static_cast<long long>(size));
+        auto* p = static_cast<char*>(::operator new(size + kHeader));
+        *reinterpret_cast<HeapAccount**>(p) = Heap::holdAccount();
+        return p + kHeader;
+    }
+    static void operator delete(void* p, size_t size) noexcept {
+        auto* header = static_cast<char*>(p) - kHeader;
+        auto* account = *reinterpret_cast<HeapAccount**>(header);
+        Heap::charge(account, _Kind, -static_cast<long long>(size));
+        Heap::dropAccount(account);
+        ::operator delete(header);
+    }
+
+private:
+    static constexpr size_t kHeader = alignof(std::max_align_t);
+};
+
+template <typename _ValueType>
+struct HeapBox : public HeapObject {
+    template <typename... _ArgumentType>
+    explicit HeapBox(_ArgumentType&&... args)
+        : value(std::forward<_ArgumentType>(args)...) {}
+
+    _ValueType value;
+};
+
+// Counted reference to a heap object, the interface is the subset of
+// std::shared_ptr lin values need
+template <typename _ValueType>
+class HeapRef {
+public:
+    explicit HeapRef() = default;
+    HeapRef(const HeapRef& rhs) : box(rhs.box) { retain(); }
+    HeapRef(HeapRef&& rhs) noexcept : box(rhs.box) { rhs.box = nullptr; }
+    ~HeapRef() { drop(); }
+
+    HeapRef& operator=(const HeapRef& rhs) {
+        if (box != rhs.box) {
+            drop();
+            box = rhs.box;
+            retain();
+        }
+        return *this;
+    }
+    HeapRef& operator=(HeapRef&& rhs) noexcept {
+        if (this != &rhs) {
+            drop();
+            box = rhs.box;
+            rhs.box = nullptr;
+        }
+        return *this;
+    }
+
+    template <typename... _ArgumentType>
+    static HeapRef make(_ArgumentType&&... args) {
+        Heap::allocated();
+        HeapRef ref;
+        ref.box =
+            new HeapBox<_ValueType>(std::forward<_ArgumentType>(args)...);
+        ref.box->refs = 1;
+        ref.box->kind = HeapTraits<_ValueType>::kind;
+        ref.box->account = Heap::holdAccount();
+        ref.resized();
+        return ref;
+    }
+
+    // Recharge the object after its value grew or shrank
+    void resized() {
+        size_t bytes = sizeof(HeapBox<_ValueType>) +
+                       HeapTraits<_ValueType>::bytes(box->value);
+        if (bytes != box->bytes) {
+            Heap::resize(box, bytes);
+        }
+    }
+
+    _ValueType* operator->() const { return &box->value; }
+    _ValueType& operator*() const { return box->value; }
+    long use_count() const { return box ? box->refs : 0; }
+
+    bool operator==(const HeapRef& rhs) const { return box == rhs.box; }
+    bool operator!=(const HeapRef& rhs) const { return box != rhs.box; }
+
+private:
+    void retain() {
+        if (box != nullptr) {
+            box->refs++;
+        }
+    }
+    void drop() {
+        if (box != nullptr && --box->refs == 0) {
+            Heap::release(box);
+        }
+        box = nullptr;
+    }
+
+    HeapBox<_ValueType>* box{};
+};
+}  // namespace lin
@@ -0,0 +1,506 @@
+#include "HotReload.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "Memo.h"
+#include "Module.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+// One inotify instance serves all reloaders of the process, the number of
+// instances a user may create is limited
+struct Watches {
+    int fd = -1;
+    // Reloaders by the watch of the directory their file is in
+    std::unordered_multimap<int, HotReload*> reloaders;
+};
+
+Watches& watches() {
+    // Never destroyed, programs may outlive static destruction
+    static auto* w = new Watches;
+    return *w;
+}
+
+// Visit every node of the trees below roots, quickened nodes together with
+// the generic nodes they stand for
+template <typename _Visitor>
+void forEachNode(std::vector<AstNode*> roots, _Visitor&& visit) {
+    auto& stack = roots;
+    auto push = [&](AstNode* node) {
+        if (node != nullptr) {
+            stack.push_back(node);
+        }
+    };
+    auto pushBlock = [&](Block* block) {
+        if (block != nullptr) {
+            stack.insert(stack.end(), block->stmts.begin(), block->stmts.end());
+        }
+    };
+    while (!stack.empty()) {
+        auto* node = stack.back();
+        stack.pop_back();
+        visit(node);
+        if (auto* e = dynamic_cast<QuickenedExpr*>(node)) {
+            push(e->genericExpr());
+        } else if (auto* e = dynamic_cast<ArrayExpr*>(node)) {
+            for (auto* element : e->literal) {
+                push(element);
+            }
+        } else if (auto* e = dynamic_cast<DictExpr*>(node)) {
+            for (auto& [key, value] : e->literal) {
+                push(key);
+                push(value);
+            }
+        } else if (auto* e = dynamic_cast<IndexExpr*>(node)) {
+            push(e->index);
+            push(e->second);
+        } else if (auto* e = dynamic_cast<SliceExpr*>(node)) {
+            push(e->base);
+            push(e->lo);
+            push(e->hi);
+        } else if (auto* e = dynamic_cast<BinaryExpr*>(node)) {
+            push(e->lhs);
+            push(e->rhs);
+        } else if (auto* e = dynamic_cast<LogicalExpr*>(node)) {
+            push(e->lhs);
+            push(e->rhs);
+        } else if (auto* e = dynamic_cast<FunCallExpr*>(node)) {
+            for (auto* arg : e->args) {
+                push(arg);
+            }
+        } else if (auto* e = dynamic_cast<AssignExpr*>(node)) {
+            push(e->lhs);
+            push(e->rhs);
+        } else if (auto* s = dynamic_cast<ExpressionStmt*>(node)) {
+            push(s->expr);
+        } else if (auto* s = dynamic_cast<ReturnStmt*>(node)) {
+            push(s->ret);
+        } else if (auto* s = dynamic_cast<IfStmt*>(node)) {
+            push(s->cond);
+            pushBlock(s->block);
+            pushBlock(s->elseBlock);
+        } else if (auto* s = dynamic_cast<ForStmt*>(node)) {
+            push(s->lo);
+            push(s->hi);
+            push(s->step);
+            pushBlock(s->block);
+        } else if (auto* s = dynamic_cast<WhileStmt*>(node)) {
+            push(s->cond);
+            pushBlock(s->block);
+        }
+    }
+}
+
+std::vector<AstNode*> rootsOf(Function* f) {
+    if (f->block == nullptr) {
+        return {};
+    }
+    return std::vector<AstNode*>(f->block->stmts.begin(),
+                                 f->block->stmts.end());
+}
+
+// Move an unchanged item to where its text is now, functions are updated
+// once they run again
+void moveItem(const Parser::Item& item, int delta) {
+    if (item.function != nullptr) {
+        item.function->lineShift += delta;
+    } else if (item.statement != nullptr && delta != 0) {
+        forEachNode({item.statement},
+                    [&](AstNode* node) { node->line += delta; });
+    }
+}
+
+bool isImport(const Parser::Item& item) {
+    return item.function == nullptr && item.statement == nullptr;
+}
+
+void release(std::vector<Parser::Item>& items) {
+    for (auto& item : items) {
+        delete item.function;
+        delete item.statement;
+    }
+    items.clear();
+}
+}  // namespace
+
+HotReload::HotReload(Runtime* rt, std::string fileName,
+                     std::vector<Parser::Item> items)
+    : rt(rt), fileName(std::move(fileName)), items(std::move(items)) {
+    size_t slash = this->fileName.rfind('/');
+    directory = this->fileName.substr(0, slash + 1);
+    baseName = this->fileName.substr(slash + 1);
+
+    auto& w = watches();
+    if (w.fd < 0) {
+        w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (w.fd < 0) {
+            panic("ReloadError: can not watch %s: %s\n",
+                  this->fileName.c_str(), strerror(errno));
+        }
+    }
+    // Editors which save by renaming a new file over the old one replace
+    // the inode, so the directory is watched rather than the file
+    watch = inotify_add_watch(w.fd, directory.empty() ? "." : directory.c_str(),
+                              IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch < 0) {
+        panic("ReloadError: can not watch %s: %s\n", this->fileName.c_str(),
+              strerror(errno));
+    }
+    w.reloaders.emplace(watch, this);
+
+    for (auto& item : this->items) {
+        if (item.function != nullptr) {
+            addCallees(item.function);
+        }
+    }
+}
+
+HotReload::~HotReload() {
+    auto& w = watches();
+    auto range = w.reloaders.equal_range(watch);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == this) {
+            w.reloaders.erase(it);
+            break;
+        }
+    }
+    // Reloaders of files in the same directory share its watch
+    if (w.reloaders.count(watch) == 0) {
+        inotify_rm_watch(w.fd, watch);
+    }
+}
+
+void HotReload::readEvents(bool block) {
+    auto& w = watches();
+    if (block) {
+        pollfd ready{w.fd, POLLIN, 0};
+        while (poll(&ready, 1, -1) < 0) {
+            if (errno != EINTR) {
+                panic("ReloadError: can not wait for changes: %s\n",
+                      strerror(errno));
+            }
+        }
+    }
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t n = read(w.fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        for (char* p = buffer; p < buffer + n;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            for (auto& [wd, reloader] : w.reloaders) {
+                // Events were lost when the queue overflowed
+                if ((event->mask & IN_Q_OVERFLOW) != 0 ||
+                    (wd == event->wd && event->len > 0 &&
+                     reloader->baseName == event->name)) {
+                    reloader->stale = true;
+                    reloader->notified = true;
+                }
+            }
+        }
+    }
+}
+
+bool HotReload::update() {
+    readEvents(false);
+    if (!stale) {
+        return false;
+    }
+    notified = false;
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in) {
+        panic("ReloadError: can not read %s\n", fileName.c_str());
+    }
+    std::ostringstream text;
+    text << in.rdbuf();
+    bool changed = apply(text.str());
+    stale = false;
+    return changed;
+}
+
+void HotReload::wait() {
+    while (!notified) {
+        readEvents(true);
+    }
+}
+
+bool HotReload::apply(const std::string& text) {
+    const std::string& source = rt->getSource();
+    if (text == source) {
+        return false;
+    }
+    // The edit lies between the common prefix and suffix of both texts
+    size_t limit = std::min(source.size(), text.size());
+    size_t prefix =
+        std::mismatch(source.begin(), source.begin() + limit, text.begin())
+            .first -
+        source.begin();
+    size_t suffix = std::mismatch(source.rbegin(),
+                                  source.rbegin() + (limit - prefix),
+                                  text.rbegin())
+                        .first -
+                    source.rbegin();
+    size_t editEnd = source.size() - suffix;
+    // Added to offsets behind the edit, wraps around when text shrank
+    size_t growth = text.size() - source.size();
+
+    // Parsing starts at the last item whose first token the edit left alone,
+    // as that token decided where the item in front of it ended. Lexing a
+    // token may look at two characters past it.
+    size_t first = std::partition_point(items.begin(), items.end(),
+                                        [&](const Parser::Item& item) {
+                                            return item.firstTokenEnd + 1 <
+                                                   prefix;
+                                        }) -
+                   items.begin();
+    first = first > 0 ? first - 1 : 0;
+    // Items behind the edit which may be parsed as before
+    size_t behind = std::partition_point(items.begin(), items.end(),
+                                         [&](const Parser::Item& item) {
+                                             return item.begin < editEnd;
+                                         }) -
+                    items.begin();
+
+    std::vector<Parser::Item> parsed;
+    size_t last = behind;
+    int lineShift = 0;
+    // Items [first, last) are replaced by the parsed ones
+    auto parse = [&]() {
+        Parser p(std::make_unique<std::istringstream>(text), directory);
+        if (first == 0) {
+            p.seek(0, 1, 0);
+        } else {
+            p.seek(items[first].begin, items[first].line, items[first].column);
+        }
+        try {
+            for (;;) {
+                while (last < items.size() &&
+                       items[last].begin + growth < p.tokenOffset()) {
+                    last++;
+                }
+                // In step with an unchanged item, the rest parses as before
+                if (last < items.size() &&
+                    items[last].begin + growth == p.tokenOffset() &&
+                    items[last].column == p.tokenColumn()) {
+                    lineShift = p.tokenLine() - items[last].line;
+                    break;
+                }
+                Parser::Item item;
+                if (!p.parseItem(item)) {
+                    break;
+                }
+                parsed.push_back(item);
+            }
+        } catch (...) {
+            release(parsed);
+            throw;
+        }
+    };
+    parse();
+
+    // Imports change which functions there are, parse everything again
+    bool whole =
+        std::any_of(parsed.begin(), parsed.end(), isImport) ||
+        std::any_of(items.begin() + first, items.begin() + last, isImport);
+    std::unique_ptr<Runtime> imported;
+    if (whole) {
+        release(parsed);
+        first = 0;
+        last = items.size();
+        parse();
+        imported = std::make_unique<Runtime>();
+        try {
+            for (auto& item : parsed) {
+                if (isImport(item)) {
+                    Module::import(imported.get(), item.import, directory);
+                }
+            }
+        } catch (...) {
+            release(parsed);
+            throw;
+        }
+    }
+
+    std::unordered_map<std::string, Parser::Item*> replaced;
+    for (size_t i = first; i < last; i++) {
+        if (items[i].function != nullptr) {
+            replaced.emplace(items[i].function->name, &items[i]);
+        }
+    }
+    std::unordered_set<std::string> defined;
+    for (auto& item : parsed) {
+        if (item.function == nullptr) {
+            continue;
+        }
+        std::string name = item.function->name;
+        bool clash = whole ? imported->hasFunction(name)
+                           : replaced.count(name) == 0 && rt->hasFunction(name);
+        if (!defined.insert(name).second || clash) {
+            release(parsed);
+            panic("SyntaxError: multiply function definitions of %s found",
+                  name.c_str());
+        }
+    }
+
+    // Nothing can fail from here on. Functions whose text is the same keep
+    // everything they learned while running.
+    std::vector<Function*> added;
+    for (auto& item : parsed) {
+        if (item.function == nullptr) {
+            continue;
+        }
+        auto old = replaced.find(item.function->name);
+        if (old != replaced.end()) {
+            auto& before = *old->second;
+            if (before.column == item.column &&
+                source.compare(before.begin, before.end - before.begin, text,
+                               item.begin, item.end - item.begin) == 0) {
+                delete item.function;
+                item.function = before.function;
+                moveItem(item, item.line - before.line);
+                replaced.erase(old);
+                continue;
+            }
+        }
+        added.push_back(item.function);
+    }
+    std::vector<Function*> removed;
+    for (auto& [name, item] : replaced) {
+        removed.push_back(item->function);
+        rt->removeFunction(name);
+        removeCallees(item->function);
+    }
+    if (whole) {
+        for (auto* f : rt->getFunctions()) {
+            if (f->home != nullptr && f->home != rt) {
+                rt->removeFunction(f->name);
+            }
+        }
+        for (auto* f : imported->getFunctions()) {
+            rt->addFunction(f->name, f);
+        }
+    }
+    for (auto* f : added) {
+        rt->addFunction(f->name, f);
+        addCallees(f);
+    }
+
+    auto hasStatement = [](const Parser::Item& item) {
+        return item.statement != nullptr;
+    };
+    std::vector<Statement*> statements;
+    for (auto& item : parsed) {
+        if (item.statement != nullptr) {
+            statements.push_back(item.statement);
+        }
+    }
+    rt->replaceStatements(
+        std::count_if(items.begin(), items.begin() + first, hasStatement),
+        std::count_if(items.begin() + first, items.begin() + last,
+                      hasStatement),
+        statements);
+
+    for (size_t i = last; i < items.size(); i++) {
+        items[i].begin += growth;
+        items[i].end += growth;
+        items[i].firstTokenEnd += growth;
+        items[i].line += lineShift;
+        moveItem(items[i], lineShift);
+    }
+    items.erase(items.begin() + first, items.begin() + last);
+    items.insert(items.begin() + first, parsed.begin(), parsed.end());
+    rt->setSource(text);
+
+    // Callers of a changed function may now compute different results, or
+    // turn pure or impure along with it
+    std::vector<Function*> affected = added;
+    std::unordered_set<Function*> seen(added.begin(), added.end());
+    std::vector<std::string> names;
+    for (auto* f : removed) {
+        names.push_back(f->name);
+    }
+    for (auto* f : added) {
+        names.push_back(f->name);
+    }
+    if (whole) {
+        // So may the callers of any imported function
+        for (auto* f : imported->getFunctions()) {
+            names.push_back(f->name);
+        }
+    }
+    while (!names.empty()) {
+        auto calling = callers.find(names.back());
+        names.pop_back();
+        if (calling == callers.end()) {
+            continue;
+        }
+        for (auto* f : calling->second) {
+            if (seen.insert(f).second) {
+                affected.push_back(f);
+                names.push_back(f->name);
+            }
+        }
+    }
+    Memo::reanalyze(rt, affected);
+    for (auto* f : removed) {
+        if (f->memo != nullptr) {
+            f->memo->clear();
+        }
+        delete f;
+    }
+    return true;
+}
+
+void HotReload::shiftLines(Function* f) {
+    int delta = f->lineShift;
+    f->lineShift = 0;
+    forEachNode(rootsOf(f), [&](AstNode* node) { node->line += delta; });
+}
+
+void HotReload::addCallees(Function* f) {
+    auto& names = callees[f];
+    forEachNode(rootsOf(f), [&](AstNode* node) {
+        if (auto* call = dynamic_cast<FunCallExpr*>(node)) {
+            names.push_back(call->funcName);
+            // Builtins like sort_by call the function a string names
+            for (auto* arg : call->args) {
+                if (auto* name = dynamic_cast<StringExpr*>(arg)) {
+                    names.push_back(name->literal.str());
+                }
+            }
+        }
+    });
+    for (auto& name : names) {
+        callers[name].insert(f);
+    }
+}
+
+void HotReload::removeCallees(Function* f) {
+    auto it = callees.find(f);
+    if (it == callees.end()) {
+        return;
+    }
+    for (auto& name : it->second) {
+        auto calling = callers.find(name);
+        if (calling != callers.end()) {
+            calling->second.erase(f);
+            if (calling->second.empty()) {
+                callers.erase(calling);
+            }
+        }
+    }
+    callees.erase(it);
+}
+}  // namespace lin
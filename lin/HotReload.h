@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Lin.hpp"
+#include "Parser.h"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Follows edits of the script file a long-lived program was parsed from.
+// The file is watched with inotify. An edit is applied by parsing the text
+// again from the first top-level item it may have touched, until the parser
+// reaches an unchanged item behind the edit, so the work done depends on the
+// size of the edit rather than on the size of the file.
+//
+// Functions whose text did not change are kept together with their quickened
+// nodes, compiled code and memoized results, changed ones are swapped for
+// their new definitions. Callers of a changed function drop their memoized
+// results and get their purity analyzed again. Editing an import makes the
+// whole file parse again, unchanged functions are still kept.
+//
+// Edits are applied by update() only, which must be called between runs of
+// the program. Text which does not parse leaves the program as it was.
+//===----------------------------------------------------------------------===//
+class HotReload {
+public:
+    // Watch fileName, rt was parsed from it into items
+    explicit HotReload(Runtime* rt, std::string fileName,
+                       std::vector<Parser::Item> items);
+    ~HotReload();
+
+    // Apply edits of the file since the last successful update, returns
+    // whether the program changed
+    bool update();
+
+    // Block until the file is written again
+    void wait();
+
+    // Apply the edits which turn the current source of the program into
+    // text, returns whether the program changed
+    bool apply(const std::string& text);
+
+    // Move the nodes of f by the lines its text moved since they were parsed
+    static void shiftLines(Function* f);
+
+private:
+    // Drain events of the inotify instance shared by all reloaders, block
+    // until there is one if block is set
+    static void readEvents(bool block);
+
+    void addCallees(Function* f);
+    void removeCallees(Function* f);
+
+    Runtime* rt;
+    std::string fileName;
+    // Directory imports are resolved against and name of the file within
+    std::string directory;
+    std::string baseName;
+    // Top-level items of the current source, in the order of the source
+    std::vector<Parser::Item> items;
+    // Names each function of the program may call and the functions which
+    // may call a name
+    std::unordered_map<Function*, std::vector<std::string>> callees;
+    std::unordered_map<std::string, std::unordered_set<Function*>> callers;
+    int watch = -1;
+    // The file was written since the last successful update
+    bool stale = false;
+    // The file was written since the last attempt to update
+    bool notified = false;
+};
+}  // namespace lin
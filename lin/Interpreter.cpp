@@ -1,12 +1,38 @@
+#include <algorithm>
 #include <deque>
 #include <memory>
 #include <vector>
 #include "Ast.h"
 #include "Builtin.h"
+#include "Fiber.h"
+#include "HashTable.h"
+#include "HotReload.h"
 #include "Interpreter.h"
+#include "Jit.h"
 #include "Lin.hpp"
+#include "Matrix.h"
+#include "Memo.h"
+#include "Snapshot.h"
 #include "Utils.hpp"
 
+// Executions with the same operand types after which a generic node replaces
+// itself by its specialized variant
+static constexpr int kQuickenThreshold = 8;
+
+namespace {
+// Leaves every context of a call when the call ends, including the ones of
+// blocks it was running when a panic unwound it
+struct CallContexts {
+    ~CallContexts() {
+        while (!chain.empty()) {
+            Interpreter::leaveContext(chain);
+        }
+    }
+
+    std::deque<lin::Context*> chain;
+};
+}  // namespace
+
 //===----------------------------------------------------------------------===//
 // Lin interpreter, as its name described, will interpret all statements within
 // top-level source file. This part defines internal functions of interpreter
@@ -15,13 +41,8 @@
 Interpreter::Interpreter(const std::string& fileName)
     : p(new Parser(fileName)), rt(new lin::Runtime) {}
 
-Interpreter::~Interpreter() {
-    delete p;
-    delete rt;
-}
-
 lin::Value Expression::eval(lin::Runtime* rt,
-                            std::deque<lin::Context*> ctxChain) {
+                            std::deque<lin::Context*>& ctxChain) {
     panic(
         "RuntimeError: can not evaluate abstract expression at line %d, column "
         "%d\n",
@@ -29,22 +50,70 @@ lin::Value Expression::eval(lin::Runtime* rt,
 }
 
 lin::ExecResult Statement::interpret(lin::Runtime* rt,
-                                     std::deque<lin::Context*> ctxChain) {
+                                     std::deque<lin::Context*>& ctxChain) {
     panic(
         "RuntimeError: can not interpret abstract statement at line %d, column "
         "%d\n",
         line, column);
 }
 
+Interpreter::~Interpreter() {
+    for (auto* ctx : ctxChain) {
+        delete ctx;
+    }
+    delete p;
+    delete rt;
+}
+
 void Interpreter::execute() {
     this->p->parse(this->rt);
+    lin::Memo::analyze(this->rt);
     this->ctxChain.push_back(new lin::Context);
 
+    if (snapshotLine < 0) {
+        runStatements(rt, ctxChain);
+        return;
+    }
+    auto& lines = p->getStatementLines();
+    size_t split = 0;
+    while (split < lines.size() && lines[split] <= snapshotLine) {
+        split++;
+    }
+    runStatements(rt, ctxChain, 0, split);
+    lin::Snapshot::save(snapshotPath, rt, ctxChain.front(), split);
+    runStatements(rt, ctxChain, split);
+}
+
+void Interpreter::snapshotAfter(int line, std::string path) {
+    snapshotLine = line;
+    snapshotPath = std::move(path);
+}
+
+void Interpreter::runStatements(lin::Runtime* rt,
+                                std::deque<lin::Context*>& ctxChain,
+                                size_t first, size_t last) {
+    if (lin::Fiber::enabled()) {
+        lin::Fiber(rt, ctxChain.front(), first, last).run();
+        return;
+    }
     auto stmts = rt->getStatements();
-    for (auto stmt : stmts) {
+    last = std::min(last, stmts.size());
+    for (size_t i = first; i < last; i++) {
         // std::cout << stmt->astString() << "\n";
-        stmt->interpret(rt, ctxChain);
+        rt->setResumePoint(ctxChain.front(), i + 1);
+        stmts[i]->interpret(rt, ctxChain);
+    }
+    rt->setResumePoint(nullptr, 0);
+}
+
+lin::Variable* Interpreter::findVariable(
+    const std::deque<lin::Context*>& ctxChain, const std::string& identName) {
+    for (auto p = ctxChain.crbegin(); p != ctxChain.crend(); ++p) {
+        if (auto* var = (*p)->getVariable(identName); var != nullptr) {
+            return var;
+        }
     }
+    return nullptr;
 }
 
 void Interpreter::enterContext(std::deque<lin::Context*>& ctxChain) {
@@ -60,18 +129,52 @@ void Interpreter::leaveContext(std::deque<lin::Context*>& ctxChain) {
 }
 
 lin::Value Interpreter::callFunction(lin::Runtime* rt, lin::Function* f,
-                                     std::deque<lin::Context*> previousCtxChain,
-                                     std::vector<Expression*> args) {
+                                     std::vector<lin::Value> args) {
+    if (lin::Fiber::enabled()) {
+        // Calls of builtins and hosts run on a fiber of their own
+        lin::Fiber fiber(rt, f, std::move(args));
+        fiber.run();
+        return fiber.result();
+    }
+    if (f->native != nullptr) {
+        return f->native(std::move(args));
+    }
+    if (f->home != nullptr) {
+        // Code compiled for the function and quickened nodes of it live as
+        // long as its module does
+        rt = f->home;
+    }
+    if (f->memo != nullptr && f->memo->active() &&
+        lin::MemoCache::cacheable(args)) {
+        if (auto* cached = f->memo->find(args); cached != nullptr) {
+            return *cached;
+        }
+        // Arguments are moved into the context of the call
+        auto key = args;
+        lin::Value result = runFunction(rt, f, std::move(args));
+        f->memo->insert(std::move(key), result);
+        return result;
+    }
+    return runFunction(rt, f, std::move(args));
+}
+
+lin::Value Interpreter::runFunction(lin::Runtime* rt, lin::Function* f,
+                                    std::vector<lin::Value> args) {
+    if (f->lineShift != 0) {
+        lin::HotReload::shiftLines(f);
+    }
+    if (lin::Value result;
+        lin::Jit::enabled() && lin::Jit::callFunction(rt, f, args, result)) {
+        return result;
+    }
     // Execute user defined function
-    std::deque<lin::Context*> funcCtxChain;
+    CallContexts contexts;
+    auto& funcCtxChain = contexts.chain;
     Interpreter::enterContext(funcCtxChain);
 
     auto* funcCtx = funcCtxChain.back();
     for (int i = 0; i < f->params.size(); i++) {
-        std::string paramName = f->params[i];
-        // Evaluate argument values from previouse context chain
-        lin::Value argValue = args[i]->eval(rt, previousCtxChain);
-        funcCtx->createVariable(f->params[i], argValue);
+        funcCtx->createVariable(f->params[i], std::move(args[i]));
     }
 
     lin::ExecResult ret(lin::ExecNormal);
@@ -81,8 +184,10 @@ lin::Value Interpreter::callFunction(lin::Runtime* rt, lin::Function* f,
             break;
         }
     }
-    Interpreter::leaveContext(funcCtxChain);
 
+    if (ret.execType != lin::ExecReturn) {
+        return lin::Value(lin::Null);
+    }
     return ret.retValue;
 }
 
@@ -92,7 +197,9 @@ lin::Value Interpreter::calcUnaryExpr(lin::Value& lhs, Token opt, int line,
         case TK_MINUS:
             switch (lhs.type) {
                 case lin::Int:
-                    return lin::Value(lin::Int, -std::any_cast<int>(lhs.data));
+                    return lin::negInt(std::any_cast<long long>(lhs.data));
+                case lin::BigInt:
+                    return lin::BigIntData::neg(lhs.ref<lin::BigIntData>());
                 case lin::Double:
                     return lin::Value(lin::Double,
                                       -std::any_cast<double>(lhs.data));
@@ -115,7 +222,8 @@ lin::Value Interpreter::calcUnaryExpr(lin::Value& lhs, Token opt, int line,
             break;
         case TK_BITNOT:
             if (lhs.type == lin::Int) {
-                return lin::Value(lin::Int, ~std::any_cast<int>(lhs.data));
+                return lin::Value(lin::Int,
+                                  ~std::any_cast<long long>(lhs.data));
             } else {
                 panic(
                     "TypeError: invalid operand type for operator "
@@ -203,15 +311,36 @@ lin::Value Interpreter::assignSwitch(Token opt, lin::Value lhs,
     }
 }
 
+void Interpreter::assignTo(Token opt, lin::Value& target, lin::Value rhs) {
+    // Accumulating into an array or a string appends to its storage in place
+    // when target owns it, which makes a loop of n appends cost O(n)
+    if (opt == TK_PLUS_AGN) {
+        if (target.isType<lin::String>()) {
+            auto& str = target.ref<lin::StringData>();
+            if (rhs.isType<lin::String>()) {
+                str.append(rhs.ref<lin::StringData>().view());
+            } else {
+                str.append(valueToStdString(rhs));
+            }
+            return;
+        }
+        if (target.isType<lin::Array>() && !rhs.isType<lin::String>()) {
+            target.ref<lin::ArrayData>().push(std::move(rhs));
+            return;
+        }
+    }
+    target = assignSwitch(opt, target, std::move(rhs));
+}
+
 //===----------------------------------------------------------------------===//
 // Interpret various statements within given runtime and context chain. Runtime
 // holds all necessary data that widely used in every context. Context chain
 // saves a linked contexts of current execution flow.
 //===----------------------------------------------------------------------===//
 lin::ExecResult IfStmt::interpret(lin::Runtime* rt,
-                                  std::deque<lin::Context*> ctxChain) {
+                                  std::deque<lin::Context*>& ctxChain) {
     lin::ExecResult ret(lin::ExecNormal);
-    Value cond = this->cond->eval(rt, ctxChain);
+    Value cond = evalExpr(this->cond, rt, ctxChain);
     if (!cond.isType<lin::Bool>()) {
         panic(
             "TypeError: expects bool type in while condition at line %d, "
@@ -253,12 +382,15 @@ lin::ExecResult IfStmt::interpret(lin::Runtime* rt,
 }
 
 lin::ExecResult WhileStmt::interpret(lin::Runtime* rt,
-                                     std::deque<lin::Context*> ctxChain) {
+                                     std::deque<lin::Context*>& ctxChain) {
     lin::ExecResult ret;
-    Value cond = this->cond->eval(rt, ctxChain);
+    Value cond = evalExpr(this->cond, rt, ctxChain);
 
     Interpreter::enterContext(ctxChain);
     while (true == cond.cast<bool>()) {
+        if (lin::Jit::enabled() && lin::Jit::runLoop(rt, this, ctxChain, ret)) {
+            goto outside;
+        }
         for (auto& stmt : block->stmts) {
             // std::cout << stmt->astString() << "\n";
             ret = stmt->interpret(rt, ctxChain);
@@ -274,7 +406,7 @@ lin::ExecResult WhileStmt::interpret(lin::Runtime* rt,
                 break;
             }
         }
-        cond = this->cond->eval(rt, ctxChain);
+        cond = evalExpr(this->cond, rt, ctxChain);
         if (!cond.isType<lin::Bool>()) {
             panic(
                 "TypeError: expects bool type in while condition at line %d, "
@@ -288,26 +420,90 @@ outside:
     return ret;
 }
 
+lin::ExecResult ForStmt::interpret(lin::Runtime* rt,
+                                   std::deque<lin::Context*>& ctxChain) {
+    lin::ExecResult ret;
+    auto evalBound = [&](Expression* e, const char* what) {
+        return Interpreter::forBound(e->eval(rt, ctxChain), what, line, column);
+    };
+    // Counter is kept unboxed, stepping beyond the range of ints ends the loop
+    long long i = evalBound(lo, "lower bound");
+    const long long end = evalBound(hi, "upper bound");
+    const long long stride = step ? evalBound(step, "step") : 1;
+    if (stride == 0) {
+        panic("ValueError: step of for loop can not be zero at line %d, "
+              "col %d\n",
+              line, column);
+    }
+
+    Interpreter::enterContext(ctxChain);
+    ctxChain.back()->createVariable(identName, lin::Value(lin::Int, 0LL));
+    auto* var = ctxChain.back()->getVariable(identName);
+    for (; stride > 0 ? i < end : i > end;) {
+        if (lin::Jit::enabled() &&
+            lin::Jit::runLoop(rt, this, ctxChain, i, end, stride, ret)) {
+            goto outside;
+        }
+        // Assignments to the loop variable do not affect iteration
+        if (var->value.isType<lin::Int>()) {
+            var->value.ref<long long>() = i;
+        } else {
+            var->value = lin::Value(lin::Int, i);
+        }
+        for (auto& stmt : block->stmts) {
+            ret = stmt->interpret(rt, ctxChain);
+            if (ret.execType == lin::ExecReturn) {
+                goto outside;
+            } else if (ret.execType == lin::ExecBreak) {
+                // Disable propagating through the whole chain
+                ret.execType = lin::ExecNormal;
+                goto outside;
+            } else if (ret.execType == lin::ExecContinue) {
+                // Disable propagating through the whole chain
+                ret.execType = lin::ExecNormal;
+                break;
+            }
+        }
+        if (__builtin_add_overflow(i, stride, &i)) {
+            break;
+        }
+    }
+
+outside:
+    Interpreter::leaveContext(ctxChain);
+    return ret;
+}
+
+long long Interpreter::forBound(const lin::Value& v, const char* what,
+                                int line, int column) {
+    if (!v.isType<lin::Int>()) {
+        panic("TypeError: expects int %s of for loop at line %d, col %d\n",
+              what, line, column);
+    }
+    return v.cast<long long>();
+}
+
 lin::ExecResult ExpressionStmt::interpret(lin::Runtime* rt,
-                                          std::deque<lin::Context*> ctxChain) {
+                                          std::deque<lin::Context*>& ctxChain) {
     // std::cout << this->expr->astString() << "\n";
-    this->expr->eval(rt, ctxChain);
+    evalExpr(this->expr, rt, ctxChain);
     return lin::ExecResult(lin::ExecNormal);
 }
 
 lin::ExecResult ReturnStmt::interpret(lin::Runtime* rt,
-                                      std::deque<lin::Context*> ctxChain) {
-    Value retVal = this->ret->eval(rt, ctxChain);
+                                      std::deque<lin::Context*>& ctxChain) {
+    Value retVal =
+        this->ret ? evalExpr(this->ret, rt, ctxChain) : lin::Value(lin::Null);
     return lin::ExecResult(lin::ExecReturn, retVal);
 }
 
 lin::ExecResult BreakStmt::interpret(lin::Runtime* rt,
-                                     std::deque<lin::Context*> ctxChain) {
+                                     std::deque<lin::Context*>& ctxChain) {
     return lin::ExecResult(lin::ExecBreak);
 }
 
 lin::ExecResult ContinueStmt::interpret(lin::Runtime* rt,
-                                        std::deque<lin::Context*> ctxChain) {
+                                        std::deque<lin::Context*>& ctxChain) {
     return lin::ExecResult(lin::ExecContinue);
 }
 
@@ -317,46 +513,63 @@ lin::ExecResult ContinueStmt::interpret(lin::Runtime* rt,
 // of(also all) data type in lin and can get value by interpreter directly.
 //===----------------------------------------------------------------------===//
 lin::Value NullExpr::eval(lin::Runtime* rt,
-                          std::deque<lin::Context*> ctxChain) {
+                          std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::Null);
 }
 
 lin::Value BoolExpr::eval(lin::Runtime* rt,
-                          std::deque<lin::Context*> ctxChain) {
+                          std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::Bool, this->literal);
 }
 
 lin::Value CharExpr::eval(lin::Runtime* rt,
-                          std::deque<lin::Context*> ctxChain) {
+                          std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::Char, this->literal);
 }
 
-lin::Value IntExpr::eval(lin::Runtime* rt, std::deque<lin::Context*> ctxChain) {
+lin::Value IntExpr::eval(lin::Runtime* rt,
+                         std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::Int, this->literal);
 }
 
+lin::Value BigIntExpr::eval(lin::Runtime* rt,
+                            std::deque<lin::Context*>& ctxChain) {
+    return lin::Value(lin::BigInt, this->literal);
+}
+
 lin::Value DoubleExpr::eval(lin::Runtime* rt,
-                            std::deque<lin::Context*> ctxChain) {
+                            std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::Double, this->literal);
 }
 
 lin::Value StringExpr::eval(lin::Runtime* rt,
-                            std::deque<lin::Context*> ctxChain) {
+                            std::deque<lin::Context*>& ctxChain) {
     return lin::Value(lin::String, this->literal);
 }
 
 lin::Value ArrayExpr::eval(lin::Runtime* rt,
-                           std::deque<lin::Context*> ctxChain) {
+                           std::deque<lin::Context*>& ctxChain) {
     std::vector<lin::Value> elements;
     for (auto& e : this->literal) {
         elements.push_back(e->eval(rt, ctxChain));
     }
 
-    return lin::Value(lin::Array, elements);
+    return lin::toValue(std::move(elements));
+}
+
+lin::Value DictExpr::eval(lin::Runtime* rt,
+                          std::deque<lin::Context*>& ctxChain) {
+    lin::HashTable table;
+    for (auto& [key, value] : this->literal) {
+        lin::Value k = key->eval(rt, ctxChain);
+        table.getOrInsert(k) = value->eval(rt, ctxChain);
+    }
+
+    return lin::Value(lin::Dict, std::move(table));
 }
 
 lin::Value IdentExpr::eval(lin::Runtime* rt,
-                           std::deque<lin::Context*> ctxChain) {
+                           std::deque<lin::Context*>& ctxChain) {
     for (auto p = ctxChain.crbegin(); p != ctxChain.crend(); ++p) {
         auto* ctx = *p;
         if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
@@ -368,72 +581,225 @@ lin::Value IdentExpr::eval(lin::Runtime* rt,
 }
 
 lin::Value IndexExpr::eval(lin::Runtime* rt,
-                           std::deque<lin::Context*> ctxChain) {
-    for (auto p = ctxChain.crbegin(); p != ctxChain.crend(); ++p) {
-        auto* ctx = *p;
-        if (auto* var = ctx->getVariable(this->identName); var != nullptr) {
-            auto idx = this->index->eval(rt, ctxChain);
-            if (!idx.isType<lin::Int>()) {
-                panic(
-                    "TypeError: expects int type within indexing expression at "
-                    "line %d, col %d\n",
-                    line, column);
-            }
-            if (idx.cast<int>() >=
-                var->value.cast<std::vector<lin::Value>>().size()) {
-                panic("IndexError: index %d out of range at line %d, col %d\n",
-                      idx.cast<int>(), line, column);
+                           std::deque<lin::Context*>& ctxChain) {
+    auto* var = lookup(ctxChain);
+    auto idx = evalExpr(this->index, rt, ctxChain);
+    if (this->second != nullptr) {
+        auto col = evalExpr(this->second, rt, ctxChain);
+        return subscript(var->value, idx, col);
+    }
+    if (!quickened) {
+        if (var->value.isType<lin::Array>() && idx.isType<lin::Int>()) {
+            if (++intHits == kQuickenThreshold) {
+                quickened = true;
+                replacement = new ArrayIndexIntExpr(this);
             }
-            return var->value.cast<std::vector<lin::Value>>()[idx.cast<int>()];
+        } else {
+            intHits = 0;
         }
     }
-    panic("RuntimeError: use of undefined variable \"%s\" at line %d, col %d\n",
-          identName.c_str(), this->line, this->column);
+    return subscript(var->value, idx);
+}
+
+lin::Variable* IndexExpr::lookup(const std::deque<lin::Context*>& ctxChain) {
+    auto* var = Interpreter::findVariable(ctxChain, this->identName);
+    if (var == nullptr) {
+        panic(
+            "RuntimeError: use of undefined variable \"%s\" at line %d, col "
+            "%d\n",
+            identName.c_str(), this->line, this->column);
+    }
+    return var;
+}
+
+lin::Value IndexExpr::subscript(const lin::Value& base, const lin::Value& idx) {
+    return Interpreter::subscript(base, idx, identName, line, column);
+}
+
+lin::Value IndexExpr::subscript(const lin::Value& base, const lin::Value& idx,
+                                const lin::Value& second) {
+    return Interpreter::subscript(base, idx, second, identName, line, column);
+}
+
+lin::Value Interpreter::subscript(const lin::Value& base, const lin::Value& idx,
+                                  const std::string& identName, int line,
+                                  int column) {
+    if (base.isType<lin::Dict>()) {
+        if (auto* v = base.ref<lin::HashTable>().find(idx); v != nullptr) {
+            return *v;
+        }
+        panic("KeyError: key %s not found at line %d, col %d\n",
+              valueToStdString(idx).c_str(), line, column);
+    }
+    if (!base.isType<lin::Array>() && !base.isType<lin::String>() &&
+        !base.isType<lin::Matrix>()) {
+        panic(
+            "TypeError: expects array, string, dict or matrix type of variable "
+            "%s at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    if (!idx.isType<lin::Int>()) {
+        panic(
+            "TypeError: expects int type within indexing expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    long long i = idx.cast<long long>();
+    // A single index selects a row of a matrix as an array
+    if (base.isType<lin::Matrix>()) {
+        auto& m = base.ref<lin::MatrixData>();
+        if (i < 0 || static_cast<size_t>(i) >= m.rows()) {
+            panic("IndexError: index %lld out of range at line %d, col %d\n",
+                  i, line, column);
+        }
+        return lin::Value(lin::Array, m.row(i));
+    }
+    if (base.isType<lin::String>()) {
+        auto& str = base.ref<lin::StringData>();
+        if (i < 0 || static_cast<size_t>(i) >= str.size()) {
+            panic("IndexError: index %lld out of range at line %d, col %d\n",
+                  i, line, column);
+        }
+        return lin::Value(lin::Char, str[i]);
+    }
+    auto& arr = base.ref<lin::ArrayData>();
+    if (i < 0 || static_cast<size_t>(i) >= arr.size()) {
+        panic("IndexError: index %lld out of range at line %d, col %d\n", i,
+              line, column);
+    }
+    return arr[i];
+}
+
+lin::Value Interpreter::subscript(const lin::Value& base, const lin::Value& idx,
+                                  const lin::Value& second,
+                                  const std::string& identName, int line,
+                                  int column) {
+    if (!base.isType<lin::Matrix>()) {
+        // Element of the element selected by the first index
+        return subscript(subscript(base, idx, identName, line, column), second,
+                         identName, line, column);
+    }
+    auto& m = base.ref<lin::MatrixData>();
+    auto [i, j] = matrixIndices(m, idx, second, line, column);
+    return m.at(i, j);
+}
+
+std::pair<size_t, size_t> Interpreter::matrixIndices(
+    const lin::MatrixData& m, const lin::Value& idx, const lin::Value& second,
+    int line, int column) {
+    if (!idx.isType<lin::Int>() || !second.isType<lin::Int>()) {
+        panic(
+            "TypeError: expects int type within indexing expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    long long i = idx.cast<long long>(), j = second.cast<long long>();
+    if (i < 0 || static_cast<size_t>(i) >= m.rows() || j < 0 ||
+        static_cast<size_t>(j) >= m.cols()) {
+        panic("IndexError: index [%lld, %lld] out of range at line %d, col "
+              "%d\n",
+              i, j, line, column);
+    }
+    return {i, j};
+}
+
+lin::Value ArrayIndexIntExpr::eval(lin::Runtime* rt,
+                                   std::deque<lin::Context*>& ctxChain) {
+    auto* var = generic->lookup(ctxChain);
+    auto idx = evalExpr(generic->index, rt, ctxChain);
+    if (var->value.isType<lin::Array>() && idx.isType<lin::Int>()) {
+        auto& arr = var->value.ref<lin::ArrayData>();
+        auto i = static_cast<size_t>(idx.cast<long long>());
+        if (i < arr.size()) {
+            return arr[i];
+        }
+        return generic->subscript(var->value, idx);
+    }
+    // Generic path may panic, this node is only given up once it returned
+    lin::Value result = generic->subscript(var->value, idx);
+    if (!deoptimized) {
+        deoptimized = true;
+        replacement = generic;
+        rt->retireExpression(this);
+    }
+    return result;
+}
+
+lin::Value SliceExpr::eval(lin::Runtime* rt,
+                           std::deque<lin::Context*>& ctxChain) {
+    lin::Value base = this->base->eval(rt, ctxChain);
+    long long length = Interpreter::sliceLength(base, line, column);
+
+    auto bound = [&](Expression* e, long long defaultValue) {
+        if (e == nullptr) {
+            return defaultValue;
+        }
+        return Interpreter::sliceBound(e->eval(rt, ctxChain), line, column);
+    };
+    long long lo = bound(this->lo, 0);
+    long long hi = bound(this->hi, length);
+    return sliceValue(base, lo, hi);
+}
+
+long long Interpreter::sliceLength(const lin::Value& base, int line,
+                                   int column) {
+    if (base.isType<lin::Array>()) {
+        return base.ref<lin::ArrayData>().size();
+    }
+    if (base.isType<lin::String>()) {
+        return base.ref<lin::StringData>().size();
+    }
+    panic("TypeError: can not slice value of %s type at line %d, col %d\n",
+          valueTypeName(base.type), line, column);
+}
+
+long long Interpreter::sliceBound(const lin::Value& v, int line,
+                                  int column) {
+    if (!v.isType<lin::Int>()) {
+        panic(
+            "TypeError: expects int type within slicing expression at "
+            "line %d, col %d\n",
+            line, column);
+    }
+    return v.cast<long long>();
 }
 
 lin::Value AssignExpr::eval(lin::Runtime* rt,
-                            std::deque<lin::Context*> ctxChain) {
-    lin::Value rhs = this->rhs->eval(rt, ctxChain);
+                            std::deque<lin::Context*>& ctxChain) {
+    lin::Value rhs = evalExpr(this->rhs, rt, ctxChain);
 
     if (typeid(*lhs) == typeid(IdentExpr)) {
-        std::string identName = dynamic_cast<IdentExpr*>(lhs)->identName;
+        const std::string& identName =
+            dynamic_cast<IdentExpr*>(lhs)->identName;
 
         for (auto p = ctxChain.crbegin(); p != ctxChain.crend(); ++p) {
             if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                var->value =
-                    Interpreter::assignSwitch(this->opt, var->value, rhs);
+                Interpreter::assignTo(this->opt, var->value, rhs);
                 return rhs;
             }
         }
 
         (ctxChain.back())->createVariable(identName, rhs);
     } else if (typeid(*lhs) == typeid(IndexExpr)) {
-        std::string identName = dynamic_cast<IndexExpr*>(lhs)->identName;
-        lin::Value index =
-            dynamic_cast<IndexExpr*>(lhs)->index->eval(rt, ctxChain);
-        if (!index.isType<lin::Int>()) {
-            panic(
-                "TypeError: expects int type when applying indexing "
-                "to variable %s at line %d, col %d\n",
-                identName.c_str(), line, column);
+        auto* target = dynamic_cast<IndexExpr*>(lhs);
+        const std::string& identName = target->identName;
+        lin::Value index = evalExpr(target->index, rt, ctxChain);
+        lin::Value second;
+        if (target->second != nullptr) {
+            second = evalExpr(target->second, rt, ctxChain);
         }
-        for (auto p = ctxChain.crbegin(); p != ctxChain.crend(); ++p) {
-            if (auto* var = (*p)->getVariable(identName); var != nullptr) {
-                if (!var->value.isType<lin::Array>()) {
-                    panic(
-                        "TypeError: expects array type of variable %s "
-                        "at line %d, col %d\n",
-                        identName.c_str(), line, column);
-                }
-                auto&& temp = var->value.cast<std::vector<lin::Value>>();
-                temp[index.cast<int>()] = Interpreter::assignSwitch(
-                    this->opt, temp[index.cast<int>()], rhs);
-                var->value.data = std::move(temp);
-                return rhs;
-            }
+        auto* var = Interpreter::findVariable(ctxChain, identName);
+        if (var == nullptr) {
+            (ctxChain.back())->createVariable(identName, rhs);
+            return rhs;
+        }
+        if (target->second != nullptr) {
+            Interpreter::assignIndex(this->opt, var->value, index, second, rhs,
+                                     identName, line, column);
+        } else {
+            Interpreter::assignIndex(this->opt, var->value, index, rhs,
+                                     identName, line, column);
         }
-
-        (ctxChain.back())->createVariable(identName, rhs);
     } else {
         panic("SyntaxError: can not assign to %s at line %d, col %d\n",
               typeid(lhs).name(), line, column);
@@ -441,22 +807,164 @@ lin::Value AssignExpr::eval(lin::Runtime* rt,
     return rhs;
 }
 
+void Interpreter::assignIndex(Token opt, lin::Value& target,
+                              const lin::Value& index, lin::Value rhs,
+                              const std::string& identName, int line,
+                              int column) {
+    if (target.isType<lin::Dict>()) {
+        auto& table = target.ref<lin::HashTable>();
+        if (opt == TK_ASSIGN) {
+            table.getOrInsert(index) = std::move(rhs);
+        } else if (auto* v = table.find(index); v != nullptr) {
+            Interpreter::assignTo(opt, *v, std::move(rhs));
+        } else {
+            panic("KeyError: key %s not found at line %d, col %d\n",
+                  valueToStdString(index).c_str(), line, column);
+        }
+        return;
+    }
+    if (!index.isType<lin::Int>()) {
+        panic(
+            "TypeError: expects int type when applying indexing "
+            "to variable %s at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    if (target.isType<lin::Matrix>()) {
+        panic(
+            "TypeError: expects two indices to assign an element of matrix %s "
+            "at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    if (!target.isType<lin::Array>()) {
+        panic(
+            "TypeError: expects array type of variable %s "
+            "at line %d, col %d\n",
+            identName.c_str(), line, column);
+    }
+    auto& arr = target.ref<lin::ArrayData>();
+    long long i = index.cast<long long>();
+    if (i < 0 || static_cast<size_t>(i) >= arr.size()) {
+        panic("IndexError: index %lld out of range at line %d, col %d\n", i,
+              line, column);
+    }
+    Value* elements = arr.mutableData();
+    Interpreter::assignTo(opt, elements[i], std::move(rhs));
+}
+
+void Interpreter::assignIndex(Token opt, lin::Value& target,
+                              const lin::Value& index,
+                              const lin::Value& second, lin::Value rhs,
+                              const std::string& identName, int line,
+                              int column) {
+    if (!target.isType<lin::Matrix>()) {
+        // Assign within the element selected by the first index, which is
+        // made unique first like any element assigned to
+        lin::Value* element;
+        if (target.isType<lin::Dict>()) {
+            element = target.ref<lin::HashTable>().find(index);
+            if (element == nullptr) {
+                panic("KeyError: key %s not found at line %d, col %d\n",
+                      valueToStdString(index).c_str(), line, column);
+            }
+        } else {
+            subscript(target, index, identName, line, column);
+            if (!target.isType<lin::Array>()) {
+                panic(
+                    "TypeError: expects array type of variable %s "
+                    "at line %d, col %d\n",
+                    identName.c_str(), line, column);
+            }
+            element = target.ref<lin::ArrayData>().mutableData() +
+                      index.cast<long long>();
+        }
+        assignIndex(opt, *element, second, std::move(rhs), identName, line,
+                    column);
+        return;
+    }
+    auto& m = target.ref<lin::MatrixData>();
+    auto [i, j] = matrixIndices(m, index, second, line, column);
+    if (opt != TK_ASSIGN) {
+        lin::Value value = m.at(i, j);
+        Interpreter::assignTo(opt, value, std::move(rhs));
+        rhs = std::move(value);
+    }
+    if (!m.accepts(rhs)) {
+        if (rhs.isType<lin::BigInt>()) {
+            panic("ValueError: %s does not fit an element of int matrix %s "
+                  "at line %d, col %d\n",
+                  valueToStdString(rhs).c_str(), identName.c_str(), line,
+                  column);
+        }
+        panic("TypeError: can not store %s value into %s matrix %s at line "
+              "%d, col %d\n",
+              valueTypeName(rhs.type), m.isDouble() ? "double" : "int",
+              identName.c_str(), line, column);
+    }
+    m.set(i, j, rhs);
+}
+
 lin::Value FunCallExpr::eval(lin::Runtime* rt,
-                             std::deque<lin::Context*> ctxChain) {
+                             std::deque<lin::Context*>& ctxChain) {
+    if (auto* mutatorFunc = rt->getMutatorFunction(this->funcName);
+        mutatorFunc != nullptr) {
+        if (this->args.empty()) {
+            panic("ArgumentError: %s expects at least one argument\n",
+                  this->funcName.c_str());
+        }
+        // Update the variable named by first argument, other expressions are
+        // evaluated into a temporary value
+        lin::Value temp;
+        lin::Value* self = &temp;
+        if (typeid(*this->args[0]) == typeid(IdentExpr)) {
+            auto* ident = dynamic_cast<IdentExpr*>(this->args[0]);
+            auto* var = Interpreter::findVariable(ctxChain, ident->identName);
+            if (var == nullptr) {
+                panic(
+                    "RuntimeError: use of undefined variable \"%s\" at line "
+                    "%d, col %d\n",
+                    ident->identName.c_str(), ident->line, ident->column);
+            }
+            self = &var->value;
+        } else {
+            temp = evalExpr(this->args[0], rt, ctxChain);
+        }
+        std::vector<Value> arguments;
+        for (size_t i = 1; i < this->args.size(); i++) {
+            arguments.push_back(evalExpr(this->args[i], rt, ctxChain));
+        }
+        return mutatorFunc(rt, *self,
+                           lin::Arguments(arguments.data(), arguments.size()));
+    }
     if (auto* builtinFunc = rt->getBuiltinFunction(this->funcName);
         builtinFunc != nullptr) {
+        // Most builtin calls take a few arguments, evaluate them on stack
+        constexpr size_t kInlineArgs = 4;
+        if (this->args.size() <= kInlineArgs) {
+            Value arguments[kInlineArgs];
+            for (size_t i = 0; i < this->args.size(); i++) {
+                arguments[i] = evalExpr(this->args[i], rt, ctxChain);
+            }
+            return builtinFunc(rt, ctxChain,
+                               lin::Arguments(arguments, this->args.size()));
+        }
         std::vector<Value> arguments;
-        for (auto e : this->args) {
-            arguments.push_back(e->eval(rt, ctxChain));
+        for (auto& e : this->args) {
+            arguments.push_back(evalExpr(e, rt, ctxChain));
         }
-        return builtinFunc(rt, ctxChain, arguments);
+        return builtinFunc(rt, ctxChain,
+                           lin::Arguments(arguments.data(), arguments.size()));
     }
     if (auto* func = rt->getFunction(this->funcName); func != nullptr) {
         if (func->params.size() != this->args.size()) {
             panic("ArgumentError: expects %d arguments but got %d",
                   func->params.size(), this->args.size());
         }
-        return Interpreter::callFunction(rt, func, ctxChain, this->args);
+        // Evaluate argument values from caller's context chain
+        std::vector<Value> arguments;
+        for (auto& e : this->args) {
+            arguments.push_back(evalExpr(e, rt, ctxChain));
+        }
+        return Interpreter::callFunction(rt, func, std::move(arguments));
     }
 
     panic(
@@ -466,17 +974,130 @@ lin::Value FunCallExpr::eval(lin::Runtime* rt,
         this->funcName.c_str());
 }
 
+lin::Value LogicalExpr::eval(lin::Runtime* rt,
+                             std::deque<lin::Context*>& ctxChain) {
+    lin::Value lhs = evalExpr(this->lhs, rt, ctxChain);
+    if (!lhs.isType<lin::Bool>()) {
+        panic("TypeError: unexpected arguments of operator %s at line %d, "
+              "col %d\n",
+              opt == TK_LOGAND ? "&&" : "||", line, column);
+    }
+    // false && rhs and true || rhs are decided without evaluating rhs
+    if (lhs.cast<bool>() == (opt == TK_LOGOR)) {
+        return lhs;
+    }
+    lin::Value rhs = evalExpr(this->rhs, rt, ctxChain);
+    if (!rhs.isType<lin::Bool>()) {
+        panic("TypeError: unexpected arguments of operator %s at line %d, "
+              "col %d\n",
+              opt == TK_LOGAND ? "&&" : "||", line, column);
+    }
+    return rhs;
+}
+
 lin::Value BinaryExpr::eval(lin::Runtime* rt,
-                            std::deque<lin::Context*> ctxChain) {
+                            std::deque<lin::Context*>& ctxChain) {
     lin::Value lhs =
-        this->lhs ? this->lhs->eval(rt, ctxChain) : lin::Value(lin::Null);
+        this->lhs ? evalExpr(this->lhs, rt, ctxChain) : lin::Value(lin::Null);
     lin::Value rhs =
-        this->rhs ? this->rhs->eval(rt, ctxChain) : lin::Value(lin::Null);
+        this->rhs ? evalExpr(this->rhs, rt, ctxChain) : lin::Value(lin::Null);
     Token opt = this->opt;
 
     if (!lhs.isType<lin::Null>() && rhs.isType<lin::Null>()) {
         return Interpreter::calcUnaryExpr(lhs, opt, line, column);
     }
 
+    if (!quickened) {
+        if (lhs.isType<lin::Int>() && rhs.isType<lin::Int>()) {
+            if (++intHits == kQuickenThreshold) {
+                quickened = true;
+                replacement = Interpreter::quickenIntBinaryExpr(this);
+            }
+        } else {
+            intHits = 0;
+        }
+    }
     return Interpreter::calcBinaryExpr(lhs, opt, rhs, line, column);
 }
+
+Expression* Interpreter::quickenIntBinaryExpr(BinaryExpr* generic) {
+    switch (generic->opt) {
+        case TK_PLUS:
+            return new IntBinaryExpr<TK_PLUS>(generic);
+        case TK_MINUS:
+            return new IntBinaryExpr<TK_MINUS>(generic);
+        case TK_TIMES:
+            return new IntBinaryExpr<TK_TIMES>(generic);
+        case TK_DIV:
+            return new IntBinaryExpr<TK_DIV>(generic);
+        case TK_MOD:
+            return new IntBinaryExpr<TK_MOD>(generic);
+        case TK_EQ:
+            return new IntBinaryExpr<TK_EQ>(generic);
+        case TK_NE:
+            return new IntBinaryExpr<TK_NE>(generic);
+        case TK_GT:
+            return new IntBinaryExpr<TK_GT>(generic);
+        case TK_GE:
+            return new IntBinaryExpr<TK_GE>(generic);
+        case TK_LT:
+            return new IntBinaryExpr<TK_LT>(generic);
+        case TK_LE:
+            return new IntBinaryExpr<TK_LE>(generic);
+        default:
+            // Other operators keep running through the generic node
+            return nullptr;
+    }
+}
+
+template <Token _Opt>
+lin::Value IntBinaryExpr<_Opt>::eval(lin::Runtime* rt,
+                                     std::deque<lin::Context*>& ctxChain) {
+    lin::Value lhs = evalExpr(generic->lhs, rt, ctxChain);
+    lin::Value rhs = evalExpr(generic->rhs, rt, ctxChain);
+    if (lhs.isType<lin::Int>() && rhs.isType<lin::Int>()) {
+        long long l = lhs.cast<long long>(), r = rhs.cast<long long>();
+        switch (_Opt) {
+            case TK_PLUS:
+                return lin::addInts(l, r);
+            case TK_MINUS:
+                return lin::subInts(l, r);
+            case TK_TIMES:
+                return lin::mulInts(l, r);
+            case TK_DIV:
+            case TK_MOD:
+                // Zero divisors behave exactly as in the generic path
+                if (r == 0) {
+                    break;
+                }
+                return _Opt == TK_DIV ? lin::divInts(l, r)
+                                      : lin::modInts(l, r);
+            case TK_EQ:
+                return lin::Value(lin::Bool, l == r);
+            case TK_NE:
+                return lin::Value(lin::Bool, l != r);
+            case TK_GT:
+                return lin::Value(lin::Bool, l > r);
+            case TK_GE:
+                return lin::Value(lin::Bool, l >= r);
+            case TK_LT:
+                return lin::Value(lin::Bool, l < r);
+            case TK_LE:
+                return lin::Value(lin::Bool, l <= r);
+            default:
+                break;
+        }
+        return Interpreter::calcBinaryExpr(lhs, _Opt, rhs, line, column);
+    }
+    // Same as the generic node, which treats a null rhs as unary operator
+    lin::Value result =
+        !lhs.isType<lin::Null>() && rhs.isType<lin::Null>()
+            ? Interpreter::calcUnaryExpr(lhs, _Opt, line, column)
+            : Interpreter::calcBinaryExpr(lhs, _Opt, rhs, line, column);
+    if (!deoptimized) {
+        deoptimized = true;
+        replacement = generic;
+        rt->retireExpression(this);
+    }
+    return result;
+}
@@ -1,6 +1,8 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include "Lin.hpp"
+#include "Matrix.h"
 #include "Parser.h"
 
 class Interpreter {
@@ -11,14 +13,30 @@ public:
 public:
     void execute();
 
+    // Save a snapshot to path once the top-level statements starting at or
+    // before line ran, execution then goes on
+    void snapshotAfter(int line, std::string path);
+
 public:
+    static lin::Variable* findVariable(
+        const std::deque<lin::Context*>& ctxChain,
+        const std::string& identName);
+
     static void enterContext(std::deque<lin::Context*>& ctxChain);
 
     static void leaveContext(std::deque<lin::Context*>& ctxChain);
 
     static lin::Value callFunction(lin::Runtime* rt, lin::Function* f,
-                                   std::deque<lin::Context*> previousCtxChain,
-                                   std::vector<Expression*> args);
+                                   std::vector<lin::Value> args);
+    // Run the body of f regardless of its result cache
+    static lin::Value runFunction(lin::Runtime* rt, lin::Function* f,
+                                  std::vector<lin::Value> args);
+
+    // Run top-level statements within [first, last) in the global context
+    // which ctxChain starts with
+    static void runStatements(lin::Runtime* rt,
+                              std::deque<lin::Context*>& ctxChain,
+                              size_t first = 0, size_t last = SIZE_MAX);
 
     static lin::Value calcBinaryExpr(lin::Value lhs, Token opt, Value rhs,
                                      int line, int column);
@@ -26,6 +44,39 @@ public:
     static lin::Value calcUnaryExpr(lin::Value& lhs, Token opt, int line,
                                     int column);
     static lin::Value assignSwitch(Token opt, lin::Value lhs, lin::Value rhs);
+    static void assignTo(Token opt, lin::Value& target, lin::Value rhs);
+    static void assignIndex(Token opt, lin::Value& target,
+                            const lin::Value& index, lin::Value rhs,
+                            const std::string& identName, int line, int column);
+    // Assign an element of a matrix, or within an element of an array or dict
+    static void assignIndex(Token opt, lin::Value& target,
+                            const lin::Value& index, const lin::Value& second,
+                            lin::Value rhs, const std::string& identName,
+                            int line, int column);
+
+    // Checks shared by the interpreter and C++ code emitted ahead of time,
+    // they panic with the same messages at the position they are given
+    static lin::Value subscript(const lin::Value& base, const lin::Value& idx,
+                                const std::string& identName, int line,
+                                int column);
+    static lin::Value subscript(const lin::Value& base, const lin::Value& idx,
+                                const lin::Value& second,
+                                const std::string& identName, int line,
+                                int column);
+    // Checked position of a matrix element
+    static std::pair<size_t, size_t> matrixIndices(const lin::MatrixData& m,
+                                                   const lin::Value& idx,
+                                                   const lin::Value& second,
+                                                   int line, int column);
+    static long long sliceLength(const lin::Value& base, int line,
+                                 int column);
+    static long long sliceBound(const lin::Value& v, int line, int column);
+    static long long forBound(const lin::Value& v, const char* what,
+                              int line, int column);
+
+    // Specialized variant of an int only BinaryExpr or nullptr if its
+    // operator has none
+    static Expression* quickenIntBinaryExpr(BinaryExpr* generic);
 
 private:
     void parseCommandOption(int argc, char* argv) {}
@@ -34,4 +85,6 @@ private:
     std::deque<lin::Context*> ctxChain;
     lin::Runtime* rt;
     Parser* p;
+    int snapshotLine = -1;
+    std::string snapshotPath;
 };
@@ -0,0 +1,1305 @@
+#include "Jit.h"
+#include <climits>
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+#include "Interpreter.h"
+#include "Utils.hpp"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#include <sys/mman.h>
+#include <unistd.h>
+#define LIN_JIT_SUPPORTED 1
+#else
+#define LIN_JIT_SUPPORTED 0
+#endif
+
+namespace lin {
+// Loop iterations and function calls after which code counts as hot
+static constexpr int kHotLoop = 64;
+static constexpr int kHotFunction = 16;
+// Compiled variants per loop or function before it is left to interpreter
+static constexpr int kMaxVariants = 4;
+static constexpr size_t kMaxSlots = 256;
+
+namespace {
+struct RegionStats {
+    std::string where;
+    size_t codeSize;
+    long long entries;
+};
+
+struct JitStats {
+    bool enabled = LIN_JIT_SUPPORTED;
+    int loops = 0;
+    int functions = 0;
+    int rejected = 0;
+    long long guardMisses = 0;
+    long long entries = 0;
+    size_t codeBytes = 0;
+    std::vector<RegionStats> regions;
+} stats;
+
+//===----------------------------------------------------------------------===//
+// A minimal x86-64 assembler. Generated code keeps the slot array it gets in
+// rdi, evaluates expressions into rax and uses rcx, rdx and the stack as
+// scratch. Every variable lives in a 8 bytes slot, ints are 64 bits wide as
+// in the interpreter and bools are 0 or 1. Doubles are kept as their bits in
+// the same registers and slots, they only move to xmm0 and xmm1 for the
+// instruction computing on them. The stack pointer of the entry is kept in
+// rsi, so an int operation which overflows can leave the region from any
+// depth of its expression.
+//===----------------------------------------------------------------------===//
+enum Cond : uint8_t {
+    CondO = 0x0,
+    CondB = 0x2,
+    CondAE = 0x3,
+    CondE = 0x4,
+    CondNE = 0x5,
+    CondBE = 0x6,
+    CondA = 0x7,
+    CondP = 0xa,
+    CondNP = 0xb,
+    CondL = 0xc,
+    CondGE = 0xd,
+    CondLE = 0xe,
+    CondG = 0xf,
+};
+
+inline Cond invert(Cond cc) { return static_cast<Cond>(cc ^ 1); }
+
+class Assembler {
+public:
+    using Label = size_t;
+
+    Label newLabel() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+    void bind(Label l) { labels[l] = static_cast<long>(code.size()); }
+
+    void jmp(Label l) {
+        emit({0xe9});
+        fixup(l);
+    }
+    void jcc(Cond cc, Label l) {
+        emit({0x0f, static_cast<uint8_t>(0x80 | cc)});
+        fixup(l);
+    }
+
+    // Writes to 32 bits registers clear their upper half
+    void movEaxImm(int32_t imm) {
+        emit({0xb8});
+        emit32(imm);
+    }
+    void movRaxImm(int64_t imm) { movImm(0, imm); }
+    void movRcxImm(int64_t imm) { movImm(1, imm); }
+    void loadRax(int slot) { slotOp({0x48, 0x8b, 0x87}, slot); }
+    void loadRcx(int slot) { slotOp({0x48, 0x8b, 0x8f}, slot); }
+    void storeRax(int slot) { slotOp({0x48, 0x89, 0x87}, slot); }
+    void cmpRax(int slot) { slotOp({0x48, 0x3b, 0x87}, slot); }
+    void addRax(int slot) { slotOp({0x48, 0x03, 0x87}, slot); }
+    void addRaxImm(int32_t imm) {
+        emit({0x48, 0x05});
+        emit32(imm);
+    }
+    void decSlot(int slot) { slotOp({0x48, 0xff, 0x8f}, slot); }
+
+    void pushRax() { emit({0x50}); }
+    void popRax() { emit({0x58}); }
+    void movRcxRax() { emit({0x48, 0x89, 0xc1}); }
+    void movRaxRdx() { emit({0x48, 0x89, 0xd0}); }
+    void saveRsp() { emit({0x48, 0x89, 0xe6}); }
+    void restoreRsp() { emit({0x48, 0x89, 0xf4}); }
+
+    void addRaxRcx() { emit({0x48, 0x01, 0xc8}); }
+    void subRaxRcx() { emit({0x48, 0x29, 0xc8}); }
+    void imulRaxRcx() { emit({0x48, 0x0f, 0xaf, 0xc1}); }
+    void andRaxRcx() { emit({0x48, 0x21, 0xc8}); }
+    void orRaxRcx() { emit({0x48, 0x09, 0xc8}); }
+    // Signed rax / rcx, quotient in rax and remainder in rdx
+    void idivRcx() { emit({0x48, 0x99, 0x48, 0xf7, 0xf9}); }
+    void negRax() { emit({0x48, 0xf7, 0xd8}); }
+    void notRax() { emit({0x48, 0xf7, 0xd0}); }
+    void xorEaxOne() { emit({0x83, 0xf0, 0x01}); }
+    void xorEaxEax() { emit({0x31, 0xc0}); }
+
+    void cmpRaxRcx() { emit({0x48, 0x39, 0xc8}); }
+    void cmpRcxMinusOne() { emit({0x48, 0x83, 0xf9, 0xff}); }
+    void testRcxRcx() { emit({0x48, 0x85, 0xc9}); }
+    void testEaxEax() { emit({0x85, 0xc0}); }
+    void setccEax(Cond cc) {
+        emit({0x0f, static_cast<uint8_t>(0x90 | cc), 0xc0});
+        emit({0x0f, 0xb6, 0xc0});
+    }
+    // al = cc1 && cc2 or al = cc1 || cc2, zero extended to eax
+    void setccEaxBoth(Cond cc1, Cond cc2, bool both) {
+        emit({0x0f, static_cast<uint8_t>(0x90 | cc1), 0xc0});
+        emit({0x0f, static_cast<uint8_t>(0x90 | cc2), 0xc1});
+        emit({static_cast<uint8_t>(both ? 0x20 : 0x08), 0xc8});
+        emit({0x0f, 0xb6, 0xc0});
+    }
+
+    // Doubles: bits of rax and rcx go to xmm0 and xmm1, ints are converted
+    void movXmm0Rax() { emit({0x66, 0x48, 0x0f, 0x6e, 0xc0}); }
+    void movXmm1Rcx() { emit({0x66, 0x48, 0x0f, 0x6e, 0xc9}); }
+    void cvtXmm0Rax() { emit({0xf2, 0x48, 0x0f, 0x2a, 0xc0}); }
+    void cvtXmm1Rcx() { emit({0xf2, 0x48, 0x0f, 0x2a, 0xc9}); }
+    void movRaxXmm0() { emit({0x66, 0x48, 0x0f, 0x7e, 0xc0}); }
+    void addsd() { emit({0xf2, 0x0f, 0x58, 0xc1}); }
+    void subsd() { emit({0xf2, 0x0f, 0x5c, 0xc1}); }
+    void mulsd() { emit({0xf2, 0x0f, 0x59, 0xc1}); }
+    void divsd() { emit({0xf2, 0x0f, 0x5e, 0xc1}); }
+    // Unordered compares of xmm0 with xmm1 and of xmm1 with xmm0, a NaN
+    // operand sets ZF, PF and CF
+    void ucomisd() { emit({0x66, 0x0f, 0x2e, 0xc1}); }
+    void ucomisdSwapped() { emit({0x66, 0x0f, 0x2e, 0xc8}); }
+    // Negate the double in rax by flipping its sign bit
+    void btcRaxSign() { emit({0x48, 0x0f, 0xba, 0xf8, 0x3f}); }
+    void ret() { emit({0xc3}); }
+
+    // Resolve jumps, every label used must have been bound
+    std::vector<uint8_t>& finish() {
+        for (auto [pos, l] : fixups) {
+            int32_t rel = static_cast<int32_t>(labels[l] - (pos + 4));
+            memcpy(&code[pos], &rel, sizeof(rel));
+        }
+        fixups.clear();
+        return code;
+    }
+
+private:
+    void emit(std::initializer_list<uint8_t> bytes) {
+        code.insert(code.end(), bytes);
+    }
+    void emit32(int32_t v) {
+        uint8_t bytes[4];
+        memcpy(bytes, &v, sizeof(v));
+        code.insert(code.end(), bytes, bytes + 4);
+    }
+    // Sign extended 32 bits immediate if it fits, movabs otherwise
+    void movImm(uint8_t reg, int64_t imm) {
+        if (imm >= INT32_MIN && imm <= INT32_MAX) {
+            emit({0x48, 0xc7, static_cast<uint8_t>(0xc0 | reg)});
+            emit32(static_cast<int32_t>(imm));
+        } else {
+            emit({0x48, static_cast<uint8_t>(0xb8 | reg)});
+            uint8_t bytes[8];
+            memcpy(bytes, &imm, sizeof(imm));
+            code.insert(code.end(), bytes, bytes + 8);
+        }
+    }
+    void slotOp(std::initializer_list<uint8_t> opcode, int slot) {
+        emit(opcode);
+        emit32(slot * 8);
+    }
+    void fixup(Label l) {
+        fixups.emplace_back(code.size(), l);
+        emit32(0);
+    }
+
+    std::vector<uint8_t> code;
+    std::vector<long> labels;
+    std::vector<std::pair<size_t, Label>> fixups;
+};
+
+Expression* unwrap(Expression* e) {
+    while (auto* q = dynamic_cast<QuickenedExpr*>(e)) {
+        e = q->genericExpr();
+    }
+    return e;
+}
+
+bool isComparison(Token opt) {
+    return anyone(opt, TK_EQ, TK_NE, TK_LT, TK_LE, TK_GT, TK_GE);
+}
+
+int64_t doubleBits(double d) {
+    int64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return bits;
+}
+
+Cond conditionOf(Token opt) {
+    switch (opt) {
+        case TK_EQ:
+            return CondE;
+        case TK_NE:
+            return CondNE;
+        case TK_LT:
+            return CondL;
+        case TK_LE:
+            return CondLE;
+        case TK_GT:
+            return CondG;
+        default:
+            return CondGE;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Region compiler translates a loop or a function body into native code. It
+// mirrors the context chain with a stack of scopes at compile time, so names
+// resolve exactly as they would in the interpreter. Anything outside of the
+// int, double and bool subset makes the whole region fall back to the
+// interpreter.
+//===----------------------------------------------------------------------===//
+class RegionCompiler {
+public:
+    explicit RegionCompiler(JitRegion* region,
+                            const std::deque<Context*>* ctxChain)
+        : region(region), ctxChain(ctxChain) {
+        // Slot 0 receives the return value
+        slotTypes.push_back(Null);
+        scopes.emplace_back();
+        overflow = as.newLabel();
+        suspend = as.newLabel();
+        as.saveRsp();
+    }
+
+    bool compileWhile(WhileStmt* loop);
+    bool compileFor(ForStmt* loop, bool countsUp);
+    bool compileFunction(Function* f, const std::vector<Value>& args);
+
+    std::vector<uint8_t>& code() { return as.finish(); }
+
+private:
+    struct LoopLabels {
+        Assembler::Label breakLabel;
+        Assembler::Label continueLabel;
+    };
+
+    int newSlot(ValueType type);
+    int lookup(const std::string& name);
+    bool assign(const std::string& name, Token opt, ValueType type);
+
+    ValueType genExpr(Expression* e);
+    ValueType genOperands(BinaryExpr* e, ValueType& rhsType);
+    bool genCond(Expression* e, Assembler::Label falseLabel);
+    bool genStmt(Statement* stmt);
+    bool genStmts(const std::vector<Statement*>& stmts);
+    bool genScopedBlock(Block* block);
+    bool genReturn(ReturnStmt* stmt);
+    bool genFor(ForStmt* loop);
+    void genArithmetic(Token opt);
+    void genDivision(bool remainder);
+    // Operation on rax and rcx of which at least one is a double, returns the
+    // type of the result or Null if the interpreter would raise an error
+    ValueType genDoubleOperation(Token opt, ValueType lhsType,
+                                 ValueType rhsType);
+    // Compare doubles in rax and rcx, flags then hold cc of the returned
+    // condition unless NaN handling needs two conditions, then eax is set
+    bool genDoubleCompare(Token opt, Cond& cc);
+    // Take one iteration of the budget and jump back to header of the loop
+    // the region runs
+    void genBackEdge(Assembler::Label header);
+    // Copy the live-ins, and the counter of a ForStmt region, to their
+    // checkpoint slots at label checkpoint and go on at body. Generated once
+    // the region is complete, so every live-in is known.
+    void genCheckpoint(Assembler::Label checkpoint, Assembler::Label body);
+    void genExits();
+
+    Assembler as;
+    // Stubs leaving the region with ExitOverflow and ExitSuspend
+    Assembler::Label overflow;
+    Assembler::Label suspend;
+    JitRegion* region;
+    const std::deque<Context*>* ctxChain;
+    std::vector<std::unordered_map<std::string, int>> scopes;
+    std::vector<ValueType> slotTypes;
+    std::vector<LoopLabels> loops;
+};
+
+int RegionCompiler::newSlot(ValueType type) {
+    slotTypes.push_back(type);
+    return static_cast<int>(slotTypes.size() - 1);
+}
+
+// Slot of name or -1 if it is undefined, or -2 if it holds a value of a type
+// native code does not handle
+int RegionCompiler::lookup(const std::string& name) {
+    for (auto s = scopes.rbegin(); s != scopes.rend(); ++s) {
+        if (auto res = s->find(name); res != s->end()) {
+            return res->second;
+        }
+    }
+    if (ctxChain == nullptr) {
+        return -1;
+    }
+    auto* var = Interpreter::findVariable(*ctxChain, name);
+    if (var == nullptr) {
+        return -1;
+    }
+    if (!anyone(var->value.type, Int, Double, Bool)) {
+        return -2;
+    }
+    int slot = newSlot(var->value.type);
+    scopes.front()[name] = slot;
+    region->liveIns.push_back(name);
+    region->liveInTypes.push_back(var->value.type);
+    region->liveInSlots.push_back(slot);
+    return slot;
+}
+
+// Store eax of the given type into variable name
+bool RegionCompiler::assign(const std::string& name, Token opt,
+                            ValueType type) {
+    int slot = lookup(name);
+    if (slot == -2) {
+        return false;
+    }
+    if (slot == -1) {
+        // Assignments to unknown variables create them in innermost context,
+        // compound ones included
+        slot = newSlot(type);
+        scopes.back()[name] = slot;
+        region->absent.push_back(name);
+        as.storeRax(slot);
+        return true;
+    }
+    if (opt == TK_ASSIGN) {
+        if (slotTypes[slot] != type) {
+            return false;
+        }
+        as.storeRax(slot);
+        return true;
+    }
+    if (slotTypes[slot] == Double && anyone(type, Int, Double)) {
+        // The slot stays a double, whatever type the value added had
+        Token binaryOpt;
+        switch (opt) {
+            case TK_PLUS_AGN:
+                binaryOpt = TK_PLUS;
+                break;
+            case TK_MINUS_AGN:
+                binaryOpt = TK_MINUS;
+                break;
+            case TK_TIMES_AGN:
+                binaryOpt = TK_TIMES;
+                break;
+            case TK_DIV_AGN:
+                binaryOpt = TK_DIV;
+                break;
+            default:
+                return false;
+        }
+        as.movRcxRax();
+        as.loadRax(slot);
+        if (genDoubleOperation(binaryOpt, Double, type) == Null) {
+            return false;
+        }
+        as.storeRax(slot);
+        return true;
+    }
+    if (slotTypes[slot] != Int || type != Int) {
+        return false;
+    }
+    as.movRcxRax();
+    as.loadRax(slot);
+    switch (opt) {
+        case TK_PLUS_AGN:
+            genArithmetic(TK_PLUS);
+            break;
+        case TK_MINUS_AGN:
+            genArithmetic(TK_MINUS);
+            break;
+        case TK_TIMES_AGN:
+            genArithmetic(TK_TIMES);
+            break;
+        case TK_DIV_AGN:
+            genDivision(false);
+            break;
+        case TK_MOD_AGN:
+            genDivision(true);
+            break;
+        default:
+            return false;
+    }
+    as.storeRax(slot);
+    return true;
+}
+
+// rax op rcx for +, - and *, results which overflow leave the region
+void RegionCompiler::genArithmetic(Token opt) {
+    if (opt == TK_PLUS) {
+        as.addRaxRcx();
+    } else if (opt == TK_MINUS) {
+        as.subRaxRcx();
+    } else {
+        as.imulRaxRcx();
+    }
+    as.jcc(CondO, overflow);
+}
+
+// Quotient or remainder of rax / rcx. The one quotient which overflows is
+// -2^63 / -1, which traps in idiv, so a divisor of -1 negates instead. A zero
+// divisor leaves the region and the interpreter raises the error.
+void RegionCompiler::genDivision(bool remainder) {
+    auto general = as.newLabel();
+    auto done = as.newLabel();
+    as.testRcxRcx();
+    as.jcc(CondE, overflow);
+    as.cmpRcxMinusOne();
+    as.jcc(CondNE, general);
+    if (remainder) {
+        as.xorEaxEax();
+    } else {
+        as.negRax();
+        as.jcc(CondO, overflow);
+    }
+    as.jmp(done);
+    as.bind(general);
+    as.idivRcx();
+    if (remainder) {
+        as.movRaxRdx();
+    }
+    as.bind(done);
+}
+
+// Doubles compute like the interpreter's operators do: an int operand of +,
+// -, * and / is converted first, comparisons need doubles on both sides and
+// % is no double operator
+ValueType RegionCompiler::genDoubleOperation(Token opt, ValueType lhsType,
+                                             ValueType rhsType) {
+    if (isComparison(opt)) {
+        Cond cc;
+        if (lhsType != Double || rhsType != Double) {
+            return Null;
+        }
+        if (genDoubleCompare(opt, cc)) {
+            as.setccEax(cc);
+        }
+        return Bool;
+    }
+    if (!anyone(opt, TK_PLUS, TK_MINUS, TK_TIMES, TK_DIV) ||
+        !anyone(lhsType, Int, Double) || !anyone(rhsType, Int, Double)) {
+        return Null;
+    }
+    if (lhsType == Int) {
+        as.cvtXmm0Rax();
+    } else {
+        as.movXmm0Rax();
+    }
+    if (rhsType == Int) {
+        as.cvtXmm1Rcx();
+    } else {
+        as.movXmm1Rcx();
+    }
+    switch (opt) {
+        case TK_PLUS:
+            as.addsd();
+            break;
+        case TK_MINUS:
+            as.subsd();
+            break;
+        case TK_TIMES:
+            as.mulsd();
+            break;
+        default:
+            as.divsd();
+            break;
+    }
+    as.movRaxXmm0();
+    return Double;
+}
+
+// A comparison with NaN is false, only != is true. Ordered comparisons test
+// flags of ucomisd which a NaN leaves false. == and != need PF as well, they
+// set eax right away and return false.
+bool RegionCompiler::genDoubleCompare(Token opt, Cond& cc) {
+    as.movXmm0Rax();
+    as.movXmm1Rcx();
+    switch (opt) {
+        case TK_LT:
+        case TK_LE:
+            as.ucomisdSwapped();
+            cc = opt == TK_LT ? CondA : CondAE;
+            return true;
+        case TK_GT:
+        case TK_GE:
+            as.ucomisd();
+            cc = opt == TK_GT ? CondA : CondAE;
+            return true;
+        default:
+            as.ucomisd();
+            if (opt == TK_EQ) {
+                as.setccEaxBoth(CondE, CondNP, true);
+            } else {
+                as.setccEaxBoth(CondNE, CondP, false);
+            }
+            return false;
+    }
+}
+
+void RegionCompiler::genBackEdge(Assembler::Label header) {
+    as.decSlot(region->budgetSlot);
+    as.jcc(CondLE, suspend);
+    as.jmp(header);
+}
+
+void RegionCompiler::genCheckpoint(Assembler::Label checkpoint,
+                                   Assembler::Label body) {
+    as.bind(checkpoint);
+    for (size_t i = 0; i < region->liveInSlots.size(); i++) {
+        int slot = region->liveInSlots[i];
+        region->checkpointSlots.push_back(newSlot(slotTypes[slot]));
+        as.loadRax(slot);
+        as.storeRax(region->checkpointSlots.back());
+    }
+    if (region->counterSlot >= 0) {
+        region->counterCheckpoint = newSlot(Int);
+        as.loadRax(region->counterSlot);
+        as.storeRax(region->counterCheckpoint);
+    }
+    as.jmp(body);
+}
+
+// Normal exit of the region followed by the stubs of the other exits
+void RegionCompiler::genExits() {
+    as.movEaxImm(Jit::ExitNormal);
+    as.ret();
+    as.bind(overflow);
+    as.restoreRsp();
+    as.movEaxImm(Jit::ExitOverflow);
+    as.ret();
+    as.bind(suspend);
+    as.movEaxImm(Jit::ExitSuspend);
+    as.ret();
+}
+
+// Evaluate lhs into rax and rhs into rcx, returns type of lhs
+ValueType RegionCompiler::genOperands(BinaryExpr* e, ValueType& rhsType) {
+    ValueType lhsType = genExpr(e->lhs);
+    if (lhsType == Null) {
+        return Null;
+    }
+    // Literals and variables go straight to ecx, rest passes through stack
+    Expression* rhs = unwrap(e->rhs);
+    if (auto* lit = dynamic_cast<IntExpr*>(rhs)) {
+        as.movRcxImm(lit->literal);
+        rhsType = Int;
+    } else if (auto* lit = dynamic_cast<DoubleExpr*>(rhs)) {
+        as.movRcxImm(doubleBits(lit->literal));
+        rhsType = Double;
+    } else if (auto* ident = dynamic_cast<IdentExpr*>(rhs)) {
+        int slot = lookup(ident->identName);
+        if (slot < 0) {
+            return Null;
+        }
+        as.loadRcx(slot);
+        rhsType = slotTypes[slot];
+    } else {
+        as.pushRax();
+        rhsType = genExpr(rhs);
+        as.movRcxRax();
+        as.popRax();
+    }
+    return rhsType == Null ? Null : lhsType;
+}
+
+ValueType RegionCompiler::genExpr(Expression* e) {
+    e = unwrap(e);
+    if (auto* lit = dynamic_cast<IntExpr*>(e)) {
+        as.movRaxImm(lit->literal);
+        return Int;
+    }
+    if (auto* lit = dynamic_cast<DoubleExpr*>(e)) {
+        as.movRaxImm(doubleBits(lit->literal));
+        return Double;
+    }
+    if (auto* lit = dynamic_cast<BoolExpr*>(e)) {
+        as.movEaxImm(lit->literal ? 1 : 0);
+        return Bool;
+    }
+    if (auto* ident = dynamic_cast<IdentExpr*>(e)) {
+        int slot = lookup(ident->identName);
+        if (slot < 0) {
+            return Null;
+        }
+        as.loadRax(slot);
+        return slotTypes[slot];
+    }
+    if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+        auto end = as.newLabel();
+        if (genExpr(logical->lhs) != Bool) {
+            return Null;
+        }
+        as.testEaxEax();
+        as.jcc(logical->opt == TK_LOGAND ? CondE : CondNE, end);
+        if (genExpr(logical->rhs) != Bool) {
+            return Null;
+        }
+        as.bind(end);
+        return Bool;
+    }
+    auto* binary = dynamic_cast<BinaryExpr*>(e);
+    if (binary == nullptr) {
+        return Null;
+    }
+    if (binary->rhs == nullptr) {
+        ValueType type = genExpr(binary->lhs);
+        if (binary->opt == TK_MINUS && type == Int) {
+            as.negRax();
+            as.jcc(CondO, overflow);
+        } else if (binary->opt == TK_MINUS && type == Double) {
+            as.btcRaxSign();
+        } else if (binary->opt == TK_BITNOT && type == Int) {
+            as.notRax();
+        } else if (binary->opt == TK_LOGNOT && type == Bool) {
+            as.xorEaxOne();
+        } else {
+            return Null;
+        }
+        return type;
+    }
+
+    ValueType rhsType;
+    ValueType lhsType = genOperands(binary, rhsType);
+    if (lhsType == Null) {
+        return Null;
+    }
+    if (lhsType == Double || rhsType == Double) {
+        return genDoubleOperation(binary->opt, lhsType, rhsType);
+    }
+    if (lhsType != rhsType) {
+        return Null;
+    }
+    if (isComparison(binary->opt)) {
+        if (lhsType == Bool && !anyone(binary->opt, TK_EQ, TK_NE)) {
+            return Null;
+        }
+        as.cmpRaxRcx();
+        as.setccEax(conditionOf(binary->opt));
+        return Bool;
+    }
+    if (lhsType != Int) {
+        return Null;
+    }
+    switch (binary->opt) {
+        case TK_PLUS:
+        case TK_MINUS:
+        case TK_TIMES:
+            genArithmetic(binary->opt);
+            break;
+        case TK_DIV:
+            genDivision(false);
+            break;
+        case TK_MOD:
+            genDivision(true);
+            break;
+        case TK_BITAND:
+            as.andRaxRcx();
+            break;
+        case TK_BITOR:
+            as.orRaxRcx();
+            break;
+        default:
+            return Null;
+    }
+    return Int;
+}
+
+// Jump to falseLabel unless e is true, comparisons jump on flags directly
+bool RegionCompiler::genCond(Expression* e, Assembler::Label falseLabel) {
+    e = unwrap(e);
+    if (auto* binary = dynamic_cast<BinaryExpr*>(e);
+        binary != nullptr && binary->rhs != nullptr &&
+        isComparison(binary->opt)) {
+        ValueType rhsType;
+        ValueType lhsType = genOperands(binary, rhsType);
+        if (lhsType == Null || lhsType != rhsType ||
+            (lhsType == Bool && !anyone(binary->opt, TK_EQ, TK_NE))) {
+            return false;
+        }
+        if (lhsType == Double) {
+            if (Cond cc; genDoubleCompare(binary->opt, cc)) {
+                as.jcc(invert(cc), falseLabel);
+            } else {
+                as.testEaxEax();
+                as.jcc(CondE, falseLabel);
+            }
+            return true;
+        }
+        as.cmpRaxRcx();
+        as.jcc(invert(conditionOf(binary->opt)), falseLabel);
+        return true;
+    }
+    if (genExpr(e) != Bool) {
+        return false;
+    }
+    as.testEaxEax();
+    as.jcc(CondE, falseLabel);
+    return true;
+}
+
+bool RegionCompiler::genStmts(const std::vector<Statement*>& stmts) {
+    for (auto* stmt : stmts) {
+        if (!genStmt(stmt)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RegionCompiler::genScopedBlock(Block* block) {
+    scopes.emplace_back();
+    bool ok = genStmts(block->stmts);
+    scopes.pop_back();
+    return ok;
+}
+
+bool RegionCompiler::genReturn(ReturnStmt* stmt) {
+    if (stmt->ret == nullptr) {
+        as.movEaxImm(Jit::ExitReturnNull);
+        as.ret();
+        return true;
+    }
+    ValueType type = genExpr(stmt->ret);
+    if (type == Null ||
+        (region->returnType != Null && region->returnType != type)) {
+        return false;
+    }
+    region->returnType = type;
+    as.storeRax(0);
+    as.movEaxImm(Jit::ExitReturnValue);
+    as.ret();
+    return true;
+}
+
+bool RegionCompiler::genFor(ForStmt* loop) {
+    region->innerLoops = true;
+    // Step has to be a constant, its sign decides the loop condition and a
+    // zero step is an error left to the interpreter
+    long long stride = 1;
+    if (loop->step != nullptr) {
+        Expression* step = unwrap(loop->step);
+        auto* neg = dynamic_cast<BinaryExpr*>(step);
+        if (neg != nullptr && neg->rhs == nullptr && neg->opt == TK_MINUS) {
+            step = unwrap(neg->lhs);
+        }
+        auto* lit = dynamic_cast<IntExpr*>(step);
+        if (lit == nullptr || lit->literal == 0) {
+            return false;
+        }
+        stride = neg != nullptr ? -lit->literal : lit->literal;
+        if (stride < INT32_MIN || stride > INT32_MAX) {
+            return false;
+        }
+    }
+
+    int counter = newSlot(Int);
+    int end = newSlot(Int);
+    if (genExpr(loop->lo) != Int) {
+        return false;
+    }
+    as.storeRax(counter);
+    if (genExpr(loop->hi) != Int) {
+        return false;
+    }
+    as.storeRax(end);
+
+    // Loop variable always lives in the loop's own context
+    scopes.emplace_back();
+    int var = newSlot(Int);
+    scopes.back()[loop->identName] = var;
+    auto header = as.newLabel();
+    auto next = as.newLabel();
+    auto exit = as.newLabel();
+    as.bind(header);
+    as.loadRax(counter);
+    as.cmpRax(end);
+    as.jcc(stride > 0 ? CondGE : CondLE, exit);
+    as.storeRax(var);
+    loops.push_back({exit, next});
+    bool ok = genStmts(loop->block->stmts);
+    loops.pop_back();
+    scopes.pop_back();
+    // Stepping beyond the range of ints ends the loop in the interpreter
+    as.bind(next);
+    as.loadRax(counter);
+    as.addRaxImm(static_cast<int32_t>(stride));
+    as.jcc(CondO, overflow);
+    as.storeRax(counter);
+    as.jmp(header);
+    as.bind(exit);
+    return ok;
+}
+
+bool RegionCompiler::genStmt(Statement* stmt) {
+    if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+        Expression* e = unwrap(s->expr);
+        if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+            auto* ident = dynamic_cast<IdentExpr*>(assign->lhs);
+            if (ident == nullptr) {
+                return false;
+            }
+            ValueType type = genExpr(assign->rhs);
+            return type != Null && this->assign(ident->identName, assign->opt,
+                                                type);
+        }
+        // Expressions of the subset have no side effects but may trap
+        return genExpr(e) != Null;
+    }
+    if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+        auto elseLabel = as.newLabel();
+        auto end = as.newLabel();
+        if (!genCond(s->cond, elseLabel) || !genScopedBlock(s->block)) {
+            return false;
+        }
+        as.jmp(end);
+        as.bind(elseLabel);
+        if (s->elseBlock != nullptr && !genScopedBlock(s->elseBlock)) {
+            return false;
+        }
+        as.bind(end);
+        return true;
+    }
+    if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+        region->innerLoops = true;
+        auto header = as.newLabel();
+        auto exit = as.newLabel();
+        as.bind(header);
+        if (!genCond(s->cond, exit)) {
+            return false;
+        }
+        loops.push_back({exit, header});
+        bool ok = genScopedBlock(s->block);
+        loops.pop_back();
+        as.jmp(header);
+        as.bind(exit);
+        return ok;
+    }
+    if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+        return genFor(s);
+    }
+    if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+        return genReturn(s);
+    }
+    if (dynamic_cast<BreakStmt*>(stmt) != nullptr && !loops.empty()) {
+        as.jmp(loops.back().breakLabel);
+        return true;
+    }
+    if (dynamic_cast<ContinueStmt*>(stmt) != nullptr && !loops.empty()) {
+        as.jmp(loops.back().continueLabel);
+        return true;
+    }
+    return false;
+}
+
+// The loop has been entered already, so its body context is the innermost
+// one of the chain and the compile time base scope stands for it
+bool RegionCompiler::compileWhile(WhileStmt* loop) {
+    region->budgetSlot = newSlot(Int);
+    auto header = as.newLabel();
+    auto checkpoint = as.newLabel();
+    auto body = as.newLabel();
+    auto next = as.newLabel();
+    auto exit = as.newLabel();
+    as.bind(header);
+    if (!genCond(loop->cond, exit)) {
+        return false;
+    }
+    // An iteration begins once the condition held, as Jit::runLoop does
+    as.jmp(checkpoint);
+    as.bind(body);
+    loops.push_back({exit, next});
+    if (!genStmts(loop->block->stmts)) {
+        return false;
+    }
+    as.bind(next);
+    genBackEdge(header);
+    as.bind(exit);
+    genExits();
+    genCheckpoint(checkpoint, body);
+    return slotTypes.size() <= kMaxSlots;
+}
+
+bool RegionCompiler::compileFor(ForStmt* loop, bool countsUp) {
+    region->counterSlot = newSlot(Int);
+    region->endSlot = newSlot(Int);
+    region->strideSlot = newSlot(Int);
+    region->budgetSlot = newSlot(Int);
+    region->countsUp = countsUp;
+    int var = lookup(loop->identName);
+    if (var < 0 || slotTypes[var] != Int) {
+        return false;
+    }
+
+    auto header = as.newLabel();
+    auto checkpoint = as.newLabel();
+    auto body = as.newLabel();
+    auto next = as.newLabel();
+    auto exit = as.newLabel();
+    as.bind(header);
+    as.loadRax(region->counterSlot);
+    as.cmpRax(region->endSlot);
+    as.jcc(countsUp ? CondGE : CondLE, exit);
+    as.jmp(checkpoint);
+    as.bind(body);
+    as.loadRax(region->counterSlot);
+    as.storeRax(var);
+    loops.push_back({exit, next});
+    if (!genStmts(loop->block->stmts)) {
+        return false;
+    }
+    as.bind(next);
+    as.loadRax(region->counterSlot);
+    as.addRax(region->strideSlot);
+    as.jcc(CondO, overflow);
+    as.storeRax(region->counterSlot);
+    genBackEdge(header);
+    as.bind(exit);
+    genExits();
+    genCheckpoint(checkpoint, body);
+    return slotTypes.size() <= kMaxSlots;
+}
+
+bool RegionCompiler::compileFunction(Function* f,
+                                     const std::vector<Value>& args) {
+    for (size_t i = 0; i < f->params.size(); i++) {
+        if (!anyone(args[i].type, Int, Double, Bool)) {
+            return false;
+        }
+        int slot = newSlot(args[i].type);
+        // Like createVariable, a repeated parameter name keeps first value
+        scopes.front().emplace(f->params[i], slot);
+        region->liveIns.push_back(f->params[i]);
+        region->liveInTypes.push_back(args[i].type);
+        region->liveInSlots.push_back(slot);
+    }
+    if (!genStmts(f->block->stmts)) {
+        return false;
+    }
+    genExits();
+    return slotTypes.size() <= kMaxSlots;
+}
+
+//===----------------------------------------------------------------------===//
+// Runtime side of the JIT, guarding entries and moving values between
+// variables and slots
+//===----------------------------------------------------------------------===//
+bool install(JitRegion* region, std::vector<uint8_t>& code) {
+#if LIN_JIT_SUPPORTED
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+    memcpy(memory, code.data(), code.size());
+    // Never writable and executable at the same time
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+    region->memory = memory;
+    region->memorySize = size;
+    region->codeSize = code.size();
+    region->code = reinterpret_cast<JitRegion::NativeCode>(memory);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool guardsHold(const JitRegion* region,
+                const std::deque<Context*>& ctxChain,
+                std::vector<Variable*>& vars) {
+    vars.clear();
+    for (size_t i = 0; i < region->liveIns.size(); i++) {
+        auto* var = Interpreter::findVariable(ctxChain, region->liveIns[i]);
+        if (var == nullptr || var->value.type != region->liveInTypes[i]) {
+            return false;
+        }
+        vars.push_back(var);
+    }
+    for (auto& name : region->absent) {
+        if (Interpreter::findVariable(ctxChain, name) != nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void loadSlot(int64_t* slots, int slot, const Value& v) {
+    switch (v.type) {
+        case Int:
+            slots[slot] = v.cast<long long>();
+            break;
+        case Double:
+            slots[slot] = doubleBits(v.cast<double>());
+            break;
+        default:
+            slots[slot] = v.cast<bool>();
+            break;
+    }
+}
+
+double slotDouble(const int64_t* slots, int slot) {
+    double d;
+    memcpy(&d, &slots[slot], sizeof(d));
+    return d;
+}
+
+Value slotValue(const int64_t* slots, int slot, ValueType type) {
+    long long v = slots[slot];
+    switch (type) {
+        case Int:
+            return Value(Int, v);
+        case Double:
+            return Value(Double, slotDouble(slots, slot));
+        default:
+            return Value(Bool, v != 0);
+    }
+}
+
+int runRegion(JitRegion* region, int64_t* slots,
+              const std::vector<Variable*>& vars) {
+    for (size_t i = 0; i < vars.size(); i++) {
+        loadSlot(slots, region->liveInSlots[i], vars[i]->value);
+        // The condition of a WhileStmt is checked again before the first
+        // checkpoint is taken
+        loadSlot(slots, region->checkpointSlots[i], vars[i]->value);
+    }
+    if (region->counterCheckpoint >= 0) {
+        slots[region->counterCheckpoint] = slots[region->counterSlot];
+    }
+    stats.entries++;
+    stats.regions[region->statIndex].entries++;
+    int exit = region->code(slots);
+    // The iteration which overflowed is left to the interpreter
+    const auto& from = exit == Jit::ExitOverflow ? region->checkpointSlots
+                                                 : region->liveInSlots;
+    for (size_t i = 0; i < vars.size(); i++) {
+        int slot = from[i];
+        switch (region->liveInTypes[i]) {
+            case Int:
+                vars[i]->value.ref<long long>() = slots[slot];
+                break;
+            case Double:
+                vars[i]->value.ref<double>() = slotDouble(slots, slot);
+                break;
+            default:
+                vars[i]->value.ref<bool>() = slots[slot] != 0;
+                break;
+        }
+    }
+    return exit;
+}
+
+void addRegion(Runtime* rt, JitProfile& prof, JitRegion* region,
+               std::string where) {
+    region->next = prof.regions;
+    region->statIndex = stats.regions.size();
+    prof.regions = region;
+    rt->addJitRegion(region);
+    stats.codeBytes += region->codeSize;
+    stats.regions.push_back({std::move(where), region->codeSize, 0});
+}
+
+// Find a variant of a hot loop whose guards hold, compile one if there is
+// none and the loop did not run out of variants
+template <typename _LoopStmt, typename _Compile, typename _Fits>
+JitRegion* selectLoopRegion(Runtime* rt, _LoopStmt* loop,
+                            std::deque<Context*>& ctxChain,
+                            std::vector<Variable*>& vars, _Fits fits,
+                            _Compile compile) {
+    auto& prof = loop->jit;
+    if (prof.hotness < kHotLoop) {
+        prof.hotness++;
+        return nullptr;
+    }
+    int variants = 0;
+    for (auto* r = prof.regions; r != nullptr; r = r->next, variants++) {
+        if (fits(r) && guardsHold(r, ctxChain, vars)) {
+            return r;
+        }
+    }
+    if (variants > 0) {
+        stats.guardMisses++;
+    }
+    if (variants == kMaxVariants) {
+        prof.rejected = true;
+        return nullptr;
+    }
+    auto* region = new JitRegion;
+    RegionCompiler compiler(region, &ctxChain);
+    if (!compile(compiler) || !install(region, compiler.code())) {
+        delete region;
+        prof.rejected = true;
+        stats.rejected++;
+        return nullptr;
+    }
+    stats.loops++;
+    addRegion(rt, prof, region, "loop at line " + std::to_string(loop->line));
+    guardsHold(region, ctxChain, vars);
+    return region;
+}
+
+ExecResult loopResult(const JitRegion* region, const int64_t* slots,
+                      int exit) {
+    if (exit == Jit::ExitSuspend) {
+        return ExecResult(ExecContinue);
+    }
+    if (exit == Jit::ExitReturnValue) {
+        return ExecResult(ExecReturn, slotValue(slots, 0, region->returnType));
+    }
+    if (exit == Jit::ExitReturnNull) {
+        return ExecResult(ExecReturn, Value(Null));
+    }
+    return ExecResult(ExecNormal);
+}
+}  // namespace
+
+JitRegion::~JitRegion() {
+#if LIN_JIT_SUPPORTED
+    if (memory != nullptr) {
+        munmap(memory, memorySize);
+    }
+#endif
+}
+
+bool Jit::enabled() { return stats.enabled; }
+
+void Jit::setEnabled(bool on) { stats.enabled = on && LIN_JIT_SUPPORTED; }
+
+void Jit::dumpStats(std::ostream& os) {
+    os << "jit: " << (stats.enabled ? "enabled" : "disabled") << ", "
+       << stats.loops << " loops and " << stats.functions
+       << " functions compiled into " << stats.codeBytes << " bytes\n";
+    os << "jit: " << stats.rejected << " regions rejected, "
+       << stats.guardMisses << " guard misses, " << stats.entries
+       << " native entries\n";
+    for (auto& r : stats.regions) {
+        os << "jit:   " << r.where << ", " << r.codeSize << " bytes, "
+           << r.entries << " entries\n";
+    }
+}
+
+bool Jit::runLoop(Runtime* rt, WhileStmt* loop,
+                  std::deque<Context*>& ctxChain, ExecResult& result,
+                  long long* budget) {
+    if (loop->jit.rejected) {
+        return false;
+    }
+    std::vector<Variable*> vars;
+    auto* region = selectLoopRegion(
+        rt, loop, ctxChain, vars, [](JitRegion*) { return true; },
+        [&](RegionCompiler& c) { return c.compileWhile(loop); });
+    if (region == nullptr || (budget != nullptr && region->innerLoops)) {
+        return false;
+    }
+    int64_t slots[kMaxSlots];
+    long long entryBudget = budget != nullptr ? *budget : LLONG_MAX;
+    slots[region->budgetSlot] = entryBudget;
+    int exit = runRegion(region, slots, vars);
+    if (budget != nullptr) {
+        *budget = slots[region->budgetSlot];
+    }
+    if (exit == ExitOverflow) {
+        // A loop overflowing right away would only overflow again
+        loop->jit.rejected = slots[region->budgetSlot] == entryBudget;
+        return false;
+    }
+    result = loopResult(region, slots, exit);
+    return true;
+}
+
+bool Jit::runLoop(Runtime* rt, ForStmt* loop, std::deque<Context*>& ctxChain,
+                  long long& counter, long long end, long long stride,
+                  ExecResult& result, long long* budget) {
+    if (loop->jit.rejected) {
+        return false;
+    }
+    std::vector<Variable*> vars;
+    bool countsUp = stride > 0;
+    auto* region = selectLoopRegion(
+        rt, loop, ctxChain, vars,
+        [&](JitRegion* r) { return r->countsUp == countsUp; },
+        [&](RegionCompiler& c) { return c.compileFor(loop, countsUp); });
+    if (region == nullptr || (budget != nullptr && region->innerLoops)) {
+        return false;
+    }
+    int64_t slots[kMaxSlots];
+    long long entryBudget = budget != nullptr ? *budget : LLONG_MAX;
+    slots[region->counterSlot] = counter;
+    slots[region->endSlot] = end;
+    slots[region->strideSlot] = stride;
+    slots[region->budgetSlot] = entryBudget;
+    int exit = runRegion(region, slots, vars);
+    if (budget != nullptr) {
+        *budget = slots[region->budgetSlot];
+    }
+    if (exit == ExitOverflow) {
+        loop->jit.rejected = slots[region->budgetSlot] == entryBudget;
+        counter = slots[region->counterCheckpoint];
+        return false;
+    }
+    counter = slots[region->counterSlot];
+    result = loopResult(region, slots, exit);
+    return true;
+}
+
+bool Jit::callFunction(Runtime* rt, Function* f,
+                       const std::vector<Value>& args, Value& result,
+                       bool bounded) {
+    auto& prof = f->jit;
+    if (prof.rejected || args.size() != f->params.size()) {
+        return false;
+    }
+    if (prof.hotness < kHotFunction) {
+        prof.hotness++;
+        return false;
+    }
+    JitRegion* region = prof.regions;
+    int variants = 0;
+    for (; region != nullptr; region = region->next, variants++) {
+        size_t i = 0;
+        while (i < args.size() && args[i].type == region->liveInTypes[i]) {
+            i++;
+        }
+        if (i == args.size()) {
+            break;
+        }
+    }
+    if (region == nullptr) {
+        if (variants > 0) {
+            stats.guardMisses++;
+        }
+        if (variants == kMaxVariants) {
+            prof.rejected = true;
+            return false;
+        }
+        region = new JitRegion;
+        RegionCompiler compiler(region, nullptr);
+        if (!compiler.compileFunction(f, args) ||
+            !install(region, compiler.code())) {
+            delete region;
+            prof.rejected = true;
+            stats.rejected++;
+            return false;
+        }
+        stats.functions++;
+        addRegion(rt, prof, region, "function " + f->name);
+    }
+    if (bounded && region->innerLoops) {
+        return false;
+    }
+
+    int64_t slots[kMaxSlots];
+    for (size_t i = 0; i < args.size(); i++) {
+        loadSlot(slots, region->liveInSlots[i], args[i]);
+    }
+    stats.entries++;
+    stats.regions[region->statIndex].entries++;
+    int exit = region->code(slots);
+    if (exit == ExitOverflow) {
+        // Other arguments may well fit, the function stays compiled
+        return false;
+    }
+    result = exit == ExitReturnValue ? slotValue(slots, 0, region->returnType)
+                                     : Value(Null);
+    return true;
+}
+}  // namespace lin
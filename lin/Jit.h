@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Ast.h"
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Baseline JIT of lin. Loops and functions which turn hot are compiled to
+// x86-64 machine code if they only compute with int, double and bool values,
+// doubles on SSE2 scalar instructions. The code is specialized for the types
+// variables had when it was compiled, these are guarded on every entry and
+// the interpreter simply keeps going whenever no compiled variant fits.
+//===----------------------------------------------------------------------===//
+struct JitRegion {
+    using NativeCode = int (*)(int64_t* slots);
+
+    explicit JitRegion() = default;
+    ~JitRegion();
+
+    NativeCode code{};
+    void* memory{};
+    size_t memorySize = 0;
+    size_t codeSize = 0;
+
+    // Variables loaded from the context chain (or arguments of a function) on
+    // entry and stored back on exit
+    std::vector<std::string> liveIns;
+    std::vector<ValueType> liveInTypes;
+    std::vector<int> liveInSlots;
+    // Variables created by the region itself, they must not exist on entry
+    std::vector<std::string> absent;
+    ValueType returnType = Null;
+
+    // Hidden slots of a ForStmt region which takes over the loop counter
+    int counterSlot = -1;
+    int endSlot = -1;
+    int strideSlot = -1;
+    bool countsUp = true;
+    // Hidden slot of a loop region counting down the iterations it may take
+    int budgetSlot = -1;
+    // Hidden slots of a loop region holding live-ins, and the counter of a
+    // ForStmt region, as they were when the current iteration began
+    std::vector<int> checkpointSlots;
+    int counterCheckpoint = -1;
+    // Set if the region runs loops of its own, no budget limits them
+    bool innerLoops = false;
+
+    size_t statIndex = 0;
+    JitRegion* next{};
+};
+
+class Jit {
+public:
+    // Native code exit codes. An int operation which overflowed or divided by
+    // zero leaves the region, the interpreter redoes its work computing a
+    // BigInt or raising the error: a loop stores variables back as they were
+    // when the iteration began and only that iteration is redone, a function
+    // stores nothing back and the whole call is redone. A loop whose budget
+    // ran out leaves between two iterations with variables stored back.
+    enum ExitCode {
+        ExitNormal = 0,
+        ExitReturnValue = 1,
+        ExitReturnNull = 2,
+        ExitOverflow = 3,
+        ExitSuspend = 4,
+    };
+
+    static bool enabled();
+    static void setEnabled(bool on);
+    static void dumpStats(std::ostream& os);
+
+    // Called at the top of every loop iteration, runs the rest of the loop
+    // natively once it is hot. Returns false if the interpreter should carry
+    // on with this iteration.
+    //
+    // Given a budget, native code takes at most that many iterations, at
+    // least one, and subtracts the ones it took. Loops with loops inside are
+    // left to the interpreter then. A loop which used up the budget is
+    // suspended between two iterations, result is ExecContinue and the loop
+    // goes on once it is entered again with counter advanced.
+    //
+    // An iteration which overflowed returns false as well, variables and
+    // counter are those it began with. Native code takes the loop over again
+    // from the next iteration on, unless the overflow came before native code
+    // finished any iteration.
+    static bool runLoop(Runtime* rt, WhileStmt* loop,
+                        std::deque<Context*>& ctxChain, ExecResult& result,
+                        long long* budget = nullptr);
+    static bool runLoop(Runtime* rt, ForStmt* loop,
+                        std::deque<Context*>& ctxChain, long long& counter,
+                        long long end, long long stride, ExecResult& result,
+                        long long* budget = nullptr);
+
+    // Call f natively if it is hot and compiled for types of args. Bounded
+    // calls only run code without loops, which is done in a short while.
+    static bool callFunction(Runtime* rt, Function* f,
+                             const std::vector<Value>& args, Value& result,
+                             bool bounded = false);
+};
+}  // namespace lin
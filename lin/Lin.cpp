@@ -1,38 +1,151 @@
+#include "Ast.h"
+#include "Binding.hpp"
 #include "Builtin.h"
+#include "Jit.h"
 #include "Lin.hpp"
+#include "Memo.h"
 #include "Utils.hpp"
 
 namespace lin {
+namespace {
+// Either operand is a BigInt and the other one an Int or BigInt
+bool bigIntOperands(const Value& lhs, const Value& rhs) {
+    return (lhs.isType<lin::BigInt>() &&
+            (rhs.isType<lin::Int>() || rhs.isType<lin::BigInt>())) ||
+           (lhs.isType<lin::Int>() && rhs.isType<lin::BigInt>());
+}
+
+bool isInteger(const Value& v) {
+    return v.isType<lin::Int>() || v.isType<lin::BigInt>();
+}
+
+double integerToDouble(const Value& v) {
+    return v.isType<lin::Int>() ? static_cast<double>(v.cast<long long>())
+                                : v.ref<BigIntData>().toDouble();
+}
+}  // namespace
 
 Context::~Context() {
     for (auto v : vars) {
         delete v.second;
     }
+    for (auto f : funcs) {
+        // Imported functions belong to the runtime of their module
+        if (f.second->home == nullptr || f.second->home == this) {
+            delete f.second;
+        }
+    }
 }
 
 Runtime::Runtime() {
     builtin["print"] = &lin_builtin_print;
     builtin["println"] = &lin_builtin_println;
     builtin["typeof"] = &lin_builtin_typeof;
-    builtin["input"] = &lin_builtin_input;
+    builtin["input"] = &bindNative<&lin_builtin_input>;
+    builtin["slice"] = &bindNative<&lin_builtin_slice>;
     builtin["length"] = &lin_builtin_length;
+    builtin["keys"] = &lin_builtin_keys;
+    builtin["has"] = &lin_builtin_has;
+    builtin["sort"] = &bindNative<&lin_builtin_sort>;
+    builtin["sort_by"] = &lin_builtin_sort_by;
+    builtin["bsearch"] = &bindNative<&lin_builtin_bsearch>;
+    builtin["min"] = &bindNative<&lin_builtin_min>;
+    builtin["max"] = &bindNative<&lin_builtin_max>;
+    builtin["sum"] = &bindNative<&lin_builtin_sum>;
+    builtin["prefix_sum"] = &bindNative<&lin_builtin_prefix_sum>;
+    builtin["reverse"] = &bindNative<&lin_builtin_reverse>;
+    builtin["memstats"] = &lin_builtin_memstats;
+    builtin["snapshot"] = &lin_builtin_snapshot;
+    builtin["matrix"] = &bindNative<&lin_builtin_matrix>;
+    builtin["to_matrix"] = &bindNative<&lin_builtin_to_matrix>;
+    builtin["shape"] = &bindNative<&lin_builtin_shape>;
+    builtin["matmul"] = &bindNative<&lin_builtin_matmul>;
+    builtin["transpose"] = &bindNative<&lin_builtin_transpose>;
+    builtin["row_sum"] = &bindNative<&lin_builtin_row_sum>;
+    builtin["row_min"] = &bindNative<&lin_builtin_row_min>;
+    builtin["row_max"] = &bindNative<&lin_builtin_row_max>;
+    builtin["col_sum"] = &bindNative<&lin_builtin_col_sum>;
+    builtin["col_min"] = &bindNative<&lin_builtin_col_min>;
+    builtin["col_max"] = &bindNative<&lin_builtin_col_max>;
+    mutator["remove"] = &lin_builtin_remove;
+    mutator["fill"] = &lin_builtin_fill;
+}
+
+Runtime::~Runtime() {
+    for (auto* stmt : stmts) {
+        delete stmt;
+    }
+    for (auto* expr : retired) {
+        delete expr;
+    }
+    for (auto* region : jitRegions) {
+        delete region;
+    }
+    for (auto* cache : memoCaches) {
+        delete cache;
+    }
+    Heap::collect();
+}
+
+void Runtime::retireExpression(Expression* expr) { retired.push_back(expr); }
+
+void Runtime::addJitRegion(JitRegion* region) { jitRegions.push_back(region); }
+
+void Runtime::addMemoCache(MemoCache* cache) { memoCaches.push_back(cache); }
+
+void Runtime::addBuiltinFunction(const std::string& name, BuiltinFuncType f) {
+    builtin[name] = f;
 }
 
 bool Runtime::hasBuiltinFunction(const std::string& name) {
-    return builtin.count(name) == 1;
+    return builtin.count(name) == 1 || mutator.count(name) == 1;
 }
 
 Runtime::BuiltinFuncType Runtime::getBuiltinFunction(const std::string& name) {
     if (auto res = builtin.find(name); res != builtin.end()) {
         return res->second;
     }
-    return builtin[name];
+    return nullptr;
+}
+
+Runtime::MutatorFuncType Runtime::getMutatorFunction(const std::string& name) {
+    if (auto res = mutator.find(name); res != mutator.end()) {
+        return res->second;
+    }
+    return nullptr;
 }
 
 void Runtime::addStatement(Statement* stmt) { stmts.push_back(stmt); }
 
 std::vector<Statement*> Runtime::getStatements() { return stmts; }
 
+void Runtime::replaceStatements(size_t first, size_t count,
+                                const std::vector<Statement*>& replacement) {
+    for (size_t i = first; i < first + count; i++) {
+        delete stmts[i];
+    }
+    stmts.erase(stmts.begin() + first, stmts.begin() + first + count);
+    stmts.insert(stmts.begin() + first, replacement.begin(),
+                 replacement.end());
+}
+
+void Runtime::setSource(std::string text) { source = std::move(text); }
+
+const std::string& Runtime::getSource() const { return source; }
+
+void Runtime::setDirectory(std::string dir) { directory = std::move(dir); }
+
+const std::string& Runtime::getDirectory() const { return directory; }
+
+void Runtime::setResumePoint(Context* globals, size_t next) {
+    resumeGlobals = globals;
+    resumeStatement = next;
+}
+
+Context* Runtime::getResumeGlobals() const { return resumeGlobals; }
+
+size_t Runtime::getResumeStatement() const { return resumeStatement; }
+
 bool Context::hasVariable(const std::string& identName) {
     return vars.count(identName) == 1;
 }
@@ -51,10 +164,20 @@ Variable* Context::getVariable(const std::string& identName) {
     return nullptr;
 }
 
+std::vector<Variable*> Context::getVariables() {
+    std::vector<Variable*> result;
+    for (auto& [name, var] : vars) {
+        result.push_back(var);
+    }
+    return result;
+}
+
 void Context::addFunction(const std::string& name, Function* f) {
     funcs.insert(std::make_pair(name, f));
 }
 
+void Context::removeFunction(const std::string& name) { funcs.erase(name); }
+
 bool Context::hasFunction(const std::string& name) {
     return funcs.count(name) == 1;
 }
@@ -66,27 +189,113 @@ Function* Context::getFunction(const std::string& name) {
     return nullptr;
 }
 
+std::vector<Function*> Context::getFunctions() {
+    std::vector<Function*> result;
+    for (auto& [name, f] : funcs) {
+        result.push_back(f);
+    }
+    return result;
+}
+
+ArrayData ArrayData::slice(size_t lo, size_t hi) const {
+    ArrayData result(*this);
+    result.offset = offset + lo;
+    result.length = hi - lo;
+    return result;
+}
+
+void ArrayData::makeUnique() {
+    if (storage.use_count() != 1 || offset != 0 || length != storage->size()) {
+        storage = HeapRef<std::vector<Value>>::make(begin(), end());
+        offset = 0;
+    }
+}
+
+Value* ArrayData::mutableData() {
+    makeUnique();
+    return storage->data();
+}
+
+void ArrayData::push(Value v) {
+    makeUnique();
+    storage->push_back(std::move(v));
+    length++;
+    storage.resized();
+}
+
+void StringData::makeUnique() {
+    if (storage.use_count() != 1 || offset != 0 || length != storage->size()) {
+        storage = HeapRef<std::string>::make(view());
+        offset = 0;
+    }
+}
+
+size_t StringData::hash() const {
+    if (hashCode == 0) {
+        hashCode = std::hash<std::string_view>{}(view()) | 1;
+    }
+    return hashCode;
+}
+
+bool StringData::equals(const StringData& rhs) const {
+    if (length != rhs.length) {
+        return false;
+    }
+    if (storage == rhs.storage && offset == rhs.offset) {
+        return true;
+    }
+    if (hashCode != 0 && rhs.hashCode != 0 && hashCode != rhs.hashCode) {
+        return false;
+    }
+    return view() == rhs.view();
+}
+
+int StringData::compare(const StringData& rhs) const {
+    if (storage == rhs.storage && offset == rhs.offset &&
+        length == rhs.length) {
+        return 0;
+    }
+    return view().compare(rhs.view());
+}
+
+void StringData::append(std::string_view text) {
+    makeUnique();
+    storage->append(text);
+    length = storage->size();
+    hashCode = 0;
+    storage.resized();
+}
+
+StringData StringData::slice(size_t lo, size_t hi) const {
+    StringData result(*this);
+    result.offset = offset + lo;
+    result.length = hi - lo;
+    result.hashCode = 0;
+    return result;
+}
+
 Value Value::operator+(Value rhs) {
     Value result;
     // Basic
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
-        result.type = lin::Int;
-        result.data = cast<int>() + rhs.cast<int>();
+        result = addInts(cast<long long>(), rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result = BigIntData::add(BigIntData::of(*this), BigIntData::of(rhs));
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
         result.data = cast<double>() + rhs.cast<double>();
-    } else if (isType<lin::Int>() && rhs.isType<lin::Double>()) {
+    } else if (isInteger(*this) && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
-        result.data = cast<int>() + rhs.cast<double>();
-    } else if (isType<lin::Double>() && rhs.isType<lin::Int>()) {
+        result.data = integerToDouble(*this) + rhs.cast<double>();
+    } else if (isType<lin::Double>() && isInteger(rhs)) {
         result.type = lin::Double;
-        result.data = cast<double>() + rhs.cast<int>();
+        result.data = cast<double>() + integerToDouble(rhs);
     } else if (isType<lin::Char>() && rhs.isType<lin::Int>()) {
         result.type = lin::Char;
-        result.data = static_cast<char>(cast<char>() + rhs.cast<int>());
+        result.data = static_cast<char>(cast<char>() + rhs.cast<long long>());
     } else if (isType<lin::Int>() && rhs.isType<lin::Char>()) {
         result.type = lin::Char;
-        result.data = static_cast<char>(cast<int>() + rhs.cast<char>());
+        result.data = static_cast<char>(cast<long long>() + rhs.cast<char>());
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Char;
         result.data = static_cast<char>(cast<char>() + rhs.cast<char>());
@@ -95,19 +304,20 @@ Value Value::operator+(Value rhs) {
     // One of operands has string type, we say the result value was a string
     else if (isType<lin::String>() || rhs.isType<lin::String>()) {
         result.type = lin::String;
-        result.data = valueToStdString(*this) + valueToStdString(rhs);
+        result.data =
+            StringData(valueToStdString(*this) + valueToStdString(rhs));
     }
     // Array
     else if (isType<lin::Array>()) {
         result.type = lin::Array;
-        auto resultArr = this->cast<std::vector<lin::Value>>();
-        resultArr.push_back(rhs);
-        result.data = resultArr;
+        auto resultArr = this->cast<lin::ArrayData>();
+        resultArr.push(rhs);
+        result.data = std::move(resultArr);
     } else if (rhs.isType<lin::Array>()) {
         result.type = lin::Array;
-        auto resultArr = rhs.cast<std::vector<lin::Value>>();
-        resultArr.push_back(*this);
-        result.data = resultArr;
+        auto resultArr = rhs.cast<lin::ArrayData>();
+        resultArr.push(*this);
+        result.data = std::move(resultArr);
     }
     // Invalid
     else {
@@ -119,23 +329,24 @@ Value Value::operator+(Value rhs) {
 Value Value::operator-(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
-        result.type = lin::Int;
-        result.data = cast<int>() - rhs.cast<int>();
+        result = subInts(cast<long long>(), rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result = BigIntData::sub(BigIntData::of(*this), BigIntData::of(rhs));
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
         result.data = cast<double>() - rhs.cast<double>();
-    } else if (isType<lin::Int>() && rhs.isType<lin::Double>()) {
+    } else if (isInteger(*this) && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
-        result.data = cast<int>() - rhs.cast<double>();
-    } else if (isType<lin::Double>() && rhs.isType<lin::Int>()) {
+        result.data = integerToDouble(*this) - rhs.cast<double>();
+    } else if (isType<lin::Double>() && isInteger(rhs)) {
         result.type = lin::Double;
-        result.data = cast<double>() - rhs.cast<int>();
+        result.data = cast<double>() - integerToDouble(rhs);
     } else if (isType<lin::Char>() && rhs.isType<lin::Int>()) {
         result.type = lin::Char;
-        result.data = static_cast<char>(cast<char>() - rhs.cast<int>());
+        result.data = static_cast<char>(cast<char>() - rhs.cast<long long>());
     } else if (isType<lin::Int>() && rhs.isType<lin::Char>()) {
         result.type = lin::Char;
-        result.data = static_cast<char>(cast<int>() - rhs.cast<char>());
+        result.data = static_cast<char>(cast<long long>() - rhs.cast<char>());
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Char;
         result.data = static_cast<char>(cast<char>() - rhs.cast<char>());
@@ -150,35 +361,38 @@ Value Value::operator*(Value rhs) {
     Value result;
     // Basic
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
-        result.type = lin::Int;
-        result.data = cast<int>() * rhs.cast<int>();
+        result = mulInts(cast<long long>(), rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result = BigIntData::mul(BigIntData::of(*this), BigIntData::of(rhs));
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
         result.data = cast<double>() * rhs.cast<double>();
-    } else if (isType<lin::Int>() && rhs.isType<lin::Double>()) {
+    } else if (isInteger(*this) && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
-        result.data = cast<int>() * rhs.cast<double>();
-    } else if (isType<lin::Double>() && rhs.isType<lin::Int>()) {
+        result.data = integerToDouble(*this) * rhs.cast<double>();
+    } else if (isType<lin::Double>() && isInteger(rhs)) {
         result.type = lin::Double;
-        result.data = cast<double>() * rhs.cast<int>();
+        result.data = cast<double>() * integerToDouble(rhs);
     }
     // String
     else if (isType<lin::String>() && rhs.isType<lin::Int>()) {
         result.type = lin::String;
-        result.data = repeatString(rhs.cast<int>(), cast<std::string>());
+        result.data = StringData(
+            repeatString(rhs.cast<long long>(), ref<StringData>().view()));
     } else if (isType<lin::Int>() && rhs.isType<lin::String>()) {
         result.type = lin::String;
-        result.data = repeatString(cast<int>(), rhs.cast<std::string>());
+        result.data = StringData(
+            repeatString(cast<long long>(), rhs.ref<StringData>().view()));
     }
     // Array
     else if (isType<lin::Int>() && rhs.isType<lin::Array>()) {
         result.type = lin::Array;
-        result.data = repeatArray(
-            cast<int>(), std::move(rhs.cast<std::vector<lin::Value>>()));
+        result.data = ArrayData(
+            repeatArray(cast<long long>(), rhs.ref<lin::ArrayData>()));
     } else if (isType<lin::Array>() && rhs.isType<lin::Int>()) {
         result.type = lin::Array;
-        result.data = repeatArray(rhs.cast<int>(),
-                                  std::move(cast<std::vector<lin::Value>>()));
+        result.data = ArrayData(
+            repeatArray(rhs.cast<long long>(), ref<lin::ArrayData>()));
     } else {
         panic("TypeError: unexpected arguments of operator *");
     }
@@ -188,17 +402,18 @@ Value Value::operator*(Value rhs) {
 Value Value::operator/(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
-        result.type = lin::Int;
-        result.data = cast<int>() / rhs.cast<int>();
+        result = divInts(cast<long long>(), rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result = BigIntData::div(BigIntData::of(*this), BigIntData::of(rhs));
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
         result.data = cast<double>() / rhs.cast<double>();
-    } else if (isType<lin::Int>() && rhs.isType<lin::Double>()) {
+    } else if (isInteger(*this) && rhs.isType<lin::Double>()) {
         result.type = lin::Double;
-        result.data = cast<int>() / rhs.cast<double>();
-    } else if (isType<lin::Double>() && rhs.isType<lin::Int>()) {
+        result.data = integerToDouble(*this) / rhs.cast<double>();
+    } else if (isType<lin::Double>() && isInteger(rhs)) {
         result.type = lin::Double;
-        result.data = cast<double>() / rhs.cast<int>();
+        result.data = cast<double>() / integerToDouble(rhs);
     } else {
         panic("TypeError: unexpected arguments of operator /");
     }
@@ -208,8 +423,9 @@ Value Value::operator/(Value rhs) {
 Value Value::operator%(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
-        result.type = lin::Int;
-        result.data = (int)cast<int>() % rhs.cast<int>();
+        result = modInts(cast<long long>(), rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result = BigIntData::mod(BigIntData::of(*this), BigIntData::of(rhs));
     } else {
         panic("TypeError: unexpected arguments of operator %");
     }
@@ -242,16 +458,17 @@ Value Value::operator==(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() == rhs.cast<int>());
+        result.data = (cast<long long>() == rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) == 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() == rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr == rhsStr);
+        result.data = ref<StringData>().equals(rhs.ref<StringData>());
     } else if (isType<lin::Bool>() && rhs.isType<lin::Bool>()) {
         result.type = lin::Bool;
         result.data = (cast<bool>() == rhs.cast<bool>());
@@ -271,16 +488,17 @@ Value Value::operator!=(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() != rhs.cast<int>());
+        result.data = (cast<long long>() != rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) != 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() != rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr != rhsStr);
+        result.data = !ref<StringData>().equals(rhs.ref<StringData>());
     } else if (isType<lin::Bool>() && rhs.isType<lin::Bool>()) {
         result.type = lin::Bool;
         result.data = (cast<bool>() != rhs.cast<bool>());
@@ -300,16 +518,17 @@ Value Value::operator>(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() > rhs.cast<int>());
+        result.data = (cast<long long>() > rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) > 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() > rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr > rhsStr);
+        result.data = (ref<StringData>().compare(rhs.ref<StringData>()) > 0);
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Bool;
         result.data = (cast<char>() > rhs.cast<char>());
@@ -323,16 +542,17 @@ Value Value::operator>=(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() >= rhs.cast<int>());
+        result.data = (cast<long long>() >= rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) >= 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() >= rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr >= rhsStr);
+        result.data = (ref<StringData>().compare(rhs.ref<StringData>()) >= 0);
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Bool;
         result.data = (cast<char>() >= rhs.cast<char>());
@@ -346,16 +566,17 @@ Value Value::operator<(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() < rhs.cast<int>());
+        result.data = (cast<long long>() < rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) < 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() < rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr < rhsStr);
+        result.data = (ref<StringData>().compare(rhs.ref<StringData>()) < 0);
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Bool;
         result.data = (cast<char>() < rhs.cast<char>());
@@ -369,16 +590,17 @@ Value Value::operator<=(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Bool;
-        result.data = (cast<int>() <= rhs.cast<int>());
+        result.data = (cast<long long>() <= rhs.cast<long long>());
+    } else if (bigIntOperands(*this, rhs)) {
+        result.type = lin::Bool;
+        result.data =
+            (BigIntData::of(*this).compare(BigIntData::of(rhs)) <= 0);
     } else if (isType<lin::Double>() && rhs.isType<lin::Double>()) {
         result.type = lin::Bool;
         result.data = (cast<double>() <= rhs.cast<double>());
     } else if (isType<lin::String>() && rhs.isType<lin::String>()) {
         result.type = lin::Bool;
-        std::string lhsStr, rhsStr;
-        lhsStr = valueToStdString(*this);
-        rhsStr = valueToStdString(rhs);
-        result.data = (lhsStr <= rhsStr);
+        result.data = (ref<StringData>().compare(rhs.ref<StringData>()) <= 0);
     } else if (isType<lin::Char>() && rhs.isType<lin::Char>()) {
         result.type = lin::Bool;
         result.data = (cast<char>() <= rhs.cast<char>());
@@ -392,7 +614,7 @@ Value Value::operator&(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Int;
-        result.data = (cast<int>() & rhs.cast<int>());
+        result.data = (cast<long long>() & rhs.cast<long long>());
     } else {
         panic("TypeError: unexpected arguments of operator &");
     }
@@ -403,7 +625,7 @@ Value Value::operator|(Value rhs) {
     Value result;
     if (isType<lin::Int>() && rhs.isType<lin::Int>()) {
         result.type = lin::Int;
-        result.data = (cast<int>() | rhs.cast<int>());
+        result.data = (cast<long long>() | rhs.cast<long long>());
     } else {
         panic("TypeError: unexpected arguments of operator |");
     }
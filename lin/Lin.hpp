@@ -21,24 +21,61 @@ Runtime *--> Statement
 
 #include <any>
 #include <deque>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
+#include "BigInt.h"
+#include "Heap.h"
 
 struct Statement;
 struct Expression;
+[[noreturn]] void panic(char const* const format, ...);
 
 namespace lin {
-enum ValueType { Int, Double, String, Bool, Char, Null, Array };
+enum ValueType {
+    Int,
+    Double,
+    String,
+    Bool,
+    Char,
+    Null,
+    Array,
+    Dict,
+    BigInt,
+    Matrix,
+};
 enum ExecutionResultType { ExecNormal, ExecReturn, ExecBreak, ExecContinue };
+// Set by @memo and @nomemo annotations, otherwise the purity analysis decides
+enum MemoizeMode { MemoizeAuto, MemoizeOn, MemoizeOff };
+
+struct JitRegion;
+class MemoCache;
+class Runtime;
+
+// How often a loop or function ran and which native code was compiled for it
+struct JitProfile {
+    int hotness = 0;
+    // Set once the code can not or should not be compiled anymore
+    bool rejected = false;
+    // Variants specialized for different variable types, owned by runtime
+    JitRegion* regions{};
+};
 
-struct Block {
+struct Block : public HeapCharged<HeapAst> {
     explicit Block() = default;
+    ~Block();
 
     std::vector<Statement*> stmts;
 };
 
-struct Function {
+struct Value;
+
+struct Function : public HeapCharged<HeapAst> {
+    // Entry of a function compiled ahead of time, such functions have no block
+    using NativeFuncType = Value (*)(std::vector<Value> args);
+
     explicit Function() = default;
     ~Function() { delete block; }
 
@@ -46,6 +83,19 @@ struct Function {
     std::vector<std::string> params;
     Block* block{};
     Expression* retExpr{};
+    JitProfile jit;
+    NativeFuncType native{};
+    MemoizeMode memoize = MemoizeAuto;
+    // Results of calls if the function is memoized, owned by runtime
+    MemoCache* memo{};
+    // Set by the purity analysis
+    bool pure = false;
+    // Runtime of the module the function was imported from, which owns it
+    // and runs it, null for functions of the program itself
+    Runtime* home{};
+    // Lines the function moved by within its file since its nodes were
+    // updated, hot reloads leave updating them to the next run
+    int lineShift = 0;
 };
 
 struct Value {
@@ -55,10 +105,17 @@ struct Value {
         : type(type), data(std::move(data)) {}
 
     template <int _LinType>
-    inline bool isType();
+    inline bool isType() const;
+
+    template <typename _CastingType>
+    inline _CastingType cast() const;
+
+    // Like cast() but refers to the stored data rather than copying it out
+    template <typename _CastingType>
+    inline const _CastingType& ref() const;
 
     template <typename _CastingType>
-    inline _CastingType cast();
+    inline _CastingType& ref();
 
     template <typename _DataType>
     inline void set(_DataType data);
@@ -86,6 +143,91 @@ struct Value {
     std::any data;
 };
 
+template <>
+struct HeapTraits<std::vector<Value>> {
+    static constexpr HeapKind kind = HeapArray;
+    static size_t bytes(const std::vector<Value>& v) {
+        return v.capacity() * sizeof(Value);
+    }
+};
+
+template <>
+struct HeapTraits<std::string> {
+    static constexpr HeapKind kind = HeapString;
+    static size_t bytes(const std::string& v) { return v.capacity(); }
+};
+
+//===----------------------------------------------------------------------===//
+// Array and string values share their storage between copies and slices of
+// them, the storage lives on the counted heap of Heap.h. Storage is copied
+// before the first mutation of a value which does not own it exclusively, so
+// arrays and strings keep value semantics.
+//===----------------------------------------------------------------------===//
+class ArrayData {
+public:
+    explicit ArrayData() : ArrayData(std::vector<Value>()) {}
+    explicit ArrayData(std::vector<Value> elements)
+        : storage(HeapRef<std::vector<Value>>::make(std::move(elements))),
+          offset(0),
+          length(storage->size()) {}
+
+    size_t size() const { return length; }
+    const Value& operator[](size_t i) const { return (*storage)[offset + i]; }
+    const Value* begin() const { return storage->data() + offset; }
+    const Value* end() const { return begin() + length; }
+
+    // Elements within [lo, hi), the result shares storage with this array
+    ArrayData slice(size_t lo, size_t hi) const;
+
+    // Elements may be modified in place through the returned pointer
+    Value* mutableData();
+    void push(Value v);
+
+private:
+    void makeUnique();
+
+    HeapRef<std::vector<Value>> storage;
+    size_t offset;
+    size_t length;
+};
+
+// Strings are immutable from the script's point of view. Their characters
+// are only appended in place while a single value owns the buffer, so the
+// length is always cached and the hash is cached once computed.
+class StringData {
+public:
+    explicit StringData() : StringData(std::string()) {}
+    explicit StringData(std::string text)
+        : storage(HeapRef<std::string>::make(std::move(text))),
+          offset(0),
+          length(storage->size()) {}
+
+    size_t size() const { return length; }
+    char operator[](size_t i) const { return (*storage)[offset + i]; }
+    std::string_view view() const {
+        return std::string_view(storage->data() + offset, length);
+    }
+    std::string str() const { return std::string(view()); }
+    size_t hash() const;
+
+    bool equals(const StringData& rhs) const;
+    int compare(const StringData& rhs) const;
+
+    void append(std::string_view text);
+
+    // Characters within [lo, hi), the result shares storage with this string
+    StringData slice(size_t lo, size_t hi) const;
+
+private:
+    void makeUnique();
+
+    HeapRef<std::string> storage;
+    size_t offset;
+    size_t length;
+    // Zero means the hash was not computed yet
+    mutable size_t hashCode = 0;
+};
+
 struct ExecResult {
     explicit ExecResult() : execType(ExecNormal) {}
     explicit ExecResult(ExecutionResultType execType) : execType(execType) {}
@@ -96,14 +238,14 @@ struct ExecResult {
     Value retValue;
 };
 
-struct Variable {
+struct Variable : public HeapCharged<HeapFrame> {
     explicit Variable() = default;
 
     std::string name;
     Value value;
 };
 
-class Context {
+class Context : public HeapCharged<HeapFrame> {
 public:
     explicit Context() = default;
     virtual ~Context();
@@ -111,44 +253,182 @@ public:
     bool hasVariable(const std::string& identName);
     void createVariable(const std::string& identName, Value value);
     Variable* getVariable(const std::string& identName);
+    std::vector<Variable*> getVariables();
 
     void addFunction(const std::string& name, Function* f);
+    // Forget the function called name, it is not deleted
+    void removeFunction(const std::string& name);
     bool hasFunction(const std::string& name);
     Function* getFunction(const std::string& name);
+    std::vector<Function*> getFunctions();
 
 private:
     std::unordered_map<std::string, Variable*> vars;
     std::unordered_map<std::string, Function*> funcs;
 };
 
+// Read-only view over evaluated arguments of a builtin function call, values
+// are never copied when they are handed over to builtin functions
+class Arguments {
+public:
+    explicit Arguments(const Value* first, size_t count)
+        : first(first), count(count) {}
+
+    size_t size() const { return count; }
+    const Value& operator[](size_t i) const { return first[i]; }
+    const Value* begin() const { return first; }
+    const Value* end() const { return first + count; }
+
+private:
+    const Value* first;
+    size_t count;
+};
+
 class Runtime : public Context {
-    using BuiltinFuncType = Value (*)(Runtime*, std::deque<Context*>,
-                                      std::vector<Value>);
+public:
+    using BuiltinFuncType = Value (*)(Runtime*, const std::deque<Context*>&,
+                                      Arguments);
+    // Mutator builtins update their first argument in place when it names a
+    // variable, rest arguments are passed as usual
+    using MutatorFuncType = Value (*)(Runtime*, Value& self, Arguments);
 
 public:
     explicit Runtime();
+    ~Runtime() override;
 
+    void addBuiltinFunction(const std::string& name, BuiltinFuncType f);
     bool hasBuiltinFunction(const std::string& name);
     BuiltinFuncType getBuiltinFunction(const std::string& name);
+    MutatorFuncType getMutatorFunction(const std::string& name);
 
     void addStatement(Statement* stmt);
     std::vector<Statement*> getStatements();
+    // Delete count statements starting at first and put replacement there
+    void replaceStatements(size_t first, size_t count,
+                           const std::vector<Statement*>& replacement);
+
+    // Source code the program was parsed from, snapshots embed it
+    void setSource(std::string text);
+    const std::string& getSource() const;
+    // Directory imports of the source are resolved against, empty for the
+    // working directory
+    void setDirectory(std::string dir);
+    const std::string& getDirectory() const;
+
+    // Global context of the running program and the top-level statement
+    // following the running one, a snapshot taken now resumes from there
+    void setResumePoint(Context* globals, size_t next);
+    Context* getResumeGlobals() const;
+    size_t getResumeStatement() const;
+
+    // Quickened nodes which were replaced while they might still be running,
+    // e.g. by a recursive call, are kept alive until the runtime goes away
+    void retireExpression(Expression* expr);
+
+    // Compiled code lives as long as the functions and statements it was
+    // compiled from
+    void addJitRegion(JitRegion* region);
+    void addMemoCache(MemoCache* cache);
 
 private:
     std::unordered_map<std::string, BuiltinFuncType> builtin;
+    std::unordered_map<std::string, MutatorFuncType> mutator;
     std::vector<Statement*> stmts;
+    std::vector<Expression*> retired;
+    std::vector<JitRegion*> jitRegions;
+    std::vector<MemoCache*> memoCaches;
+    std::string source;
+    std::string directory;
+    Context* resumeGlobals{};
+    size_t resumeStatement = 0;
 };
 
+inline Value toValue(int v) {
+    return Value(lin::Int, static_cast<long long>(v));
+}
+inline Value toValue(long long v) { return Value(lin::Int, v); }
+inline Value toValue(double v) { return Value(lin::Double, v); }
+inline Value toValue(bool v) { return Value(lin::Bool, v); }
+inline Value toValue(char v) { return Value(lin::Char, v); }
+inline Value toValue(std::string v) {
+    return Value(lin::String, StringData(std::move(v)));
+}
+inline Value toValue(const char* v) { return toValue(std::string(v)); }
+inline Value toValue(std::vector<Value> v) {
+    return Value(lin::Array, ArrayData(std::move(v)));
+}
+inline Value toValue(Value v) { return v; }
+
+// Int operators on the inline 64 bits, a result which does not fit them is
+// computed again by BigIntData. Division by zero traps like it always did.
+inline Value addInts(long long lhs, long long rhs) {
+    long long result;
+    if (__builtin_add_overflow(lhs, rhs, &result)) {
+        return BigIntData::add(BigIntData(lhs), BigIntData(rhs));
+    }
+    return Value(lin::Int, result);
+}
+
+inline Value subInts(long long lhs, long long rhs) {
+    long long result;
+    if (__builtin_sub_overflow(lhs, rhs, &result)) {
+        return BigIntData::sub(BigIntData(lhs), BigIntData(rhs));
+    }
+    return Value(lin::Int, result);
+}
+
+inline Value mulInts(long long lhs, long long rhs) {
+    long long result;
+    if (__builtin_mul_overflow(lhs, rhs, &result)) {
+        return BigIntData::mul(BigIntData(lhs), BigIntData(rhs));
+    }
+    return Value(lin::Int, result);
+}
+
+inline Value negInt(long long v) {
+    long long result;
+    if (__builtin_sub_overflow(0LL, v, &result)) {
+        return BigIntData::neg(BigIntData(v));
+    }
+    return Value(lin::Int, result);
+}
+
+// The one quotient which overflows is -2^63 / -1, a zero divisor panics
+// like BigInt division does
+inline Value divInts(long long lhs, long long rhs) {
+    if (rhs == 0) {
+        panic("ValueError: integer division by zero\n");
+    }
+    return rhs == -1 ? negInt(lhs) : Value(lin::Int, lhs / rhs);
+}
+
+inline Value modInts(long long lhs, long long rhs) {
+    if (rhs == 0) {
+        panic("ValueError: integer division by zero\n");
+    }
+    return Value(lin::Int, rhs == -1 ? 0LL : lhs % rhs);
+}
+
 template <int _LinType>
-inline bool Value::isType() {
+inline bool Value::isType() const {
     return this->type == _LinType;
 }
 
 template <typename _CastingType>
-inline _CastingType Value::cast() {
+inline _CastingType Value::cast() const {
     return std::any_cast<_CastingType>(data);
 }
 
+template <typename _CastingType>
+inline const _CastingType& Value::ref() const {
+    return *std::any_cast<_CastingType>(&data);
+}
+
+template <typename _CastingType>
+inline _CastingType& Value::ref() {
+    return *std::any_cast<_CastingType>(&data);
+}
+
 template <typename _DataType>
 inline void Value::set(_DataType data) {
     this->data = std::make_any<_DataType>(std::move(data));
@@ -1,15 +1,171 @@
 #include <string.h>
 #include <iostream>
+#include "Aot.h"
+#include "Engine.h"
+#include "Fiber.h"
+#include "Heap.h"
 #include "Interpreter.h"
+#include "Jit.h"
+#include "Module.h"
+#include "Server.h"
+#include "Snapshot.h"
+#include "Types.h"
 #include "Utils.hpp"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        panic("Feed your *.lin source file to interpreter!\n");
+// Size of --max-heap or --max-stack in bytes, a K, M or G suffix scales it
+static long long parseSize(const char* text) {
+    char* end = nullptr;
+    long long size = strtoll(text, &end, 10);
+    switch (*end) {
+        case 'G':
+        case 'g':
+            size <<= 10;
+            [[fallthrough]];
+        case 'M':
+        case 'm':
+            size <<= 10;
+            [[fallthrough]];
+        case 'K':
+        case 'k':
+            size <<= 10;
+            end++;
+            break;
+        default:
+            break;
+    }
+    if (end == text || *end != '\0' || size <= 0) {
+        panic("Invalid size %s\n", text);
     }
+    return size;
+}
+
+int main(int argc, char* argv[]) {
+    bool jitStats = false;
+    bool heapStats = false;
+    bool emitCpp = false;
+    bool explainTypes = false;
+    bool benchParse = false;
+    bool watch = false;
+    int status = 0;
+    try {
+        const char* fileName = nullptr;
+        const char* socketPath = nullptr;
+        const char* restorePath = nullptr;
+        int snapshotLine = -1;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--no-jit") == 0) {
+                lin::Jit::setEnabled(false);
+            } else if (strcmp(argv[i], "--jit-stats") == 0) {
+                jitStats = true;
+            } else if (strcmp(argv[i], "--heap-stats") == 0) {
+                heapStats = true;
+            } else if (strncmp(argv[i], "--max-heap=", 11) == 0) {
+                lin::Heap::setLimit(parseSize(argv[i] + 11));
+            } else if (strcmp(argv[i], "--stackless") == 0) {
+                lin::Fiber::setEnabled(true);
+            } else if (strncmp(argv[i], "--max-stack=", 12) == 0) {
+                lin::Fiber::setStackLimit(parseSize(argv[i] + 12));
+            } else if (strncmp(argv[i], "--module-cache=", 15) == 0) {
+                lin::Module::setCacheDirectory(argv[i] + 15);
+            } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+                socketPath = argv[++i];
+            } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+                restorePath = argv[++i];
+            } else if (strncmp(argv[i], "--snapshot-after=", 17) == 0) {
+                snapshotLine = atoi(argv[i] + 17);
+            } else if (strcmp(argv[i], "--emit-cpp") == 0) {
+                emitCpp = true;
+            } else if (strcmp(argv[i], "--explain-types") == 0) {
+                explainTypes = true;
+            } else if (strcmp(argv[i], "--bench-parse") == 0) {
+                benchParse = true;
+            } else if (strcmp(argv[i], "--watch") == 0) {
+                watch = true;
+            } else if (strncmp(argv[i], "--", 2) == 0) {
+                panic("Unknown option %s\n", argv[i]);
+            } else {
+                fileName = argv[i];
+            }
+        }
+        if (socketPath != nullptr) {
+            // Run scripts sent over the socket until the process is killed
+            lin::Server(socketPath).serve();
+            return status;
+        }
+        if (restorePath == nullptr && fileName == nullptr) {
+            panic("Feed your *.lin source file to interpreter!\n");
+        }
+        if (restorePath != nullptr &&
+            (explainTypes || emitCpp || benchParse || watch)) {
+            panic("A restored snapshot can only be run\n");
+        }
 
-    Interpreter lin(argv[1]);
-    lin.execute();
-//  Parser::printLex(argv[1]);
-    return 0;
+        if (benchParse) {
+            // Measure parsing alone, the script is not run
+            Parser::benchmark(fileName, std::cout);
+            return status;
+        }
+        if (explainTypes) {
+            // List what static type inference proved without running
+            auto program = lin::Engine().compileFile(fileName);
+            lin::TypeInference(program->runtime()).explain(std::cout);
+            return status;
+        }
+        if (emitCpp) {
+            // Translate the script into C++ on stdout instead of running it
+            auto program = lin::Engine().compileFile(fileName);
+            lin::Aot::emitCpp(program->runtime(), fileName, std::cout);
+            return status;
+        }
+
+        if (watch) {
+            // Run the script again whenever it is saved, only functions the
+            // edit touched are parsed again
+            lin::Engine engine;
+            auto program = engine.watchFile(fileName);
+            for (;;) {
+                try {
+                    engine.run(*program);
+                } catch (const lin::LinError& e) {
+                    std::cout << std::flush;
+                    fputs(e.what(), stdout);
+                }
+                std::cout << std::flush;
+                for (bool changed = false; !changed;) {
+                    program->wait();
+                    try {
+                        changed = program->update();
+                    } catch (const lin::LinError& e) {
+                        fputs(e.what(), stdout);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+        if (restorePath != nullptr) {
+            // Resume a program from the point its snapshot was taken at
+            lin::Snapshot::resume(restorePath);
+        } else {
+            Interpreter lin(fileName);
+            if (snapshotLine >= 0) {
+                lin.snapshotAfter(snapshotLine,
+                                  std::string(fileName) + ".snap");
+            }
+            lin.execute();
+        }
+        //  Parser::printLex(argv[1]);
+    } catch (const lin::LinError& e) {
+        std::cout << std::flush;
+        fputs(e.what(), stdout);
+        status = EXIT_FAILURE;
+    }
+    if (jitStats) {
+        std::cout << std::flush;
+        lin::Jit::dumpStats(std::cerr);
+    }
+    if (heapStats) {
+        std::cout << std::flush;
+        lin::Heap::dumpStats(std::cerr);
+    }
+    return status;
 }
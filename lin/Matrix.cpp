@@ -0,0 +1,374 @@
+#include "Matrix.h"
+#include <algorithm>
+#include <climits>
+#include <type_traits>
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+// Edge of the square blocks kernels work on, three blocks of doubles fit a
+// typical 256K L2 cache
+constexpr size_t kMultiplyBlock = 64;
+constexpr size_t kTransposeBlock = 32;
+
+// Number of elements of a rows x cols matrix, checked against the heap limit
+size_t elementCount(size_t rows, size_t cols) {
+    size_t count;
+    if (__builtin_mul_overflow(rows, cols, &count) ||
+        count > static_cast<size_t>(LLONG_MAX) / sizeof(double)) {
+        panic("ValueError: matrix of %zu x %zu elements is too large\n", rows,
+              cols);
+    }
+    Heap::reserve(static_cast<long long>(count * sizeof(double)));
+    return count;
+}
+
+double numberOf(const Value& v) {
+    if (v.isType<lin::BigInt>()) {
+        return v.ref<BigIntData>().toDouble();
+    }
+    return v.isType<lin::Int>() ? v.cast<long long>() : v.cast<double>();
+}
+
+std::vector<double> toDoubles(const MatrixData& m) {
+    if (m.isDouble()) {
+        return std::vector<double>(m.doubleData(),
+                                   m.doubleData() + m.rows() * m.cols());
+    }
+    return std::vector<double>(m.intData(), m.intData() + m.rows() * m.cols());
+}
+
+// c += a * b for an n x m matrix a and an m x p matrix b. Blocks of a, b and
+// c are reused from cache, the innermost loop runs along rows of b and c.
+template <typename _ElementType>
+void multiplyBlocked(const _ElementType* a, const _ElementType* b,
+                     _ElementType* c, size_t n, size_t m, size_t p) {
+    for (size_t i0 = 0; i0 < n; i0 += kMultiplyBlock) {
+        size_t i1 = std::min(i0 + kMultiplyBlock, n);
+        for (size_t k0 = 0; k0 < m; k0 += kMultiplyBlock) {
+            size_t k1 = std::min(k0 + kMultiplyBlock, m);
+            for (size_t j0 = 0; j0 < p; j0 += kMultiplyBlock) {
+                size_t j1 = std::min(j0 + kMultiplyBlock, p);
+                for (size_t i = i0; i < i1; i++) {
+                    _ElementType* row = c + i * p;
+                    for (size_t k = k0; k < k1; k++) {
+                        _ElementType aik = a[i * m + k];
+                        const _ElementType* brow = b + k * p;
+                        for (size_t j = j0; j < j1; j++) {
+                            row[j] += aik * brow[j];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+unsigned long long maxMagnitude(const long long* p, size_t n) {
+    unsigned long long result = 0;
+    for (size_t i = 0; i < n; i++) {
+        auto v = static_cast<unsigned long long>(p[i]);
+        result = std::max(result, p[i] < 0 ? 0 - v : v);
+    }
+    return result;
+}
+
+// Whether no partial sum of an int product can leave 64 bits
+bool productFits(const MatrixData& lhs, const MatrixData& rhs) {
+    unsigned __int128 bound =
+        static_cast<unsigned __int128>(
+            maxMagnitude(lhs.intData(), lhs.rows() * lhs.cols())) *
+        maxMagnitude(rhs.intData(), rhs.rows() * rhs.cols());
+    return bound <= LLONG_MAX && bound * lhs.cols() <= LLONG_MAX;
+}
+
+// Exact dot products for int operands whose partial sums may overflow, only
+// results which do not fit are an error
+void multiplyChecked(const long long* a, const long long* b, long long* c,
+                     size_t n, size_t m, size_t p) {
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < p; j++) {
+            __int128 sum = 0;
+            bool overflow = false;
+            for (size_t k = 0; k < m && !overflow; k++) {
+                overflow = __builtin_add_overflow(
+                    sum, static_cast<__int128>(a[i * m + k]) * b[k * p + j],
+                    &sum);
+            }
+            if (overflow || sum < LLONG_MIN || sum > LLONG_MAX) {
+                panic("ValueError: element (%zu, %zu) of int matrix product "
+                      "does not fit 64 bits\n",
+                      i, j);
+            }
+            c[i * p + j] = static_cast<long long>(sum);
+        }
+    }
+}
+
+template <typename _ElementType>
+void transposeBlocked(const _ElementType* src, _ElementType* dest,
+                      size_t rows, size_t cols) {
+    for (size_t i0 = 0; i0 < rows; i0 += kTransposeBlock) {
+        size_t i1 = std::min(i0 + kTransposeBlock, rows);
+        for (size_t j0 = 0; j0 < cols; j0 += kTransposeBlock) {
+            size_t j1 = std::min(j0 + kTransposeBlock, cols);
+            for (size_t i = i0; i < i1; i++) {
+                for (size_t j = j0; j < j1; j++) {
+                    dest[j * rows + i] = src[i * cols + j];
+                }
+            }
+        }
+    }
+}
+
+// Exact sum of n ints which are stride elements apart
+Value sumInts(const long long* p, size_t n, size_t stride) {
+    long long sum = 0, next;
+    size_t k = 0;
+    for (; k < n; k++) {
+        if (__builtin_add_overflow(sum, p[k * stride], &next)) {
+            break;
+        }
+        sum = next;
+    }
+    Value exact = toValue(sum);
+    for (; k < n; k++) {
+        exact = exact + toValue(p[k * stride]);
+    }
+    return exact;
+}
+
+template <typename _ElementType>
+_ElementType combine(MatrixData::Reduction op, _ElementType acc,
+                     _ElementType v) {
+    switch (op) {
+        case MatrixData::ReduceMin:
+            return v < acc ? v : acc;
+        case MatrixData::ReduceMax:
+            return v > acc ? v : acc;
+        default:
+            return acc + v;
+    }
+}
+
+template <typename _ElementType>
+std::vector<Value> reduceEachRow(const _ElementType* p, size_t rows,
+                                 size_t cols, MatrixData::Reduction op) {
+    std::vector<Value> result;
+    result.reserve(rows);
+    for (size_t i = 0; i < rows; i++) {
+        const _ElementType* row = p + i * cols;
+        if constexpr (std::is_same_v<_ElementType, long long>) {
+            if (op == MatrixData::ReduceSum) {
+                result.push_back(sumInts(row, cols, 1));
+                continue;
+            }
+        }
+        _ElementType acc = op == MatrixData::ReduceSum ? 0 : row[0];
+        for (size_t j = 0; j < cols; j++) {
+            acc = combine(op, acc, row[j]);
+        }
+        result.push_back(toValue(acc));
+    }
+    return result;
+}
+
+// Columns are reduced a row at a time, so the matrix is read in storage
+// order. Int columns whose sum overflowed are summed again exactly.
+template <typename _ElementType>
+std::vector<Value> reduceEachColumn(const _ElementType* p, size_t rows,
+                                    size_t cols, MatrixData::Reduction op) {
+    std::vector<_ElementType> acc(cols);
+    std::vector<bool> overflow(cols);
+    for (size_t j = 0; j < cols && op != MatrixData::ReduceSum; j++) {
+        acc[j] = p[j];
+    }
+    for (size_t i = 0; i < rows; i++) {
+        const _ElementType* row = p + i * cols;
+        for (size_t j = 0; j < cols; j++) {
+            if constexpr (std::is_same_v<_ElementType, long long>) {
+                if (op == MatrixData::ReduceSum) {
+                    overflow[j] =
+                        overflow[j] ||
+                        __builtin_add_overflow(acc[j], row[j], &acc[j]);
+                    continue;
+                }
+            }
+            acc[j] = combine(op, acc[j], row[j]);
+        }
+    }
+    std::vector<Value> result;
+    result.reserve(cols);
+    for (size_t j = 0; j < cols; j++) {
+        if constexpr (std::is_same_v<_ElementType, long long>) {
+            if (overflow[j]) {
+                result.push_back(sumInts(p + j, rows, cols));
+                continue;
+            }
+        }
+        result.push_back(toValue(acc[j]));
+    }
+    return result;
+}
+}  // namespace
+
+MatrixData::MatrixData(size_t rows, size_t cols, long long fill)
+    : MatrixData(rows, cols) {
+    ints = HeapRef<std::vector<long long>>::make(elementCount(rows, cols),
+                                                 fill);
+}
+
+MatrixData::MatrixData(size_t rows, size_t cols, double fill)
+    : MatrixData(rows, cols) {
+    doubles =
+        HeapRef<std::vector<double>>::make(elementCount(rows, cols), fill);
+}
+
+MatrixData MatrixData::fromRows(const ArrayData& rows) {
+    size_t cols = 0;
+    bool anyDouble = false;
+    for (size_t i = 0; i < rows.size(); i++) {
+        if (!rows[i].isType<lin::Array>()) {
+            panic("TypeError: rows of a matrix must be arrays but got %s\n",
+                  valueTypeName(rows[i].type));
+        }
+        auto& row = rows[i].ref<ArrayData>();
+        if (i == 0) {
+            cols = row.size();
+        } else if (row.size() != cols) {
+            panic("ValueError: rows of a matrix must have equal length\n");
+        }
+        for (auto& e : row) {
+            if (!anyone(e.type, lin::Int, lin::BigInt, lin::Double)) {
+                panic(
+                    "TypeError: elements of a matrix must be numbers but got "
+                    "%s\n",
+                    valueTypeName(e.type));
+            }
+            anyDouble = anyDouble || !e.isType<lin::Int>();
+        }
+    }
+    MatrixData result = anyDouble ? MatrixData(rows.size(), cols, 0.0)
+                                  : MatrixData(rows.size(), cols, 0LL);
+    for (size_t i = 0; i < rows.size(); i++) {
+        auto& row = rows[i].ref<ArrayData>();
+        for (size_t j = 0; j < cols; j++) {
+            result.set(i, j, row[j]);
+        }
+    }
+    return result;
+}
+
+long long* MatrixData::mutableIntData() {
+    if (ints.use_count() != 1) {
+        ints = HeapRef<std::vector<long long>>::make(*ints);
+    }
+    return ints->data();
+}
+
+double* MatrixData::mutableDoubleData() {
+    if (doubles.use_count() != 1) {
+        doubles = HeapRef<std::vector<double>>::make(*doubles);
+    }
+    return doubles->data();
+}
+
+Value MatrixData::at(size_t i, size_t j) const {
+    if (isDouble()) {
+        return Value(lin::Double, (*doubles)[i * width + j]);
+    }
+    return Value(lin::Int, (*ints)[i * width + j]);
+}
+
+ArrayData MatrixData::row(size_t i) const {
+    std::vector<Value> elements;
+    elements.reserve(width);
+    for (size_t j = 0; j < width; j++) {
+        elements.push_back(at(i, j));
+    }
+    return ArrayData(std::move(elements));
+}
+
+bool MatrixData::accepts(const Value& v) const {
+    if (isDouble()) {
+        return anyone(v.type, lin::Int, lin::BigInt, lin::Double);
+    }
+    return v.isType<lin::Int>();
+}
+
+void MatrixData::set(size_t i, size_t j, const Value& v) {
+    if (isDouble()) {
+        mutableDoubleData()[i * width + j] = numberOf(v);
+    } else {
+        mutableIntData()[i * width + j] = v.cast<long long>();
+    }
+}
+
+void MatrixData::fill(const Value& v) {
+    if (isDouble()) {
+        std::fill_n(mutableDoubleData(), height * width, numberOf(v));
+    } else {
+        std::fill_n(mutableIntData(), height * width, v.cast<long long>());
+    }
+}
+
+MatrixData MatrixData::multiply(const MatrixData& lhs,
+                                const MatrixData& rhs) {
+    if (lhs.width != rhs.height) {
+        panic("ValueError: can not multiply %zu x %zu matrix by %zu x %zu "
+              "matrix\n",
+              lhs.height, lhs.width, rhs.height, rhs.width);
+    }
+    size_t n = lhs.height, m = lhs.width, p = rhs.width;
+    if (!lhs.isDouble() && !rhs.isDouble()) {
+        MatrixData result(n, p, 0LL);
+        if (productFits(lhs, rhs)) {
+            multiplyBlocked(lhs.intData(), rhs.intData(),
+                            result.mutableIntData(), n, m, p);
+        } else {
+            multiplyChecked(lhs.intData(), rhs.intData(),
+                            result.mutableIntData(), n, m, p);
+        }
+        return result;
+    }
+    MatrixData result(n, p, 0.0);
+    // Int operands of a mixed product are converted once up front
+    std::vector<double> a, b;
+    if (!lhs.isDouble()) {
+        a = toDoubles(lhs);
+    }
+    if (!rhs.isDouble()) {
+        b = toDoubles(rhs);
+    }
+    multiplyBlocked(lhs.isDouble() ? lhs.doubleData() : a.data(),
+                    rhs.isDouble() ? rhs.doubleData() : b.data(),
+                    result.mutableDoubleData(), n, m, p);
+    return result;
+}
+
+MatrixData MatrixData::transpose() const {
+    if (isDouble()) {
+        MatrixData result(width, height, 0.0);
+        transposeBlocked(doubleData(), result.mutableDoubleData(), height,
+                         width);
+        return result;
+    }
+    MatrixData result(width, height, 0LL);
+    transposeBlocked(intData(), result.mutableIntData(), height, width);
+    return result;
+}
+
+std::vector<Value> MatrixData::reduceRows(Reduction op) const {
+    if (isDouble()) {
+        return reduceEachRow(doubleData(), height, width, op);
+    }
+    return reduceEachRow(intData(), height, width, op);
+}
+
+std::vector<Value> MatrixData::reduceColumns(Reduction op) const {
+    if (isDouble()) {
+        return reduceEachColumn(doubleData(), height, width, op);
+    }
+    return reduceEachColumn(intData(), height, width, op);
+}
+}  // namespace lin
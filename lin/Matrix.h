@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "Lin.hpp"
+
+namespace lin {
+template <>
+struct HeapTraits<std::vector<long long>> {
+    static constexpr HeapKind kind = HeapMatrix;
+    static size_t bytes(const std::vector<long long>& v) {
+        return v.capacity() * sizeof(long long);
+    }
+};
+
+template <>
+struct HeapTraits<std::vector<double>> {
+    static constexpr HeapKind kind = HeapMatrix;
+    static size_t bytes(const std::vector<double>& v) {
+        return v.capacity() * sizeof(double);
+    }
+};
+
+//===----------------------------------------------------------------------===//
+// Storage of matrix values. Elements are either all ints or all doubles and
+// are kept unboxed in one row-major buffer, so m[i, j] is a multiply and an
+// add away and kernels run over plain arrays of numbers. The buffer lives on
+// the counted heap and is shared between copies until one of them writes an
+// element, like the storage of arrays.
+//===----------------------------------------------------------------------===//
+class MatrixData {
+public:
+    explicit MatrixData(size_t rows, size_t cols, long long fill);
+    explicit MatrixData(size_t rows, size_t cols, double fill);
+    // Rows given as arrays of equal length. Elements are ints, or numbers
+    // which make a double matrix as soon as one of them is a double
+    static MatrixData fromRows(const ArrayData& rows);
+
+    size_t rows() const { return height; }
+    size_t cols() const { return width; }
+    bool isDouble() const { return doubles.use_count() != 0; }
+
+    // Elements in row-major order, depending on the element type
+    const long long* intData() const { return ints->data(); }
+    const double* doubleData() const { return doubles->data(); }
+    // Elements may be modified in place through the returned pointers
+    long long* mutableIntData();
+    double* mutableDoubleData();
+
+    // Element (i, j) and row i, indices are not checked
+    Value at(size_t i, size_t j) const;
+    ArrayData row(size_t i) const;
+    // Store v into element (i, j) or into every element. Int matrices only
+    // take ints, double matrices any number
+    void set(size_t i, size_t j, const Value& v);
+    void fill(const Value& v);
+    // Whether set and fill would accept v
+    bool accepts(const Value& v) const;
+
+    // Product computed on cache sized blocks, a double operand makes the
+    // product a double matrix. Int products panic rather than overflow.
+    static MatrixData multiply(const MatrixData& lhs, const MatrixData& rhs);
+    MatrixData transpose() const;
+
+    enum Reduction { ReduceSum, ReduceMin, ReduceMax };
+    // One result per row or per column. Int sums which do not fit 64 bits
+    // become BigInts like sums of arrays do, minimums and maximums need at
+    // least one element per row or column
+    std::vector<Value> reduceRows(Reduction op) const;
+    std::vector<Value> reduceColumns(Reduction op) const;
+
+private:
+    explicit MatrixData(size_t rows, size_t cols) : height(rows), width(cols) {}
+
+    size_t height;
+    size_t width;
+    // Exactly one of them holds the elements
+    HeapRef<std::vector<long long>> ints;
+    HeapRef<std::vector<double>> doubles;
+};
+
+inline Value toValue(MatrixData v) { return Value(lin::Matrix, std::move(v)); }
+}  // namespace lin
@@ -0,0 +1,337 @@
+#include "Memo.h"
+#include <cstring>
+#include <unordered_set>
+#include "Ast.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+// Builtins whose results only depend on their arguments, builtins added by
+// an embedding host are never assumed to be pure
+const std::unordered_set<std::string> kPureBuiltins = {
+    "typeof",     "slice",      "length",     "keys",       "has",
+    "sort",       "bsearch",    "min",        "max",        "sum",
+    "prefix_sum", "reverse",    "matrix",     "to_matrix",  "shape",
+    "matmul",     "transpose",  "row_sum",    "row_min",    "row_max",
+    "col_sum",    "col_min",    "col_max",
+};
+
+// Builtins which call the user function named by their last argument
+const std::unordered_set<std::string> kCallingBuiltins = {"sort_by"};
+
+size_t mixBits(uint64_t x) {
+    // Finalizer of MurmurHash3
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+}
+
+class PurityAnalysis {
+public:
+    explicit PurityAnalysis(Runtime* rt) : rt(rt) {}
+
+    // Collect which of functions call anything impure in their bodies,
+    // callees of a pure function must turn out pure as well. Any other
+    // function of rt is as pure as recorded.
+    std::unordered_set<Function*> impureFunctions(
+        const std::vector<Function*>& functions) {
+        analyzed.insert(functions.begin(), functions.end());
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto* f : functions) {
+                if (impure.count(f) == 0 && !isPure(f->block)) {
+                    impure.insert(f);
+                    changed = true;
+                }
+            }
+        }
+        return impure;
+    }
+
+private:
+    bool isPure(Block* block) {
+        if (block == nullptr) {
+            return true;
+        }
+        for (auto* stmt : block->stmts) {
+            if (!isPure(stmt)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isPure(Statement* stmt) {
+        if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+            return isPure(s->expr);
+        }
+        if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+            return isPure(s->ret);
+        }
+        if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+            return isPure(s->cond) && isPure(s->block) &&
+                   isPure(s->elseBlock);
+        }
+        if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+            return isPure(s->cond) && isPure(s->block);
+        }
+        if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+            return isPure(s->lo) && isPure(s->hi) && isPure(s->step) &&
+                   isPure(s->block);
+        }
+        return true;
+    }
+
+    bool isPure(Expression* e) {
+        if (e == nullptr) {
+            return true;
+        }
+        if (auto* quickened = dynamic_cast<QuickenedExpr*>(e)) {
+            return isPure(quickened->genericExpr());
+        }
+        if (auto* call = dynamic_cast<FunCallExpr*>(e)) {
+            return isPure(call);
+        }
+        if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+            return isPure(assign->lhs) && isPure(assign->rhs);
+        }
+        if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+            return isPure(binary->lhs) && isPure(binary->rhs);
+        }
+        if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+            return isPure(logical->lhs) && isPure(logical->rhs);
+        }
+        if (auto* index = dynamic_cast<IndexExpr*>(e)) {
+            return isPure(index->index) && isPure(index->second);
+        }
+        if (auto* slice = dynamic_cast<SliceExpr*>(e)) {
+            return isPure(slice->base) && isPure(slice->lo) &&
+                   isPure(slice->hi);
+        }
+        if (auto* array = dynamic_cast<ArrayExpr*>(e)) {
+            for (auto* element : array->literal) {
+                if (!isPure(element)) {
+                    return false;
+                }
+            }
+        }
+        if (auto* dict = dynamic_cast<DictExpr*>(e)) {
+            for (auto& [key, value] : dict->literal) {
+                if (!isPure(key) || !isPure(value)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool isPure(FunCallExpr* e) {
+        for (auto* arg : e->args) {
+            if (!isPure(arg)) {
+                return false;
+            }
+        }
+        const std::string& name = e->funcName;
+        if (rt->getMutatorFunction(name) != nullptr) {
+            // Mutators only update a local variable of the caller
+            return true;
+        }
+        if (kCallingBuiltins.count(name) == 1) {
+            auto* callee = e->args.empty()
+                               ? nullptr
+                               : dynamic_cast<StringExpr*>(e->args.back());
+            return callee != nullptr && isPureCallee(callee->literal.str());
+        }
+        if (rt->getBuiltinFunction(name) != nullptr) {
+            return kPureBuiltins.count(name) == 1;
+        }
+        // A callee unknown at this point may well be a native a host
+        // registers later, so it is never assumed to be pure
+        return isPureCallee(name);
+    }
+
+    bool isPureCallee(const std::string& name) {
+        auto* f = rt->getFunction(name);
+        if (f == nullptr) {
+            return false;
+        }
+        return analyzed.count(f) == 1 ? impure.count(f) == 0 : f->pure;
+    }
+
+    Runtime* rt;
+    std::unordered_set<Function*> analyzed;
+    std::unordered_set<Function*> impure;
+};
+}  // namespace
+
+bool MemoCache::cacheable(const std::vector<Value>& args) {
+    for (auto& arg : args) {
+        if (!anyone(arg.type, Int, BigInt, Double, Bool, Char, Null, String)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t MemoCache::hashOf(const std::vector<Value>& args) {
+    size_t hash = args.size();
+    for (auto& arg : args) {
+        uint64_t bits = 0;
+        switch (arg.type) {
+            case Int:
+                bits = static_cast<uint64_t>(arg.ref<long long>());
+                break;
+            case BigInt:
+                bits = arg.ref<BigIntData>().hash();
+                break;
+            case Double:
+                memcpy(&bits, &arg.ref<double>(), sizeof(bits));
+                break;
+            case Bool:
+                bits = arg.ref<bool>();
+                break;
+            case Char:
+                bits = static_cast<uint8_t>(arg.ref<char>());
+                break;
+            case String:
+                bits = arg.ref<StringData>().hash();
+                break;
+            default:
+                break;
+        }
+        hash = mixBits(hash * 31 + (bits ^ (uint64_t(arg.type) << 56)));
+    }
+    return hash;
+}
+
+bool MemoCache::argsEqual(const std::vector<Value>& lhs,
+                          const std::vector<Value>& rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); i++) {
+        if (lhs[i].type != rhs[i].type) {
+            return false;
+        }
+        switch (lhs[i].type) {
+            case Int:
+                if (lhs[i].ref<long long>() != rhs[i].ref<long long>()) {
+                    return false;
+                }
+                break;
+            case BigInt:
+                if (lhs[i].ref<BigIntData>().compare(
+                        rhs[i].ref<BigIntData>()) != 0) {
+                    return false;
+                }
+                break;
+            case Double:
+                // Bitwise, 0.0 and -0.0 give different results of 1 / x
+                if (memcmp(&lhs[i].ref<double>(), &rhs[i].ref<double>(),
+                           sizeof(double)) != 0) {
+                    return false;
+                }
+                break;
+            case Bool:
+                if (lhs[i].ref<bool>() != rhs[i].ref<bool>()) {
+                    return false;
+                }
+                break;
+            case Char:
+                if (lhs[i].ref<char>() != rhs[i].ref<char>()) {
+                    return false;
+                }
+                break;
+            case String:
+                if (!lhs[i].ref<StringData>().equals(
+                        rhs[i].ref<StringData>())) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+const Value* MemoCache::find(const std::vector<Value>& args) {
+    if (++lookups == kSamplePeriod) {
+        // Less than one call in eight was answered from the cache
+        gaveUp = hits < kSamplePeriod / 8;
+        lookups = hits = 0;
+    }
+    if (slots.empty()) {
+        return nullptr;
+    }
+    size_t hash = hashOf(args);
+    auto& entry = slots[hash & (kSlots - 1)];
+    if (entry.used && entry.hash == hash && argsEqual(entry.args, args)) {
+        hits++;
+        return &entry.result;
+    }
+    return nullptr;
+}
+
+void MemoCache::insert(std::vector<Value> args, Value result) {
+    if (slots.empty()) {
+        slots.resize(kSlots);
+    }
+    size_t hash = hashOf(args);
+    auto& entry = slots[hash & (kSlots - 1)];
+    entry.args = std::move(args);
+    entry.result = std::move(result);
+    entry.hash = hash;
+    entry.used = true;
+}
+
+void MemoCache::clear() {
+    slots.clear();
+    gaveUp = false;
+    lookups = hits = 0;
+}
+
+void Memo::analyze(Runtime* rt) {
+    std::vector<Function*> functions;
+    for (auto* f : rt->getFunctions()) {
+        // Functions of modules were analyzed along with their module
+        if (f->home == nullptr || f->home == rt) {
+            functions.push_back(f);
+        }
+    }
+    auto impure = PurityAnalysis(rt).impureFunctions(functions);
+    for (auto* f : functions) {
+        attach(rt, f, impure.count(f) == 0);
+    }
+}
+
+void Memo::reanalyze(Runtime* rt, const std::vector<Function*>& functions) {
+    auto impure = PurityAnalysis(rt).impureFunctions(functions);
+    for (auto* f : functions) {
+        if (f->memo != nullptr) {
+            f->memo->clear();
+            if (f->memoize == MemoizeAuto && impure.count(f) == 1) {
+                // The cache stays with the runtime, it is merely unused
+                f->memo = nullptr;
+            }
+        }
+        attach(rt, f, impure.count(f) == 0);
+    }
+}
+
+void Memo::attach(Runtime* rt, Function* f, bool pure) {
+    f->pure = pure;
+    if (f->memo != nullptr || f->block == nullptr ||
+        f->memoize == MemoizeOff) {
+        return;
+    }
+    if (f->memoize == MemoizeOn || pure) {
+        f->memo = new MemoCache(f->memoize == MemoizeOn);
+        rt->addMemoCache(f->memo);
+    }
+}
+}  // namespace lin
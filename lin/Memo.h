@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Result cache of one pure function. Slots are direct mapped by the hash of
+// the arguments, a call colliding with a cached one replaces its result, so
+// the cache never grows beyond kSlots entries.
+//===----------------------------------------------------------------------===//
+class MemoCache {
+public:
+    explicit MemoCache(bool forced) : forced(forced) {}
+
+    // Only calls whose arguments are all scalars or strings are cached
+    static bool cacheable(const std::vector<Value>& args);
+
+    // Whether lookups are still worth their cost, caches of functions which
+    // are not annotated with @memo give up when they hardly ever hit
+    bool active() const { return forced || !gaveUp; }
+
+    const Value* find(const std::vector<Value>& args);
+    void insert(std::vector<Value> args, Value result);
+    // Forget all results and start over sampling the hit rate
+    void clear();
+
+private:
+    static constexpr size_t kSlots = 4096;
+    // Lookups after which the hit rate is checked
+    static constexpr uint32_t kSamplePeriod = 4096;
+
+    struct Entry {
+        std::vector<Value> args;
+        Value result;
+        size_t hash = 0;
+        bool used = false;
+    };
+
+    static size_t hashOf(const std::vector<Value>& args);
+    static bool argsEqual(const std::vector<Value>& lhs,
+                          const std::vector<Value>& rhs);
+
+    std::vector<Entry> slots;
+    bool forced;
+    bool gaveUp = false;
+    uint32_t lookups = 0;
+    uint32_t hits = 0;
+};
+
+//===----------------------------------------------------------------------===//
+// Automatic memoization of user defined functions. A function is pure when it
+// only calls builtins without side effects (print, println and input are not)
+// and pure user functions. Writes to outer variables need no check, a lin
+// function only ever sees its own parameters and locals. Annotating a function
+// with @memo or @nomemo overrides the analysis.
+//===----------------------------------------------------------------------===//
+class Memo {
+public:
+    // Attach result caches to the functions of rt, run once after parsing
+    static void analyze(Runtime* rt);
+    // Record whether f of rt is pure and attach a result cache to it if it
+    // is to be memoized, for functions whose purity is known already
+    static void attach(Runtime* rt, Function* f, bool pure);
+    // Analyze functions of rt again after their bodies or callees changed,
+    // other functions keep the purity recorded for them. Results cached for
+    // the functions are dropped.
+    static void reanalyze(Runtime* rt, const std::vector<Function*>& functions);
+};
+}  // namespace lin
@@ -0,0 +1,953 @@
+#include "Module.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include "Ast.h"
+#include "Memo.h"
+#include "Parser.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+constexpr char kMagic[8] = {'L', 'I', 'N', 'M', 'O', 'D', 'L', '4'};
+
+struct Header {
+    char magic[8];
+    // Source the module was compiled from
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t fileSize;
+    // Bytes following the header, a damaged file is compiled again
+    uint64_t payloadHash;
+};
+
+// Syntax trees are written as node records in post-order, a record follows
+// the records of its children and reading it takes them off a stack
+enum Tag : uint8_t {
+    TagAbsent,
+    TagBool,
+    TagChar,
+    TagNull,
+    TagInt,
+    TagBigInt,
+    TagDouble,
+    TagString,
+    TagArray,
+    TagDict,
+    TagIdent,
+    TagIndex,
+    TagSlice,
+    TagBinary,
+    TagLogical,
+    TagFunCall,
+    TagAssign,
+    TagBreak,
+    TagContinue,
+    TagExpression,
+    TagReturn,
+    TagIf,
+    TagFor,
+    TagWhile,
+    TagBlock,
+};
+
+// Node of a syntax tree being written or read, blocks are no AST nodes and
+// optional children are absent
+struct Item {
+    AstNode* node{};
+    Block* block{};
+    bool statement = false;
+};
+
+struct LinkedModule {
+    std::unique_ptr<Runtime> rt;
+    // Functions defined by the module itself, in the order of definition
+    std::vector<Function*> functions;
+};
+
+struct Registry {
+    std::string cacheDirectory;
+    // Linked modules keyed by the hash of their source and the directory
+    // their imports are resolved against
+    std::map<std::pair<uint64_t, std::string>, std::unique_ptr<LinkedModule>>
+        modules;
+    // Modules being linked, importing one of them again is a cycle
+    std::set<std::string> linking;
+};
+
+Registry& registry() {
+    // Never destroyed, functions of modules may be referred to until exit
+    static auto* registry = new Registry;
+    return *registry;
+}
+
+// FNV-1a
+uint64_t hashOf(std::string_view text) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string directoryOf(const std::string& path) {
+    return path.substr(0, path.rfind('/') + 1);
+}
+
+std::string resolve(const std::string& path, const std::string& directory) {
+    return !path.empty() && path[0] == '/' ? path : directory + path;
+}
+
+bool readFile(const std::string& path, std::string& text) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    text.assign(std::istreambuf_iterator<char>(in),
+                std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+Expression* genericOf(Expression* e) {
+    if (auto* q = dynamic_cast<QuickenedExpr*>(e)) {
+        return q->genericExpr();
+    }
+    return e;
+}
+
+class ModuleWriter {
+public:
+    void addFunction(Function* f);
+    void addString(const std::string& s) {
+        add<uint32_t>(s.size());
+        bytes += s;
+    }
+    template <typename _Type>
+    void add(_Type v) {
+        bytes.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    std::string bytes;
+
+private:
+    // Children of item in the order they are written
+    static void childrenOf(const Item& item, std::vector<Item>& children);
+    void addRecord(const Item& item);
+};
+
+void ModuleWriter::childrenOf(const Item& item, std::vector<Item>& children) {
+    auto expr = [&](Expression* e) {
+        children.push_back(Item{e != nullptr ? genericOf(e) : nullptr});
+    };
+    auto block = [&](Block* b) { children.push_back(Item{nullptr, b}); };
+    if (item.block != nullptr) {
+        for (auto* stmt : item.block->stmts) {
+            children.push_back(Item{stmt});
+        }
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(item.node)) {
+        for (auto* element : e->literal) {
+            expr(element);
+        }
+    } else if (auto* e = dynamic_cast<DictExpr*>(item.node)) {
+        for (auto& [key, value] : e->literal) {
+            expr(key);
+            expr(value);
+        }
+    } else if (auto* e = dynamic_cast<IndexExpr*>(item.node)) {
+        expr(e->index);
+        expr(e->second);
+    } else if (auto* e = dynamic_cast<SliceExpr*>(item.node)) {
+        expr(e->base);
+        expr(e->lo);
+        expr(e->hi);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(item.node)) {
+        expr(e->lhs);
+        expr(e->rhs);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(item.node)) {
+        expr(e->lhs);
+        expr(e->rhs);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(item.node)) {
+        for (auto* arg : e->args) {
+            expr(arg);
+        }
+    } else if (auto* e = dynamic_cast<AssignExpr*>(item.node)) {
+        expr(e->lhs);
+        expr(e->rhs);
+    } else if (auto* s = dynamic_cast<ExpressionStmt*>(item.node)) {
+        expr(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(item.node)) {
+        expr(s->ret);
+    } else if (auto* s = dynamic_cast<IfStmt*>(item.node)) {
+        expr(s->cond);
+        block(s->block);
+        block(s->elseBlock);
+    } else if (auto* s = dynamic_cast<ForStmt*>(item.node)) {
+        expr(s->lo);
+        expr(s->hi);
+        expr(s->step);
+        block(s->block);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(item.node)) {
+        expr(s->cond);
+        block(s->block);
+    }
+}
+
+void ModuleWriter::addRecord(const Item& item) {
+    if (item.block != nullptr) {
+        add<uint8_t>(TagBlock);
+        add<uint32_t>(item.block->stmts.size());
+        return;
+    }
+    auto* node = item.node;
+    if (node == nullptr) {
+        add<uint8_t>(TagAbsent);
+        return;
+    }
+    auto header = [&](Tag tag) {
+        add<uint8_t>(tag);
+        add<int32_t>(node->line);
+        add<int32_t>(node->column);
+    };
+    if (auto* e = dynamic_cast<BoolExpr*>(node)) {
+        header(TagBool);
+        add<uint8_t>(e->literal);
+    } else if (auto* e = dynamic_cast<CharExpr*>(node)) {
+        header(TagChar);
+        add<char>(e->literal);
+    } else if (dynamic_cast<NullExpr*>(node)) {
+        header(TagNull);
+    } else if (auto* e = dynamic_cast<IntExpr*>(node)) {
+        header(TagInt);
+        add<int64_t>(e->literal);
+    } else if (auto* e = dynamic_cast<BigIntExpr*>(node)) {
+        header(TagBigInt);
+        addString(e->literal.str());
+    } else if (auto* e = dynamic_cast<DoubleExpr*>(node)) {
+        header(TagDouble);
+        add<double>(e->literal);
+    } else if (auto* e = dynamic_cast<StringExpr*>(node)) {
+        header(TagString);
+        addString(std::string(e->literal.view()));
+    } else if (auto* e = dynamic_cast<ArrayExpr*>(node)) {
+        header(TagArray);
+        add<uint32_t>(e->literal.size());
+    } else if (auto* e = dynamic_cast<DictExpr*>(node)) {
+        header(TagDict);
+        add<uint32_t>(e->literal.size());
+    } else if (auto* e = dynamic_cast<IdentExpr*>(node)) {
+        header(TagIdent);
+        addString(e->identName);
+    } else if (auto* e = dynamic_cast<IndexExpr*>(node)) {
+        header(TagIndex);
+        addString(e->identName);
+    } else if (dynamic_cast<SliceExpr*>(node)) {
+        header(TagSlice);
+    } else if (auto* e = dynamic_cast<BinaryExpr*>(node)) {
+        header(TagBinary);
+        add<uint8_t>(e->opt);
+    } else if (auto* e = dynamic_cast<LogicalExpr*>(node)) {
+        header(TagLogical);
+        add<uint8_t>(e->opt);
+    } else if (auto* e = dynamic_cast<FunCallExpr*>(node)) {
+        header(TagFunCall);
+        addString(e->funcName);
+        add<uint32_t>(e->args.size());
+    } else if (auto* e = dynamic_cast<AssignExpr*>(node)) {
+        header(TagAssign);
+        add<uint8_t>(e->opt);
+    } else if (dynamic_cast<BreakStmt*>(node)) {
+        header(TagBreak);
+    } else if (dynamic_cast<ContinueStmt*>(node)) {
+        header(TagContinue);
+    } else if (dynamic_cast<ExpressionStmt*>(node)) {
+        header(TagExpression);
+    } else if (dynamic_cast<ReturnStmt*>(node)) {
+        header(TagReturn);
+    } else if (dynamic_cast<IfStmt*>(node)) {
+        header(TagIf);
+    } else if (auto* s = dynamic_cast<ForStmt*>(node)) {
+        header(TagFor);
+        addString(s->identName);
+    } else if (dynamic_cast<WhileStmt*>(node)) {
+        header(TagWhile);
+    } else {
+        panic("ImportError: can not compile %s\n", typeid(*node).name());
+    }
+}
+
+void ModuleWriter::addFunction(Function* f) {
+    addString(f->name);
+    add<uint32_t>(f->params.size());
+    for (auto& param : f->params) {
+        addString(param);
+    }
+    add<uint8_t>(f->memoize);
+
+    // The number of records is known once they are written
+    size_t countAt = bytes.size();
+    add<uint32_t>(0);
+    uint32_t count = 0;
+    std::vector<std::pair<Item, bool>> stack{{Item{nullptr, f->block}, false}};
+    std::vector<Item> children;
+    while (!stack.empty()) {
+        auto [item, expanded] = stack.back();
+        stack.pop_back();
+        if (expanded) {
+            addRecord(item);
+            count++;
+            continue;
+        }
+        stack.emplace_back(item, true);
+        children.clear();
+        childrenOf(item, children);
+        for (auto c = children.rbegin(); c != children.rend(); ++c) {
+            stack.emplace_back(*c, false);
+        }
+    }
+    memcpy(&bytes[countAt], &count, sizeof(count));
+}
+
+class ModuleReader {
+public:
+    explicit ModuleReader(const std::string& bytes) : bytes(bytes) {}
+    ~ModuleReader() {
+        // Left over by a corrupt file
+        for (auto& item : stack) {
+            delete item.node;
+            delete item.block;
+        }
+    }
+
+    Function* readFunction();
+    std::string readString() {
+        auto size = read<uint32_t>();
+        need(size);
+        pos += size;
+        return bytes.substr(pos - size, size);
+    }
+    template <typename _Type>
+    _Type read() {
+        _Type v;
+        need(sizeof(v));
+        memcpy(&v, bytes.data() + pos, sizeof(v));
+        pos += sizeof(v);
+        return v;
+    }
+    bool done() const { return pos == bytes.size(); }
+
+    [[noreturn]] static void corrupted() {
+        panic("ImportError: compiled module is corrupted\n");
+    }
+
+private:
+    enum Kind {
+        KindExpr,
+        KindOptionalExpr,
+        KindStmt,
+        KindBlock,
+        KindOptionalBlock,
+    };
+
+    void need(size_t size) {
+        if (size > bytes.size() - pos) {
+            corrupted();
+        }
+    }
+
+    // Children are checked before a node is built of them, so nodes are
+    // never lost or freed twice on the way out of a corrupt file
+    static bool fits(const Item& item, Kind kind);
+    void require(std::initializer_list<Kind> kinds);
+    void require(size_t count, Kind kind);
+    Expression* popExpr();
+    Statement* popStmt();
+    Block* popBlock();
+
+    void readRecord();
+    Token readToken();
+    StringData intern(const std::string& literal);
+
+    const std::string& bytes;
+    size_t pos = 0;
+    std::vector<Item> stack;
+    std::unordered_map<std::string, StringData> literals;
+};
+
+bool ModuleReader::fits(const Item& item, Kind kind) {
+    switch (kind) {
+        case KindExpr:
+            return item.node != nullptr && !item.statement;
+        case KindOptionalExpr:
+            return item.block == nullptr && !item.statement;
+        case KindStmt:
+            return item.statement;
+        case KindBlock:
+            return item.block != nullptr;
+        case KindOptionalBlock:
+            return item.node == nullptr;
+    }
+    return false;
+}
+
+void ModuleReader::require(std::initializer_list<Kind> kinds) {
+    if (kinds.size() > stack.size()) {
+        corrupted();
+    }
+    auto item = stack.end() - kinds.size();
+    for (auto kind : kinds) {
+        if (!fits(*item++, kind)) {
+            corrupted();
+        }
+    }
+}
+
+void ModuleReader::require(size_t count, Kind kind) {
+    if (count > stack.size()) {
+        corrupted();
+    }
+    for (auto item = stack.end() - count; item != stack.end(); ++item) {
+        if (!fits(*item, kind)) {
+            corrupted();
+        }
+    }
+}
+
+Expression* ModuleReader::popExpr() {
+    auto* e = static_cast<Expression*>(stack.back().node);
+    stack.pop_back();
+    return e;
+}
+
+Statement* ModuleReader::popStmt() {
+    auto* s = static_cast<Statement*>(stack.back().node);
+    stack.pop_back();
+    return s;
+}
+
+Block* ModuleReader::popBlock() {
+    auto* b = stack.back().block;
+    stack.pop_back();
+    return b;
+}
+
+Token ModuleReader::readToken() {
+    auto opt = read<uint8_t>();
+    if (opt > KW_IMPORT) {
+        corrupted();
+    }
+    return static_cast<Token>(opt);
+}
+
+StringData ModuleReader::intern(const std::string& literal) {
+    auto res = literals.find(literal);
+    if (res == literals.end()) {
+        res = literals.emplace(literal, StringData(literal)).first;
+        res->second.hash();
+    }
+    return res->second;
+}
+
+void ModuleReader::readRecord() {
+    auto tag = read<uint8_t>();
+    if (tag == TagAbsent) {
+        stack.push_back(Item{});
+        return;
+    }
+    if (tag == TagBlock) {
+        auto count = read<uint32_t>();
+        require(count, KindStmt);
+        auto* b = new Block;
+        b->stmts.resize(count);
+        for (size_t i = count; i > 0; i--) {
+            b->stmts[i - 1] = popStmt();
+        }
+        stack.push_back(Item{nullptr, b});
+        return;
+    }
+    auto line = read<int32_t>();
+    auto column = read<int32_t>();
+    switch (tag) {
+        case TagBool: {
+            auto literal = read<uint8_t>() != 0;
+            auto* e = new BoolExpr(line, column);
+            e->literal = literal;
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagChar: {
+            auto literal = read<char>();
+            auto* e = new CharExpr(line, column);
+            e->literal = literal;
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagNull:
+            stack.push_back(Item{new NullExpr(line, column)});
+            break;
+        case TagInt: {
+            auto literal = read<int64_t>();
+            auto* e = new IntExpr(line, column);
+            e->literal = literal;
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagBigInt: {
+            auto literal = readString();
+            auto* e = new BigIntExpr(line, column);
+            e->literal = BigIntData::parse(literal);
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagDouble: {
+            auto literal = read<double>();
+            auto* e = new DoubleExpr(line, column);
+            e->literal = literal;
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagString: {
+            auto literal = intern(readString());
+            auto* e = new StringExpr(line, column);
+            e->literal = literal;
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagArray: {
+            auto count = read<uint32_t>();
+            require(count, KindExpr);
+            auto* e = new ArrayExpr(line, column);
+            e->literal.resize(count);
+            for (size_t i = count; i > 0; i--) {
+                e->literal[i - 1] = popExpr();
+            }
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagDict: {
+            auto count = read<uint32_t>();
+            if (count > stack.size() / 2) {
+                corrupted();
+            }
+            require(count * 2, KindExpr);
+            auto* e = new DictExpr(line, column);
+            e->literal.resize(count);
+            for (size_t i = count; i > 0; i--) {
+                e->literal[i - 1].second = popExpr();
+                e->literal[i - 1].first = popExpr();
+            }
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagIdent: {
+            auto name = readString();
+            stack.push_back(Item{new IdentExpr(std::move(name), line, column)});
+            break;
+        }
+        case TagIndex: {
+            auto name = readString();
+            require({KindExpr, KindOptionalExpr});
+            auto* e = new IndexExpr(line, column);
+            e->identName = std::move(name);
+            e->second = popExpr();
+            e->index = popExpr();
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagSlice: {
+            require({KindExpr, KindOptionalExpr, KindOptionalExpr});
+            auto* e = new SliceExpr(line, column);
+            e->hi = popExpr();
+            e->lo = popExpr();
+            e->base = popExpr();
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagBinary: {
+            // Unary operators have no rhs
+            auto opt = readToken();
+            require({KindExpr, KindOptionalExpr});
+            auto* e = new BinaryExpr(line, column);
+            e->opt = opt;
+            e->rhs = popExpr();
+            e->lhs = popExpr();
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagLogical: {
+            auto opt = readToken();
+            require({KindExpr, KindExpr});
+            auto* e = new LogicalExpr(line, column);
+            e->opt = opt;
+            e->rhs = popExpr();
+            e->lhs = popExpr();
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagFunCall: {
+            auto name = readString();
+            auto count = read<uint32_t>();
+            require(count, KindExpr);
+            auto* e = new FunCallExpr(line, column);
+            e->funcName = std::move(name);
+            e->args.resize(count);
+            for (size_t i = count; i > 0; i--) {
+                e->args[i - 1] = popExpr();
+            }
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagAssign: {
+            auto opt = readToken();
+            require({KindExpr, KindExpr});
+            auto* e = new AssignExpr(line, column);
+            e->opt = opt;
+            e->rhs = popExpr();
+            e->lhs = popExpr();
+            stack.push_back(Item{e});
+            break;
+        }
+        case TagBreak: {
+            auto* s = new BreakStmt(line, column);
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagContinue: {
+            auto* s = new ContinueStmt(line, column);
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagExpression: {
+            require({KindExpr});
+            auto* s = new ExpressionStmt(nullptr, line, column);
+            s->expr = popExpr();
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagReturn: {
+            require({KindOptionalExpr});
+            auto* s = new ReturnStmt(line, column);
+            s->ret = popExpr();
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagIf: {
+            require({KindExpr, KindBlock, KindOptionalBlock});
+            auto* s = new IfStmt(line, column);
+            s->elseBlock = popBlock();
+            s->block = popBlock();
+            s->cond = popExpr();
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagFor: {
+            auto name = readString();
+            require({KindExpr, KindExpr, KindOptionalExpr, KindBlock});
+            auto* s = new ForStmt(line, column);
+            s->identName = std::move(name);
+            s->block = popBlock();
+            s->step = popExpr();
+            s->hi = popExpr();
+            s->lo = popExpr();
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        case TagWhile: {
+            require({KindExpr, KindBlock});
+            auto* s = new WhileStmt(line, column);
+            s->block = popBlock();
+            s->cond = popExpr();
+            stack.push_back(Item{s, nullptr, true});
+            break;
+        }
+        default:
+            corrupted();
+    }
+}
+
+Function* ModuleReader::readFunction() {
+    auto name = readString();
+    std::vector<std::string> params(read<uint32_t>());
+    for (auto& param : params) {
+        param = readString();
+    }
+    auto memoize = read<uint8_t>();
+    if (memoize > MemoizeOff) {
+        corrupted();
+    }
+    auto records = read<uint32_t>();
+    for (uint32_t i = 0; i < records; i++) {
+        readRecord();
+    }
+    if (stack.size() != 1) {
+        corrupted();
+    }
+    require({KindBlock});
+    auto* f = new Function;
+    f->name = std::move(name);
+    f->params = std::move(params);
+    f->memoize = static_cast<MemoizeMode>(memoize);
+    f->block = popBlock();
+    return f;
+}
+
+std::string cacheFileOf(uint64_t hash) {
+    auto& dir = registry().cacheDirectory;
+    if (dir.empty()) {
+        return "";
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.linm",
+             static_cast<unsigned long long>(hash));
+    return resolve(name, dir.back() == '/' ? dir : dir + "/");
+}
+
+// Module as kept in a cache file, along with the imports it was linked to
+struct CompiledModule {
+    std::vector<Function*> functions;
+    // Results of the purity analysis for the functions
+    std::vector<bool> pure;
+    // Paths as written in the module and hashes of the sources they had
+    std::vector<std::pair<std::string, uint64_t>> imports;
+};
+
+// The compiled module in path, or false if there is no usable one
+bool readCompiled(const std::string& path, const std::string& source,
+                  uint64_t hash, CompiledModule& module) {
+    std::string bytes;
+    if (!readFile(path, bytes) || bytes.size() < sizeof(Header)) {
+        return false;
+    }
+    Header h;
+    memcpy(&h, bytes.data(), sizeof(h));
+    if (memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 ||
+        h.sourceHash != hash || h.sourceSize != source.size() ||
+        h.fileSize != bytes.size() ||
+        h.payloadHash !=
+            hashOf(std::string_view(bytes).substr(sizeof(Header)))) {
+        return false;
+    }
+    ModuleReader reader(bytes);
+    try {
+        reader.read<Header>();
+        auto importCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < importCount; i++) {
+            auto import = reader.readString();
+            module.imports.emplace_back(import, reader.read<uint64_t>());
+        }
+        auto functionCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < functionCount; i++) {
+            module.functions.push_back(reader.readFunction());
+            module.pure.push_back(reader.read<uint8_t>() != 0);
+        }
+        if (!reader.done()) {
+            ModuleReader::corrupted();
+        }
+    } catch (const LinError&) {
+        for (auto* f : module.functions) {
+            delete f;
+        }
+        module = CompiledModule{};
+        return false;
+    }
+    return true;
+}
+
+void writeCompiled(const std::string& path, const std::string& source,
+                   uint64_t hash, const CompiledModule& module) {
+    ModuleWriter writer;
+    writer.add(Header{});
+    writer.add<uint32_t>(module.imports.size());
+    for (auto& [import, importHash] : module.imports) {
+        writer.addString(import);
+        writer.add<uint64_t>(importHash);
+    }
+    writer.add<uint32_t>(module.functions.size());
+    for (auto* f : module.functions) {
+        writer.addFunction(f);
+        writer.add<uint8_t>(f->pure);
+    }
+    Header h{};
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.sourceHash = hash;
+    h.sourceSize = source.size();
+    h.fileSize = writer.bytes.size();
+    h.payloadHash =
+        hashOf(std::string_view(writer.bytes).substr(sizeof(Header)));
+    memcpy(&writer.bytes[0], &h, sizeof(h));
+
+    // Written aside and renamed, a reader never sees a partial file. The
+    // cache only saves parsing, failing to write it is no error
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(writer.bytes.data(), writer.bytes.size());
+        if (!out.flush()) {
+            out.close();
+            remove(temp.c_str());
+            return;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        remove(temp.c_str());
+    }
+}
+
+void addFunctionOf(Runtime* rt, Function* f, const std::string& module) {
+    if (auto* defined = rt->getFunction(f->name); defined != nullptr) {
+        // Imported once more along another path
+        if (defined == f) {
+            return;
+        }
+        panic("ImportError: function %s of module %s is already defined\n",
+              f->name.c_str(), module.c_str());
+    }
+    rt->addFunction(f->name, f);
+}
+
+// Link the module at path and register its functions into rt, returns the
+// hash of its source
+uint64_t importModule(Runtime* rt, const std::string& path,
+                      const std::string& directory);
+
+std::unique_ptr<LinkedModule> link(const std::string& path,
+                                   const std::string& source, uint64_t hash) {
+    auto linked = std::make_unique<LinkedModule>();
+    linked->rt = std::make_unique<Runtime>();
+    auto* rt = linked->rt.get();
+    auto directory = directoryOf(path);
+    auto cacheFile = cacheFileOf(hash);
+
+    CompiledModule module;
+    bool cached = !cacheFile.empty() &&
+                  readCompiled(cacheFile, source, hash, module);
+    // Purity of functions depends on the functions they call, results of
+    // the analysis only hold while imported modules stay the same
+    bool analyzed = cached;
+    if (cached) {
+        for (size_t i = 0; i < module.functions.size(); i++) {
+            auto* f = module.functions[i];
+            if (rt->hasFunction(f->name)) {
+                // Functions added before belong to rt already
+                auto name = f->name;
+                for (; i < module.functions.size(); i++) {
+                    delete module.functions[i];
+                }
+                panic("SyntaxError: multiply function definitions of %s found",
+                      name.c_str());
+            }
+            rt->addFunction(f->name, f);
+        }
+        for (auto& [import, importHash] : module.imports) {
+            analyzed &= importModule(rt, import, directory) == importHash;
+        }
+    } else {
+        Parser p(std::make_unique<std::istringstream>(source), directory);
+        p.parse(rt);
+        if (!rt->getStatements().empty()) {
+            panic("ImportError: module %s has top-level statements\n",
+                  path.c_str());
+        }
+        for (auto* f : rt->getFunctions()) {
+            // Functions imported from further modules run there
+            if (f->home == nullptr) {
+                module.functions.push_back(f);
+            }
+        }
+        for (auto& import : p.getImports()) {
+            // Linked while parsing, this finds them again
+            module.imports.emplace_back(
+                import, importModule(rt, import, directory));
+        }
+    }
+    for (auto* f : module.functions) {
+        f->home = rt;
+    }
+    if (analyzed) {
+        for (size_t i = 0; i < module.functions.size(); i++) {
+            Memo::attach(rt, module.functions[i], module.pure[i]);
+        }
+    } else {
+        Memo::analyze(rt);
+    }
+    if (!cacheFile.empty() && !(cached && analyzed)) {
+        writeCompiled(cacheFile, source, hash, module);
+    }
+    linked->functions = std::move(module.functions);
+    return linked;
+}
+
+uint64_t importModule(Runtime* rt, const std::string& path,
+                      const std::string& directory) {
+    auto file = resolve(path, directory);
+    char resolved[PATH_MAX];
+    std::string source;
+    if (realpath(file.c_str(), resolved) == nullptr ||
+        !readFile(resolved, source)) {
+        panic("ImportError: can not open module %s\n", file.c_str());
+    }
+    file = resolved;
+
+    auto& state = registry();
+    if (state.linking.count(file) != 0) {
+        panic("ImportError: circular import of module %s\n", file.c_str());
+    }
+    auto key = std::make_pair(hashOf(source), directoryOf(file));
+    auto res = state.modules.find(key);
+    if (res == state.modules.end()) {
+        state.linking.insert(file);
+        std::unique_ptr<LinkedModule> linked;
+        try {
+            linked = link(file, source, key.first);
+        } catch (...) {
+            state.linking.erase(file);
+            throw;
+        }
+        state.linking.erase(file);
+        res = state.modules.emplace(key, std::move(linked)).first;
+    }
+    for (auto* f : res->second->functions) {
+        addFunctionOf(rt, f, file);
+    }
+    return key.first;
+}
+}  // namespace
+
+void Module::import(Runtime* rt, const std::string& path,
+                    const std::string& directory) {
+    importModule(rt, path, directory);
+}
+
+void Module::setCacheDirectory(std::string dir) {
+    // Create missing directories along the path, so the cache is not
+    // silently left unwritten. An empty path turns caching off.
+    for (size_t end = dir.find('/', 1); !dir.empty();
+         end = dir.find('/', end + 1)) {
+        auto prefix = dir.substr(0, end);
+        if (mkdir(prefix.c_str(), 0777) != 0 && errno != EEXIST) {
+            panic("ImportError: can not create module cache %s: %s\n",
+                  prefix.c_str(), strerror(errno));
+        }
+        if (end == std::string::npos) {
+            struct stat st;
+            if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+                panic("ImportError: module cache %s is not a directory\n",
+                      dir.c_str());
+            }
+            break;
+        }
+    }
+    registry().cacheDirectory = std::move(dir);
+}
+}  // namespace lin
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Modules are lin files which define functions for other files to import:
+//
+//   import "path/to/helpers.lin"
+//
+// A module may import further modules but has no top-level statements.
+// Relative paths are resolved against the directory of the importing file.
+// Each module is compiled and linked once per process into a runtime of its
+// own, which keeps its functions together with their compiled code and
+// result caches. Importing registers the functions defined by the module
+// itself into the importing runtime, they still run within the runtime of
+// their module.
+//
+// Compiled modules are keyed by a hash of their source. With a cache
+// directory set, the syntax trees of compiled modules are kept there across
+// runs, so unchanged modules are not parsed again. A cache file which does
+// not fit its source is ignored and written again.
+//===----------------------------------------------------------------------===//
+class Module {
+public:
+    // Register the functions of the module at path into rt, a relative path
+    // is resolved against directory
+    static void import(Runtime* rt, const std::string& path,
+                       const std::string& directory);
+
+    // Directory compiled modules are kept in, none by default. A missing
+    // directory is created, one which can not be is an ImportError.
+    static void setCacheDirectory(std::string dir);
+};
+}  // namespace lin
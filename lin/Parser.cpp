@@ -1,5 +1,10 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
 #include <typeinfo>
 #include "Lin.hpp"
+#include "Module.h"
 #include "Parser.h"
 #include "Utils.hpp"
 
@@ -12,61 +17,177 @@ void Parser::printLex(const std::string& fileName) {
     } while (std::get<0>(tk) != TK_EOF);
 }
 
+void Parser::benchmark(const std::string& fileName, std::ostream& out) {
+    std::string text;
+    std::string directory;
+    {
+        Parser p(fileName);
+        text = p.text;
+        directory = p.directory;
+    }
+    using Clock = std::chrono::steady_clock;
+    Clock::duration elapsed{};
+    int rounds = 0;
+    // Repeat for at least a second so that small files are timed reliably
+    while (rounds < 3 || elapsed < std::chrono::seconds(1)) {
+        // Neither setting up the runtime nor freeing the tree is timed
+        auto rt = std::make_unique<lin::Runtime>();
+        auto start = Clock::now();
+        Parser p(std::make_unique<std::istringstream>(text), directory);
+        p.parse(rt.get());
+        elapsed += Clock::now() - start;
+        rounds++;
+    }
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    double megabytes = static_cast<double>(text.size()) * rounds / 1e6;
+    out << fileName << ": " << text.size() << " bytes parsed " << rounds
+        << " times in " << seconds << " s, " << megabytes / seconds
+        << " MB/s\n";
+}
+
 Parser::Parser(const std::string& fileName)
+    : Parser(std::make_unique<std::ifstream>(fileName),
+             fileName.substr(0, fileName.rfind('/') + 1)) {
+    if (source->fail()) {
+        panic("ParserError: can not open source file");
+    }
+}
+
+Parser::Parser(std::unique_ptr<std::istream> source, std::string directory)
     : keywords({{"if", KW_IF},
                 {"else", KW_ELSE},
                 {"while", KW_WHILE},
                 {"null", KW_NULL},
                 {"true", KW_TRUE},
                 {"false", KW_FALSE},
-                {"for", KW_FALSE},
+                {"for", KW_FOR},
+                {"in", KW_IN},
                 {"func", KW_FUNC},
                 {"return", KW_RETURN},
                 {"break", KW_BREAK},
-                {"continue", KW_CONTINUE}}) {
-    fs.open(fileName);
-    if (!fs.is_open()) {
-        panic("ParserError: can not open source file");
+                {"continue", KW_CONTINUE},
+                {"import", KW_IMPORT}}),
+      source(std::move(source)),
+      directory(std::move(directory)) {
+    if (this->source->good()) {
+        // Keep the text, the runtime hands it on to snapshots and the lexer
+        // reads it in place
+        text.assign(std::istreambuf_iterator<char>(*this->source),
+                    std::istreambuf_iterator<char>());
     }
 }
 
-Parser::~Parser() { fs.close(); }
+lin::StringData Parser::internString(const std::string& literal) {
+    auto res = literals.find(literal);
+    if (res == literals.end()) {
+        res = literals.emplace(literal, lin::StringData(literal)).first;
+        res->second.hash();
+    }
+    return res->second;
+}
 
-Expression* Parser::parsePrimaryExpr() {
+void Parser::expect(Token tk, const char* lexeme) {
+    if (getCurrentToken() != tk) {
+        panic("SyntaxError: expects %s but got \"%s\" at line %d, col %d\n",
+              lexeme, getCurrentLexeme().c_str(), line, column);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+// Expressions are parsed by operator precedence with explicit stacks, so
+// neither long operator chains nor deeply nested brackets grow the C++ stack.
+// Each bracketed construct still open, e.g. the arguments of a call, is a
+// frame with its own base on the shared operand and operator stacks.
+//===----------------------------------------------------------------------===//
+struct Parser::ExprFrame {
+    enum Kind {
+        Root,
+        Group,
+        CallArgs,
+        ArrayItems,
+        DictKey,
+        DictValue,
+        IndexLo,
+        IndexSecond,
+        SliceHi,
+        AssignRhs,
+    };
+
+    Kind kind = Root;
+    // Sizes of the operand and operator stacks when the frame was opened
+    size_t operands = 0;
+    size_t operators = 0;
+    // Node the expression of the frame becomes part of
+    Expression* node{};
+    // Key of a dict entry waiting for its value
+    Expression* key{};
+    // Variable subscripted by an index or slice
+    std::string identName;
+};
+
+struct Parser::PendingOperator {
+    Token opt;
+    bool prefix;
+    // Position the node of the operator is reported at
+    int line;
+    int column;
+};
+
+static bool startsOperand(Token tk) {
+    return anyone(tk, LIT_DOUBLE, LIT_INT, LIT_STR, LIT_CHAR, TK_IDENT,
+                  TK_LPAREN, TK_LBRACKET, TK_LBRACE, KW_TRUE, KW_FALSE,
+                  KW_NULL);
+}
+
+Expression* Parser::parsePrimaryExpr(std::vector<ExprFrame>& frames,
+                                     size_t operands, size_t operators) {
+    auto open = [&](ExprFrame::Kind kind, Expression* node) {
+        frames.push_back(ExprFrame{kind, operands, operators, node});
+        return nullptr;
+    };
     if (getCurrentToken() == TK_IDENT) {
         auto ident = getCurrentLexeme();
         currentToken = next();
         switch (getCurrentToken()) {
             case TK_LPAREN: {
                 currentToken = next();
-                auto* val = new FunCallExpr(line, column);
+                std::unique_ptr<FunCallExpr> val(new FunCallExpr(line, column));
                 val->funcName = ident;
-                while (getCurrentToken() != TK_RPAREN) {
-                    val->args.push_back(parseExpression());
-                    if (getCurrentToken() == TK_COMMA) {
-                        currentToken = next();
-                    }
+                if (getCurrentToken() != TK_RPAREN) {
+                    return open(ExprFrame::CallArgs, val.release());
                 }
-                assert(getCurrentToken() == TK_RPAREN);
                 currentToken = next();
-                return val;
+                return val.release();
             }
             case TK_LBRACKET: {
                 currentToken = next();
-                auto* val = new IndexExpr(line, column);
-                val->identName = ident;
-                val->index = parseExpression();
-                assert(val->index != nullptr);
-                assert(getCurrentToken() == TK_RBRACKET);
+                if (getCurrentToken() != TK_COLON) {
+                    open(ExprFrame::IndexLo, nullptr);
+                    frames.back().identName = ident;
+                    return nullptr;
+                }
                 currentToken = next();
-                return val;
+                std::unique_ptr<SliceExpr> val(new SliceExpr(line, column));
+                val->base = new IdentExpr(ident, line, column);
+                if (getCurrentToken() != TK_RBRACKET) {
+                    return open(ExprFrame::SliceHi, val.release());
+                }
+                currentToken = next();
+                return val.release();
             }
             default: {
                 return new IdentExpr(ident, line, column);
             }
         }
     } else if (getCurrentToken() == LIT_INT) {
-        auto val = atoi(getCurrentLexeme().c_str());
+        errno = 0;
+        auto val = strtoll(getCurrentLexeme().c_str(), nullptr, 10);
+        if (errno == ERANGE) {
+            auto* ret = new BigIntExpr(line, column);
+            ret->literal = lin::BigIntData::parse(getCurrentLexeme());
+            currentToken = next();
+            return ret;
+        }
         currentToken = next();
         auto* ret = new IntExpr(line, column);
         ret->literal = val;
@@ -81,7 +202,7 @@ Expression* Parser::parsePrimaryExpr() {
         auto val = getCurrentLexeme();
         currentToken = next();
         auto* ret = new StringExpr(line, column);
-        ret->literal = val;
+        ret->literal = internString(val);
         return ret;
     } else if (getCurrentToken() == LIT_CHAR) {
         auto val = getCurrentLexeme();
@@ -100,77 +221,298 @@ Expression* Parser::parsePrimaryExpr() {
         return new NullExpr(line, column);
     } else if (getCurrentToken() == TK_LPAREN) {
         currentToken = next();
-        auto val = parseExpression();
-        assert(getCurrentToken() == TK_RPAREN);
-        currentToken = next();
-        return val;
+        return open(ExprFrame::Group, nullptr);
     } else if (getCurrentToken() == TK_LBRACKET) {
         currentToken = next();
-        auto* ret = new ArrayExpr(line, column);
+        std::unique_ptr<ArrayExpr> ret(new ArrayExpr(line, column));
         if (getCurrentToken() != TK_RBRACKET) {
-            while (getCurrentToken() != TK_RBRACKET) {
-                ret->literal.push_back(parseExpression());
-                if (getCurrentToken() == TK_COMMA) {
-                    currentToken = next();
-                }
-            }
-            assert(getCurrentToken() == TK_RBRACKET);
-            currentToken = next();
-            return ret;
-        } else {
-            currentToken = next();
-            // It's an empty array literal
-            return ret;
+            return open(ExprFrame::ArrayItems, ret.release());
         }
+        currentToken = next();
+        // It's an empty array literal
+        return ret.release();
+    } else if (getCurrentToken() == TK_LBRACE) {
+        currentToken = next();
+        std::unique_ptr<DictExpr> ret(new DictExpr(line, column));
+        if (getCurrentToken() != TK_RBRACE) {
+            return open(ExprFrame::DictKey, ret.release());
+        }
+        currentToken = next();
+        return ret.release();
     }
     return nullptr;
 }
 
-Expression* Parser::parseUnaryExpr() {
-    if (anyone(getCurrentToken(), TK_MINUS, TK_LOGNOT, TK_BITNOT)) {
-        auto val = new BinaryExpr(line, column);
-        val->opt = getCurrentToken();
-        currentToken = next();
-        val->lhs = parseUnaryExpr();
-        return val;
-    } else if (anyone(getCurrentToken(), LIT_DOUBLE, LIT_INT, LIT_STR, LIT_CHAR,
-                      TK_IDENT, TK_LPAREN, TK_LBRACKET, KW_TRUE, KW_FALSE,
-                      KW_NULL)) {
-        return parsePrimaryExpr();
+Expression* Parser::closeFrame(std::vector<ExprFrame>& frames,
+                               Expression* e) {
+    auto& frame = frames.back();
+    // e is owned here until it becomes part of a node of the frame, so that
+    // it is freed if a syntax error is raised before
+    std::unique_ptr<Expression> owned(e);
+    Expression* result = nullptr;
+    switch (frame.kind) {
+        case ExprFrame::Group:
+            expect(TK_RPAREN, "\")\"");
+            currentToken = next();
+            result = owned.release();
+            break;
+        case ExprFrame::CallArgs: {
+            auto* call = static_cast<FunCallExpr*>(frame.node);
+            call->args.push_back(owned.release());
+            if (getCurrentToken() == TK_COMMA) {
+                currentToken = next();
+            }
+            if (getCurrentToken() != TK_RPAREN) {
+                // Next argument
+                return nullptr;
+            }
+            currentToken = next();
+            result = call;
+            break;
+        }
+        case ExprFrame::ArrayItems: {
+            auto* array = static_cast<ArrayExpr*>(frame.node);
+            array->literal.push_back(owned.release());
+            if (getCurrentToken() == TK_COMMA) {
+                currentToken = next();
+            }
+            if (getCurrentToken() != TK_RBRACKET) {
+                return nullptr;
+            }
+            currentToken = next();
+            result = array;
+            break;
+        }
+        case ExprFrame::DictKey:
+            frame.key = owned.release();
+            expect(TK_COLON, "\":\"");
+            currentToken = next();
+            frame.kind = ExprFrame::DictValue;
+            return nullptr;
+        case ExprFrame::DictValue: {
+            auto* dict = static_cast<DictExpr*>(frame.node);
+            dict->literal.emplace_back(frame.key, owned.release());
+            frame.key = nullptr;
+            if (getCurrentToken() == TK_COMMA) {
+                currentToken = next();
+            }
+            if (getCurrentToken() != TK_RBRACE) {
+                frame.kind = ExprFrame::DictKey;
+                return nullptr;
+            }
+            currentToken = next();
+            result = dict;
+            break;
+        }
+        case ExprFrame::IndexLo:
+            if (getCurrentToken() == TK_COLON) {
+                currentToken = next();
+                auto* val = new SliceExpr(line, column);
+                val->base = new IdentExpr(frame.identName, line, column);
+                val->lo = owned.release();
+                frame.kind = ExprFrame::SliceHi;
+                frame.node = val;
+                if (getCurrentToken() != TK_RBRACKET) {
+                    return nullptr;
+                }
+                currentToken = next();
+                result = val;
+            } else {
+                auto* val = new IndexExpr(line, column);
+                val->identName = frame.identName;
+                val->index = owned.release();
+                frame.node = val;
+                // Second index of m[i, j] or m[i][j]
+                if (getCurrentToken() != TK_COMMA) {
+                    expect(TK_RBRACKET, "\"]\"");
+                }
+                bool comma = getCurrentToken() == TK_COMMA;
+                currentToken = next();
+                if (comma || getCurrentToken() == TK_LBRACKET) {
+                    if (!comma) {
+                        currentToken = next();
+                    }
+                    frame.kind = ExprFrame::IndexSecond;
+                    return nullptr;
+                }
+                result = val;
+            }
+            break;
+        case ExprFrame::IndexSecond:
+            static_cast<IndexExpr*>(frame.node)->second = owned.release();
+            expect(TK_RBRACKET, "\"]\"");
+            currentToken = next();
+            // Only matrices take two indices, a[i][j][k] has no meaning
+            if (getCurrentToken() == TK_LBRACKET) {
+                panic(
+                    "SyntaxError: expects at most two indices but got \"[\" "
+                    "at line %d, col %d\n",
+                    line, column);
+            }
+            result = frame.node;
+            break;
+        case ExprFrame::SliceHi:
+            static_cast<SliceExpr*>(frame.node)->hi = owned.release();
+            expect(TK_RBRACKET, "\"]\"");
+            currentToken = next();
+            result = frame.node;
+            break;
+        default:
+            break;
     }
-    return nullptr;
+    frames.pop_back();
+    return result;
 }
 
-Expression* Parser::parseExpression(short oldPrecedence) {
-    auto* p = parseUnaryExpr();
+Expression* Parser::parseExpression() {
+    std::vector<ExprFrame> frames(1);
+    std::vector<Expression*> operands;
+    std::vector<PendingOperator> operators;
+    // Node built last which is neither an operand nor part of a frame yet
+    Expression* p = nullptr;
+
+    // Whatever is still held when parsing ends was left over by a syntax
+    // error, a complete expression is handed out before
+    struct Discard {
+        std::vector<ExprFrame>& frames;
+        std::vector<Expression*>& operands;
+        Expression*& p;
 
-    if (anyone(getCurrentToken(), TK_ASSIGN, TK_PLUS_AGN, TK_MINUS_AGN,
-               TK_TIMES_AGN, TK_DIV_AGN, TK_MOD_AGN)) {
-        if (typeid(*p) != typeid(IdentExpr) &&
-            typeid(*p) != typeid(IndexExpr)) {
-            panic("SyntaxError: can not assign to %s", typeid(*p).name());
+        ~Discard() {
+            delete p;
+            for (auto* e : operands) {
+                delete e;
+            }
+            for (auto& frame : frames) {
+                delete frame.node;
+                delete frame.key;
+            }
         }
-        auto* assignExpr = new AssignExpr(line, column);
-        assignExpr->opt = getCurrentToken();
-        assignExpr->lhs = p;
-        currentToken = next();
-        assignExpr->rhs = parseExpression();
-        return assignExpr;
-    }
+    } discard{frames, operands, p};
 
-    while (anyone(getCurrentToken(), TK_BITOR, TK_BITAND, TK_BITNOT, TK_LOGOR,
-                  TK_LOGAND, TK_LOGNOT, TK_EQ, TK_NE, TK_GT, TK_GE, TK_LT,
-                  TK_LE, TK_PLUS, TK_MINUS, TK_MOD, TK_TIMES, TK_DIV)) {
-        short currentPrecedence = Parser::precedence(getCurrentToken());
-        if (oldPrecedence > currentPrecedence) {
-            return p;
+    // Build nodes of binary operators of the innermost frame which bind at
+    // least as tight as minPrecedence, all binary operators are left
+    // associative
+    auto reduce = [&](short minPrecedence) {
+        while (operators.size() > frames.back().operators &&
+               precedence(operators.back().opt) >= minPrecedence) {
+            auto op = operators.back();
+            operators.pop_back();
+            auto* rhs = operands.back();
+            operands.pop_back();
+            auto* lhs = operands.back();
+            operands.pop_back();
+            if (anyone(op.opt, TK_LOGAND, TK_LOGOR)) {
+                auto* node = new LogicalExpr(op.line, op.column);
+                node->lhs = lhs;
+                node->opt = op.opt;
+                node->rhs = rhs;
+                operands.push_back(node);
+            } else {
+                auto* node = new BinaryExpr(op.line, op.column);
+                node->lhs = lhs;
+                node->opt = op.opt;
+                node->rhs = rhs;
+                operands.push_back(node);
+            }
+        }
+    };
+
+    for (;;) {
+        // Operand, prefix operators apply to it before any binary operator
+        size_t prefixes = operators.size();
+        while (anyone(getCurrentToken(), TK_MINUS, TK_LOGNOT, TK_BITNOT)) {
+            operators.push_back(
+                PendingOperator{getCurrentToken(), true, line, column});
+            currentToken = next();
+        }
+        if (!startsOperand(getCurrentToken())) {
+            if (operators.size() > prefixes) {
+                panic(
+                    "SyntaxError: expects operand but got \"%s\" at line %d, "
+                    "col %d\n",
+                    getCurrentLexeme().c_str(), line, column);
+            }
+            if (frames.size() == 1 && operands.empty() && operators.empty()) {
+                // Nothing here looks like an expression
+                return nullptr;
+            }
+            panic(
+                "SyntaxError: expects expression but got \"%s\" at line %d, "
+                "col %d\n",
+                getCurrentLexeme().c_str(), line, column);
+        }
+        p = parsePrimaryExpr(frames, operands.size(), operators.size());
+        bool assigned = false;
+        while (p != nullptr) {
+            if (!assigned) {
+                while (operators.size() > frames.back().operators &&
+                       operators.back().prefix) {
+                    auto op = operators.back();
+                    operators.pop_back();
+                    auto* val = new BinaryExpr(op.line, op.column);
+                    val->opt = op.opt;
+                    val->lhs = p;
+                    p = val;
+                }
+                if (anyone(getCurrentToken(), TK_ASSIGN, TK_PLUS_AGN,
+                           TK_MINUS_AGN, TK_TIMES_AGN, TK_DIV_AGN,
+                           TK_MOD_AGN)) {
+                    if (typeid(*p) != typeid(IdentExpr) &&
+                        typeid(*p) != typeid(IndexExpr)) {
+                        panic("SyntaxError: can not assign to %s",
+                              typeid(*p).name());
+                    }
+                    auto* assignExpr = new AssignExpr(line, column);
+                    assignExpr->opt = getCurrentToken();
+                    assignExpr->lhs = p;
+                    frames.push_back(ExprFrame{ExprFrame::AssignRhs,
+                                               operands.size(),
+                                               operators.size(), assignExpr});
+                    p = nullptr;
+                    currentToken = next();
+                    break;
+                }
+            }
+            operands.push_back(p);
+            p = nullptr;
+
+            if (short currentPrecedence = precedence(getCurrentToken());
+                currentPrecedence > 0) {
+                reduce(currentPrecedence);
+                operators.push_back(
+                    PendingOperator{getCurrentToken(), false, line, column});
+                currentToken = next();
+                break;
+            }
+            // The innermost frame ends here
+            reduce(1);
+            auto* e = operands.back();
+            operands.pop_back();
+            if (frames.back().kind == ExprFrame::Root) {
+                return e;
+            }
+            if (frames.back().kind == ExprFrame::AssignRhs) {
+                // An assignment takes everything up to where its value ends
+                auto* assignExpr = static_cast<AssignExpr*>(frames.back().node);
+                assignExpr->rhs = e;
+                frames.pop_back();
+                p = assignExpr;
+                assigned = true;
+                continue;
+            }
+            p = closeFrame(frames, e);
+            assigned = false;
         }
-        auto tmp = new BinaryExpr(line, column);
-        tmp->lhs = p;
-        tmp->opt = getCurrentToken();
-        currentToken = next();
-        tmp->rhs = parseExpression(currentPrecedence + 1);
-        p = tmp;
+    }
+}
+
+Expression* Parser::parseOperand() {
+    auto* p = parseExpression();
+    if (p == nullptr) {
+        panic("SyntaxError: expects expression but got \"%s\" at line %d, "
+              "col %d\n",
+              getCurrentLexeme().c_str(), line, column);
     }
     return p;
 }
@@ -184,46 +526,74 @@ ExpressionStmt* Parser::parseExpressionStmt() {
 }
 
 IfStmt* Parser::parseIfStmt() {
-    auto* node = new IfStmt(line, column);
+    std::unique_ptr<IfStmt> node(new IfStmt(line, column));
     currentToken = next();
-    node->cond = parseExpression();
-    assert(getCurrentToken() == TK_RPAREN);
+    node->cond = parseOperand();
+    expect(TK_RPAREN, "\")\"");
     currentToken = next();
-    node->block = parseBlock();
-    if (getCurrentToken() == KW_ELSE) {
-        currentToken = next();
-        node->elseBlock = parseBlock();
-    }
-    return node;
+    return node.release();
 }
 
 WhileStmt* Parser::parseWhileStmt() {
-    auto* node = new WhileStmt(line, column);
+    std::unique_ptr<WhileStmt> node(new WhileStmt(line, column));
     currentToken = next();
-    node->cond = parseExpression();
-    assert(getCurrentToken() == TK_RPAREN);
+    node->cond = parseOperand();
+    expect(TK_RPAREN, "\")\"");
     currentToken = next();
-    node->block = parseBlock();
-    return node;
+    return node.release();
+}
+
+ForStmt* Parser::parseForStmt() {
+    std::unique_ptr<ForStmt> node(new ForStmt(line, column));
+    expect(TK_IDENT, "loop variable");
+    node->identName = getCurrentLexeme();
+    currentToken = next();
+    expect(KW_IN, "\"in\"");
+    currentToken = next();
+    node->lo = parseOperand();
+    expect(TK_RANGE, "\"..\"");
+    currentToken = next();
+    node->hi = parseOperand();
+    // step is not reserved so that it remains usable as an identifier
+    if (getCurrentToken() == TK_IDENT && getCurrentLexeme() == "step") {
+        currentToken = next();
+        node->step = parseOperand();
+    }
+    expect(TK_LBRACE, "\"{\"");
+    return node.release();
 }
 
 ReturnStmt* Parser::parseReturnStmt() {
-    auto* node = new ReturnStmt(line, column);
+    std::unique_ptr<ReturnStmt> node(new ReturnStmt(line, column));
     node->ret = parseExpression();
-    return node;
+    return node.release();
 }
 
-Statement* Parser::parseStatement() {
+Statement* Parser::parseStatementHead(Block**& body) {
     Statement* node;
+    body = nullptr;
     switch (getCurrentToken()) {
-        case KW_IF:
+        case KW_IF: {
+            currentToken = next();
+            auto* ifStmt = parseIfStmt();
+            body = &ifStmt->block;
+            node = ifStmt;
+            break;
+        }
+        case KW_WHILE: {
             currentToken = next();
-            node = parseIfStmt();
+            auto* whileStmt = parseWhileStmt();
+            body = &whileStmt->block;
+            node = whileStmt;
             break;
-        case KW_WHILE:
+        }
+        case KW_FOR: {
             currentToken = next();
-            node = parseWhileStmt();
+            auto* forStmt = parseForStmt();
+            body = &forStmt->block;
+            node = forStmt;
             break;
+        }
         case KW_RETURN:
             currentToken = next();
             node = parseReturnStmt();
@@ -243,22 +613,48 @@ Statement* Parser::parseStatement() {
     return node;
 }
 
-std::vector<Statement*> Parser::parseStatementList() {
-    std::vector<Statement*> node;
-    Statement* p;
-    while ((p = parseStatement()) != nullptr) {
-        node.push_back(p);
+Statement* Parser::parseStatement() {
+    Block** body = nullptr;
+    std::unique_ptr<Statement> node(parseStatementHead(body));
+    if (body != nullptr) {
+        *body = parseBlock(node.get());
     }
-    return node;
+    return node.release();
 }
 
-Block* Parser::parseBlock() {
-    Block* node{new Block};
+Block* Parser::parseBlock(Statement* owner) {
+    // Nested statements and their blocks are part of node as soon as they
+    // are parsed, so a syntax error frees all of them along with node
+    std::unique_ptr<Block> node(new Block);
     currentToken = next();
-    node->stmts = parseStatementList();
-    assert(getCurrentToken() == TK_RBRACE);
-    currentToken = next();
-    return node;
+    // Blocks of nested statements are kept on an explicit stack together
+    // with the statement owning them, an if statement may go on with else
+    std::vector<std::pair<Block*, Statement*>> open{{node.get(), owner}};
+    while (!open.empty()) {
+        auto [block, blockOwner] = open.back();
+        Block** body = nullptr;
+        if (auto* stmt = parseStatementHead(body); stmt != nullptr) {
+            block->stmts.push_back(stmt);
+            if (body != nullptr) {
+                *body = new Block;
+                currentToken = next();
+                open.emplace_back(*body, stmt);
+            }
+            continue;
+        }
+        expect(TK_RBRACE, "\"}\"");
+        currentToken = next();
+        open.pop_back();
+        auto* ifStmt = dynamic_cast<IfStmt*>(blockOwner);
+        if (ifStmt != nullptr && ifStmt->elseBlock == nullptr &&
+            getCurrentToken() == KW_ELSE) {
+            currentToken = next();
+            ifStmt->elseBlock = new Block;
+            currentToken = next();
+            open.emplace_back(ifStmt->elseBlock, ifStmt);
+        }
+    }
+    return node.release();
 }
 
 std::vector<std::string> Parser::parseParameterList() {
@@ -273,51 +669,106 @@ std::vector<std::string> Parser::parseParameterList() {
         if (getCurrentToken() == TK_IDENT) {
             node.push_back(getCurrentLexeme());
         } else {
-            assert(getCurrentToken() == TK_COMMA);
+            expect(TK_COMMA, "\",\"");
         }
         currentToken = next();
     }
-    assert(getCurrentToken() == TK_RPAREN);
+    expect(TK_RPAREN, "\")\"");
     currentToken = next();
     return move(node);
 }
 
-lin::Function* Parser::parseFuncDef(lin::Context* context) {
-    assert(getCurrentToken() == KW_FUNC);
-    currentToken = next();
-
-    // Check if function was already be defined
-    if (context->hasFunction(getCurrentLexeme())) {
-        panic("SyntaxError: multiply function definitions of %s found",
-              getCurrentLexeme().c_str());
+lin::Function* Parser::parseFuncDef() {
+    lin::MemoizeMode memoize = lin::MemoizeAuto;
+    while (getCurrentToken() == TK_ANNOTATION) {
+        if (getCurrentLexeme() == "memo") {
+            memoize = lin::MemoizeOn;
+        } else if (getCurrentLexeme() == "nomemo") {
+            memoize = lin::MemoizeOff;
+        } else {
+            panic("SyntaxError: unknown annotation @%s at line %d, col %d\n",
+                  getCurrentLexeme().c_str(), line, column);
+        }
+        currentToken = next();
     }
+    expect(KW_FUNC, "\"func\"");
+    currentToken = next();
 
-    auto* node = new lin::Function;
+    std::unique_ptr<lin::Function> node(new lin::Function);
     node->name = getCurrentLexeme();
+    node->memoize = memoize;
     currentToken = next();
-    assert(getCurrentToken() == TK_LPAREN);
+    expect(TK_LPAREN, "\"(\"");
     node->params = parseParameterList();
     node->block = parseBlock();
 
-    return node;
+    return node.release();
 }
 
 void Parser::parse(lin::Runtime* rt) {
+    rt->setSource(text);
+    rt->setDirectory(directory);
     currentToken = next();
-    if (getCurrentToken() == TK_EOF) {
-        return;
-    }
-    do {
-        if (getCurrentToken() == KW_FUNC) {
-            auto* f = parseFuncDef(rt);
+    Item item;
+    while (parseItem(item)) {
+        if (auto* f = item.function; f != nullptr) {
+            // Check if function was already be defined
+            if (rt->hasFunction(f->name)) {
+                std::string name = f->name;
+                delete f;
+                panic("SyntaxError: multiply function definitions of %s found",
+                      name.c_str());
+            }
             rt->addFunction(f->name, f);
+        } else if (item.statement != nullptr) {
+            rt->addStatement(item.statement);
+            statementLines.push_back(item.line);
         } else {
-            rt->addStatement(parseStatement());
+            imports.push_back(item.import);
+            lin::Module::import(rt, item.import, directory);
         }
-    } while (getCurrentToken() != TK_EOF);
+        items.push_back(item);
+    }
+}
+
+void Parser::seek(size_t offset, int line, int column) {
+    pos = offset;
+    this->line = line;
+    this->column = column;
+    currentToken = next();
+}
+
+bool Parser::parseItem(Item& item) {
+    if (getCurrentToken() == TK_EOF) {
+        return false;
+    }
+    item = Item();
+    item.begin = tokenOffset();
+    item.firstTokenEnd = pos;
+    item.line = tokenLine();
+    item.column = tokenColumn();
+    if (getCurrentToken() == KW_IMPORT) {
+        currentToken = next();
+        expect(LIT_STR, "module path");
+        item.import = getCurrentLexeme();
+        currentToken = next();
+    } else if (getCurrentToken() == KW_FUNC ||
+               getCurrentToken() == TK_ANNOTATION) {
+        item.function = parseFuncDef();
+    } else if (auto* stmt = parseStatement(); stmt != nullptr) {
+        item.statement = stmt;
+    } else {
+        panic("SyntaxError: unexpected \"%s\" at line %d, col %d\n",
+              getCurrentLexeme().c_str(), line, column);
+    }
+    item.end = previousEnd;
+    return true;
 }
 
 std::tuple<Token, std::string> Parser::next() {
+    // The current token ends where reading the next one starts
+    previousEnd = pos;
+    tokenBegin = text.size();
     char c = getNextChar();
 
     if (c == EOF) {
@@ -355,16 +806,23 @@ std::tuple<Token, std::string> Parser::next() {
             return std::make_tuple(TK_EOF, "");
         }
     }
+    tokenBegin = pos - 1;
     //INTEGER or DOUBLE
     if (c >= '0' && c <= '9') {
         std::string lexeme{c};
         bool isDouble = false;
         char cn = peekNextChar();
         while ((cn >= '0' && cn <= '9') || (!isDouble && cn == '.')) {
+            c = getNextChar();
             if (c == '.') {
+                // Digits followed by two dots are the lower bound of a range
+                if (peekNextChar() == '.') {
+                    putBackChar();
+                    column--;
+                    break;
+                }
                 isDouble = true;
             }
-            c = getNextChar();
             cn = peekNextChar();
             lexeme += c;
         }
@@ -403,6 +861,10 @@ std::tuple<Token, std::string> Parser::next() {
         std::string lexeme;
         char cn = peekNextChar();
         while (cn != '"') {
+            if (pos >= text.size()) {
+                panic("SyntaxError: unterminated string at line %d, col %d\n",
+                      line, column);
+            }
             c = getNextChar();
             lexeme += c;
             cn = peekNextChar();
@@ -411,6 +873,16 @@ std::tuple<Token, std::string> Parser::next() {
         return std::make_tuple(LIT_STR, lexeme);
     }
     //
+    if (c == '@') {
+        std::string lexeme;
+        char cn = peekNextChar();
+        while ((cn >= 'a' && cn <= 'z') || (cn >= 'A' && cn <= 'Z') ||
+               (cn >= '0' && cn <= '9') || cn == '_') {
+            lexeme += getNextChar();
+            cn = peekNextChar();
+        }
+        return std::make_tuple(TK_ANNOTATION, lexeme);
+    }
     if (c == '[') {
         return std::make_tuple(TK_LBRACKET, "[");
     }
@@ -432,6 +904,13 @@ std::tuple<Token, std::string> Parser::next() {
     if (c == ',') {
         return std::make_tuple(TK_COMMA, ",");
     }
+    if (c == ':') {
+        return std::make_tuple(TK_COLON, ":");
+    }
+    if (c == '.' && peekNextChar() == '.') {
+        c = getNextChar();
+        return std::make_tuple(TK_RANGE, "..");
+    }
     if (c == '+') {
         if (peekNextChar() == '=') {
             c = getNextChar();
@@ -1,54 +1,115 @@
 #pragma once
 
-#include <cassert>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 #include "Ast.h"
 #include "Lin.hpp"
 
 class Parser {
 public:
     explicit Parser(const std::string& fileName);
-    ~Parser();
+    // Modules imported by relative paths are looked up within directory
+    explicit Parser(std::unique_ptr<std::istream> source,
+                    std::string directory = "");
+    ~Parser() = default;
+
+public:
+    // Top-level import, function definition or statement of a program,
+    // items with neither a function nor a statement are imports
+    struct Item {
+        lin::Function* function{};
+        Statement* statement{};
+        // Path of the imported module as it was written
+        std::string import;
+        // Offsets of the first character and past the last token in text
+        size_t begin = 0;
+        size_t end = 0;
+        // Offset past the first token, which decided where the item in
+        // front of this one ended
+        size_t firstTokenEnd = 0;
+        // Position of the lexer in front of the first character
+        int line = 1;
+        int column = 0;
+    };
 
 public:
     void parse(lin::Runtime* rt);
+    // Items added to the runtime by parse(), in the order of the source
+    const std::vector<Item>& getItems() const { return items; }
+    // Go on reading at offset of text, with the position of the lexer at
+    // that offset, which must be the beginning of an item
+    void seek(size_t offset, int line, int column);
+    // Parse the item at the current token without adding it to any runtime,
+    // false at the end of the text
+    bool parseItem(Item& item);
+    // Position of the lexer in front of the current token
+    size_t tokenOffset() const { return tokenBegin; }
+    int tokenLine() const { return line; }
+    int tokenColumn() const {
+        return column - static_cast<int>(pos - tokenBegin);
+    }
+    // Lines top-level statements start at, in the order of the statements
+    const std::vector<int>& getStatementLines() const {
+        return statementLines;
+    }
+    // Paths of the modules imported by the program, as they were written
+    const std::vector<std::string>& getImports() const { return imports; }
     static void printLex(const std::string& fileName);
+    // Parse the file repeatedly and report parsing throughput to out
+    static void benchmark(const std::string& fileName, std::ostream& out);
     short precedence(Token op);
 
 private:
-    Expression* parsePrimaryExpr();
-    Expression* parseUnaryExpr();
-    Expression* parseExpression(
-        short oldPrecedence = 1 /*default to lowest precedence(0) + 1*/);
+    struct ExprFrame;
+    struct PendingOperator;
+
+    Expression* parsePrimaryExpr(std::vector<ExprFrame>& frames,
+                                 size_t operands, size_t operators);
+    Expression* closeFrame(std::vector<ExprFrame>& frames, Expression* e);
+    Expression* parseExpression();
+    Expression* parseOperand();
     ExpressionStmt* parseExpressionStmt();
     IfStmt* parseIfStmt();
     WhileStmt* parseWhileStmt();
+    ForStmt* parseForStmt();
     ReturnStmt* parseReturnStmt();
+    // Parse a statement up to its block, body is set to where the block of
+    // the statement goes or to null if it has none
+    Statement* parseStatementHead(Block**& body);
     Statement* parseStatement();
-    std::vector<Statement*> parseStatementList();
-    Block* parseBlock();
+    Block* parseBlock(Statement* owner = nullptr);
     std::vector<std::string> parseParameterList();
-    lin::Function* parseFuncDef(lin::Context* context);
+    lin::Function* parseFuncDef();
 
 private:
     std::tuple<Token, std::string> next();
 
+    void expect(Token tk, const char* lexeme);
+
+    lin::StringData internString(const std::string& literal);
+
     inline char getNextChar() {
         column++;
-        return static_cast<char>(fs.get());
+        return pos < text.size() ? text[pos++] : static_cast<char>(EOF);
+    }
+
+    inline char peekNextChar() const {
+        return pos < text.size() ? text[pos] : static_cast<char>(EOF);
     }
 
-    inline char peekNextChar() { return static_cast<char>(fs.peek()); }
+    inline void putBackChar() { pos--; }
 
     inline Token getCurrentToken() const {
         return std::get<Token>(currentToken);
     }
-    inline std::string getCurrentLexeme() const {
+    inline const std::string& getCurrentLexeme() const {
         return std::get<std::string>(currentToken);
     }
 
@@ -57,7 +118,28 @@ private:
 
     std::tuple<Token, std::string> currentToken;
 
-    std::fstream fs;
+    std::unordered_map<std::string, lin::StringData> literals;
+
+    std::unique_ptr<std::istream> source;
+
+    std::string text;
+
+    // Offset of the next character of text to read
+    size_t pos = 0;
+
+    // Offsets of the first character of the current token and past the
+    // end of the token before it
+    size_t tokenBegin = 0;
+    size_t previousEnd = 0;
+
+    std::vector<int> statementLines;
+
+    // Directory of the source file, empty for the working directory
+    std::string directory;
+
+    std::vector<std::string> imports;
+
+    std::vector<Item> items;
 
     int line = 1;
 
@@ -0,0 +1,332 @@
+#include "Server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include "Fiber.h"
+#include "Heap.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+// Stdout of a request. The script writes into a queue, the server sends it
+// on as far as the client takes it without blocking, so a client which does
+// not read holds up nobody but its own request.
+class SocketBuffer : public std::streambuf {
+public:
+    explicit SocketBuffer(int fd) : fd(fd) {
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    // Bytes written which the client did not take yet
+    size_t backlog() const { return queued.size() + (pptr() - pbase()); }
+
+    // Send as much of the backlog as the socket takes. Once the client went
+    // away further output is dropped and false is returned.
+    bool flush() {
+        enqueue();
+        size_t sent = 0;
+        while (sent < queued.size()) {
+            // A client which went away must not kill the server by SIGPIPE
+            ssize_t n = send(fd, queued.data() + sent, queued.size() - sent,
+                             MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (n < 0) {
+                broken = true;
+                queued.clear();
+                return false;
+            }
+            sent += n;
+        }
+        queued.erase(0, sent);
+        return true;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        enqueue();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override {
+        enqueue();
+        return 0;
+    }
+
+private:
+    void enqueue() {
+        if (!broken) {
+            queued.append(pbase(), pptr() - pbase());
+        }
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    int fd;
+    char buffer[4096];
+    std::string queued;
+    bool broken = false;
+};
+
+// Steps a request runs before the next one gets its turn
+constexpr long long kSliceSteps = 4096;
+// Output a request may have queued before it waits for its client to read
+constexpr size_t kMaxBacklog = 64 * 1024;
+
+// A socket left behind by a previous server would make bind fail, it is
+// removed once nothing listens on it anymore. Any other file at the path, or
+// the socket of a server still running, is left alone.
+void removeStaleSocket(const sockaddr_un& addr) {
+    struct stat st;
+    if (lstat(addr.sun_path, &st) < 0) {
+        return;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        panic("ServerError: %s exists and is not a socket\n", addr.sun_path);
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        panic("ServerError: can not create socket: %s\n", strerror(errno));
+    }
+    int connected =
+        connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    int error = errno;
+    close(probe);
+    if (connected == 0) {
+        panic("ServerError: another server is listening on %s\n",
+              addr.sun_path);
+    }
+    if (error != ECONNREFUSED) {
+        panic("ServerError: can not probe socket %s: %s\n", addr.sun_path,
+              strerror(error));
+    }
+    unlink(addr.sun_path);
+}
+}  // namespace
+
+struct Server::Session {
+    // The heap limit of the server applies to each request on its own
+    explicit Session(int client)
+        : client(client),
+          out(client),
+          heap(Heap::newAccount(Heap::limit())) {}
+    ~Session() { Heap::dropAccount(heap); }
+
+    int client;
+    // Bytes of the request read so far
+    std::string request;
+    SocketBuffer out;
+    std::istringstream in;
+    // Charged for whatever the request allocates
+    HeapAccount* heap;
+    // Program the fiber runs, null until the request was read completely
+    std::shared_ptr<Program> program;
+    std::unique_ptr<Fiber> fiber;
+    // The request ended, the session stays until its output was sent
+    bool finished = false;
+};
+
+Server::Server(std::string socketPath) : socketPath(std::move(socketPath)) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (this->socketPath.size() >= sizeof(addr.sun_path)) {
+        panic("ServerError: socket path %s is too long\n",
+              this->socketPath.c_str());
+    }
+    strcpy(addr.sun_path, this->socketPath.c_str());
+    removeStaleSocket(addr);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        panic("ServerError: can not create socket: %s\n", strerror(errno));
+    }
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(listener, 64) < 0) {
+        int error = errno;
+        close(listener);
+        panic("ServerError: can not listen on %s: %s\n", addr.sun_path,
+              strerror(error));
+    }
+}
+
+Server::~Server() {
+    for (auto& session : sessions) {
+        close(session.client);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+}
+
+void Server::serve() {
+    for (;;) {
+        // Wait for connections, requests and clients taking output only while
+        // no fiber can run. A fiber whose client is behind on reading waits.
+        std::vector<pollfd> fds{{listener, POLLIN, 0}};
+        bool running = false;
+        for (auto& session : sessions) {
+            short events = session.out.backlog() > 0 ? POLLOUT : 0;
+            if (session.fiber != nullptr) {
+                running = running || session.out.backlog() < kMaxBacklog;
+            } else if (!session.finished) {
+                events |= POLLIN;
+            }
+            fds.push_back({session.client, events, 0});
+        }
+        if (poll(fds.data(), fds.size(), running ? 0 : -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            panic("ServerError: can not poll connections: %s\n",
+                  strerror(errno));
+        }
+        size_t next = 1;
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            const pollfd& fd = fds[next++];
+            if (it->fiber != nullptr) {
+                if (it->out.backlog() < kMaxBacklog) {
+                    runSlice(*it);
+                }
+            } else if (!it->finished && fd.revents != 0) {
+                receive(*it);
+            }
+            if (it->out.backlog() > 0 && (fd.revents != 0 || it->finished)) {
+                it->out.flush();
+            }
+            if (it->finished && it->out.backlog() == 0) {
+                close(it->client);
+                it = sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            accept();
+        }
+    }
+}
+
+void Server::accept() {
+    int client = ::accept(listener, nullptr, nullptr);
+    if (client < 0) {
+        if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) {
+            return;
+        }
+        panic("ServerError: can not accept connection: %s\n",
+              strerror(errno));
+    }
+    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+    sessions.emplace_back(client);
+}
+
+void Server::receive(Session& session) {
+    char buffer[4096];
+    ssize_t n = read(session.client, buffer, sizeof(buffer));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (n > 0) {
+        session.request.append(buffer, n);
+        return;
+    }
+    if (n == 0) {
+        start(session);
+    }
+    if (session.fiber == nullptr) {
+        finish(session);
+    }
+}
+
+std::shared_ptr<Program> Server::programOf(const std::string& path) {
+    auto& program = programs[path];
+    if (program == nullptr) {
+        program = engine.watchFile(path);
+    } else if (program.use_count() == 1) {
+        // Requests still running the program keep the edits for later
+        program->update();
+    }
+    return program;
+}
+
+void Server::start(Session& session) {
+    HeapAccountScope scope(session.heap);
+    std::ostream out(&session.out);
+    try {
+        const std::string& request = session.request;
+        size_t eol = request.find('\n');
+        if (eol == std::string::npos) {
+            panic("ServerError: request has no header line\n");
+        }
+        std::string header = request.substr(0, eol);
+        size_t body = eol + 1;
+        std::shared_ptr<Program> program;
+        if (header.compare(0, 4, "RUN ") == 0) {
+            program = programOf(header.substr(4));
+        } else if (header.compare(0, 5, "EVAL ") == 0) {
+            char* end = nullptr;
+            size_t length = strtoull(header.c_str() + 5, &end, 10);
+            if (*end != '\0' || length > request.size() - body) {
+                panic("ServerError: bad source length in %s\n",
+                      header.c_str());
+            }
+            program = engine.compile(request.substr(body, length));
+            body += length;
+        } else {
+            panic("ServerError: unknown request %s\n", header.c_str());
+        }
+        session.in.str(request.substr(body));
+        session.fiber = engine.spawn(*program);
+        session.program = std::move(program);
+    } catch (const LinError& e) {
+        out << e.what();
+    } catch (const std::exception& e) {
+        out << "RuntimeError: " << e.what() << "\n";
+    }
+}
+
+void Server::runSlice(Session& session) {
+    HeapAccountScope scope(session.heap);
+    auto* oldOut = std::cout.rdbuf(&session.out);
+    auto* oldIn = std::cin.rdbuf(session.in.rdbuf());
+    bool done = true;
+    try {
+        done = session.fiber->resume(kSliceSteps);
+    } catch (const LinError& e) {
+        std::cout << e.what();
+    } catch (const std::exception& e) {
+        // Whatever went wrong, the server keeps serving other requests
+        std::cout << "RuntimeError: " << e.what() << "\n";
+    }
+    std::cout.rdbuf(oldOut);
+    std::cin.rdbuf(oldIn);
+    std::cout.clear();
+    std::cin.clear();
+    if (done) {
+        finish(session);
+    }
+}
+
+void Server::finish(Session& session) {
+    HeapAccountScope scope(session.heap);
+    session.out.pubsync();
+    session.finished = true;
+    session.fiber.reset();
+    session.program.reset();
+    Heap::collect();
+}
+}  // namespace lin
@@ -0,0 +1,60 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "Engine.h"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Long-lived lin process serving scripts over a unix domain socket, so short
+// scripts pay neither process startup nor parsing. A client sends one request
+// per connection and shuts down its writing side:
+//
+//   RUN <path>\n<stdin>              run the script file at path
+//   EVAL <length>\n<source><stdin>   run length bytes of source code
+//
+// Whatever follows the script becomes its stdin. Stdout of the script is
+// streamed back while it runs, errors are reported in the same form as the
+// command line interpreter reports them, then the server closes the
+// connection. Every request runs in a fresh global context and is charged
+// to a heap account of its own, see Heap.h. Programs of script files are
+// parsed once and kept with their compiled code and result caches, edits of
+// a file only replace the functions they touched, once no request runs the
+// program anymore.
+//
+// Requests run cooperatively on one thread: each one is a fiber, the server
+// resumes the fibers in turn for a slice of steps and accepts connections and
+// reads requests in between, so a long running script does not hold up
+// others. Output a client does not read yet is queued, and a request stops
+// being resumed while too much of it is.
+//===----------------------------------------------------------------------===//
+class Server {
+public:
+    explicit Server(std::string socketPath);
+    ~Server();
+
+    // Accept and run requests, never returns normally
+    void serve();
+
+private:
+    struct Session;
+
+    void accept();
+    // Read from the client of session, starts the request once it was read
+    // completely
+    void receive(Session& session);
+    void start(Session& session);
+    // Resume the fiber of session for a slice
+    void runSlice(Session& session);
+    // End the request of session, its output is still sent
+    void finish(Session& session);
+    std::shared_ptr<Program> programOf(const std::string& path);
+
+    std::string socketPath;
+    int listener = -1;
+    Engine engine;
+    std::list<Session> sessions;
+    std::unordered_map<std::string, std::shared_ptr<Program>> programs;
+};
+}  // namespace lin
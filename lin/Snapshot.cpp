@@ -0,0 +1,535 @@
+#include "Snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include "Engine.h"
+#include "HashTable.h"
+#include "Interpreter.h"
+#include "Matrix.h"
+#include "Utils.hpp"
+
+namespace lin {
+namespace {
+constexpr char kMagic[8] = {'L', 'I', 'N', 'S', 'N', 'A', 'P', '3'};
+
+// Elements of one kind laid out contiguously somewhere in the file
+struct Section {
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Sections follow the header in this order, so each of them is aligned
+struct Header {
+    char magic[8];
+    uint64_t fileSize;
+    // Top-level statement to resume with
+    uint64_t next;
+    Section records;
+    Section globals;
+    Section children;
+    Section source;
+    // Absolute directory imports of the source are resolved against
+    Section directory;
+    Section pool;
+};
+
+struct Record {
+    uint32_t type;
+    // Elements of an array, entries of a dict or bytes of a string or of the
+    // digits of a BigInt. Whether elements of a matrix are doubles.
+    uint32_t count;
+    union {
+        // Ints, bools and chars
+        int64_t i;
+        double d;
+        // First child of an array or dict, or first byte of a string, of the
+        // digits of a BigInt or of a matrix
+        uint64_t offset;
+    };
+};
+
+// Pool bytes of a matrix record start with its shape, the elements follow
+struct MatrixShape {
+    uint64_t rows;
+    uint64_t cols;
+};
+
+struct Global {
+    // Name of the variable within the pool
+    uint64_t name;
+    uint32_t nameLength;
+    uint32_t record;
+};
+
+class SnapshotWriter {
+public:
+    // Index of the record of v, records of its elements are written first
+    uint32_t add(const Value& v);
+    uint64_t addBytes(std::string_view bytes);
+
+    std::vector<Record> records;
+    std::vector<uint32_t> children;
+    std::string pool;
+
+private:
+    struct Pending {
+        const Value* value;
+        std::vector<const Value*> items;
+        std::vector<uint32_t> done;
+    };
+
+    // Record of a scalar, a string or an array written before, or nothing if
+    // v still has elements to write
+    bool addLeaf(const Value& v, uint32_t* index);
+    uint32_t addCompound(const Pending& p);
+
+    // Arrays, strings and matrices written so far keyed by their storage,
+    // values sharing storage are written once
+    std::map<std::pair<const void*, size_t>, uint32_t> written;
+};
+
+bool SnapshotWriter::addLeaf(const Value& v, uint32_t* index) {
+    Record r;
+    // Unused bytes are zeroed, so equal states give equal files
+    memset(&r, 0, sizeof(r));
+    r.type = v.type;
+    switch (v.type) {
+        case Int:
+            r.i = v.ref<long long>();
+            break;
+        case BigInt: {
+            std::string digits = v.ref<BigIntData>().str();
+            r.count = digits.size();
+            r.offset = addBytes(digits);
+            break;
+        }
+        case Double:
+            r.d = v.ref<double>();
+            break;
+        case Bool:
+            r.i = v.ref<bool>();
+            break;
+        case Char:
+            r.i = v.ref<char>();
+            break;
+        case Null:
+            break;
+        case String: {
+            auto text = v.ref<StringData>().view();
+            auto key = std::make_pair(static_cast<const void*>(text.data()),
+                                      text.size());
+            if (auto res = written.find(key); res != written.end()) {
+                *index = res->second;
+                return true;
+            }
+            r.count = text.size();
+            r.offset = addBytes(text);
+            written.emplace(key, records.size());
+            break;
+        }
+        case Array: {
+            auto& arr = v.ref<ArrayData>();
+            auto key = std::make_pair(static_cast<const void*>(arr.begin()),
+                                      arr.size());
+            if (auto res = written.find(key); res != written.end()) {
+                *index = res->second;
+                return true;
+            }
+            return false;
+        }
+        case Dict:
+            return false;
+        case Matrix: {
+            auto& m = v.ref<MatrixData>();
+            // Both element types take 8 bytes
+            std::string_view elements(
+                m.isDouble() ? reinterpret_cast<const char*>(m.doubleData())
+                             : reinterpret_cast<const char*>(m.intData()),
+                m.rows() * m.cols() * 8);
+            // Empty matrices of any shape may share a null data pointer
+            auto key = std::make_pair(
+                static_cast<const void*>(elements.data()), m.rows());
+            if (auto res = written.find(key);
+                !elements.empty() && res != written.end()) {
+                *index = res->second;
+                return true;
+            }
+            MatrixShape shape{m.rows(), m.cols()};
+            r.count = m.isDouble();
+            r.offset = addBytes(std::string_view(
+                reinterpret_cast<const char*>(&shape), sizeof(shape)));
+            addBytes(elements);
+            if (!elements.empty()) {
+                written.emplace(key, records.size());
+            }
+            break;
+        }
+    }
+    *index = records.size();
+    records.push_back(r);
+    return true;
+}
+
+uint32_t SnapshotWriter::addCompound(const Pending& p) {
+    Record r;
+    memset(&r, 0, sizeof(r));
+    r.type = p.value->type;
+    r.offset = children.size();
+    children.insert(children.end(), p.done.begin(), p.done.end());
+    if (p.value->isType<Array>()) {
+        auto& arr = p.value->ref<ArrayData>();
+        r.count = arr.size();
+        written.emplace(std::make_pair(static_cast<const void*>(arr.begin()),
+                                       arr.size()),
+                        records.size());
+    } else {
+        r.count = p.done.size() / 2;
+    }
+    records.push_back(r);
+    return records.size() - 1;
+}
+
+uint32_t SnapshotWriter::add(const Value& v) {
+    uint32_t index = 0;
+    // Nested arrays may be deeper than the C++ stack, so elements are
+    // visited with an explicit stack
+    std::vector<Pending> stack;
+    auto visit = [&](const Value* value) {
+        if (addLeaf(*value, &index)) {
+            return true;
+        }
+        Pending p{value};
+        if (value->isType<Array>()) {
+            for (auto& e : value->ref<ArrayData>()) {
+                p.items.push_back(&e);
+            }
+        } else {
+            value->ref<HashTable>().forEach(
+                [&p](const Value& key, const Value& item) {
+                    p.items.push_back(&key);
+                    p.items.push_back(&item);
+                });
+        }
+        stack.push_back(std::move(p));
+        return false;
+    };
+    if (visit(&v)) {
+        return index;
+    }
+    while (!stack.empty()) {
+        size_t top = stack.size() - 1;
+        if (stack[top].done.size() < stack[top].items.size()) {
+            if (visit(stack[top].items[stack[top].done.size()])) {
+                stack[top].done.push_back(index);
+            }
+            continue;
+        }
+        index = addCompound(stack[top]);
+        stack.pop_back();
+        if (!stack.empty()) {
+            stack.back().done.push_back(index);
+        }
+    }
+    return index;
+}
+
+uint64_t SnapshotWriter::addBytes(std::string_view bytes) {
+    uint64_t offset = pool.size();
+    pool.append(bytes);
+    return offset;
+}
+
+// Read-only mapping of a snapshot file
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            panic("SnapshotError: can not open %s\n", path.c_str());
+        }
+        size = st.st_size;
+        void* p = MAP_FAILED;
+        if (size != 0) {
+            p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (p == MAP_FAILED) {
+            panic("SnapshotError: can not map %s\n", path.c_str());
+        }
+        base = static_cast<const char*>(p);
+    }
+    ~MappedFile() { munmap(const_cast<char*>(base), size); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const Header& header() const {
+        auto& h = *reinterpret_cast<const Header*>(base);
+        if (size < sizeof(Header) || memcmp(h.magic, kMagic, 8) != 0 ||
+            h.fileSize != size) {
+            panic("SnapshotError: not a lin snapshot or truncated\n");
+        }
+        return h;
+    }
+
+    // Elements of section, fixed up from their offset to where the file is
+    // mapped
+    template <typename _ElementType>
+    const _ElementType* section(const Section& s) const {
+        if (s.offset > size || s.offset % alignof(_ElementType) != 0 ||
+            s.count > (size - s.offset) / sizeof(_ElementType)) {
+            panic("SnapshotError: section out of file bounds\n");
+        }
+        return reinterpret_cast<const _ElementType*>(base + s.offset);
+    }
+
+private:
+    const char* base{};
+    size_t size = 0;
+};
+
+// Directory dir relative to the working directory as an absolute path ending
+// in a slash
+std::string absoluteDirectory(const std::string& dir) {
+    char resolved[PATH_MAX];
+    if (realpath(dir.empty() ? "." : dir.c_str(), resolved) == nullptr) {
+        panic("SnapshotError: can not resolve directory %s: %s\n",
+              dir.c_str(), strerror(errno));
+    }
+    std::string result = resolved;
+    return result.back() == '/' ? result : result + "/";
+}
+
+[[noreturn]] void corrupted() {
+    panic("SnapshotError: snapshot is corrupted\n");
+}
+
+std::vector<Value> restoreValues(const MappedFile& file, const Header& h) {
+    auto* records = file.section<Record>(h.records);
+    auto* children = file.section<uint32_t>(h.children);
+    auto* pool = file.section<char>(h.pool);
+    std::vector<Value> values;
+    values.reserve(h.records.count);
+    // Children of a record always precede it, one pass restores everything
+    auto child = [&](const Record& r, uint64_t k) -> const Value& {
+        uint32_t index = children[r.offset + k];
+        if (index >= values.size()) {
+            corrupted();
+        }
+        return values[index];
+    };
+    for (uint64_t i = 0; i < h.records.count; i++) {
+        const Record& r = records[i];
+        switch (r.type) {
+            case Int:
+                values.push_back(toValue(static_cast<long long>(r.i)));
+                break;
+            case BigInt:
+                if (r.offset > h.pool.count ||
+                    r.count > h.pool.count - r.offset) {
+                    corrupted();
+                }
+                values.push_back(Value(
+                    BigInt, BigIntData::parse(std::string_view(
+                                pool + r.offset, r.count))));
+                break;
+            case Double:
+                values.push_back(toValue(r.d));
+                break;
+            case Bool:
+                values.push_back(toValue(r.i != 0));
+                break;
+            case Char:
+                values.push_back(toValue(static_cast<char>(r.i)));
+                break;
+            case Null:
+                values.push_back(Value(Null));
+                break;
+            case String:
+                if (r.offset > h.pool.count ||
+                    r.count > h.pool.count - r.offset) {
+                    corrupted();
+                }
+                values.push_back(
+                    toValue(std::string(pool + r.offset, r.count)));
+                break;
+            case Array: {
+                if (r.offset > h.children.count ||
+                    r.count > h.children.count - r.offset) {
+                    corrupted();
+                }
+                std::vector<Value> elements;
+                elements.reserve(r.count);
+                for (uint64_t k = 0; k < r.count; k++) {
+                    elements.push_back(child(r, k));
+                }
+                values.push_back(toValue(std::move(elements)));
+                break;
+            }
+            case Dict: {
+                if (r.offset > h.children.count ||
+                    r.count > (h.children.count - r.offset) / 2) {
+                    corrupted();
+                }
+                HashTable table;
+                for (uint64_t k = 0; k < r.count; k++) {
+                    auto& key = child(r, 2 * k);
+                    if (!HashTable::isHashable(key)) {
+                        corrupted();
+                    }
+                    table.getOrInsert(key) = child(r, 2 * k + 1);
+                }
+                values.push_back(Value(Dict, std::move(table)));
+                break;
+            }
+            case Matrix: {
+                MatrixShape shape;
+                if (r.offset > h.pool.count ||
+                    sizeof(shape) > h.pool.count - r.offset) {
+                    corrupted();
+                }
+                memcpy(&shape, pool + r.offset, sizeof(shape));
+                uint64_t bytes;
+                if (__builtin_mul_overflow(shape.rows, shape.cols, &bytes) ||
+                    __builtin_mul_overflow(bytes, 8, &bytes) ||
+                    bytes > h.pool.count - r.offset - sizeof(shape)) {
+                    corrupted();
+                }
+                const char* elements = pool + r.offset + sizeof(shape);
+                auto m = r.count != 0
+                             ? MatrixData(shape.rows, shape.cols, 0.0)
+                             : MatrixData(shape.rows, shape.cols, 0LL);
+                // Empty matrices have no buffer to copy into
+                if (bytes != 0) {
+                    void* data = m.isDouble()
+                                     ? static_cast<void*>(m.mutableDoubleData())
+                                     : static_cast<void*>(m.mutableIntData());
+                    memcpy(data, elements, bytes);
+                }
+                values.push_back(toValue(std::move(m)));
+                break;
+            }
+            default:
+                corrupted();
+        }
+    }
+    return values;
+}
+}  // namespace
+
+void Snapshot::save(const std::string& path, Runtime* rt, Context* globals,
+                    size_t next) {
+    SnapshotWriter writer;
+    std::vector<Global> vars;
+    for (auto* var : globals->getVariables()) {
+        Global g{};
+        g.record = writer.add(var->value);
+        g.name = writer.addBytes(var->name);
+        g.nameLength = var->name.size();
+        vars.push_back(g);
+    }
+
+    Header h{};
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.next = next;
+    uint64_t offset = sizeof(Header);
+    auto place = [&offset](Section& s, uint64_t count, size_t elementSize) {
+        s.offset = offset;
+        s.count = count;
+        offset += count * elementSize;
+    };
+    auto& source = rt->getSource();
+    auto directory = absoluteDirectory(rt->getDirectory());
+    place(h.records, writer.records.size(), sizeof(Record));
+    place(h.globals, vars.size(), sizeof(Global));
+    place(h.children, writer.children.size(), sizeof(uint32_t));
+    place(h.source, source.size(), 1);
+    place(h.directory, directory.size(), 1);
+    place(h.pool, writer.pool.size(), 1);
+    h.fileSize = offset;
+
+    // Written aside and renamed, a reader never sees a partial snapshot
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(writer.records.data()),
+                  writer.records.size() * sizeof(Record));
+        out.write(reinterpret_cast<const char*>(vars.data()),
+                  vars.size() * sizeof(Global));
+        out.write(reinterpret_cast<const char*>(writer.children.data()),
+                  writer.children.size() * sizeof(uint32_t));
+        out.write(source.data(), source.size());
+        out.write(directory.data(), directory.size());
+        out.write(writer.pool.data(), writer.pool.size());
+        if (!out.flush()) {
+            panic("SnapshotError: can not write %s\n", temp.c_str());
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) {
+        panic("SnapshotError: can not write %s\n", path.c_str());
+    }
+}
+
+void Snapshot::resume(const std::string& path) {
+    // Declared first, the program outlives the global context
+    std::shared_ptr<Program> program;
+    std::deque<Context*> ctxChain;
+    Interpreter::enterContext(ctxChain);
+    try {
+        size_t next = 0;
+        {
+            MappedFile file(path);
+            const Header& h = file.header();
+            auto* source = file.section<char>(h.source);
+            auto* directory = file.section<char>(h.directory);
+            // Imports resolve as they did for the saved program, wherever
+            // it is resumed
+            program = Engine().compile(
+                std::string(source, h.source.count),
+                std::string(directory, h.directory.count));
+            if (h.next > program->runtime()->getStatements().size()) {
+                corrupted();
+            }
+            next = h.next;
+
+            auto values = restoreValues(file, h);
+            auto* globals = file.section<Global>(h.globals);
+            auto* pool = file.section<char>(h.pool);
+            for (uint64_t i = 0; i < h.globals.count; i++) {
+                auto& g = globals[i];
+                if (g.record >= values.size() || g.name > h.pool.count ||
+                    g.nameLength > h.pool.count - g.name) {
+                    corrupted();
+                }
+                ctxChain.front()->createVariable(
+                    std::string(pool + g.name, g.nameLength),
+                    values[g.record]);
+            }
+            // Restored values own their storage, the file is unmapped here
+        }
+        Interpreter::runStatements(program->runtime(), ctxChain, next);
+    } catch (...) {
+        // Release global context and contexts of the blocks which were
+        // running before propagating the error
+        while (!ctxChain.empty()) {
+            Interpreter::leaveContext(ctxChain);
+        }
+        throw;
+    }
+    Interpreter::leaveContext(ctxChain);
+}
+}  // namespace lin
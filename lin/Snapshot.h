@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include "Lin.hpp"
+
+namespace lin {
+//===----------------------------------------------------------------------===//
+// Snapshots of a program between two top-level statements, so a script which
+// spends its start building tables can be resumed right after it. A snapshot
+// file holds the source of the program along with the directory its imports
+// are resolved against, the index of the top-level statement to resume with
+// and the global variables. Values are flat records which
+// refer to each other and to a pool of string bytes by offsets relative to
+// the file: restoring maps the file and fixes records up into values in a
+// single pass, children always precede their parents. Values sharing their
+// storage are written once and share it again after restoring.
+//
+// Functions are defined again by parsing the embedded source, compiled code
+// and result caches are rebuilt as the resumed program runs.
+//===----------------------------------------------------------------------===//
+class Snapshot {
+public:
+    // Write the variables of globals and the program of rt to path,
+    // resuming will start with top-level statement next
+    static void save(const std::string& path, Runtime* rt, Context* globals,
+                     size_t next);
+
+    // Restore the snapshot at path and run the rest of its program
+    static void resume(const std::string& path);
+};
+}  // namespace lin
@@ -0,0 +1,580 @@
+#include "Types.h"
+#include <algorithm>
+#include <bitset>
+#include "Utils.hpp"
+
+namespace lin {
+bool singleType(TypeMask mask, ValueType& type) {
+    if (std::bitset<32>(mask).count() != 1) {
+        return false;
+    }
+    for (int t = Int; t <= Matrix; t++) {
+        if (mask == typeBit(static_cast<ValueType>(t))) {
+            type = static_cast<ValueType>(t);
+        }
+    }
+    return true;
+}
+
+std::string typeMaskName(TypeMask mask) {
+    if (mask == 0) {
+        return "none";
+    }
+    if (mask == kAnyType) {
+        return "any";
+    }
+    std::string name;
+    for (int t = Int; t <= Matrix; t++) {
+        if (mask & typeBit(static_cast<ValueType>(t))) {
+            name += (name.empty() ? "" : "|");
+            // Scripts see one int type, the listing tells them apart
+            name += t == BigInt ? "bigint"
+                                : valueTypeName(static_cast<ValueType>(t));
+        }
+    }
+    return name;
+}
+
+Token compoundOperator(Token opt) {
+    switch (opt) {
+        case TK_PLUS_AGN:
+            return TK_PLUS;
+        case TK_MINUS_AGN:
+            return TK_MINUS;
+        case TK_TIMES_AGN:
+            return TK_TIMES;
+        case TK_DIV_AGN:
+            return TK_DIV;
+        case TK_MOD_AGN:
+            return TK_MOD;
+        default:
+            return opt;
+    }
+}
+
+namespace {
+constexpr TypeMask kInt = typeBit(Int);
+constexpr TypeMask kDouble = typeBit(Double);
+constexpr TypeMask kString = typeBit(String);
+constexpr TypeMask kBool = typeBit(Bool);
+constexpr TypeMask kChar = typeBit(Char);
+constexpr TypeMask kNull = typeBit(Null);
+constexpr TypeMask kArray = typeBit(Array);
+constexpr TypeMask kDict = typeBit(Dict);
+constexpr TypeMask kBigInt = typeBit(BigInt);
+constexpr TypeMask kMatrix = typeBit(Matrix);
+// Results of arithmetic on bigints, which may fit 64 bits again
+constexpr TypeMask kInteger = kInt | kBigInt;
+
+// Results of builtin functions, builtins missing here may return anything
+const std::unordered_map<std::string, TypeMask> kBuiltinTypes = {
+    {"print", kInt},
+    {"println", kInt},
+    {"typeof", kString},
+    {"input", kString},
+    {"slice", kArray | kString},
+    {"length", kInt},
+    {"keys", kArray},
+    {"has", kBool},
+    {"sort", kArray},
+    {"sort_by", kArray},
+    {"bsearch", kInt},
+    {"sum", kInteger | kDouble},
+    {"prefix_sum", kArray},
+    {"reverse", kArray | kString},
+    {"remove", kBool},
+    {"memstats", kDict},
+    {"snapshot", kNull},
+    {"fill", kNull},
+    {"matrix", kMatrix},
+    {"to_matrix", kMatrix},
+    {"shape", kArray},
+    {"matmul", kMatrix},
+    {"transpose", kMatrix},
+    {"row_sum", kArray},
+    {"row_min", kArray},
+    {"row_max", kArray},
+    {"col_sum", kArray},
+    {"col_min", kArray},
+    {"col_max", kArray},
+};
+
+// Mutators which never change the type of the variable they update
+const char* const kTypePreservingMutators[] = {"remove", "fill"};
+
+// Same as BinaryExpr::eval and the operators of lin::Value, combinations
+// which panic have no result. Int arithmetic is int, see TypeMask.
+TypeMask unaryType(Token opt, ValueType lhs) {
+    switch (opt) {
+        case TK_MINUS:
+            if (lhs == Int) {
+                return kInt;
+            }
+            if (lhs == BigInt) {
+                return kInteger;
+            }
+            return lhs == Double ? kDouble : 0;
+        case TK_LOGNOT:
+            return lhs == Bool ? kBool : 0;
+        case TK_BITNOT:
+            return lhs == Int ? kInt : 0;
+        default:
+            return typeBit(lhs);
+    }
+}
+
+TypeMask binaryType(Token opt, ValueType lhs, ValueType rhs) {
+    if (lhs != Null && rhs == Null) {
+        return unaryType(opt, lhs);
+    }
+    const bool integral = anyone(lhs, Int, BigInt) && anyone(rhs, Int, BigInt);
+    auto numeric = [&]() -> TypeMask {
+        if (lhs == Int && rhs == Int) {
+            return kInt;
+        }
+        if (integral) {
+            return kInteger;
+        }
+        if (anyone(lhs, Int, BigInt, Double) &&
+            anyone(rhs, Int, BigInt, Double)) {
+            return kDouble;
+        }
+        return 0;
+    };
+    auto character = [&]() -> TypeMask {
+        return (lhs == Char && (rhs == Int || rhs == Char)) ||
+                       (lhs == Int && rhs == Char)
+                   ? kChar
+                   : 0;
+    };
+    switch (opt) {
+        case TK_PLUS:
+            if (auto t = numeric() | character(); t != 0) {
+                return t;
+            }
+            if (lhs == String || rhs == String) {
+                return kString;
+            }
+            return lhs == Array || rhs == Array ? kArray : 0;
+        case TK_MINUS:
+            return numeric() | character();
+        case TK_TIMES:
+            if (auto t = numeric(); t != 0) {
+                return t;
+            }
+            if ((lhs == String && rhs == Int) || (lhs == Int && rhs == String)) {
+                return kString;
+            }
+            return (lhs == Array && rhs == Int) || (lhs == Int && rhs == Array)
+                       ? kArray
+                       : 0;
+        case TK_DIV:
+            return numeric();
+        case TK_MOD:
+            return numeric() & kInteger;
+        case TK_BITAND:
+        case TK_BITOR:
+            return lhs == Int && rhs == Int ? kInt : 0;
+        case TK_EQ:
+        case TK_NE:
+            if (integral) {
+                return kBool;
+            }
+            return lhs == rhs && !anyone(lhs, Array, Dict, Matrix)
+                       ? kBool
+                       : 0;
+        case TK_GT:
+        case TK_GE:
+        case TK_LT:
+        case TK_LE:
+            if (integral) {
+                return kBool;
+            }
+            return lhs == rhs && anyone(lhs, Int, Double, String, Char) ? kBool
+                                                                        : 0;
+        case TK_LOGAND:
+        case TK_LOGOR:
+            return lhs == Bool && rhs == Bool ? kBool : 0;
+        default:
+            return kAnyType;
+    }
+}
+
+TypeMask binaryType(Token opt, TypeMask lhs, TypeMask rhs) {
+    TypeMask result = 0;
+    for (int l = Int; l <= Matrix; l++) {
+        if ((lhs & typeBit(static_cast<ValueType>(l))) == 0) {
+            continue;
+        }
+        for (int r = Int; r <= Matrix; r++) {
+            if (rhs & typeBit(static_cast<ValueType>(r))) {
+                result |= binaryType(opt, static_cast<ValueType>(l),
+                                     static_cast<ValueType>(r));
+            }
+        }
+    }
+    return result;
+}
+
+void collectStrings(Expression* e, std::vector<std::string>& strings);
+
+void collectStrings(Block* block, std::vector<std::string>& strings) {
+    if (block == nullptr) {
+        return;
+    }
+    for (auto* stmt : block->stmts) {
+        if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+            collectStrings(s->expr, strings);
+        } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+            collectStrings(s->ret, strings);
+        } else if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+            collectStrings(s->cond, strings);
+            collectStrings(s->block, strings);
+            collectStrings(s->elseBlock, strings);
+        } else if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+            collectStrings(s->cond, strings);
+            collectStrings(s->block, strings);
+        } else if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+            collectStrings(s->lo, strings);
+            collectStrings(s->hi, strings);
+            collectStrings(s->step, strings);
+            collectStrings(s->block, strings);
+        }
+    }
+}
+
+void collectStrings(Expression* e, std::vector<std::string>& strings) {
+    if (e == nullptr) {
+        return;
+    }
+    if (auto* s = dynamic_cast<StringExpr*>(e)) {
+        strings.push_back(s->literal.str());
+    } else if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+        collectStrings(assign->lhs, strings);
+        collectStrings(assign->rhs, strings);
+    } else if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+        collectStrings(binary->lhs, strings);
+        collectStrings(binary->rhs, strings);
+    } else if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+        collectStrings(logical->lhs, strings);
+        collectStrings(logical->rhs, strings);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(e)) {
+        collectStrings(index->index, strings);
+        collectStrings(index->second, strings);
+    } else if (auto* slice = dynamic_cast<SliceExpr*>(e)) {
+        collectStrings(slice->base, strings);
+        collectStrings(slice->lo, strings);
+        collectStrings(slice->hi, strings);
+    } else if (auto* call = dynamic_cast<FunCallExpr*>(e)) {
+        for (auto* arg : call->args) {
+            collectStrings(arg, strings);
+        }
+    } else if (auto* array = dynamic_cast<ArrayExpr*>(e)) {
+        for (auto* element : array->literal) {
+            collectStrings(element, strings);
+        }
+    } else if (auto* dict = dynamic_cast<DictExpr*>(e)) {
+        for (auto& [key, value] : dict->literal) {
+            collectStrings(key, strings);
+            collectStrings(value, strings);
+        }
+    }
+}
+}  // namespace
+
+TypeInference::TypeInference(Runtime* rt) : rt(rt) {
+    functions = rt->getFunctions();
+    std::sort(functions.begin(), functions.end(),
+              [](Function* a, Function* b) { return a->name < b->name; });
+
+    std::vector<std::string> strings;
+    Block topLevel;
+    topLevel.stmts = rt->getStatements();
+    collectStrings(&topLevel, strings);
+    topLevel.stmts.clear();
+    for (auto* f : functions) {
+        collectStrings(f->block, strings);
+    }
+    for (auto* f : functions) {
+        auto& unit = units[f];
+        unit.params.assign(f->params.size(), 0);
+        if (std::find(strings.begin(), strings.end(), f->name) !=
+            strings.end()) {
+            // Called by name at runtime with arguments of any type
+            unit.escapes = true;
+            unit.params.assign(f->params.size(), kAnyType);
+        }
+    }
+    units[nullptr];
+
+    auto stmts = rt->getStatements();
+    do {
+        changed = false;
+        for (auto* f : functions) {
+            current = f;
+            types = &units[f];
+            for (size_t i = 0; i < f->params.size(); i++) {
+                joinVariable(f->params[i], types->params[i]);
+            }
+            infer(f->block);
+            // Falling off the end of a function returns null
+            if (f->block->stmts.empty() ||
+                !dynamic_cast<ReturnStmt*>(f->block->stmts.back())) {
+                join(types->returns, kNull);
+            }
+        }
+        current = nullptr;
+        types = &units[nullptr];
+        for (auto* stmt : stmts) {
+            infer(stmt);
+        }
+    } while (changed);
+}
+
+TypeMask TypeInference::typeOf(Expression* e) const {
+    if (auto res = exprs.find(e); res != exprs.end()) {
+        return res->second;
+    }
+    return kAnyType;
+}
+
+TypeMask TypeInference::variableType(Function* f,
+                                     const std::string& name) const {
+    if (auto unit = units.find(f); unit != units.end()) {
+        if (auto var = unit->second.vars.find(name);
+            var != unit->second.vars.end()) {
+            return var->second;
+        }
+        return 0;
+    }
+    return kAnyType;
+}
+
+TypeMask TypeInference::returnType(Function* f) const {
+    if (auto unit = units.find(f); unit != units.end()) {
+        return unit->second.returns;
+    }
+    return kAnyType;
+}
+
+void TypeInference::join(TypeMask& target, TypeMask mask) {
+    if ((target | mask) != target) {
+        target |= mask;
+        changed = true;
+    }
+}
+
+void TypeInference::joinVariable(const std::string& name, TypeMask mask) {
+    auto [var, inserted] = types->vars.emplace(name, 0);
+    if (inserted) {
+        types->order.push_back(name);
+    }
+    join(var->second, mask);
+}
+
+TypeMask TypeInference::variable(const std::string& name) const {
+    if (auto var = types->vars.find(name); var != types->vars.end()) {
+        return var->second;
+    }
+    return 0;
+}
+
+TypeMask TypeInference::infer(Expression* e) {
+    TypeMask mask = kAnyType;
+    if (dynamic_cast<IntExpr*>(e)) {
+        mask = kInt;
+    } else if (dynamic_cast<BigIntExpr*>(e)) {
+        mask = kBigInt;
+    } else if (dynamic_cast<DoubleExpr*>(e)) {
+        mask = kDouble;
+    } else if (dynamic_cast<BoolExpr*>(e)) {
+        mask = kBool;
+    } else if (dynamic_cast<CharExpr*>(e)) {
+        mask = kChar;
+    } else if (dynamic_cast<NullExpr*>(e)) {
+        mask = kNull;
+    } else if (dynamic_cast<StringExpr*>(e)) {
+        mask = kString;
+    } else if (auto* array = dynamic_cast<ArrayExpr*>(e)) {
+        for (auto* element : array->literal) {
+            infer(element);
+        }
+        mask = kArray;
+    } else if (auto* dict = dynamic_cast<DictExpr*>(e)) {
+        for (auto& [key, value] : dict->literal) {
+            infer(key);
+            infer(value);
+        }
+        mask = kDict;
+    } else if (auto* ident = dynamic_cast<IdentExpr*>(e)) {
+        mask = variable(ident->identName);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(e)) {
+        infer(index->index);
+        TypeMask base = variable(index->identName);
+        // Elements of arrays and dicts are not tracked, a single index
+        // selects a row of a matrix
+        if (index->second != nullptr) {
+            infer(index->second);
+            mask = ((base & kMatrix) ? kInt | kDouble : 0) |
+                   ((base & (kArray | kDict)) ? kAnyType : 0);
+        } else {
+            mask = ((base & kString) ? kChar : 0) |
+                   ((base & kMatrix) ? kArray : 0) |
+                   ((base & (kArray | kDict)) ? kAnyType : 0);
+        }
+    } else if (auto* slice = dynamic_cast<SliceExpr*>(e)) {
+        mask = infer(slice->base) & (kArray | kString);
+        if (slice->lo != nullptr) {
+            infer(slice->lo);
+        }
+        if (slice->hi != nullptr) {
+            infer(slice->hi);
+        }
+    } else if (auto* binary = dynamic_cast<BinaryExpr*>(e)) {
+        TypeMask lhs = binary->lhs ? infer(binary->lhs) : kNull;
+        TypeMask rhs = binary->rhs ? infer(binary->rhs) : kNull;
+        mask = binaryType(binary->opt, lhs, rhs);
+    } else if (auto* logical = dynamic_cast<LogicalExpr*>(e)) {
+        infer(logical->lhs);
+        infer(logical->rhs);
+        mask = kBool;
+    } else if (auto* call = dynamic_cast<FunCallExpr*>(e)) {
+        mask = inferCall(call);
+    } else if (auto* assign = dynamic_cast<AssignExpr*>(e)) {
+        mask = inferAssign(assign);
+    }
+    exprs[e] = mask;
+    return mask;
+}
+
+TypeMask TypeInference::inferCall(FunCallExpr* e) {
+    std::vector<TypeMask> args;
+    for (auto* arg : e->args) {
+        args.push_back(infer(arg));
+    }
+    auto builtinType = [&]() {
+        auto res = kBuiltinTypes.find(e->funcName);
+        return res != kBuiltinTypes.end() ? res->second : kAnyType;
+    };
+    if (rt->getMutatorFunction(e->funcName) != nullptr) {
+        auto* ident = e->args.empty() ? nullptr
+                                      : dynamic_cast<IdentExpr*>(e->args[0]);
+        if (ident != nullptr &&
+            std::find(std::begin(kTypePreservingMutators),
+                      std::end(kTypePreservingMutators),
+                      e->funcName) == std::end(kTypePreservingMutators)) {
+            joinVariable(ident->identName, kAnyType);
+        }
+        return builtinType();
+    }
+    if (rt->getBuiltinFunction(e->funcName) != nullptr) {
+        return builtinType();
+    }
+    if (auto* f = rt->getFunction(e->funcName);
+        f != nullptr && f->params.size() == args.size()) {
+        auto& callee = units[f];
+        for (size_t i = 0; i < args.size(); i++) {
+            join(callee.params[i], args[i]);
+        }
+        return callee.returns;
+    }
+    // Calls which always panic have no result
+    return 0;
+}
+
+TypeMask TypeInference::inferAssign(AssignExpr* e) {
+    TypeMask rhs = infer(e->rhs);
+    if (auto* ident = dynamic_cast<IdentExpr*>(e->lhs)) {
+        // An undefined variable is created with rhs by any assignment
+        TypeMask mask = rhs;
+        if (e->opt != TK_ASSIGN) {
+            mask |= binaryType(compoundOperator(e->opt),
+                               variable(ident->identName), rhs);
+            // Appending keeps strings and arrays, see Interpreter::assignTo
+            if (e->opt == TK_PLUS_AGN) {
+                mask |= variable(ident->identName) & (kString | kArray);
+            }
+        }
+        joinVariable(ident->identName, mask);
+    } else if (auto* index = dynamic_cast<IndexExpr*>(e->lhs)) {
+        infer(index->index);
+        if (index->second != nullptr) {
+            infer(index->second);
+        }
+        // Element assignments keep arrays and dicts, but they create an
+        // undefined variable with rhs. Parameters are always defined.
+        if (current == nullptr ||
+            std::find(current->params.begin(), current->params.end(),
+                      index->identName) == current->params.end()) {
+            joinVariable(index->identName, rhs);
+        }
+    }
+    return rhs;
+}
+
+void TypeInference::infer(Block* block) {
+    if (block == nullptr) {
+        return;
+    }
+    for (auto* stmt : block->stmts) {
+        infer(stmt);
+    }
+}
+
+void TypeInference::infer(Statement* stmt) {
+    if (auto* s = dynamic_cast<ExpressionStmt*>(stmt)) {
+        infer(s->expr);
+    } else if (auto* s = dynamic_cast<ReturnStmt*>(stmt)) {
+        TypeMask mask = s->ret ? infer(s->ret) : kNull;
+        if (current != nullptr) {
+            join(types->returns, mask);
+        }
+    } else if (auto* s = dynamic_cast<IfStmt*>(stmt)) {
+        infer(s->cond);
+        infer(s->block);
+        infer(s->elseBlock);
+    } else if (auto* s = dynamic_cast<WhileStmt*>(stmt)) {
+        infer(s->cond);
+        infer(s->block);
+    } else if (auto* s = dynamic_cast<ForStmt*>(stmt)) {
+        infer(s->lo);
+        infer(s->hi);
+        if (s->step != nullptr) {
+            infer(s->step);
+        }
+        joinVariable(s->identName, kInt);
+        infer(s->block);
+    }
+}
+
+void TypeInference::explain(std::ostream& os) const {
+    auto describe = [&](const FunctionTypes& unit) {
+        for (auto& name : unit.order) {
+            os << "    " << name << ": " << typeMaskName(unit.vars.at(name))
+               << "\n";
+        }
+    };
+
+    for (auto* f : functions) {
+        auto& unit = units.at(f);
+        os << "func " << f->name << "(";
+        for (size_t i = 0; i < f->params.size(); i++) {
+            os << (i ? ", " : "") << f->params[i] << ": "
+               << typeMaskName(unit.params[i]);
+        }
+        os << ") -> " << typeMaskName(unit.returns)
+           << (unit.escapes ? ", called by name" : "") << "\n";
+        describe(unit);
+    }
+    os << "top-level\n";
+    describe(units.at(nullptr));
+
+    int single = 0;
+    for (auto& [e, mask] : exprs) {
+        ValueType type;
+        single += singleType(mask, type);
+    }
+    os << single << " of " << exprs.size()
+       << " expressions have a single type\n";
+}
+}  // namespace lin
@@ -0,0 +1,77 @@
+#pragma once
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Ast.h"
+#include "Lin.hpp"
+
+namespace lin {
+// Set of types a variable or expression may have, one bit per lin::ValueType.
+// No bit set means no value ever flows there, e.g. a call which always panics.
+// Like the JIT, inference treats the overflow of int arithmetic as the rare
+// case: int stands for results of ints which code using it checks for
+// overflow and promotes to a BigInt, bigint only for values computed from
+// one.
+using TypeMask = unsigned;
+
+constexpr TypeMask typeBit(ValueType type) { return 1u << type; }
+constexpr TypeMask kAnyType = (1u << (Matrix + 1)) - 1;
+
+// Whether mask holds exactly one type, which is stored into type
+bool singleType(TypeMask mask, ValueType& type);
+std::string typeMaskName(TypeMask mask);
+// Binary operator applied by a compound assignment like +=
+Token compoundOperator(Token opt);
+
+//===----------------------------------------------------------------------===//
+// Static type inference of lin. Variables are tracked per function (top-level
+// statements count as one more function) by name, a variable may hold every
+// type any assignment to that name within the function produces. Parameters
+// get the types of arguments at all call sites of the script, functions whose
+// names are also used as string, e.g. as comparator of sort_by, take any
+// type. The analysis runs until nothing changes, its result is sound for the
+// script as a whole but not for calls made by an embedding host.
+//===----------------------------------------------------------------------===//
+class TypeInference {
+public:
+    explicit TypeInference(Runtime* rt);
+
+    TypeMask typeOf(Expression* e) const;
+    // Pass nullptr as f for variables of top-level statements
+    TypeMask variableType(Function* f, const std::string& name) const;
+    TypeMask returnType(Function* f) const;
+
+    // Readable listing of what was proven for every function
+    void explain(std::ostream& os) const;
+
+private:
+    struct FunctionTypes {
+        std::vector<TypeMask> params;
+        TypeMask returns = 0;
+        std::map<std::string, TypeMask> vars;
+        // Names in order of their first assignment
+        std::vector<std::string> order;
+        bool escapes = false;
+    };
+
+    void join(TypeMask& target, TypeMask mask);
+    void joinVariable(const std::string& name, TypeMask mask);
+    TypeMask variable(const std::string& name) const;
+
+    TypeMask infer(Expression* e);
+    TypeMask inferCall(FunCallExpr* e);
+    TypeMask inferAssign(AssignExpr* e);
+    void infer(Statement* stmt);
+    void infer(Block* block);
+
+    Runtime* rt;
+    std::vector<Function*> functions;
+    std::unordered_map<Function*, FunctionTypes> units;
+    std::unordered_map<Expression*, TypeMask> exprs;
+    Function* current{};
+    FunctionTypes* types{};
+    bool changed = false;
+};
+}  // namespace lin
@@ -1,15 +1,23 @@
+#include <algorithm>
 #include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include "HashTable.h"
 #include "Lin.hpp"
+#include "Matrix.h"
 #include "Utils.hpp"
 
-std::string valueToStdString(lin::Value v) {
+std::string valueToStdString(const lin::Value& v) {
     switch (v.type) {
         case lin::Bool:
             return v.cast<bool>() ? "true" : "false";
         case lin::Double:
             return std::to_string(v.cast<double>());
         case lin::Int:
-            return std::to_string(v.cast<int>());
+            return std::to_string(v.cast<long long>());
+        case lin::BigInt:
+            return v.ref<lin::BigIntData>().str();
         case lin::Null:
             return "null";
         case lin::Char: {
@@ -19,7 +27,7 @@ std::string valueToStdString(lin::Value v) {
         }
         case lin::Array: {
             std::string str = "[";
-            auto elements = v.cast<std::vector<lin::Value>>();
+            auto& elements = v.ref<lin::ArrayData>();
             for (int i = 0; i < elements.size(); i++) {
                 str += valueToStdString(elements[i]);
 
@@ -30,32 +38,138 @@ std::string valueToStdString(lin::Value v) {
             str += "]";
             return str;
         }
+        case lin::Dict: {
+            std::string str = "{";
+            bool first = true;
+            v.ref<lin::HashTable>().forEach(
+                [&](const lin::Value& key, const lin::Value& value) {
+                    if (!first) {
+                        str += ",";
+                    }
+                    first = false;
+                    str += valueToStdString(key);
+                    str += ":";
+                    str += valueToStdString(value);
+                });
+            str += "}";
+            return str;
+        }
         case lin::String:
-            return v.cast<std::string>();
+            return v.ref<lin::StringData>().str();
+        case lin::Matrix: {
+            // Printed like the array of its rows
+            auto& m = v.ref<lin::MatrixData>();
+            std::string str = "[";
+            for (size_t i = 0; i < m.rows(); i++) {
+                str += i == 0 ? "[" : ",[";
+                for (size_t j = 0; j < m.cols(); j++) {
+                    if (j != 0) {
+                        str += ",";
+                    }
+                    str += valueToStdString(m.at(i, j));
+                }
+                str += "]";
+            }
+            str += "]";
+            return str;
+        }
     }
     return "unknown";
 }
 
-std::string repeatString(int count, const std::string& str) {
-    std::string result;
-    for (int i = 0; i < count; i++) {
-        result += str;
+const char* valueTypeName(lin::ValueType type) {
+    switch (type) {
+        case lin::Bool:
+            return "bool";
+        case lin::Double:
+            return "double";
+        case lin::Int:
+        case lin::BigInt:
+            return "int";
+        case lin::String:
+            return "string";
+        case lin::Null:
+            return "null";
+        case lin::Char:
+            return "char";
+        case lin::Array:
+            return "array";
+        case lin::Dict:
+            return "dict";
+        case lin::Matrix:
+            return "matrix";
+    }
+    panic("TypeError: unknown type!");
+}
+
+// Both kernels allocate the result once, copy the source a single time and
+// then keep doubling the filled prefix, so replication costs O(n*count)
+std::string repeatString(long long count, std::string_view str) {
+    if (count <= 0 || str.empty()) {
+        return std::string();
+    }
+    const size_t total = str.size() * static_cast<size_t>(count);
+    lin::Heap::reserve(static_cast<long long>(total));
+    std::string result(total, '\0');
+    char* dest = result.data();
+    std::memcpy(dest, str.data(), str.size());
+    for (size_t filled = str.size(); filled < total;) {
+        size_t chunk = std::min(filled, total - filled);
+        std::memcpy(dest + filled, dest, chunk);
+        filled += chunk;
     }
     return result;
 }
 
-std::vector<lin::Value> repeatArray(int count, std::vector<lin::Value>&& arr) {
+std::vector<lin::Value> repeatArray(long long count,
+                                    const lin::ArrayData& arr) {
     std::vector<lin::Value> result;
-    for (int i = 0; i < count; i++) {
-        result.insert(result.begin(), arr.begin(), arr.end());
+    if (count <= 0 || arr.size() == 0) {
+        return result;
+    }
+    // Elements are copied as values, nested arrays and strings among them
+    // share storage with the source rather than being deep copied
+    const size_t total = arr.size() * static_cast<size_t>(count);
+    lin::Heap::reserve(static_cast<long long>(total * sizeof(lin::Value)));
+    result.reserve(total);
+    result.insert(result.end(), arr.begin(), arr.end());
+    while (result.size() < total) {
+        size_t chunk = std::min(result.size(), total - result.size());
+        // Capacity was reserved, so appending never invalidates the source
+        std::copy_n(result.begin(), chunk, std::back_inserter(result));
     }
     return result;
 }
 
+lin::Value sliceValue(const lin::Value& v, long long lo, long long hi) {
+    auto clamp = [](long long i, size_t size) {
+        return i < 0 ? 0 : std::min(static_cast<size_t>(i), size);
+    };
+    if (v.isType<lin::Array>()) {
+        auto& arr = v.ref<lin::ArrayData>();
+        size_t begin = clamp(lo, arr.size());
+        size_t end = std::max(begin, clamp(hi, arr.size()));
+        return lin::Value(lin::Array, arr.slice(begin, end));
+    }
+    if (v.isType<lin::String>()) {
+        auto& str = v.ref<lin::StringData>();
+        size_t begin = clamp(lo, str.size());
+        size_t end = std::max(begin, clamp(hi, str.size()));
+        return lin::Value(lin::String, str.slice(begin, end));
+    }
+    panic("TypeError: can not slice value of %s type\n",
+          valueTypeName(v.type));
+}
+
 [[noreturn]] void panic(char const* const format, ...) {
     va_list args;
     va_start(args, format);
-    vfprintf(stdout, format, args);
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+    int len = vsnprintf(nullptr, 0, format, argsCopy);
+    va_end(argsCopy);
+    std::string message(len > 0 ? len : 0, '\0');
+    vsnprintf(message.data(), message.size() + 1, format, args);
     va_end(args);
-    exit(EXIT_FAILURE);
+    throw lin::LinError(message);
 }
@@ -1,14 +1,30 @@
 #pragma once
 #include <any>
 #include <deque>
+#include <stdexcept>
 #include <string>
 #include "Lin.hpp"
 
-std::string valueToStdString(lin::Value v);
+namespace lin {
+// Every error raised by lexer, parser or interpreter is reported through this
+// exception, so an embedding host can recover instead of losing its process.
+struct LinError : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+}  // namespace lin
 
-std::string repeatString(int count, const std::string& str);
+std::string valueToStdString(const lin::Value& v);
 
-std::vector<lin::Value> repeatArray(int count, std::vector<lin::Value>&& arr);
+const char* valueTypeName(lin::ValueType type);
+
+std::string repeatString(long long count, std::string_view str);
+
+std::vector<lin::Value> repeatArray(long long count,
+                                    const lin::ArrayData& arr);
+
+// Elements or characters of v within [lo, hi), bounds are clamped into range
+// and the result shares storage with v
+lin::Value sliceValue(const lin::Value& v, long long lo, long long hi);
 
 template <typename _DesireType, typename... _ArgumentType>
 inline bool anyone(_DesireType k, _ArgumentType... args) {
@@ -1,2 +1,2 @@
 #!/bin/sh
-g++ -std=c++17 Main.cpp Parser.cpp Utils.cpp Interpreter.cpp Lin.cpp Builtin.cpp Lin.hpp Utils.hpp Ast.cpp -o lin
+g++ -std=c++17 Main.cpp Parser.cpp Utils.cpp Interpreter.cpp Lin.cpp Builtin.cpp Lin.hpp Utils.hpp Ast.cpp Engine.cpp HashTable.cpp Jit.cpp Aot.cpp Types.cpp Memo.cpp Heap.cpp Server.cpp Snapshot.cpp Module.cpp HotReload.cpp Fiber.cpp BigInt.cpp Matrix.cpp -o lin
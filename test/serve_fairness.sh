@@ -0,0 +1,42 @@
+#!/bin/sh
+# console printing:
+# 2
+# ok
+#
+# A request spinning in a loop the JIT compiled must not hold up a short one
+# sent to the same server. Run from the test directory, LIN names the
+# interpreter to test, without it lin is built first.
+if [ -z "$LIN" ]; then
+    (cd ../lin && sh build.sh) || exit 1
+    LIN=../lin/lin
+fi
+lin=$LIN
+sock=/tmp/lin_serve_fairness.$$
+$lin --serve $sock &
+server=$!
+trap 'kill $server; rm -f $sock' EXIT
+sleep 0.2
+python3 - $sock <<'PY'
+import socket, sys, time
+
+def send(source):
+    s = socket.socket(socket.AF_UNIX)
+    s.connect(sys.argv[1])
+    s.sendall(b"EVAL %d\n" % len(source) + source)
+    s.shutdown(socket.SHUT_WR)
+    return s
+
+spinning = send(b"i = 0 while(true){ i += 1 }")
+time.sleep(0.2)
+start = time.time()
+short = send(b"println(1+1)")
+short.settimeout(5)
+out = b""
+while True:
+    data = short.recv(4096)
+    if not data:
+        break
+    out += data
+sys.stdout.write(out.decode())
+print("ok" if time.time() - start < 1 else "too slow")
+PY